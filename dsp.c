@@ -0,0 +1,962 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define DSP_X86 1
+#endif
+
+#include "dsp.h"
+
+#define DSP_TAU 6.283185307179586
+
+/* sin(2*pi*r) for r in [-0.25, 0.25], Taylor series through r^11. Max error is 5.7e-8, under one float ulp at 1.0, which is
+ * as good as the (float)sin() ma_waveform hands us.
+ */
+#define SIN_C1	 6.283185307f
+#define SIN_C3	-41.34170224f
+#define SIN_C5	 81.60524928f
+#define SIN_C7	-76.70585975f
+#define SIN_C9	 42.05869394f
+#define SIN_C11	-15.09464258f
+
+static inline float sin_cycles(float x)
+{
+    float r, r2;
+
+    /* Reduce to [-0.5, 0.5] then fold the outer quarters back in using sin(pi - y) = sin(y) */
+    r = x - floorf(x + 0.5f);
+    if (r > 0.25f)
+	r = 0.5f - r;
+    else if (r < -0.25f)
+	r = -0.5f - r;
+
+    r2 = r * r;
+    return r * (SIN_C1 + r2 * (SIN_C3 + r2 * (SIN_C5 + r2 * (SIN_C7 + r2 * (SIN_C9 + r2 * SIN_C11)))));
+}
+
+static inline double wrap_phase(double p)
+{
+    if (p >= 1.0 || p < 0.0)
+	p -= floor(p);
+    return p;
+}
+
+static inline void rotate(double *re, double *im, double rot_re, double rot_im)
+{
+    double r = *re * rot_re - *im * rot_im;
+
+    *im = *re * rot_im + *im * rot_re;
+    *re = r;
+}
+
+static int isa_lanes(dsp_isa_e isa)
+{
+    switch (isa)
+    {
+    case DSP_ISA_AVX2:
+	return 8;
+    case DSP_ISA_SSE2:
+	return 4;
+    default:
+	return 1;
+    }
+}
+
+/* The only trig in phasor mode, and it only runs when a frequency, the isa or the mode changes */
+static void phasor_update_rotation(osc_bank_t *bank, int o)
+{
+    double  a = DSP_TAU * bank->advance[o];
+    int	    k;
+
+    bank->rot_re[o] = cos(a);
+    bank->rot_im[o] = sin(a);
+    bank->chunk_re[o] = cos(a * isa_lanes(bank->isa));
+    bank->chunk_im[o] = sin(a * isa_lanes(bank->isa));
+    for (k = 0; k < DSP_MAX_LANES; k++)
+    {
+	bank->lane_re[o][k] = (float)cos(a * k);
+	bank->lane_im[o][k] = (float)sin(a * k);
+    }
+}
+
+static void phasor_anchor(osc_bank_t *bank, int o)
+{
+    bank->z_re[o] = cos(DSP_TAU * bank->phase[o]);
+    bank->z_im[o] = sin(DSP_TAU * bank->phase[o]);
+    bank->z_stale[o] = 0;
+}
+
+/* Oscillators with no amplitude contribute nothing, so skip them and just move their phase along. A phasor that sat idle is
+ * re-anchored from the phase when it comes back rather than being spun forward.
+ */
+static int active_oscillators(osc_bank_t *bank, int *active, uint32_t frames)
+{
+    int o;
+    int n = 0;
+
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	if (bank->amplitude[o] != 0.0f || bank->amp_left[o])
+	{
+	    if (bank->mode == OSC_MODE_PHASOR && bank->z_stale[o])
+		phasor_anchor(bank, o);
+	    active[n++] = o;
+	}
+	else
+	{
+	    bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o] * frames + bank->adv_step[o] * frames * (frames - 1.0) / 2);
+	    bank->advance[o] += bank->adv_step[o] * frames;
+	    bank->z_stale[o] = 1;
+	}
+    }
+    return n;
+}
+
+/* Recursive rotation slowly lets |z| drift away from 1. One Newton step towards 1/|z| per block is plenty to pin it. */
+static void phasor_renormalize(osc_bank_t *bank, const int *active, int nactive)
+{
+    int k;
+
+    for (k = 0; k < nactive; k++)
+    {
+	int o = active[k];
+	double g = 1.5 - 0.5 * (bank->z_re[o] * bank->z_re[o] + bank->z_im[o] * bank->z_im[o]);
+	bank->z_re[o] *= g;
+	bank->z_im[o] *= g;
+    }
+}
+
+static inline __attribute__((always_inline))
+void render_scalar_impl(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, const int ramping)
+{
+    uint32_t	i;
+    int		k;
+    int		phasor = bank->mode == OSC_MODE_PHASOR;
+
+    for (i = 0; i < frames; i++)
+    {
+	float t = 0.0f;
+	for (k = 0; k < nactive; k++)
+	{
+	    int o = active[k];
+	    if (phasor && !(ramping && bank->adv_left[o]))
+	    {
+		t += (float)bank->z_im[o] * bank->amplitude[o];
+		rotate(&bank->z_re[o], &bank->z_im[o], bank->rot_re[o], bank->rot_im[o]);
+	    }
+	    else
+		t += sin_cycles((float)bank->phase[o]) * bank->amplitude[o];
+	    bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o]);
+	    if (ramping)
+	    {
+		bank->advance[o] += bank->adv_step[o];
+		bank->amplitude[o] += bank->amp_step[o];
+	    }
+	}
+	out[i] = t;
+
+	t = fabsf(t);
+	if (t > stats->peak)
+	    stats->peak = t;
+	stats->overloads += t > DSP_OVERLOAD_LEVEL;
+    }
+}
+
+static void render_scalar(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, int ramping)
+{
+    if (ramping)
+	render_scalar_impl(bank, active, nactive, out, frames, stats, 1);
+    else
+	render_scalar_impl(bank, active, nactive, out, frames, stats, 0);
+}
+
+#ifdef DSP_X86
+static inline __m128 sin_cycles_sse2(__m128 x)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 r, r2, q, fold, p;
+
+    /* Rounds to nearest under the default MXCSR mode. Phases are tiny so the int conversion can't overflow. */
+    r = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvtps_epi32(x)));
+    q = _mm_or_ps(_mm_and_ps(r, sign), _mm_set1_ps(0.5f));
+    fold = _mm_cmpgt_ps(_mm_andnot_ps(sign, r), _mm_set1_ps(0.25f));
+    r = _mm_or_ps(_mm_and_ps(fold, _mm_sub_ps(q, r)), _mm_andnot_ps(fold, r));
+
+    r2 = _mm_mul_ps(r, r);
+    p = _mm_set1_ps(SIN_C11);
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_C9));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_C7));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_C5));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_C3));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_C1));
+    return _mm_mul_ps(p, r);
+}
+
+/* ramping is a constant at both call sites so the static case compiles without any of the ramp work */
+static inline __attribute__((always_inline))
+void render_sse2_impl(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, const int ramping)
+{
+    const __m128    lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128    tri = _mm_setr_ps(0.0f, 0.0f, 1.0f, 3.0f); /* lane * (lane - 1) / 2, for frequency ramps */
+    const __m128    sign = _mm_set1_ps(-0.0f);
+    const __m128    limit = _mm_set1_ps(DSP_OVERLOAD_LEVEL);
+    __m128	    peak = _mm_setzero_ps();
+    __m128	    step[OSC_COUNT];
+    __m128	    amp[OSC_COUNT];
+    __m128	    lre[OSC_COUNT];
+    __m128	    lim[OSC_COUNT];
+    float	    lanes[4];
+    uint32_t	    i;
+    int		    k;
+    int		    phasor = bank->mode == OSC_MODE_PHASOR;
+
+    for (k = 0; k < nactive; k++)
+    {
+	int o = active[k];
+	step[k] = _mm_mul_ps(lane, _mm_set1_ps((float)bank->advance[o]));
+	amp[k] = _mm_set1_ps(bank->amplitude[o]);
+	lre[k] = _mm_loadu_ps(bank->lane_re[o]);
+	lim[k] = _mm_loadu_ps(bank->lane_im[o]);
+    }
+
+    for (i = 0; i + 4 <= frames; i += 4)
+    {
+	__m128 acc = _mm_setzero_ps();
+	for (k = 0; k < nactive; k++)
+	{
+	    int o = active[k];
+	    __m128 x, a = amp[k];
+	    if (ramping && bank->amp_left[o])
+	    {
+		a = _mm_add_ps(_mm_set1_ps(bank->amplitude[o]), _mm_mul_ps(lane, _mm_set1_ps(bank->amp_step[o])));
+		bank->amplitude[o] += bank->amp_step[o] * 4;
+	    }
+	    if (ramping && bank->adv_left[o])
+	    {
+		x = _mm_add_ps(_mm_mul_ps(lane, _mm_set1_ps((float)bank->advance[o])), _mm_mul_ps(tri, _mm_set1_ps((float)bank->adv_step[o])));
+		x = sin_cycles_sse2(_mm_add_ps(_mm_set1_ps((float)bank->phase[o]), x));
+		bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o] * 4 + bank->adv_step[o] * 6);
+		bank->advance[o] += bank->adv_step[o] * 4;
+	    }
+	    else
+	    {
+		if (phasor)
+		{
+		    /* Im(z * e^(j*2*pi*advance*lane)) */
+		    x = _mm_add_ps(_mm_mul_ps(_mm_set1_ps((float)bank->z_re[o]), lim[k]),
+				   _mm_mul_ps(_mm_set1_ps((float)bank->z_im[o]), lre[k]));
+		    rotate(&bank->z_re[o], &bank->z_im[o], bank->chunk_re[o], bank->chunk_im[o]);
+		}
+		else
+		    x = sin_cycles_sse2(_mm_add_ps(_mm_set1_ps((float)bank->phase[o]), step[k]));
+		bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o] * 4);
+	    }
+	    acc = _mm_add_ps(acc, _mm_mul_ps(x, a));
+	}
+	_mm_storeu_ps(out + i, acc);
+
+	acc = _mm_andnot_ps(sign, acc);
+	peak = _mm_max_ps(peak, acc);
+	stats->overloads += __builtin_popcount(_mm_movemask_ps(_mm_cmpgt_ps(acc, limit)));
+    }
+
+    _mm_storeu_ps(lanes, peak);
+    for (k = 0; k < 4; k++)
+	if (lanes[k] > stats->peak)
+	    stats->peak = lanes[k];
+
+    render_scalar(bank, active, nactive, out + i, frames - i, stats, ramping);
+}
+
+static void render_sse2(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, int ramping)
+{
+    if (ramping)
+	render_sse2_impl(bank, active, nactive, out, frames, stats, 1);
+    else
+	render_sse2_impl(bank, active, nactive, out, frames, stats, 0);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 sin_cycles_avx2(__m256 x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 r, r2, q, fold, p;
+
+    r = _mm256_sub_ps(x, _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    q = _mm256_or_ps(_mm256_and_ps(r, sign), _mm256_set1_ps(0.5f));
+    fold = _mm256_cmp_ps(_mm256_andnot_ps(sign, r), _mm256_set1_ps(0.25f), _CMP_GT_OQ);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(q, r), fold);
+
+    r2 = _mm256_mul_ps(r, r);
+    p = _mm256_set1_ps(SIN_C11);
+    p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_C9));
+    p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_C7));
+    p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_C5));
+    p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_C3));
+    p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_C1));
+    return _mm256_mul_ps(p, r);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __attribute__((always_inline))
+void render_avx2_impl(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, const int ramping)
+{
+    const __m256    lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256    tri = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 3.0f, 6.0f, 10.0f, 15.0f, 21.0f);
+    const __m256    sign = _mm256_set1_ps(-0.0f);
+    const __m256    limit = _mm256_set1_ps(DSP_OVERLOAD_LEVEL);
+    __m256	    peak = _mm256_setzero_ps();
+    __m256	    step[OSC_COUNT];
+    __m256	    amp[OSC_COUNT];
+    __m256	    lre[OSC_COUNT];
+    __m256	    lim[OSC_COUNT];
+    float	    lanes[8];
+    uint32_t	    i;
+    int		    k;
+    int		    phasor = bank->mode == OSC_MODE_PHASOR;
+
+    for (k = 0; k < nactive; k++)
+    {
+	int o = active[k];
+	step[k] = _mm256_mul_ps(lane, _mm256_set1_ps((float)bank->advance[o]));
+	amp[k] = _mm256_set1_ps(bank->amplitude[o]);
+	lre[k] = _mm256_loadu_ps(bank->lane_re[o]);
+	lim[k] = _mm256_loadu_ps(bank->lane_im[o]);
+    }
+
+    for (i = 0; i + 8 <= frames; i += 8)
+    {
+	__m256 acc = _mm256_setzero_ps();
+	for (k = 0; k < nactive; k++)
+	{
+	    int o = active[k];
+	    __m256 x, a = amp[k];
+	    if (ramping && bank->amp_left[o])
+	    {
+		a = _mm256_fmadd_ps(lane, _mm256_set1_ps(bank->amp_step[o]), _mm256_set1_ps(bank->amplitude[o]));
+		bank->amplitude[o] += bank->amp_step[o] * 8;
+	    }
+	    if (ramping && bank->adv_left[o])
+	    {
+		x = _mm256_fmadd_ps(lane, _mm256_set1_ps((float)bank->advance[o]), _mm256_mul_ps(tri, _mm256_set1_ps((float)bank->adv_step[o])));
+		x = sin_cycles_avx2(_mm256_add_ps(_mm256_set1_ps((float)bank->phase[o]), x));
+		bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o] * 8 + bank->adv_step[o] * 28);
+		bank->advance[o] += bank->adv_step[o] * 8;
+	    }
+	    else
+	    {
+		if (phasor)
+		{
+		    x = _mm256_fmadd_ps(_mm256_set1_ps((float)bank->z_re[o]), lim[k],
+					_mm256_mul_ps(_mm256_set1_ps((float)bank->z_im[o]), lre[k]));
+		    rotate(&bank->z_re[o], &bank->z_im[o], bank->chunk_re[o], bank->chunk_im[o]);
+		}
+		else
+		    x = sin_cycles_avx2(_mm256_add_ps(_mm256_set1_ps((float)bank->phase[o]), step[k]));
+		bank->phase[o] = wrap_phase(bank->phase[o] + bank->advance[o] * 8);
+	    }
+	    acc = _mm256_fmadd_ps(x, a, acc);
+	}
+	_mm256_storeu_ps(out + i, acc);
+
+	acc = _mm256_andnot_ps(sign, acc);
+	peak = _mm256_max_ps(peak, acc);
+	stats->overloads += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(acc, limit, _CMP_GT_OQ)));
+    }
+
+    _mm256_storeu_ps(lanes, peak);
+    for (k = 0; k < 8; k++)
+	if (lanes[k] > stats->peak)
+	    stats->peak = lanes[k];
+
+    render_scalar(bank, active, nactive, out + i, frames - i, stats, ramping);
+}
+
+__attribute__((target("avx2,fma")))
+static void render_avx2(osc_bank_t *bank, const int *active, int nactive, float *out, uint32_t frames, dsp_block_stats_t *stats, int ramping)
+{
+    if (ramping)
+	render_avx2_impl(bank, active, nactive, out, frames, stats, 1);
+    else
+	render_avx2_impl(bank, active, nactive, out, frames, stats, 0);
+}
+#endif
+
+dsp_isa_e dsp_detect_isa(void)
+{
+#ifdef DSP_X86
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	return DSP_ISA_AVX2;
+#endif
+    return DSP_ISA_SSE2;
+#else
+    return DSP_ISA_SCALAR;
+#endif
+}
+
+const char *dsp_isa_name(dsp_isa_e isa)
+{
+    switch (isa)
+    {
+    case DSP_ISA_AVX2:
+	return "avx2";
+    case DSP_ISA_SSE2:
+	return "sse2";
+    default:
+	return "scalar";
+    }
+}
+
+const char *osc_mode_name(osc_mode_e mode)
+{
+    return mode == OSC_MODE_PHASOR ? "phasor" : "poly";
+}
+
+void osc_bank_init(osc_bank_t *bank, double sample_rate)
+{
+    int o;
+
+    memset(bank, 0, sizeof(*bank));
+    bank->sample_rate = sample_rate;
+    bank->isa = dsp_detect_isa();
+    bank->mode = OSC_MODE_POLY;
+    atomic_init(&bank->clock, 0);
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	phasor_update_rotation(bank, o);
+	bank->z_stale[o] = 1;
+    }
+}
+
+void osc_bank_set_isa(osc_bank_t *bank, dsp_isa_e isa)
+{
+    dsp_isa_e	best = dsp_detect_isa();
+    int		o;
+
+    bank->isa = isa > best ? best : isa;
+    for (o = 0; o < OSC_COUNT; o++)
+	phasor_update_rotation(bank, o);
+}
+
+void osc_bank_set_mode(osc_bank_t *bank, osc_mode_e mode)
+{
+    int o;
+
+    if (mode == bank->mode)
+	return;
+
+    bank->mode = mode;
+    for (o = 0; o < OSC_COUNT; o++)
+	bank->z_stale[o] = 1;
+}
+
+void osc_bank_set_ramp(osc_bank_t *bank, uint32_t frames)
+{
+    bank->ramp_frames = frames;
+}
+
+void osc_bank_set_freq(osc_bank_t *bank, osc_id_e osc, float freq)
+{
+    double advance = 1.0 / (bank->sample_rate / freq); /* Same expression as ma_waveform__calculate_advance */
+
+    bank->freq[osc] = freq;
+    if (bank->ramp_frames == 0 || advance == bank->advance[osc])
+    {
+	bank->advance[osc] = advance;
+	bank->adv_step[osc] = 0.0;
+	bank->adv_left[osc] = 0;
+	phasor_update_rotation(bank, osc);
+	return;
+    }
+
+    /* The phasor picks back up from the phase once the ramp is over */
+    bank->adv_target[osc] = advance;
+    bank->adv_step[osc] = (advance - bank->advance[osc]) / bank->ramp_frames;
+    bank->adv_left[osc] = bank->ramp_frames;
+    bank->z_stale[osc] = 1;
+}
+
+void osc_bank_set_amplitude(osc_bank_t *bank, osc_id_e osc, float amplitude)
+{
+    if (bank->ramp_frames == 0 || amplitude == bank->amplitude[osc])
+    {
+	bank->amplitude[osc] = amplitude;
+	bank->amp_step[osc] = 0.0f;
+	bank->amp_left[osc] = 0;
+	return;
+    }
+
+    bank->amp_target[osc] = amplitude;
+    bank->amp_step[osc] = (amplitude - bank->amplitude[osc]) / bank->ramp_frames;
+    bank->amp_left[osc] = bank->ramp_frames;
+}
+
+void osc_bank_set_phase(osc_bank_t *bank, osc_id_e osc, double phase)
+{
+    bank->phase[osc] = wrap_phase(phase);
+    bank->z_stale[osc] = 1;
+}
+
+static void render_segment(osc_bank_t *bank, float *out, uint32_t frames, dsp_block_stats_t *stats)
+{
+    int active[OSC_COUNT];
+    int nactive;
+    int ramping = 0;
+    int k;
+
+    nactive = active_oscillators(bank, active, frames);
+    if (nactive == 0)
+    {
+	memset(out, 0, frames * sizeof(float));
+	return;
+    }
+
+    for (k = 0; k < nactive; k++)
+	ramping |= bank->amp_left[active[k]] || bank->adv_left[active[k]];
+
+    switch (bank->isa)
+    {
+#ifdef DSP_X86
+    case DSP_ISA_AVX2:
+	render_avx2(bank, active, nactive, out, frames, stats, ramping);
+	break;
+    case DSP_ISA_SSE2:
+	render_sse2(bank, active, nactive, out, frames, stats, ramping);
+	break;
+#endif
+    default:
+	render_scalar(bank, active, nactive, out, frames, stats, ramping);
+	break;
+    }
+
+    if (bank->mode == OSC_MODE_PHASOR)
+	phasor_renormalize(bank, active, nactive);
+}
+
+/* Ramps are cut into segments so that every ramp runs through whole segments and finishes exactly on a boundary */
+static uint32_t ramp_segment(osc_bank_t *bank, uint32_t frames)
+{
+    int o;
+
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	if (bank->amp_left[o] && bank->amp_left[o] < frames)
+	    frames = bank->amp_left[o];
+	if (bank->adv_left[o] && bank->adv_left[o] < frames)
+	    frames = bank->adv_left[o];
+    }
+    return frames;
+}
+
+static void ramp_advance(osc_bank_t *bank, uint32_t frames)
+{
+    int o;
+
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	if (bank->amp_left[o])
+	{
+	    bank->amp_left[o] -= frames;
+	    if (!bank->amp_left[o])
+	    {
+		bank->amplitude[o] = bank->amp_target[o];
+		bank->amp_step[o] = 0.0f;
+	    }
+	}
+	if (bank->adv_left[o])
+	{
+	    bank->adv_left[o] -= frames;
+	    if (!bank->adv_left[o])
+	    {
+		bank->advance[o] = bank->adv_target[o];
+		bank->adv_step[o] = 0.0;
+		phasor_update_rotation(bank, o);
+		bank->z_stale[o] = 1;
+	    }
+	}
+    }
+}
+
+void osc_bank_render(osc_bank_t *bank, float *out, uint32_t frames, dsp_block_stats_t *stats)
+{
+    stats->peak = 0.0f;
+    stats->overloads = 0;
+
+    while (frames)
+    {
+	uint32_t n = ramp_segment(bank, frames);
+
+	render_segment(bank, out, n, stats);
+	ramp_advance(bank, n);
+	out += n;
+	frames -= n;
+    }
+}
+
+uint64_t osc_bank_clock(osc_bank_t *bank)
+{
+    return atomic_load_explicit(&bank->clock, memory_order_relaxed);
+}
+
+/* Producer side. Messages have to be posted in 'when' order; the consumer stops at the first one that isn't due yet. */
+bool osc_bank_post(osc_bank_t *bank, spsc_queue_t *params, osc_param_e param, osc_id_e osc, float value, uint64_t when)
+{
+    spsc_msg_t msg;
+
+    msg.when = when;
+    msg.stamp = osc_bank_clock(bank);
+    msg.type = param;
+    msg.index = osc;
+    msg.value = value;
+    return spsc_push(params, &msg);
+}
+
+static void osc_bank_apply(osc_bank_t *bank, const spsc_msg_t *msg, uint64_t now)
+{
+    uint64_t latency = now > msg->stamp ? now - msg->stamp : 0;
+
+    switch (msg->type)
+    {
+    case OSC_PARAM_FREQ:
+	osc_bank_set_freq(bank, msg->index, msg->value);
+	break;
+    case OSC_PARAM_AMPLITUDE:
+	osc_bank_set_amplitude(bank, msg->index, msg->value);
+	break;
+    default:
+	return;
+    }
+
+    bank->params_applied++;
+    bank->param_latency_total += latency;
+    if (latency > bank->param_latency_max)
+	bank->param_latency_max = latency;
+}
+
+void osc_bank_process(osc_bank_t *bank, spsc_queue_t *params, float *out, uint32_t frames, dsp_block_stats_t *stats)
+{
+    dsp_block_stats_t	seg;
+    const spsc_msg_t	*msg;
+    uint64_t		clock = osc_bank_clock(bank);
+    uint32_t		done = 0;
+
+    stats->peak = 0.0f;
+    stats->overloads = 0;
+
+    while (done < frames)
+    {
+	uint32_t n = frames - done;
+
+	/* Apply everything that is due, then render up to the next change that isn't */
+	while ((msg = spsc_peek(params)) != NULL)
+	{
+	    if (msg->when > clock + done)
+	    {
+		if (msg->when < clock + frames)
+		    n = msg->when - (clock + done);
+		break;
+	    }
+	    osc_bank_apply(bank, msg, clock + done);
+	    spsc_consume(params);
+	}
+
+	osc_bank_render(bank, out + done, n, &seg);
+	if (seg.peak > stats->peak)
+	    stats->peak = seg.peak;
+	stats->overloads += seg.overloads;
+	done += n;
+    }
+
+    atomic_store_explicit(&bank->clock, clock + frames, memory_order_relaxed);
+}
+
+
+/* ==================== Upsampling ==================== */
+
+void upsampler_init(upsampler_t *up, uint32_t factor)
+{
+    uint32_t	p;
+    int		k, j;
+
+    memset(up, 0, sizeof(*up));
+    if (factor > UPSAMPLE_MAX_FACTOR)
+	factor = UPSAMPLE_MAX_FACTOR;
+    up->factor = factor;
+    up->isa = dsp_detect_isa();
+
+    /* Lagrange interpolation between the middle two of the UPSAMPLE_TAPS newest inputs. It is maximally flat at DC and has
+     * deep zeros at every multiple of the internal rate, which is exactly where the images of a ~40Hz signal land, so
+     * even at a couple of kHz internal rate the error stays far below anything audible. The delay is a whole number of
+     * device frames: UPSAMPLE_TAPS / 2 * factor.
+     */
+    for (p = 0; p < factor; p++)
+    {
+	double u = UPSAMPLE_TAPS / 2 - (double)p / factor; /* How far back from the newest input this output sits */
+	for (k = 0; k < UPSAMPLE_TAPS; k++)
+	{
+	    double w = 1.0;
+	    for (j = 0; j < UPSAMPLE_TAPS; j++)
+		if (j != k)
+		    w *= (u - j) / (k - j);
+	    up->coefs[k][p] = w;
+	}
+    }
+}
+
+static void measure(const float *y, uint32_t n, dsp_block_stats_t *stats)
+{
+    float	peak = stats->peak;
+    uint32_t	overloads = stats->overloads;
+    uint32_t	i = 0;
+
+#ifdef DSP_X86
+    const __m128    sign = _mm_set1_ps(-0.0f);
+    const __m128    limit = _mm_set1_ps(DSP_OVERLOAD_LEVEL);
+    __m128	    vpeak = _mm_set1_ps(peak);
+    __m128i	    vcount = _mm_setzero_si128();
+    float	    lanes[4];
+    uint32_t	    counts[4];
+    int		    k;
+
+    /* A true compare is all ones, i.e. -1, so subtracting it counts. Cheaper than a popcount, which without -mpopcnt is a
+     * library call.
+     */
+    for (; i + 4 <= n; i += 4)
+    {
+	__m128 t = _mm_andnot_ps(sign, _mm_loadu_ps(y + i));
+	vpeak = _mm_max_ps(vpeak, t);
+	vcount = _mm_sub_epi32(vcount, _mm_castps_si128(_mm_cmpgt_ps(t, limit)));
+    }
+    _mm_storeu_ps(lanes, vpeak);
+    _mm_storeu_si128((__m128i *)counts, vcount);
+    for (k = 0; k < 4; k++)
+    {
+	if (lanes[k] > peak)
+	    peak = lanes[k];
+	overloads += counts[k];
+    }
+#endif
+    for (; i < n; i++)
+    {
+	float t = fabsf(y[i]);
+	if (t > peak)
+	    peak = t;
+	overloads += t > DSP_OVERLOAD_LEVEL;
+    }
+    stats->peak = peak;
+    stats->overloads = overloads;
+}
+
+/* The group kernels take a window of the input stream, oldest first, and write groups * factor outputs. Group g is
+ * made from w[g .. g + UPSAMPLE_TAPS), so tap k (newest first) of it is w[g + UPSAMPLE_TAPS - 1 - k].
+ */
+static void upsample_scalar(const upsampler_t *up, const float *w, uint32_t groups, float *y)
+{
+    uint32_t	g, p;
+    int		k;
+
+    for (g = 0; g < groups; g++, w++, y += up->factor)
+	for (p = 0; p < up->factor; p++)
+	{
+	    float acc = 0.0f;
+	    for (k = 0; k < UPSAMPLE_TAPS; k++)
+		acc += w[UPSAMPLE_TAPS - 1 - k] * up->coefs[k][p];
+	    y[p] = acc;
+	}
+}
+
+#ifdef DSP_X86
+/* Spelled out for UPSAMPLE_TAPS == 8 and summed pairwise, so it stays in registers and no add waits on more than two
+ * others
+ */
+static void upsample_sse2(const upsampler_t *up, const float *w, uint32_t groups, float *y)
+{
+    uint32_t g, p;
+
+    for (g = 0; g < groups; g++, w++, y += up->factor)
+    {
+	const __m128 h0 = _mm_set1_ps(w[7]), h1 = _mm_set1_ps(w[6]), h2 = _mm_set1_ps(w[5]), h3 = _mm_set1_ps(w[4]);
+	const __m128 h4 = _mm_set1_ps(w[3]), h5 = _mm_set1_ps(w[2]), h6 = _mm_set1_ps(w[1]), h7 = _mm_set1_ps(w[0]);
+
+	for (p = 0; p < up->factor; p += 4)
+	{
+	    __m128 a = _mm_add_ps(_mm_mul_ps(h0, _mm_loadu_ps(&up->coefs[0][p])), _mm_mul_ps(h1, _mm_loadu_ps(&up->coefs[1][p])));
+	    __m128 b = _mm_add_ps(_mm_mul_ps(h2, _mm_loadu_ps(&up->coefs[2][p])), _mm_mul_ps(h3, _mm_loadu_ps(&up->coefs[3][p])));
+	    __m128 c = _mm_add_ps(_mm_mul_ps(h4, _mm_loadu_ps(&up->coefs[4][p])), _mm_mul_ps(h5, _mm_loadu_ps(&up->coefs[5][p])));
+	    __m128 d = _mm_add_ps(_mm_mul_ps(h6, _mm_loadu_ps(&up->coefs[6][p])), _mm_mul_ps(h7, _mm_loadu_ps(&up->coefs[7][p])));
+	    _mm_storeu_ps(y + p, _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d)));
+	}
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void upsample_avx2(const upsampler_t *up, const float *w, uint32_t groups, float *y)
+{
+    uint32_t g, p;
+
+    for (g = 0; g < groups; g++, w++, y += up->factor)
+    {
+	const __m256 h0 = _mm256_broadcast_ss(w + 7), h1 = _mm256_broadcast_ss(w + 6);
+	const __m256 h2 = _mm256_broadcast_ss(w + 5), h3 = _mm256_broadcast_ss(w + 4);
+	const __m256 h4 = _mm256_broadcast_ss(w + 3), h5 = _mm256_broadcast_ss(w + 2);
+	const __m256 h6 = _mm256_broadcast_ss(w + 1), h7 = _mm256_broadcast_ss(w);
+
+	for (p = 0; p < up->factor; p += 8)
+	{
+	    __m256 a = _mm256_fmadd_ps(h1, _mm256_loadu_ps(&up->coefs[1][p]), _mm256_mul_ps(h0, _mm256_loadu_ps(&up->coefs[0][p])));
+	    __m256 b = _mm256_fmadd_ps(h3, _mm256_loadu_ps(&up->coefs[3][p]), _mm256_mul_ps(h2, _mm256_loadu_ps(&up->coefs[2][p])));
+	    __m256 c = _mm256_fmadd_ps(h5, _mm256_loadu_ps(&up->coefs[5][p]), _mm256_mul_ps(h4, _mm256_loadu_ps(&up->coefs[4][p])));
+	    __m256 d = _mm256_fmadd_ps(h7, _mm256_loadu_ps(&up->coefs[7][p]), _mm256_mul_ps(h6, _mm256_loadu_ps(&up->coefs[6][p])));
+	    _mm256_storeu_ps(y + p, _mm256_add_ps(_mm256_add_ps(a, b), _mm256_add_ps(c, d)));
+	}
+    }
+}
+#endif
+
+/* Feed n inputs through the filter, writing n * factor outputs. The history and the new inputs are laid end to end so the
+ * kernels can slide a window along them.
+ */
+static void upsample(upsampler_t *up, const float *in, uint32_t n, float *y)
+{
+    float	line[UPSAMPLE_TAPS - 1 + UPSAMPLE_LINE];
+    uint32_t	c;
+
+    while (n)
+    {
+	c = n < UPSAMPLE_LINE ? n : UPSAMPLE_LINE;
+	memcpy(line, up->hist, sizeof(up->hist));
+	memcpy(line + UPSAMPLE_TAPS - 1, in, c * sizeof(float));
+
+	switch (up->isa)
+	{
+#ifdef DSP_X86
+	case DSP_ISA_AVX2:
+	    if (up->factor % 8 == 0)
+	    {
+		upsample_avx2(up, line, c, y);
+		break;
+	    }
+	    /* Fall through */
+	case DSP_ISA_SSE2:
+	    if (up->factor % 4 == 0)
+	    {
+		upsample_sse2(up, line, c, y);
+		break;
+	    }
+	    /* Fall through */
+#endif
+	default:
+	    upsample_scalar(up, line, c, y);
+	    break;
+	}
+
+	memcpy(up->hist, line + c, sizeof(up->hist));
+	in += c;
+	n -= c;
+	y += c * up->factor;
+    }
+}
+
+uint32_t upsampler_run(upsampler_t *up, const float *in, uint32_t in_frames, float *out, uint32_t out_frames, dsp_block_stats_t *stats)
+{
+    uint32_t done;
+    uint32_t n;
+
+    /* Finish the group the last call had to cut short */
+    done = up->pending_len - up->pending_pos;
+    if (done > out_frames)
+	done = out_frames;
+    memcpy(out, up->pending + up->pending_pos, done * sizeof(float));
+    up->pending_pos += done;
+
+    n = (out_frames - done) / up->factor;
+    if (n > in_frames)
+	n = in_frames;
+    upsample(up, in, n, out + done);
+    done += n * up->factor;
+
+    if (n < in_frames && done < out_frames)
+    {
+	upsample(up, in + n, 1, up->pending);
+	up->pending_len = up->factor;
+	up->pending_pos = out_frames - done;
+	memcpy(out + done, up->pending, up->pending_pos * sizeof(float));
+	done = out_frames;
+    }
+
+    measure(out, done, stats);
+    return done;
+}
+
+
+/* ==================== Engine audio ==================== */
+
+bool engine_audio_init(engine_audio_t *ea, double device_rate, uint32_t rate_divider, uint32_t period_frames)
+{
+    if (rate_divider < 1)
+	rate_divider = 1;
+    if (rate_divider > UPSAMPLE_MAX_FACTOR)
+	rate_divider = UPSAMPLE_MAX_FACTOR;
+    if (period_frames < 1)
+	period_frames = 1;
+
+    ea->rate_divider = rate_divider;
+    spsc_init(&ea->params);
+    osc_bank_init(&ea->bank, device_rate / rate_divider);
+    upsampler_init(&ea->up, rate_divider);
+
+    ea->scratch = NULL;
+    ea->scratch_frames = 0;
+    if (rate_divider > 1)
+    {
+	/* A period needs at most this many new internal frames, whatever is left pending from the one before */
+	ea->scratch_frames = (period_frames + rate_divider - 1) / rate_divider + 1;
+	ea->scratch = malloc(ea->scratch_frames * sizeof(float));
+	if (!ea->scratch)
+	    return false;
+    }
+    return true;
+}
+
+void engine_audio_uninit(engine_audio_t *ea)
+{
+    free(ea->scratch);
+    ea->scratch = NULL;
+    ea->scratch_frames = 0;
+}
+
+void engine_audio_process(engine_audio_t *ea, float *out, uint32_t frames, dsp_block_stats_t *stats)
+{
+    dsp_block_stats_t	internal;
+    uint32_t		l = ea->rate_divider;
+
+    if (l <= 1)
+    {
+	osc_bank_process(&ea->bank, &ea->params, out, frames, stats);
+	return;
+    }
+
+    stats->peak = 0.0f;
+    stats->overloads = 0;
+
+    while (frames)
+    {
+	/* Whatever is still pending from the last group covers part of this block, the rest needs fresh internal samples */
+	uint32_t have = ea->up.pending_len - ea->up.pending_pos;
+	uint32_t need = frames > have ? (frames - have + l - 1) / l : 0;
+	uint32_t n;
+
+	if (need > ea->scratch_frames)
+	    need = ea->scratch_frames;
+	if (need)
+	    osc_bank_process(&ea->bank, &ea->params, ea->scratch, need, &internal);
+
+	n = upsampler_run(&ea->up, ea->scratch, need, out, frames, stats);
+	out += n;
+	frames -= n;
+    }
+}
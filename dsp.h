@@ -0,0 +1,173 @@
+#ifndef SCPULSE_DSP_H
+#define SCPULSE_DSP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spsc.h"
+
+/* Engine audio DSP. Nothing in here depends on raylib or miniaudio, so it can be used from the audio callback as well as from
+ * headless tools and benchmarks.
+ */
+
+typedef enum {
+    OSC_ROOT = 0,
+    OSC_Q = 1,
+    OSC_R = 2,
+    OSC_S = 3,
+    OSC_COUNT
+} osc_id_e;
+
+typedef enum {
+    DSP_ISA_SCALAR = 0,
+    DSP_ISA_SSE2 = 1,
+    DSP_ISA_AVX2 = 2,
+} dsp_isa_e;
+
+typedef enum {
+    OSC_MODE_POLY = 0,	    /* Polynomial sine of the wrapped phase, every sample */
+    OSC_MODE_PHASOR = 1,    /* Complex rotation of e^(j*2*pi*phase), no trig at all per sample */
+} osc_mode_e;
+
+/* spsc_msg_t types for oscillator parameter changes. index is the osc_id_e. */
+typedef enum {
+    OSC_PARAM_FREQ = 0,
+    OSC_PARAM_AMPLITUDE = 1,
+} osc_param_e;
+
+#define DSP_MAX_LANES 8
+
+/* Anything louder than this overloads the engine */
+#define DSP_OVERLOAD_LEVEL 1.0f
+
+typedef struct dsp_block_stats_s
+{
+    float	peak;	    /* Largest |sample| in the block */
+    uint32_t	overloads;  /* Number of samples with |sample| > DSP_OVERLOAD_LEVEL */
+} dsp_block_stats_t;
+
+typedef struct osc_bank_s
+{
+    /* Same semantics as ma_waveform_type_sine: out = sin(2*pi*phase) * amplitude, phase advances by freq / sample_rate
+     * each sample and a frequency change keeps the current phase. Phase is in cycles and wrapped to [0, 1) so it doesn't
+     * lose precision over long sessions the way ma_waveform's ever-growing time counter does.
+     */
+    double	phase[OSC_COUNT];
+    double	advance[OSC_COUNT];
+    float	amplitude[OSC_COUNT];
+    float	freq[OSC_COUNT];
+
+    double	sample_rate;
+    dsp_isa_e	isa;
+    osc_mode_e	mode;
+
+    /* Phasor mode. z = e^(j*2*pi*phase) is advanced in double precision a whole SIMD chunk at a time and renormalized every
+     * block; the lanes inside a chunk are z times a fixed float table of e^(j*2*pi*advance*lane).
+     */
+    double	z_re[OSC_COUNT];
+    double	z_im[OSC_COUNT];
+    double	rot_re[OSC_COUNT];  /* One sample of rotation */
+    double	rot_im[OSC_COUNT];
+    double	chunk_re[OSC_COUNT];	/* One SIMD chunk of rotation */
+    double	chunk_im[OSC_COUNT];
+    float	lane_re[OSC_COUNT][DSP_MAX_LANES];
+    float	lane_im[OSC_COUNT][DSP_MAX_LANES];
+    int		z_stale[OSC_COUNT];	/* z needs re-deriving from phase before it is used */
+
+    /* Linear ramps from the current amplitude/frequency to the last one set, over ramp_frames (0 jumps straight there). The
+     * kernels step these along with the rest of the oscillator state; a ring that isn't ramping has no steps to take. A ring
+     * whose frequency is ramping is generated by the polynomial path until the ramp ends, even in phasor mode.
+     */
+    uint32_t	ramp_frames;
+    float	amp_target[OSC_COUNT];
+    float	amp_step[OSC_COUNT];
+    uint32_t	amp_left[OSC_COUNT];
+    double	adv_target[OSC_COUNT];
+    double	adv_step[OSC_COUNT];
+    uint32_t	adv_left[OSC_COUNT];
+
+    /* Frames rendered so far. This is the clock queued parameter changes are scheduled and measured against. */
+    _Atomic uint64_t	clock;
+    uint64_t		params_applied;
+    uint64_t		param_latency_max;	/* In frames, from posting to taking effect */
+    uint64_t		param_latency_total;
+} osc_bank_t;
+
+dsp_isa_e dsp_detect_isa(void);
+const char *dsp_isa_name(dsp_isa_e isa);
+const char *osc_mode_name(osc_mode_e mode);
+
+void osc_bank_init(osc_bank_t *bank, double sample_rate);
+void osc_bank_set_isa(osc_bank_t *bank, dsp_isa_e isa); /* Clamped to what the cpu supports */
+void osc_bank_set_mode(osc_bank_t *bank, osc_mode_e mode);
+void osc_bank_set_ramp(osc_bank_t *bank, uint32_t frames);
+void osc_bank_set_freq(osc_bank_t *bank, osc_id_e osc, float freq);
+void osc_bank_set_amplitude(osc_bank_t *bank, osc_id_e osc, float amplitude);
+void osc_bank_set_phase(osc_bank_t *bank, osc_id_e osc, double phase); /* Cycles, for picking up a saved session */
+
+/* Generate every oscillator, write their sum to out and measure it, all in a single pass */
+void osc_bank_render(osc_bank_t *bank, float *out, uint32_t frames, dsp_block_stats_t *stats);
+
+/* Once the audio device is running the bank belongs to the audio thread. Other threads post changes to a queue instead of
+ * calling the setters, and osc_bank_process applies them on the audio thread at exactly the frame they asked for.
+ */
+uint64_t osc_bank_clock(osc_bank_t *bank);
+bool osc_bank_post(osc_bank_t *bank, spsc_queue_t *params, osc_param_e param, osc_id_e osc, float value, uint64_t when);
+void osc_bank_process(osc_bank_t *bank, spsc_queue_t *params, float *out, uint32_t frames, dsp_block_stats_t *stats);
+
+
+/* Polyphase FIR interpolator. Every ring sits within a few Hz of 40Hz, so the bank can run at a small fraction of the device
+ * rate and be brought back up to it here.
+ */
+#define UPSAMPLE_MAX_FACTOR 32
+#define UPSAMPLE_TAPS 8 /* Per phase, and the SIMD paths are written out for exactly 8. Output lags the input by
+			 * UPSAMPLE_TAPS / 2 internal frames.
+			 */
+
+#define UPSAMPLE_LINE 64 /* Inputs filtered per pass */
+
+typedef struct upsampler_s
+{
+    uint32_t	factor;
+    dsp_isa_e	isa;
+    float	coefs[UPSAMPLE_TAPS][UPSAMPLE_MAX_FACTOR];  /* coefs[k][p] is tap k of phase p, so one input makes a whole group */
+    float	hist[UPSAMPLE_TAPS - 1];		    /* The inputs before the next one, oldest first */
+    float	pending[UPSAMPLE_MAX_FACTOR];		    /* Tail of the last group that didn't fit in the caller's buffer */
+    uint32_t	pending_pos;
+    uint32_t	pending_len;
+} upsampler_t;
+
+void upsampler_init(upsampler_t *up, uint32_t factor);
+
+/* Turn in[0..in_frames) into up to out_frames device rate samples, including anything left pending from last time, and
+ * measure what was delivered. Returns the number of samples written to out.
+ */
+uint32_t upsampler_run(upsampler_t *up, const float *in, uint32_t in_frames, float *out, uint32_t out_frames, dsp_block_stats_t *stats);
+
+
+/* Everything the audio callback needs: the ring oscillators, their parameter queue and, when rate_divider is above 1, the
+ * upsampler that takes the bank from its internal rate to the device rate. Overload is measured on the device rate output,
+ * so peaks between the internal samples are still caught.
+ */
+typedef struct engine_audio_s
+{
+    osc_bank_t	    bank;
+    spsc_queue_t    params;
+    upsampler_t	    up;
+    uint32_t	    rate_divider;
+
+    /* Internal rate frames for one device period. At full rate the bank renders straight into the caller's buffer and
+     * there is no scratch at all.
+     */
+    float	    *scratch;
+    uint32_t	    scratch_frames;
+} engine_audio_t;
+
+/* period_frames is what the device negotiated; larger blocks still work, they are just rendered in several passes.
+ * Returns false if the scratch couldn't be allocated.
+ */
+bool engine_audio_init(engine_audio_t *ea, double device_rate, uint32_t rate_divider, uint32_t period_frames);
+void engine_audio_uninit(engine_audio_t *ea);
+void engine_audio_process(engine_audio_t *ea, float *out, uint32_t frames, dsp_block_stats_t *stats);
+
+#endif
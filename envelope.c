@@ -0,0 +1,519 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "envelope.h"
+
+#define ENVELOPE_TAU 6.283185307179586
+
+/* Samples of s' per period of the fastest partial. It has a root every half period, so this leaves four samples between
+ * neighbouring roots when the partials agree, and only loses a pair of them where the partials nearly cancel.
+ */
+#define ENVELOPE_GRID 8
+
+#define ENVELOPE_REFINE_ITERS 60
+#define ENVELOPE_REFINE_EPS 1e-10 /* Seconds. Off by this, a peak is off by around 1e-15. */
+
+#define ENVELOPE_ANCHOR 1024 /* Grid steps between exact evaluations, so rounding in the rotations can't build up */
+
+/* s, s' and s'' at t, and each partial's e^(j*angle) there so nearby points can be reached without any trig */
+typedef struct envelope_point_s
+{
+    double  t;
+    double  s;
+    double  ds;
+    double  dds;
+    double  re[ENVELOPE_PARTIALS];
+    double  im[ENVELOPE_PARTIALS];
+} envelope_point_t;
+
+static void envelope_sums(const envelope_t *env, envelope_point_t *p)
+{
+    int k;
+
+    p->s = p->ds = p->dds = 0;
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	double w = ENVELOPE_TAU * env->freq[k];
+
+	p->s += env->amp[k] * p->im[k];
+	p->ds += env->amp[k] * w * p->re[k];
+	p->dds -= env->amp[k] * w * w * p->im[k];
+    }
+}
+
+static void envelope_eval(const envelope_t *env, double t, envelope_point_t *p)
+{
+    int k;
+
+    p->t = t;
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	double c = env->phase[k] + env->freq[k] * t;
+	double a = ENVELOPE_TAU * (c - floor(c));
+
+	p->re[k] = cos(a);
+	p->im[k] = sin(a);
+    }
+    envelope_sums(env, p);
+}
+
+/* e^(j*x) for |x| <= pi/4, good to about 1e-13 */
+static void small_rotation(double x, double *re, double *im)
+{
+    double x2 = x * x;
+
+    *re = 1 + x2 * (-1.0 / 2 + x2 * (1.0 / 24 + x2 * (-1.0 / 720 + x2 * (1.0 / 40320 + x2 * (-1.0 / 3628800 + x2 * (1.0 / 479001600))))));
+    *im = x * (1 + x2 * (-1.0 / 6 + x2 * (1.0 / 120 + x2 * (-1.0 / 5040 + x2 * (1.0 / 362880 + x2 * (-1.0 / 39916800 + x2 * (1.0 / 6227020800.0)))))));
+}
+
+/* The point at t, from a point near it. Anything further than a grid step away is evaluated from scratch. */
+static void envelope_eval_near(const envelope_t *env, const envelope_point_t *from, double t, double fastest, envelope_point_t *p)
+{
+    double  d = t - from->t;
+    int	    k;
+
+    if (fabs(d) * fastest * ENVELOPE_GRID > 1)
+    {
+	envelope_eval(env, t, p);
+	return;
+    }
+
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	double re, im, r = from->re[k], i = from->im[k];
+
+	small_rotation(ENVELOPE_TAU * env->freq[k] * d, &re, &im);
+	p->re[k] = r * re - i * im;
+	p->im[k] = r * im + i * re;
+    }
+    p->t = t;
+    envelope_sums(env, p);
+}
+
+void envelope_set_rings(envelope_t *env, const sim_state_t *sim)
+{
+    int k;
+
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	env->freq[k] = sim->ring_freq[k];
+	env->amp[k] = sim_ring_amplitude(sim, k);
+    }
+}
+
+void envelope_advance(envelope_t *env, double dt)
+{
+    int k;
+
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	double c = env->phase[k] + env->freq[k] * dt;
+	env->phase[k] = c - floor(c);
+    }
+}
+
+double envelope_value(const envelope_t *env, double t)
+{
+    envelope_point_t p;
+
+    envelope_eval(env, t, &p);
+    return p.s;
+}
+
+/* Where s' crosses zero between a and b, which straddle it. Newton on s', falling back to bisection whenever a step
+ * would leave the bracket. The grid puts a within a few degrees of the carrier of the root, so it's usually three steps.
+ */
+static void refine_extremum(const envelope_t *env, double fastest, envelope_point_t a, envelope_point_t b, envelope_point_t *out)
+{
+    envelope_point_t	x = fabs(a.ds) < fabs(b.ds) ? a : b;
+    int			i;
+
+    for (i = 0; i < ENVELOPE_REFINE_ITERS && b.t - a.t > ENVELOPE_REFINE_EPS; i++)
+    {
+	double t = x.dds != 0 ? x.t - x.ds / x.dds : a.t;
+	double moved;
+
+	if (!(t > a.t && t < b.t))
+	    t = (a.t + b.t) / 2;
+	moved = fabs(t - x.t);
+	envelope_eval_near(env, &x, t, fastest, &x);
+	if (x.ds == 0 || moved < ENVELOPE_REFINE_EPS)
+	    break;
+	if ((x.ds > 0) == (a.ds > 0))
+	    a = x;
+	else
+	    b = x;
+    }
+    *out = x;
+}
+
+/* Where sign * s crosses level between a and b, which straddle it, on a stretch where s is monotonic */
+static double find_crossing(const envelope_t *env, double fastest, const envelope_point_t *a, const envelope_point_t *b, double level, double sign)
+{
+    envelope_point_t	x = *a;
+    double		ta = a->t, tb = b->t;
+    double		va = sign * a->s, v;
+    int			i;
+
+    for (i = 0; i < ENVELOPE_REFINE_ITERS && tb - ta > ENVELOPE_REFINE_EPS; i++)
+    {
+	double t = x.ds != 0 ? x.t - (sign * x.s - level) / (sign * x.ds) : ta;
+	double moved;
+
+	if (!(t > ta && t < tb))
+	    t = (ta + tb) / 2;
+	moved = fabs(t - x.t);
+	envelope_eval_near(env, &x, t, fastest, &x);
+	v = sign * x.s;
+	if (v == level || moved < ENVELOPE_REFINE_EPS)
+	    break;
+	if ((v > level) == (va > level))
+	    ta = t;
+	else
+	    tb = t;
+    }
+    return x.t;
+}
+
+/* Time where sign * s is above level on a monotonic stretch from a to b */
+static double time_above(const envelope_t *env, double fastest, const envelope_point_t *a, const envelope_point_t *b, double level, double sign)
+{
+    double va = sign * a->s, vb = sign * b->s;
+
+    if (va > level && vb > level)
+	return b->t - a->t;
+    if (va <= level && vb <= level)
+	return 0;
+    if (va > level)
+	return find_crossing(env, fastest, a, b, level, sign) - a->t;
+    return b->t - find_crossing(env, fastest, a, b, level, sign);
+}
+
+/* Cuts [t0, t1] at every extremum of s, so s is monotonic between consecutive cuts, and hands each piece to visit along
+ * with the frequency of the fastest partial that's sounding
+ */
+typedef void (*envelope_visit_f)(const envelope_t *env, double fastest, const envelope_point_t *a, const envelope_point_t *b, void *ctx);
+
+static void envelope_walk(const envelope_t *env, double t0, double t1, envelope_visit_f visit, void *ctx)
+{
+    envelope_point_t	start, prev, cur;
+    double		rot_re[ENVELOPE_PARTIALS], rot_im[ENVELOPE_PARTIALS];
+    double		fastest = 0, step;
+    long		n, steps;
+    int			k;
+
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+	if (env->amp[k] != 0 && fabs(env->freq[k]) > fastest)
+	    fastest = fabs(env->freq[k]);
+
+    envelope_eval(env, t0, &start);
+    if (fastest == 0 || t1 <= t0)
+    {
+	envelope_eval(env, t1 > t0 ? t1 : t0, &cur);
+	visit(env, fastest, &start, &cur, ctx);
+	return;
+    }
+
+    /* Every step is the same rotation, at most pi/4 for the fastest partial */
+    steps = (long)ceil((t1 - t0) * fastest * ENVELOPE_GRID);
+    step = (t1 - t0) / steps;
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+	small_rotation(ENVELOPE_TAU * env->freq[k] * step, &rot_re[k], &rot_im[k]);
+
+    prev = start;
+    for (n = 1; n <= steps; n++)
+    {
+	if (n == steps)
+	    envelope_eval_near(env, &prev, t1, fastest, &cur);
+	else if (n % ENVELOPE_ANCHOR == 0)
+	    envelope_eval(env, t0 + n * step, &cur);
+	else
+	{
+	    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+	    {
+		cur.re[k] = prev.re[k] * rot_re[k] - prev.im[k] * rot_im[k];
+		cur.im[k] = prev.re[k] * rot_im[k] + prev.im[k] * rot_re[k];
+	    }
+	    cur.t = t0 + n * step;
+	    envelope_sums(env, &cur);
+	}
+
+	if ((prev.ds > 0 && cur.ds < 0) || (prev.ds < 0 && cur.ds > 0))
+	{
+	    envelope_point_t ext;
+
+	    refine_extremum(env, fastest, prev, cur, &ext);
+	    visit(env, fastest, &start, &ext, ctx);
+	    start = ext;
+	}
+	prev = cur;
+    }
+    visit(env, fastest, &start, &cur, ctx);
+}
+
+typedef struct measure_ctx_s
+{
+    double	    level;
+    double	    peak;
+    double	    over;
+    bool	    count_over;
+} measure_ctx_t;
+
+static void visit_measure(const envelope_t *env, double fastest, const envelope_point_t *a, const envelope_point_t *b, void *ctx)
+{
+    measure_ctx_t *m = ctx;
+
+    if (fabs(a->s) > m->peak)
+	m->peak = fabs(a->s);
+    if (fabs(b->s) > m->peak)
+	m->peak = fabs(b->s);
+    if (m->count_over)
+	m->over += time_above(env, fastest, a, b, m->level, 1) + time_above(env, fastest, a, b, m->level, -1);
+}
+
+float envelope_peak(const envelope_t *env, double t0, double t1)
+{
+    measure_ctx_t m = {0, 0, 0, false};
+
+    envelope_walk(env, t0, t1, visit_measure, &m);
+    return m.peak;
+}
+
+void envelope_measure(const envelope_t *env, double t0, double t1, float level, envelope_stats_t *stats)
+{
+    measure_ctx_t m = {level, 0, 0, true};
+
+    envelope_walk(env, t0, t1, visit_measure, &m);
+    stats->peak = m.peak;
+    stats->over = m.over;
+}
+
+/* ==================== Cache ==================== */
+
+static double cache_now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t table_bytes(const envelope_cache_t *cache)
+{
+    return sizeof(envelope_table_t) + (size_t)cache->ticks * sizeof(envelope_tick_t);
+}
+
+bool envelope_cache_init(envelope_cache_t *cache, double tick, double period, float level, size_t max_bytes)
+{
+    memset(cache, 0, sizeof(*cache));
+    if (!(tick > 0) || !(period >= tick) || period / tick > UINT32_MAX)
+	return false;
+
+    cache->tick = tick;
+    cache->ticks = (uint32_t)lround(period / tick);
+    cache->period = cache->ticks * tick;
+    cache->level = level;
+
+    cache->capacity = max_bytes / table_bytes(cache);
+    if (cache->capacity == 0)
+	cache->capacity = 1;
+    cache->tables = calloc(cache->capacity, sizeof(envelope_table_t));
+    return cache->tables != NULL;
+}
+
+void envelope_cache_free(envelope_cache_t *cache)
+{
+    uint32_t i;
+
+    for (i = 0; i < cache->count; i++)
+	free(cache->tables[i].ticks);
+    free(cache->tables);
+    memset(cache, 0, sizeof(*cache));
+}
+
+size_t envelope_cache_bytes(const envelope_cache_t *cache)
+{
+    return cache->count * table_bytes(cache);
+}
+
+static void cache_key(const envelope_cache_t *cache, const envelope_t *env, envelope_key_t *key)
+{
+    int k;
+
+    memset(key, 0, sizeof(*key));
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	key->amp[k] = (int32_t)lroundf(env->amp[k] * ENVELOPE_AMP_STEPS);
+	if (key->amp[k] == 0)
+	    continue;
+	key->freq[k] = (int32_t)lround(env->freq[k] * cache->period);
+    }
+}
+
+/* The setting a key stands for, phases 0 at t = 0 */
+static void key_envelope(const envelope_cache_t *cache, const envelope_key_t *key, envelope_t *env)
+{
+    int k;
+
+    memset(env, 0, sizeof(*env));
+    for (k = 0; k < ENVELOPE_PARTIALS; k++)
+    {
+	env->freq[k] = key->freq[k] / cache->period;
+	env->amp[k] = (float)key->amp[k] / ENVELOPE_AMP_STEPS;
+    }
+}
+
+static void build_table(const envelope_cache_t *cache, envelope_table_t *table)
+{
+    envelope_t	    env;
+    envelope_stats_t stats;
+    double	    over = 0;
+    uint32_t	    n;
+
+    key_envelope(cache, &table->key, &env);
+    table->peak = 0;
+    for (n = 0; n < cache->ticks; n++)
+    {
+	envelope_measure(&env, n * cache->tick, (n + 1) * cache->tick, cache->level, &stats);
+	table->ticks[n].peak = stats.peak;
+	table->ticks[n].over = stats.over;
+	if (stats.peak > table->peak)
+	    table->peak = stats.peak;
+	over += stats.over;
+    }
+    table->duty = over / cache->period;
+}
+
+static envelope_table_t *cache_find(envelope_cache_t *cache, const envelope_key_t *key)
+{
+    uint32_t i;
+
+    cache->clock++;
+    for (i = 0; i < cache->count; i++)
+    {
+	if (!memcmp(&cache->tables[i].key, key, sizeof(*key)))
+	{
+	    cache->tables[i].used = cache->clock;
+	    return &cache->tables[i];
+	}
+    }
+    return NULL;
+}
+
+/* Where a new table goes: a fresh one while there's room, else the least recently used, whose entries are reused */
+static envelope_table_t *cache_slot(envelope_cache_t *cache, const envelope_key_t *key)
+{
+    envelope_table_t	*table;
+    uint32_t		i;
+
+    if (cache->count < cache->capacity)
+    {
+	table = &cache->tables[cache->count];
+	table->ticks = malloc(cache->ticks * sizeof(envelope_tick_t));
+	if (table->ticks == NULL)
+	    return NULL;
+	cache->count++;
+    }
+    else
+    {
+	table = &cache->tables[0];
+	for (i = 1; i < cache->count; i++)
+	    if (cache->tables[i].used < table->used)
+		table = &cache->tables[i];
+	cache->evictions++;
+    }
+
+    table->key = *key;
+    table->used = cache->clock;
+    return table;
+}
+
+const envelope_table_t *envelope_cache_get(envelope_cache_t *cache, const envelope_t *env)
+{
+    envelope_table_t	*table;
+    envelope_key_t	key;
+    double		t0, sec;
+
+    cache_key(cache, env, &key);
+    if ((table = cache_find(cache, &key)) != NULL)
+    {
+	cache->hits++;
+	return table;
+    }
+
+    cache->misses++;
+    if ((table = cache_slot(cache, &key)) == NULL)
+	return NULL;
+
+    t0 = cache_now_sec();
+    build_table(cache, table);
+    sec = cache_now_sec() - t0;
+    cache->build_sec += sec;
+    if (sec > cache->build_sec_max)
+	cache->build_sec_max = sec;
+    return table;
+}
+
+const envelope_table_t *envelope_cache_find(envelope_cache_t *cache, const envelope_t *env)
+{
+    envelope_table_t	*table;
+    envelope_key_t	key;
+
+    cache_key(cache, env, &key);
+    if ((table = cache_find(cache, &key)) != NULL)
+	cache->hits++;
+    else
+	cache->misses++;
+    return table;
+}
+
+void envelope_cache_measure(const envelope_cache_t *cache, const envelope_t *env, uint64_t tick, envelope_tick_t *out)
+{
+    envelope_key_t	key;
+    envelope_t		rounded;
+    envelope_stats_t	stats;
+    uint32_t		n = tick % cache->ticks;
+
+    /* As build_table does it, to the same bits */
+    cache_key(cache, env, &key);
+    key_envelope(cache, &key, &rounded);
+    envelope_measure(&rounded, n * cache->tick, (n + 1) * cache->tick, cache->level, &stats);
+    out->peak = stats.peak;
+    out->over = stats.over;
+}
+
+bool envelope_table_alloc(const envelope_cache_t *cache, envelope_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    table->ticks = malloc(cache->ticks * sizeof(envelope_tick_t));
+    return table->ticks != NULL;
+}
+
+void envelope_table_free(envelope_table_t *table)
+{
+    free(table->ticks);
+    memset(table, 0, sizeof(*table));
+}
+
+void envelope_table_build(const envelope_cache_t *cache, const envelope_t *env, envelope_table_t *table)
+{
+    cache_key(cache, env, &table->key);
+    build_table(cache, table);
+}
+
+const envelope_table_t *envelope_cache_put(envelope_cache_t *cache, const envelope_table_t *table)
+{
+    envelope_table_t *slot;
+
+    if ((slot = cache_find(cache, &table->key)) != NULL)
+	return slot;
+    if ((slot = cache_slot(cache, &table->key)) == NULL)
+	return NULL;
+
+    memcpy(slot->ticks, table->ticks, cache->ticks * sizeof(envelope_tick_t));
+    slot->peak = table->peak;
+    slot->duty = table->duty;
+    return slot;
+}
@@ -0,0 +1,142 @@
+#ifndef SCPULSE_ENVELOPE_H
+#define SCPULSE_ENVELOPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+/* The engine's output is the sum of the four ring sines, so how loud it gets over any stretch of time follows from their
+ * frequencies, amplitudes and phases alone. These evaluate that sum directly, with no audio rendered and no dependence
+ * on when a callback happened to run:
+ *
+ *   s(t) = sum of amp[k] * sin(2*pi*(phase[k] + freq[k]*t))
+ *
+ * which is what osc_bank_t renders at t = sample index / sample rate, minus its float rounding.
+ */
+
+#define ENVELOPE_PARTIALS SIM_RING_COUNT
+
+typedef struct envelope_s
+{
+    double	freq[ENVELOPE_PARTIALS];    /* Hz */
+    double	phase[ENVELOPE_PARTIALS];   /* Cycles at t = 0, like osc_bank_t.phase */
+    float	amp[ENVELOPE_PARTIALS];
+} envelope_t;
+
+/* Frequencies and amplitudes from the sim's rings, as post_rings would send them to the audio. The phases are left as
+ * they are, so an envelope carried along with envelope_advance stays continuous across changes.
+ */
+void envelope_set_rings(envelope_t *env, const sim_state_t *sim);
+
+/* Move t = 0 forward by dt seconds */
+void envelope_advance(envelope_t *env, double dt);
+
+double envelope_value(const envelope_t *env, double t);
+
+/* Largest |s(t)| over [t0, t1]. Exact to the last few digits, except that two extrema closer together than an eighth
+ * of the shortest period can be missed; the sum is near a null of its beat when that happens, so little is lost.
+ */
+float envelope_peak(const envelope_t *env, double t0, double t1);
+
+/* Like dsp_block_stats_t, for a stretch of time rather than a block of samples */
+typedef struct envelope_stats_s
+{
+    float	peak;	/* envelope_peak */
+    double	over;	/* Seconds where |s(t)| > level. Times the sample rate, that's the overloads the audio would count. */
+} envelope_stats_t;
+
+void envelope_measure(const envelope_t *env, double t0, double t1, float level, envelope_stats_t *stats);
+
+/* ==================== Cache ==================== */
+
+/* envelope_measure for every tick of a ring setting, worked out once when the setting is first seen, so stepping with it
+ * is a table lookup. For that to hold forever the sum has to repeat, so a cached setting has its frequencies rounded to
+ * multiples of 1/period Hz and its phases all 0 at t = 0: s(t) then repeats every period seconds, and tick n measures the
+ * same as tick n % ticks. Its amplitudes are rounded too, to 1/ENVELOPE_AMP_STEPS, so a slider dragged a hair doesn't make
+ * a new setting. A setting is its rounded frequencies and amplitudes; going back to one is a hit.
+ */
+
+#define ENVELOPE_AMP_STEPS 256 /* Per unit of amplitude. Four partials off by half a step each move a peak by 0.008 at most. */
+
+typedef struct envelope_tick_s
+{
+    float	peak;
+    float	over;	/* Seconds */
+} envelope_tick_t;
+
+typedef struct envelope_key_s
+{
+    int32_t	freq[ENVELOPE_PARTIALS];    /* In 1/period Hz, 0 for silent partials */
+    int32_t	amp[ENVELOPE_PARTIALS];	    /* In 1/ENVELOPE_AMP_STEPS, 0 for silent partials */
+} envelope_key_t;
+
+typedef struct envelope_table_s
+{
+    envelope_key_t  key;
+    envelope_tick_t *ticks;	/* cache->ticks of them */
+    float	    peak;	/* Of the whole period, the most this setting ever puts out */
+    float	    duty;	/* Share of the time over the level */
+    uint64_t	    used;	/* cache->clock when last looked up, for eviction */
+} envelope_table_t;
+
+typedef struct envelope_cache_s
+{
+    double	    tick;	/* Seconds per entry */
+    double	    period;	/* ticks * tick */
+    uint32_t	    ticks;
+    float	    level;	/* For envelope_tick_t.over */
+
+    envelope_table_t *tables;
+    uint32_t	    capacity;	/* As many as fit in the bound, at least one */
+    uint32_t	    count;
+    uint64_t	    clock;
+
+    uint64_t	    hits;
+    uint64_t	    misses;
+    uint64_t	    evictions;
+    double	    build_sec;	/* Building tables, all told */
+    double	    build_sec_max;
+} envelope_cache_t;
+
+/* Tables of period / tick entries, rounded to a whole number of ticks, and no more of them than fit in max_bytes */
+bool envelope_cache_init(envelope_cache_t *cache, double tick, double period, float level, size_t max_bytes);
+void envelope_cache_free(envelope_cache_t *cache);
+
+/* The table for env's frequencies and amplitudes; its phases don't matter. Builds it on a miss, in place of the least
+ * recently used table if the cache is full. Stays valid until the next call. NULL if a table couldn't be allocated.
+ */
+const envelope_table_t *envelope_cache_get(envelope_cache_t *cache, const envelope_t *env);
+
+/* The table for env if the cache has it, NULL if not; nothing is built. For a thread that can't wait out a build, which
+ * gets the table from envelope_table_build elsewhere and envelope_cache_put, and envelope_cache_measure till then.
+ */
+const envelope_table_t *envelope_cache_find(envelope_cache_t *cache, const envelope_t *env);
+
+/* Entry tick of env's table, measured on its own: the same to the bit as the table's, for about 1/ticks of a build */
+void envelope_cache_measure(const envelope_cache_t *cache, const envelope_t *env, uint64_t tick, envelope_tick_t *out);
+
+/* A table outside any cache, with room for cache's ticks. False if it couldn't be allocated. */
+bool envelope_table_alloc(const envelope_cache_t *cache, envelope_table_t *table);
+void envelope_table_free(envelope_table_t *table);
+
+/* Builds env's table for cache into table, reading only what envelope_cache_init set, so any thread can while another
+ * uses the cache
+ */
+void envelope_table_build(const envelope_cache_t *cache, const envelope_t *env, envelope_table_t *table);
+
+/* A copy of a built table into the cache, in place of the least recently used if it's full, unless it has one of the
+ * setting already. Either way that one is returned, valid until the next put or get. NULL if it couldn't be allocated.
+ */
+const envelope_table_t *envelope_cache_put(envelope_cache_t *cache, const envelope_table_t *table);
+
+/* Tables in memory, in bytes */
+size_t envelope_cache_bytes(const envelope_cache_t *cache);
+
+static inline const envelope_tick_t *envelope_table_at(const envelope_cache_t *cache, const envelope_table_t *table, uint64_t tick)
+{
+    return &table->ticks[tick % cache->ticks];
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SCPULSE_RNG_H
+#define SCPULSE_RNG_H
+
+#include <stdint.h>
+
+/* xoshiro128+ (Blackman and Vigna): 128 bits of state, a handful of adds, xors and shifts per number. Each sim owns one, so
+ * a seed always gives the same sequence no matter what else is running or on which thread. Its low bits are weak, so
+ * only the top 24 go into a float.
+ */
+
+typedef struct rng_s
+{
+    uint32_t s[4];
+} rng_t;
+
+static inline uint32_t rng_rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+/* splitmix64 spreads the seed over the whole state, so seeds 0, 1, 2... are as good as any and the state is never all zero */
+static inline void rng_seed(rng_t *rng, uint64_t seed)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+	uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	rng->s[2 * i] = (uint32_t)z;
+	rng->s[2 * i + 1] = (uint32_t)(z >> 32);
+    }
+}
+
+static inline uint32_t rng_next(rng_t *rng)
+{
+    uint32_t *s = rng->s;
+    uint32_t result = s[0] + s[3];
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 11);
+
+    return result;
+}
+
+/* [0, 1), exactly representable, so the same bits on every compiler and FPU */
+static inline float rng_uniform(rng_t *rng)
+{
+    return (rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Integer in [min, max] */
+static inline int rng_range(rng_t *rng, int min, int max)
+{
+    return min + (int)(((uint64_t)rng_next(rng) * (uint32_t)(max - min + 1)) >> 32);
+}
+
+/* Batch of uniforms, for code that wants all of a step's random numbers up front */
+static inline void rng_fill_uniform(rng_t *rng, float *out, uint32_t n)
+{
+    rng_t	local = *rng; /* Keeps the state in registers instead of going back through the pointer each time */
+    uint32_t	i;
+
+    for (i = 0; i < n; i++)
+	out[i] = rng_uniform(&local);
+    *rng = local;
+}
+
+#endif
@@ -7,6 +7,11 @@
 #include <string.h>
 #include <stddef.h>
 #include <unistd.h>
+#include <time.h>
+#include <stdatomic.h>
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
 
 #define RAYGUI_IMPLEMENTATION
 #include <raygui.h>
@@ -17,6 +22,14 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 
+#include "dsp.h"
+#include "sim.h"
+#include "sim_warp.h"
+#include "sim_save.h"
+#include "sim_journal.h"
+#include "sim_forecast.h"
+#include "envelope.h"
+
 #ifdef __EMSCRIPTEN__
 #include <style_cyber.h>
 #endif
@@ -32,18 +45,29 @@
 #define R_VARIANCE  0.81
 #define S_VARIANCE  0.53
 
+#define ENGINE_RATE_DIVIDER 16 /* Rings are synthesized at MY_SAMPLE_RATE / this and upsampled. 1 synthesizes at full rate. */
+#define RING_RAMP_MS 20 /* Amplitude and frequency changes glide over this long instead of clicking */
+
+#define SIM_RATE 240 /* Sim steps per second, whatever the frame rate */
+#define SIM_MAX_CATCHUP 0.25 /* Seconds. Further behind than this, the sim skips ahead instead of stepping it all */
+
+#define BEAT_PERIOD 20.0 /* Seconds of beat envelope cached per ring setting, so settings are told apart to 0.05 Hz */
+#define BEAT_CACHE_BYTES (1 << 20)
+
+#define FORECAST_SECONDS 120.0 /* How far ahead the what-if overlays look */
+#define FORECAST_LINGER 2.0 /* Seconds the overlays stay up after the last change, once the widget is let go */
+#define FORECAST_REFRESH 0.5 /* Seconds. A widget held still is forecast again from the newer steps this often. */
+#define FORECAST_POLL_US 1000 /* How often the idle forecast worker looks for a request */
+#define FORECAST_SLICE 16 /* Of its points, what a frame runs of a forecast where there's no worker: under 4 ms */
+#define FORECAST_COLOR GOLD
+
+#define SAVE_PATH "scpulse.sav" /* The session, written on exit and picked up on the next start. Delete it to start fresh. */
+#define JOURNAL_PATH "scpulse.jrn" /* This run's inputs, written on exit. scpulse-replay runs it again. */
+
 #define GUI_THEME_RGS "resources/style_cyber.rgs"
 
 #define DEFAULT_VOLUME 0.25;
 
-#define FUEL_RESTORE_RATE 50 /* Liters/s */
-#define MAX_FUEL_LEVEL 100000.0 /* Liters */
-#define MAX_COOLER_TEMP 1400 /* Degrees C */
-#define COOLER_COOL_RATE(x) ((powf((x / MAX_COOLER_TEMP), 1.2) * (MAX_COOLER_TEMP * 0.01))) /* Degrees/s */
-#define MAX_INPUT_POWER 2980 /* Amps */
-#define FUEL_CONSUME_RATE(x) ((-1 * (powf(x*20, 3))) + FUEL_RESTORE_RATE)
-#define POWER_TO_TEMP(x) (powf(x*33, 2)) /* 0 < x < 1.0 */
-
 #define HEALTH_TO_COLOR(h) (0x000000ff | (0x10 << 24) | ((127 + ((uint8_t)(h * 100))) << 16) | (0x65 << 8) )
 
 #define CHARGE_TO_COLOR(c, full, max)																    \
@@ -54,202 +78,498 @@
 
 #define TEMP_TO_COLOR(temp)	((0x000000ff) | ((0xff & (uint8_t)(((temp) / MAX_COOLER_TEMP) * 255)) << 24) | (0x20 << 0x10) | (((temp) >= MAX_COOLER_TEMP ? 0x30 : 0x80) << 8))
 
-#define POWER_TAP_DEST_STRING "Thrusters;Shields;Weapons"
-typedef enum {
-    TAP_DEST_THRUST = 0,
-    TAP_DEST_SHIELD = 1,
-    TAP_DEST_WEAPON = 2,
-} tap_dest_e;
+#define POWER_TAP_DEST_STRING "Thrusters;Shields;Weapons" /* In drain order */
+#define TAP_PANEL_X(i) (235 + 220 * (i)) /* Left of tap i's level, routing and capacitor */
+#define DRAIN_X(i) (295 + 220 * (i)) /* Left of drain i's usage bar */
+#define WARP_STRING "1x;10x;100x;1000x" /* In warp_factors order */
+#define CAPACITOR_SIZE_STRING "Small (10)\nMedium (20)\nLarge (50)" /* In capacitor_size_e order */
+#define CAPACITOR_GRADE_STRING "Consumer\nProfessional\nMilitary" /* In capacitor_grade_e order */
 
-#define CAPACITOR_SIZE_STRING "Small (10)\nMedium (20)\nLarge (50)"
-typedef enum {
-    CAP_SIZE_SMALL = 0,
-    CAP_SIZE_MED = 1,
-    CAP_SIZE_LARGE = 2,
-} capacitor_size_e;
+typedef struct sine_sources_s
+{
+    engine_audio_t audio; /* root, Q, R and S rings plus the queue that ring parameter changes reach the audio thread on.
+			     Their powers and frequencies are part of the sim state. */
+} sine_sources_t;
 
-#define CAPACITOR_GRADE_STRING "Consumer\nProfessional\nMilitary"
-typedef enum {
-    CAP_GRADE_CON = 0,
-    CAP_GRADE_PRO = 1,
-    CAP_GRADE_MIL = 2,
-} capacitor_grade_e;
+/* What the sim hands the GUI: the last two steps and when the newer one was taken, so frames in between can be blended */
+typedef struct sim_snapshot_s
+{
+    sim_state_t	prev;
+    sim_state_t	cur;
+    double	time; /* now_sec() of cur */
+} sim_snapshot_t;
 
+#define SNAP_FRESH 0x4 /* Set in a triple buffer's mid when its writer has published since its reader last took it */
 
-#define MAX_BAT_CHARGE 100.0
+/* Everything that crosses between the sim and the GUI or audio threads. The sim is the only writer of sim_state_t: the GUI
+ * sends it commands and reads snapshots, the audio hands it its block stats through atomics.
+ */
+typedef struct sim_link_s
+{
+    spsc_queue_t	cmds;	    /* GUI -> sim, spsc_msg_t type is the sim_cmd_e */
 
-static const float cap_max_charges[] = {15.0, 30.0, 70.0}; /* Indexed by capacitor_size_e */
-static const float cap_full_limits[] = {5.0, 10.0, 20.0}; /* cap_max_charges - max_full is "full" */
-static const float cap_grade_chrg_rate[] = {1.0, 2.0, 3.0}; /* Indexed by capacitor_grade_e */
-static const float cap_grade_dmg_factor[] = {3.0, 2.0, 1.0}; /* Indexed by capacitor_grade_e */
+    /* Triple buffer: the sim writes snaps[back], the GUI reads snaps[front], and mid is the one they swap through */
+    sim_snapshot_t	snaps[3];
+    _Atomic unsigned	mid;
+    unsigned		back;	    /* Sim side */
+    unsigned		front;	    /* GUI side */
 
-/* TODO: Add otehr tables for heat tolerance, damage multipliers, etc... */
+    _Atomic uint32_t	overloads;  /* Overloaded samples since the sim last took them */
+    _Atomic float	peak;	    /* Of the latest block */
+    _Atomic bool	overload;   /* The latest block overloaded */
 
-typedef struct capacitor_s
-{
-    /* Capacitors have:
-	- sizes (small, medium, large)
-	- Quality (low, average, high)
+    /* From the beat envelope of the current ring setting */
+    _Atomic float	beat_peak;  /* The most it ever puts out */
+    _Atomic float	beat_duty;  /* Share of the time it's overloaded */
 
-	- frequency tolerance?
+    _Atomic int		warp;	    /* GUI -> sim, index into warp_factors */
 
-	smaller capacitors can't hold as much charge, so they are required to have power drawn from them in order to not over-charge, over-heat, and incur damage
+    _Atomic bool	running;
+} sim_link_t;
+
+/* A what-if request: the latest step with whatever the GUI is changing applied */
+typedef struct forecast_ask_s
+{
+    sim_state_t	from;
+    uint64_t	id;
+} forecast_ask_t;
 
-    */
-    float		health;
-    float		charge;
-    float		max_charge;
-    float		full_limit;
+/* Between the GUI and the forecast worker. Triple buffers both ways, like sim_link_t's snapshots. A request is only
+ * wanted until the next one, so the worker gives up on a run as soon as latest moves on from its id.
+ */
+typedef struct forecast_link_s
+{
+    forecast_ask_t	asks[3];
+    _Atomic unsigned	ask_mid;
+    unsigned		ask_back;	/* GUI side */
+    unsigned		ask_front;	/* Worker side */
 
+    sim_forecast_t	results[3];
+    _Atomic unsigned	result_mid;
+    unsigned		result_back;	/* Worker side */
+    unsigned		result_front;	/* GUI side */
 
-    capacitor_grade_e	grade;
-    capacitor_size_e	size;
-} capacitor_t;
+    _Atomic uint64_t	latest;		/* The newest request's id. 0 is none, and stops the worker's run. */
+    _Atomic bool	running;
+} forecast_link_t;
 
-typedef struct power_drain_s
+/* Between the sim and the forecast worker, which also builds the beat tables the sim's cache doesn't have, so a new
+ * ring setting costs the sim a lookup and not a build. Triple buffers both ways again; only the newest setting is wanted.
+ */
+typedef struct beat_link_s
 {
-    float   rate;
-    float   spike_probability; /* random chance of power draw/peak */
-    bool    enabled;
-    float   factor; /* multiplier for how quickly the source gets drained */
-} power_drain_t;
+    envelope_t		asks[3];
+    _Atomic unsigned	ask_mid;
+    unsigned		ask_back;	/* Sim side */
+    unsigned		ask_front;	/* Worker side */
+
+    envelope_table_t	results[3];
+    _Atomic unsigned	result_mid;
+    unsigned		result_back;	/* Worker side */
+    unsigned		result_front;	/* Sim side */
+} beat_link_t;
+
+/* The oscillator bank is only touched by the audio thread once the device starts; everything else reaches it through
+ * waveforms.audio.params, which only the sim thread posts to once it is running.
+ */
+static sine_sources_t waveforms;
+static sim_state_t sim;	    /* Sim thread only */
+static sim_state_t sim_prev; /* sim before its latest step */
+static double sim_clock;    /* now_sec() the sim has been stepped up to */
+static sim_link_t sim_link;
+static envelope_cache_t beats; /* Sim thread only, but for the settings envelope_cache_init made */
+static envelope_t beat_env; /* The current ring setting */
+static const envelope_table_t *beat_table; /* Its table, NULL while the worker builds it */
+static beat_link_t beat_link;
+static sim_warp_t warp;	    /* Sim thread only */
+static double warp_over;    /* Overloaded samples the warp's steps haven't taken yet, less than one */
+static sim_journal_t journal; /* Sim thread only */
+static const int warp_factors[] = {1, 10, 100, 1000};
+static forecast_link_t forecast_link;
+static sim_forecaster_t forecaster; /* Forecast worker only */
+
+static sim_state_t view; /* What the GUI draws: the latest snapshot blended to now */
+static bool tap_edit_mode[SIM_TAP_COUNT]; /* Routing dropdown is open */
+static const char *const drain_names[SIM_DRAIN_COUNT] = {"Thrusters", "Shields", "Weapons"};
+static int warp_choice;
+static bool warp_edit_mode;
+static sim_state_t forecast_from; /* The step view was made from, with what the widgets sent this frame applied */
+static bool forecast_changed;	/* Something was sent this frame */
+static bool forecast_held;	/* The mouse hasn't let go since the latest change */
+static uint64_t forecast_id;
+static double forecast_asked;	/* now_sec() of the latest request */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-typedef struct power_tap_s
+/* GUI side: have the sim change something. Takes effect before its next step, and in this frame's forecast. With the
+ * queue full it's dropped, and left out of the forecast too; widgets are drawn from the sim's state, so one still held
+ * away from it sends again next frame.
+ */
+static void sim_send(sim_cmd_e cmd, int index, float value)
+{
+    spsc_msg_t msg = {0};
+
+    msg.type = cmd;
+    msg.index = index;
+    msg.value = value;
+    if (!spsc_push(&sim_link.cmds, &msg))
+	return;
+    sim_apply(&forecast_from, cmd, index, value);
+    forecast_changed = true;
+}
+
+/* Sim side: tell the audio about the rings after sim_apply or sim_step changed them */
+static void post_rings(unsigned changed)
 {
-    float	    level; /* This is the instantaneous level of input power based on overall power output. Range: 0 - 1.0 */
-    capacitor_t	    cap; /* The amount of power available for the drain is stored in the capacitor */
-    power_drain_t   *drain;
+    int r;
 
-    float	    charge_mult;
+    for (r = 0; r < SIM_RING_COUNT; r++)
+    {
+	if (changed & SIM_CHANGED_POWER)
+	    osc_bank_post(&waveforms.audio.bank, &waveforms.audio.params, OSC_PARAM_AMPLITUDE, r, sim_ring_amplitude(&sim, r), 0);
+	if ((changed & SIM_CHANGED_FREQ) && r != SIM_RING_ROOT)
+	    osc_bank_post(&waveforms.audio.bank, &waveforms.audio.params, OSC_PARAM_FREQ, r, sim.ring_freq[r], 0);
+    }
+}
 
-    /* Gui data */
-    tap_dest_e selected_dest;
-    bool edit_mode;
+/* Sim side: look the rings' beat envelope up for the HUD and the warp after they changed. A setting seen before costs
+ * nothing; a new one is handed to the worker, and the HUD keeps the last one's until beat_take has its table.
+ */
+static void post_beat(void)
+{
+    envelope_set_rings(&beat_env, &sim);
+    if ((beat_table = envelope_cache_find(&beats, &beat_env)) == NULL)
+    {
+	beat_link.asks[beat_link.ask_back] = beat_env;
+	beat_link.ask_back = atomic_exchange(&beat_link.ask_mid, beat_link.ask_back | SNAP_FRESH) & ~SNAP_FRESH;
+	return;
+    }
+    atomic_store(&sim_link.beat_peak, beat_table->peak);
+    atomic_store(&sim_link.beat_duty, beat_table->duty);
+}
 
-} power_tap_t;
+/* Sim side, between ticks: into the cache with the worker's latest table, if there's one not taken yet. It can take the
+ * place of the current setting's, so that's looked up again; a setting that's moved on since stays asked for.
+ */
+static void beat_take(void)
+{
+    if (!(atomic_load(&beat_link.result_mid) & SNAP_FRESH))
+	return;
+    beat_link.result_front = atomic_exchange(&beat_link.result_mid, beat_link.result_front) & ~SNAP_FRESH;
+    envelope_cache_put(&beats, &beat_link.results[beat_link.result_front]);
+    if ((beat_table = envelope_cache_find(&beats, &beat_env)) != NULL)
+    {
+	atomic_store(&sim_link.beat_peak, beat_table->peak);
+	atomic_store(&sim_link.beat_duty, beat_table->duty);
+    }
+}
 
-typedef struct sine_sources_s
+/* Worker side: build the newest setting the sim asked for, if there's one not taken yet. False if there wasn't. */
+static bool beat_due(void)
 {
-    ma_waveform_config rootwave_cfg;
-    ma_waveform rootwave;
-    float rootbuf[MY_SAMPLE_RATE];
-
-    ma_waveform_config qwave_cfg;
-    ma_waveform qwave;
-    float qbuf[MY_SAMPLE_RATE];
-
-    ma_waveform_config rwave_cfg;
-    ma_waveform rwave;
-    float rbuf[MY_SAMPLE_RATE];
-
-    ma_waveform_config swave_cfg;
-    ma_waveform swave;
-    float sbuf[MY_SAMPLE_RATE];
-
-    float rootwave_vol;
-    float qwave_vol;
-    float rwave_vol;
-    float swave_vol;
-
-    float rootwave_freq;
-    float qwave_freq;
-    float rwave_freq;
-    float swave_freq;
-} sine_sources_t;
+    if (!(atomic_load(&beat_link.ask_mid) & SNAP_FRESH))
+	return false;
+    beat_link.ask_front = atomic_exchange(&beat_link.ask_mid, beat_link.ask_front) & ~SNAP_FRESH;
+    envelope_table_build(&beats, &beat_link.asks[beat_link.ask_front], &beat_link.results[beat_link.result_back]);
+    beat_link.result_back = atomic_exchange(&beat_link.result_mid, beat_link.result_back | SNAP_FRESH) & ~SNAP_FRESH;
+    return true;
+}
 
-/* FIXME: Make sure threaded accesses are safe. Use volatile... */
-static sine_sources_t waveforms;
-volatile float cooler_temp;
-static float fuel_level;
-static float fuel_rate;
-//static float quantum_level;
-static float total_output_power;
-static float engine_health;
-static bool engine_overload;
+/* Sim side: the audio for sim_warp's steps. The real audio only covers real time, so each step's output power and
+ * overloads come from the beat envelope instead, like scpulse-sweep -e. Until the worker's table is in, each step's
+ * entry is measured on its own, which comes to the same bits, so a replay that builds every table runs the same.
+ */
+static uint32_t warp_audio(sim_state_t *s, unsigned changed, void *ctx)
+{
+    envelope_tick_t tick;
+    uint64_t	    n = (uint64_t)llround(s->time * SIM_RATE);
+    uint32_t	    overloads;
 
-static power_tap_t tap_bat;
-static power_tap_t tap_1;
-static power_tap_t tap_2;
-static power_tap_t tap_3;
-static power_drain_t drain_shields;
-static power_drain_t drain_weapons;
-static power_drain_t drain_thrust;
+    (void)ctx;
+    if (changed)
+    {
+	post_rings(changed);
+	post_beat();
+    }
+    if (beat_table != NULL)
+	tick = *envelope_table_at(&beats, beat_table, n);
+    else
+	envelope_cache_measure(&beats, &beat_env, n, &tick);
+
+    warp_over += tick.over * MY_SAMPLE_RATE;
+    overloads = (uint32_t)warp_over;
+    warp_over -= overloads;
+    s->engine_overload = overloads > 0;
+    s->total_output_power = tick.peak;
+    return overloads;
+}
 
-static bool quitting;
+static void sim_publish(void)
+{
+    sim_snapshot_t *snap = &sim_link.snaps[sim_link.back];
 
-/* Function declarations */
-static void cooler_add_heat(float d);
+    snap->prev = sim_prev;
+    snap->cur = sim;
+    snap->time = sim_clock;
+    sim_link.back = atomic_exchange(&sim_link.mid, sim_link.back | SNAP_FRESH) & ~SNAP_FRESH;
+}
 
+/* Sim side: one fixed step, or that times the warp factor of game time, with whatever the GUI and audio sent since the
+ * last one
+ */
+static void sim_tick(void)
+{
+    const spsc_msg_t	*msg;
+    unsigned		changed = 0;
+    uint32_t		overloads;
+    int			factor = warp_factors[atomic_load(&sim_link.warp)];
 
+    beat_take();
+    while ((msg = spsc_peek(&sim_link.cmds)) != NULL)
+    {
+	changed |= sim_apply(&sim, (sim_cmd_e)msg->type, msg->index, msg->value);
+	sim_journal_cmd(&journal, (sim_cmd_e)msg->type, msg->index, msg->value);
+	spsc_consume(&sim_link.cmds);
+	warp.averaged = 0; /* Whatever it was, the warp's rates are from before it */
+    }
+    sim_journal_warp(&journal, factor);
+    sim.engine_overload = atomic_load(&sim_link.overload);
+    sim.total_output_power = atomic_load(&sim_link.peak);
+    overloads = atomic_exchange(&sim_link.overloads, 0);
 
+    if (factor > 1)
+    {
+	/* The audio's overloads are real time's; the warp's steps take theirs from the beat envelope. warp_audio posts
+	 * what each step changed before the next one; the last one's is posted here instead.
+	 */
+	sim_journal_audio(&journal, sim.total_output_power, sim.engine_overload, 0);
+	sim_prev = sim;
+	sim_warp(&sim, (double)factor / SIM_RATE, &warp);
+	changed |= warp.changed;
+	warp.changed = 0;
+	if (changed)
+	{
+	    post_rings(changed);
+	    post_beat();
+	}
+	sim_journal_tick(&journal);
+	return;
+    }
 
+    sim_journal_audio(&journal, sim.total_output_power, sim.engine_overload, overloads);
+    if (overloads)
+	sim_audio_overload(&sim, overloads);
 
+    sim_prev = sim;
+    changed |= sim_step(&sim, 1.0 / SIM_RATE);
+    if (changed)
+    {
+	post_rings(changed);
+	post_beat();
+    }
+    sim_journal_tick(&journal);
+}
 
-static void capacitor_reset(capacitor_t *cap)
+/* Step the sim up to now, SIM_RATE steps per second of it */
+static void sim_run_due(double now)
 {
-    cap->charge = 0.0;
-    cap->health = 1.0;
-    cap->max_charge = cap_max_charges[(int)cap->size];
+    bool stepped = false;
+
+    if (now - sim_clock > SIM_MAX_CATCHUP)
+	sim_clock = now - SIM_MAX_CATCHUP;
+
+    while (now - sim_clock >= 1.0 / SIM_RATE)
+    {
+	sim_tick();
+	sim_clock += 1.0 / SIM_RATE;
+	stepped = true;
+    }
 
+    if (stepped)
+	sim_publish();
 }
 
-#if 0
-static void set_root_freq(float freq)
+#ifndef __EMSCRIPTEN__
+static void *sim_thread(void *arg)
 {
-    ma_waveform_set_frequency(&waveforms.rootwave, freq);
+    (void)arg;
+
+    while (atomic_load(&sim_link.running))
+    {
+	double wait;
+
+	sim_run_due(now_sec());
+	wait = sim_clock + 1.0 / SIM_RATE - now_sec();
+	if (wait > 0)
+	    usleep(wait * 1e6);
+    }
+    return NULL;
 }
 #endif
 
-static void set_root_power(float power)
+/* GUI side: blend the latest two steps to where the sim would be now, one step behind so there is always a newer step */
+static void sim_view(sim_state_t *out)
 {
-    ma_waveform_set_amplitude(&waveforms.rootwave, (double)power);
+    const sim_snapshot_t    *snap;
+    float		    alpha;
+
+    if (atomic_load(&sim_link.mid) & SNAP_FRESH)
+	sim_link.front = atomic_exchange(&sim_link.mid, sim_link.front) & ~SNAP_FRESH;
+    snap = &sim_link.snaps[sim_link.front];
+
+    alpha = (now_sec() - snap->time) * SIM_RATE;
+    if (alpha > 1.0)
+	alpha = 1.0;
+    if (alpha < 0.0)
+	alpha = 0.0;
+    sim_lerp(out, &snap->prev, &snap->cur, alpha);
 }
 
-static void set_q_freq(float freq)
+/* GUI side: have the worker run forecast_from ahead. latest moves first, so the run it's on stops for this one. */
+static void forecast_ask(void)
 {
-    ma_waveform_set_frequency(&waveforms.qwave, freq);
+    forecast_ask_t *ask = &forecast_link.asks[forecast_link.ask_back];
+
+    ask->from = forecast_from;
+    ask->id = ++forecast_id;
+    atomic_store(&forecast_link.latest, ask->id);
+    forecast_link.ask_back = atomic_exchange(&forecast_link.ask_mid, forecast_link.ask_back | SNAP_FRESH) & ~SNAP_FRESH;
+    forecast_asked = now_sec();
 }
 
-static void set_q_power(float power)
+/* Worker side: the newest request, if there's one not taken yet */
+static const forecast_ask_t *forecast_take(void)
 {
-    ma_waveform_set_amplitude(&waveforms.qwave, (double)power);
+    if (!(atomic_load(&forecast_link.ask_mid) & SNAP_FRESH))
+	return NULL;
+    forecast_link.ask_front = atomic_exchange(&forecast_link.ask_mid, forecast_link.ask_front) & ~SNAP_FRESH;
+    return &forecast_link.asks[forecast_link.ask_front];
 }
 
-static void set_r_freq(float freq)
+/* Worker side: hand the finished result back */
+static void forecast_publish(void)
 {
-    ma_waveform_set_frequency(&waveforms.rwave, freq);
+    forecast_link.result_back = atomic_exchange(&forecast_link.result_mid, forecast_link.result_back | SNAP_FRESH) & ~SNAP_FRESH;
 }
 
-static void set_r_power(float power)
+#ifdef __EMSCRIPTEN__
+/* No worker here, and a whole forecast is most of a frame, so each frame runs a slice of it: the newest request if one
+ * came, or else more of the one running.
+ */
+static void forecast_slice(void)
 {
-    ma_waveform_set_amplitude(&waveforms.rwave, (double)power);
+    static bool		    running;
+    const forecast_ask_t    *ask;
+
+    if ((ask = forecast_take()) != NULL)
+    {
+	sim_forecast_start(&forecaster, &ask->from, FORECAST_SECONDS, &forecast_link.results[forecast_link.result_back],
+			   ask->id);
+	running = true;
+    }
+    if (running && sim_forecast_more(&forecaster, FORECAST_SLICE))
+    {
+	forecast_publish();
+	running = false;
+    }
+}
+#else
+/* Worker side: run the newest request, if there's one not taken yet. False if there wasn't. */
+static bool forecast_due(void)
+{
+    const forecast_ask_t *ask;
+
+    if ((ask = forecast_take()) == NULL)
+	return false;
+    if (sim_forecast(&forecaster, &ask->from, FORECAST_SECONDS, &forecast_link.results[forecast_link.result_back],
+		     &forecast_link.latest, ask->id))
+	forecast_publish();
+    return true;
+}
+
+static void *forecast_thread(void *arg)
+{
+    (void)arg;
+
+    while (atomic_load(&forecast_link.running))
+	if (!beat_due() && !forecast_due())
+	    usleep(FORECAST_POLL_US);
+    return NULL;
 }
+#endif
 
-static void set_s_freq(float freq)
+/* GUI side: the newest forecast back, NULL while the overlays are down */
+static const sim_forecast_t *forecast_view(void)
 {
-    ma_waveform_set_frequency(&waveforms.swave, freq);
+    const sim_forecast_t *fc;
+
+    if (atomic_load(&forecast_link.result_mid) & SNAP_FRESH)
+	forecast_link.result_front = atomic_exchange(&forecast_link.result_mid, forecast_link.result_front) & ~SNAP_FRESH;
+    fc = &forecast_link.results[forecast_link.result_front];
+
+    if (fc->id == 0 || (!forecast_held && now_sec() - forecast_asked > FORECAST_LINGER))
+	return NULL;
+    return fc;
 }
 
-static void set_s_power(float power)
+/* GUI side: a forecast over the widget it's of, time from left to right across it and lo to hi from bottom to top */
+static void draw_curve(Rectangle r, const float *v, float lo, float hi)
 {
-    ma_waveform_set_amplitude(&waveforms.swave, (double)power);
+    Vector2 p[SIM_FORECAST_POINTS + 1];
+    int	    i;
+
+    for (i = 0; i <= SIM_FORECAST_POINTS; i++)
+    {
+	float y = (v[i] - lo) / (hi - lo);
+
+	y = y < 0 ? 0 : (y > 1 ? 1 : y);
+	p[i].x = r.x + r.width * i / SIM_FORECAST_POINTS;
+	p[i].y = r.y + r.height * (1 - y);
+    }
+    DrawLineStrip(p, SIM_FORECAST_POINTS + 1, FORECAST_COLOR);
 }
 
-static void randomize_drains(void)
+static void draw_forecast(const sim_forecast_t *fc)
 {
-    drain_thrust.spike_probability = GetRandomValue(1, 60) / 1000.0;
-    drain_shields.spike_probability = GetRandomValue(1, 180) / 1000.0;
-    drain_weapons.spike_probability = GetRandomValue(1, 100) / 1000.0;
+    const char	*text;
+    int		i;
+
+    draw_curve((Rectangle){115, 30, 760, 24}, fc->cooler_temp, 0, MAX_COOLER_TEMP);
+    draw_curve((Rectangle){115, 418, 760, 24}, fc->overload, 0, 1);
+    draw_curve((Rectangle){135, 500, 60, 200}, fc->battery, 0, MAX_BAT_CHARGE);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	draw_curve((Rectangle){TAP_PANEL_X(i) + 50, 620, 110, 20}, fc->cap_health[i], 0, 1);
+
+    if (fc->dead >= 0)
+	text = TextFormat("Dies in %.0f s", fc->dead);
+    else if (fc->overheat >= 0)
+	text = TextFormat("Overheats in %.0f s", fc->overheat);
+    else
+	text = TextFormat("%.0f C in %.0f s", fc->cooler_temp[SIM_FORECAST_POINTS], fc->seconds);
+    DrawText(text, 880, 34, 10, FORECAST_COLOR);
 }
 
 void draw_gui(void)
 {
+    const sim_state_t *cur; /* The unblended step view was made from, to see what the widgets changed */
     float	gui_value;
     float	f;
     int		c;
-    bool	input_power_changed = false;
+    int		i;
     capacitor_grade_e last_grade;
     capacitor_size_e	last_size;
+    const sim_forecast_t *fc;
+
+    sim_view(&view);
+    cur = &sim_link.snaps[sim_link.front].cur;
+    forecast_from = *cur;
+    forecast_changed = false;
 
     BeginDrawing();
     ClearBackground(BLACK);
@@ -259,634 +579,209 @@ void draw_gui(void)
 
     /* ================ Cooler Capacity ================= */
     c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, TEMP_TO_COLOR(cooler_temp >= MAX_COOLER_TEMP ? MAX_COOLER_TEMP : cooler_temp));
-    GuiProgressBar((Rectangle){115, 30, 760, 24}, "Cooler temp", TextFormat("%0.2f", cooler_temp > MAX_COOLER_TEMP ? MAX_COOLER_TEMP : cooler_temp), (float *)&cooler_temp, 0.0, MAX_COOLER_TEMP);
+    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, TEMP_TO_COLOR(view.cooler_temp >= MAX_COOLER_TEMP ? MAX_COOLER_TEMP : view.cooler_temp));
+    GuiProgressBar((Rectangle){115, 30, 760, 24}, "Cooler temp", TextFormat("%0.2f", view.cooler_temp > MAX_COOLER_TEMP ? MAX_COOLER_TEMP : view.cooler_temp), (float *)&view.cooler_temp, 0.0, MAX_COOLER_TEMP);
     GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
 
     /* ============== Fuel Capacity ============== */
     /* <capacity bar> <capacity label (float in liters)> <consumption rate (liters/sec)> */
     if (GuiButton((Rectangle){20, 70, 55, 24}, "Refuel"))
     {
-	fuel_level = MAX_FUEL_LEVEL;
+	sim_send(SIM_CMD_REFUEL, 0, 0);
     }
-    GuiProgressBar((Rectangle){115, 70, 760, 24}, "Fuel", TextFormat("%6.0f", fuel_level), &fuel_level, 0.0, MAX_FUEL_LEVEL);
-    GuiLabel((Rectangle){950, 70, 70, 24}, TextFormat("%2.2f L/s", fuel_level >= MAX_FUEL_LEVEL ? 0.0 : fuel_rate));
+    GuiProgressBar((Rectangle){115, 70, 760, 24}, "Fuel", TextFormat("%6.0f", view.fuel_level), &view.fuel_level, 0.0, MAX_FUEL_LEVEL);
+    GuiLabel((Rectangle){950, 70, 70, 24}, TextFormat("%2.2f L/s", view.fuel_level >= MAX_FUEL_LEVEL ? 0.0 : view.fuel_rate));
 
     /* ================== Input Power ================ */
     GuiGroupBox((Rectangle){ 120, 120, 100, 255 }, "Input Power");
-    gui_value = GuiVerticalSliderBar((Rectangle){ 155, 150, 34, 192 }, "Amps", TextFormat("%4.0f", waveforms.rootwave_vol * 1675), waveforms.rootwave_vol, 0.0f, 1.0f);
-    if (gui_value != waveforms.rootwave_vol)
-    {
-	if (fuel_level > 0)
-	{
-	    input_power_changed = true;
-	    waveforms.rootwave_vol = gui_value;
-	    set_root_power(waveforms.rootwave_vol);
-	}
-    }
+    gui_value = GuiVerticalSliderBar((Rectangle){ 155, 150, 34, 192 }, "Amps", TextFormat("%4.0f", view.ring_power[SIM_RING_ROOT] * 1675), view.ring_power[SIM_RING_ROOT], 0.0f, 1.0f);
+    if (gui_value != view.ring_power[SIM_RING_ROOT])
+	sim_send(SIM_CMD_POWER, SIM_RING_ROOT, gui_value); /* Ignored once the fuel runs out */
 
     /* ============= Q-Ring Settings =============== */
     GuiGroupBox((Rectangle){ 240, 120, 200, 255 }, "Q-Ring");
-    gui_value = GuiVerticalSlider((Rectangle){ 260, 150, 34, 192 }, "Freq", TextFormat("%2.2f", waveforms.qwave_freq), waveforms.qwave_freq, ROOT_FREQ + 0.07, ROOT_FREQ + Q_VARIANCE);
-    if (gui_value != waveforms.qwave_freq)
-    {
-	waveforms.qwave_freq = gui_value;
-	set_q_freq(waveforms.qwave_freq);
-    }
-    gui_value = GuiVerticalSliderBar((Rectangle){ 320, 150, 34, 192 }, "Power", TextFormat("%0.2f", waveforms.qwave_vol), waveforms.qwave_vol, 0.0f, 1.0f);
-    if (input_power_changed || gui_value != waveforms.qwave_vol)
-    {
-	waveforms.qwave_vol = gui_value;
-	set_q_power(waveforms.qwave_vol * waveforms.rootwave_vol);
-    }
+    gui_value = GuiVerticalSlider((Rectangle){ 260, 150, 34, 192 }, "Freq", TextFormat("%2.2f", view.ring_freq[SIM_RING_Q]), view.ring_freq[SIM_RING_Q], ROOT_FREQ + 0.07, ROOT_FREQ + Q_VARIANCE);
+    if (gui_value != view.ring_freq[SIM_RING_Q])
+	sim_send(SIM_CMD_FREQ, SIM_RING_Q, gui_value);
+    gui_value = GuiVerticalSliderBar((Rectangle){ 320, 150, 34, 192 }, "Power", TextFormat("%0.2f", view.ring_power[SIM_RING_Q]), view.ring_power[SIM_RING_Q], 0.0f, 1.0f);
+    if (gui_value != view.ring_power[SIM_RING_Q])
+	sim_send(SIM_CMD_POWER, SIM_RING_Q, gui_value);
 
     /* ============= R-Ring Settings =============== */
     GuiGroupBox((Rectangle){ 460, 120, 200, 255 }, "R-Ring");
-    gui_value = GuiVerticalSlider((Rectangle){ 480, 150, 34, 192 }, "Freq", TextFormat("%2.2f", waveforms.rwave_freq), waveforms.rwave_freq, ROOT_FREQ - R_VARIANCE, ROOT_FREQ - 0.11);
-    if (gui_value != waveforms.rwave_freq)
-    {
-	waveforms.rwave_freq = gui_value;
-	set_r_freq(waveforms.rwave_freq);
-    }
-    gui_value = GuiVerticalSliderBar((Rectangle){ 540, 150, 34, 192 }, "Power", TextFormat("%0.2f", waveforms.rwave_vol), waveforms.rwave_vol, 0.0f, 1.0f);
-    if (input_power_changed || gui_value != waveforms.rwave_vol)
-    {
-	waveforms.rwave_vol = gui_value;
-	set_r_power(waveforms.rwave_vol * waveforms.rootwave_vol);
-    }
+    gui_value = GuiVerticalSlider((Rectangle){ 480, 150, 34, 192 }, "Freq", TextFormat("%2.2f", view.ring_freq[SIM_RING_R]), view.ring_freq[SIM_RING_R], ROOT_FREQ - R_VARIANCE, ROOT_FREQ - 0.11);
+    if (gui_value != view.ring_freq[SIM_RING_R])
+	sim_send(SIM_CMD_FREQ, SIM_RING_R, gui_value);
+    gui_value = GuiVerticalSliderBar((Rectangle){ 540, 150, 34, 192 }, "Power", TextFormat("%0.2f", view.ring_power[SIM_RING_R]), view.ring_power[SIM_RING_R], 0.0f, 1.0f);
+    if (gui_value != view.ring_power[SIM_RING_R])
+	sim_send(SIM_CMD_POWER, SIM_RING_R, gui_value);
 
     /* ============= S-Ring Settings =============== */
     GuiGroupBox((Rectangle){ 680, 120, 200, 255 }, "S-Ring");
-    gui_value = GuiVerticalSlider((Rectangle){ 700, 150, 34, 192 }, "Freq", TextFormat("%2.2f", waveforms.swave_freq), waveforms.swave_freq, ROOT_FREQ - S_VARIANCE, ROOT_FREQ + S_VARIANCE);
+    gui_value = GuiVerticalSlider((Rectangle){ 700, 150, 34, 192 }, "Freq", TextFormat("%2.2f", view.ring_freq[SIM_RING_S]), view.ring_freq[SIM_RING_S], ROOT_FREQ - S_VARIANCE, ROOT_FREQ + S_VARIANCE);
     if (gui_value >= ROOT_FREQ && gui_value < ROOT_FREQ + 0.02) gui_value = ROOT_FREQ + 0.02;
     if (gui_value > ROOT_FREQ - 0.02  && gui_value < ROOT_FREQ) gui_value = ROOT_FREQ - 0.02;
-    if (gui_value != waveforms.swave_freq)
-    {
-	waveforms.swave_freq = gui_value;
-	set_s_freq(waveforms.swave_freq);
-    }
-    gui_value = GuiVerticalSliderBar((Rectangle){ 760, 150, 34, 192 }, "Power", TextFormat("%0.2f", waveforms.swave_vol), waveforms.swave_vol, 0.0f, 1.0f);
-    if (input_power_changed || gui_value != waveforms.swave_vol)
-    {
-	waveforms.swave_vol = gui_value;
-	set_s_power(waveforms.swave_vol * waveforms.rootwave_vol);
-    }
+    if (gui_value != view.ring_freq[SIM_RING_S])
+	sim_send(SIM_CMD_FREQ, SIM_RING_S, gui_value);
+    gui_value = GuiVerticalSliderBar((Rectangle){ 760, 150, 34, 192 }, "Power", TextFormat("%0.2f", view.ring_power[SIM_RING_S]), view.ring_power[SIM_RING_S], 0.0f, 1.0f);
+    if (gui_value != view.ring_power[SIM_RING_S])
+	sim_send(SIM_CMD_POWER, SIM_RING_S, gui_value);
 
 
     /* ============== Engine Health ============== */
     c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(engine_health));
-    GuiProgressBar((Rectangle){115, 390, 760, 15}, "Engine Health", TextFormat("%0.2f", engine_health), &engine_health, 0.0, 1.0);
+    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(view.engine_health));
+    GuiProgressBar((Rectangle){115, 390, 760, 15}, "Engine Health", TextFormat("%0.2f", view.engine_health), &view.engine_health, 0.0, 1.0);
     GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
     if (GuiButton((Rectangle){925, 390, 85, 15}, "Repair"))
-	engine_health = 1.0;
+	sim_send(SIM_CMD_REPAIR, 0, 0);
 
 
 
     /* ============= Total Power Output  =============== */
     c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    bool ovrld = engine_overload; /* Since updates are in another thread, only check once */
+    bool ovrld = view.engine_overload; /* Since updates are in another thread, only check once */
     if (ovrld)
 	GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, 0xff2020ff);
-    GuiProgressBar((Rectangle){115, 418, 760, 24}, "Power Output", TextFormat("%0.2f", total_output_power), &total_output_power, 0.0, 1.0);
+    GuiProgressBar((Rectangle){115, 418, 760, 24}, "Power Output", TextFormat("%0.2f", view.total_output_power), &view.total_output_power, 0.0, 1.0);
     if (ovrld)
 	GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
 
+    /* Where the beats of this ring setting top out, red if they overload at all */
+    float beat = atomic_load(&sim_link.beat_peak);
+    DrawRectangle(115 + (int)(760 * (beat < 1.0 ? beat : 1.0)) - 1, 416, 3, 28, atomic_load(&sim_link.beat_duty) > 0 ? RED : LIGHTGRAY);
+    GuiLabel((Rectangle){880, 423, 140, 15}, TextFormat("Beats to %0.2f", beat));
+
 
     /* ============== Battery ================ */
     GuiSetState(STATE_DISABLED);
-    GuiVerticalSliderBar((Rectangle){135, 500, 60, 200}, "Charge", TextFormat("%0.1f", tap_bat.cap.charge), tap_bat.cap.charge, 0.0f, MAX_BAT_CHARGE);
+    GuiVerticalSliderBar((Rectangle){135, 500, 60, 200}, "Charge", TextFormat("%0.1f", view.tap_bat.cap.charge), view.tap_bat.cap.charge, 0.0f, MAX_BAT_CHARGE);
     GuiSetState(STATE_NORMAL);
 
 
 
-    /* ============= Capacitor 1 ============= */
-    GuiGroupBox((Rectangle){235, 490, 200, 220}, "Capacitor 1");
-
-    if (tap_1.edit_mode) GuiLock();
-
-    GuiLabel((Rectangle){275, 500, 80, 16}, "Size");
-    last_size = tap_1.cap.size;
-    GuiToggleGroup((Rectangle){245, 520, 80, 25}, CAPACITOR_SIZE_STRING, (int *)&tap_1.cap.size);
-    tap_1.cap.max_charge = cap_max_charges[(int)tap_1.cap.size];
-    tap_1.cap.full_limit = tap_1.cap.max_charge - cap_full_limits[(int)tap_1.cap.size];
-
-    GuiLabel((Rectangle){365, 500, 80, 16}, "Grade");
-    last_grade = tap_1.cap.grade;
-    GuiToggleGroup((Rectangle){345, 520, 80, 25}, CAPACITOR_GRADE_STRING, (int *)&tap_1.cap.grade);
-
-    if (last_size != tap_1.cap.size || last_grade != tap_1.cap.grade)
-	capacitor_reset(&tap_1.cap);
-
-    if (tap_1.edit_mode) GuiUnlock();
-
-    c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(tap_1.cap.health));
-    GuiProgressBar((Rectangle){285, 620, 110, 20}, "Health", TextFormat("%2.2f", tap_1.cap.health), &tap_1.cap.health, 0.0, 1.0);
-    f = tap_1.cap.charge;
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, CHARGE_TO_COLOR(tap_1.cap.charge, tap_1.cap.full_limit,  tap_1.cap.max_charge));
-    GuiProgressBar((Rectangle){285, 650, 110, 30}, "Charge", TextFormat("%2.2f", f > tap_1.cap.full_limit ? tap_1.cap.full_limit : f),
-		    &f, 0.0, tap_1.cap.full_limit);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
-
-
-
-    /* ============= Capacitor 2 ============= */
-    GuiGroupBox((Rectangle){455, 490, 200, 220}, "Capacitor 2");
-
-    if (tap_2.edit_mode) GuiLock();
-
-    GuiLabel((Rectangle){495, 500, 80, 16}, "Size");
-    last_size = tap_2.cap.size;
-    GuiToggleGroup((Rectangle){475, 520, 80, 25}, CAPACITOR_SIZE_STRING, (int *)&tap_2.cap.size);
-    tap_2.cap.max_charge = cap_max_charges[(int)tap_2.cap.size];
-    tap_2.cap.full_limit = tap_2.cap.max_charge - cap_full_limits[(int)tap_2.cap.size];
-
-    GuiLabel((Rectangle){585, 500, 80, 16}, "Grade");
-    last_grade = tap_2.cap.grade;
-    GuiToggleGroup((Rectangle){565, 520, 80, 25}, CAPACITOR_GRADE_STRING, (int *)&tap_2.cap.grade);
-
-    if (last_size != tap_2.cap.size || last_grade != tap_2.cap.grade)
-	capacitor_reset(&tap_2.cap);
-
-    if (tap_2.edit_mode) GuiUnlock();
-
-    c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(tap_2.cap.health));
-    GuiProgressBar((Rectangle){505, 620, 110, 20}, "Health", TextFormat("%2.2f", tap_2.cap.health), &tap_2.cap.health, 0.0, 1.0);
-    f = tap_2.cap.charge;
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, CHARGE_TO_COLOR(tap_2.cap.charge, tap_2.cap.full_limit,  tap_2.cap.max_charge));
-    GuiProgressBar((Rectangle){505, 650, 110, 30}, "Charge", TextFormat("%2.2f", f > tap_2.cap.full_limit ? tap_2.cap.full_limit : f),
-		    &f, 0.0, tap_2.cap.full_limit);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
-
-
+    /* ============= Capacitors ============= */
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	const power_tap_t *tap = &view.taps[i];
+	int x = TAP_PANEL_X(i);
 
-    /* ============= Capacitor 3 ============= */
-    GuiGroupBox((Rectangle){675, 490, 200, 220}, "Capacitor 3");
+	GuiGroupBox((Rectangle){x, 490, 200, 220}, TextFormat("Capacitor %d", i + 1));
 
-    if (tap_3.edit_mode) GuiLock();
+	if (tap_edit_mode[i]) GuiLock();
 
-    GuiLabel((Rectangle){715, 500, 80, 16}, "Size");
-    last_size = tap_3.cap.size;
-    GuiToggleGroup((Rectangle){695, 520, 80, 25}, CAPACITOR_SIZE_STRING, (int *)&tap_3.cap.size);
-    tap_3.cap.max_charge = cap_max_charges[(int)tap_3.cap.size];
-    tap_3.cap.full_limit = tap_3.cap.max_charge - cap_full_limits[(int)tap_3.cap.size];
+	GuiLabel((Rectangle){x + 40, 500, 80, 16}, "Size");
+	last_size = tap->cap.size;
+	GuiToggleGroup((Rectangle){x + 10, 520, 80, 25}, CAPACITOR_SIZE_STRING, (int *)&view.taps[i].cap.size);
 
-    GuiLabel((Rectangle){805, 500, 80, 16}, "Grade");
-    last_grade = tap_3.cap.grade;
-    GuiToggleGroup((Rectangle){785, 520, 80, 25}, CAPACITOR_GRADE_STRING, (int *)&tap_3.cap.grade);
+	GuiLabel((Rectangle){x + 130, 500, 80, 16}, "Grade");
+	last_grade = tap->cap.grade;
+	GuiToggleGroup((Rectangle){x + 110, 520, 80, 25}, CAPACITOR_GRADE_STRING, (int *)&view.taps[i].cap.grade);
 
-    if (last_size != tap_3.cap.size || last_grade != tap_3.cap.grade)
-	capacitor_reset(&tap_3.cap);
+	if (last_size != tap->cap.size)
+	    sim_send(SIM_CMD_CAP_SIZE, i, tap->cap.size);
+	if (last_grade != tap->cap.grade)
+	    sim_send(SIM_CMD_CAP_GRADE, i, tap->cap.grade);
 
-    if (tap_3.edit_mode) GuiUnlock();
+	if (tap_edit_mode[i]) GuiUnlock();
 
-    c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(tap_3.cap.health));
-    GuiProgressBar((Rectangle){725, 620, 110, 20}, "Health", TextFormat("%2.2f", tap_3.cap.health), &tap_3.cap.health, 0.0, 1.0);
-    f = tap_3.cap.charge;
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, CHARGE_TO_COLOR(tap_3.cap.charge,  tap_3.cap.full_limit, tap_3.cap.max_charge));
-    GuiProgressBar((Rectangle){725, 650, 110, 30}, "Charge", TextFormat("%2.2f", f > tap_3.cap.full_limit ? tap_3.cap.full_limit : f),
-		    &f, 0.0, tap_3.cap.full_limit);
-    GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
+	c = GuiGetStyle(PROGRESSBAR, BASE_COLOR_PRESSED);
+	GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, HEALTH_TO_COLOR(tap->cap.health));
+	GuiProgressBar((Rectangle){x + 50, 620, 110, 20}, "Health", TextFormat("%2.2f", tap->cap.health), &view.taps[i].cap.health, 0.0, 1.0);
+	f = tap->cap.charge;
+	GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, CHARGE_TO_COLOR(tap->cap.charge, tap->cap.full_limit, tap->cap.max_charge));
+	GuiProgressBar((Rectangle){x + 50, 650, 110, 30}, "Charge", TextFormat("%2.2f", f > tap->cap.full_limit ? tap->cap.full_limit : f),
+			&f, 0.0, tap->cap.full_limit);
+	GuiSetStyle(PROGRESSBAR, BASE_COLOR_PRESSED, c);
+    }
 
 
 
     /* =========== Power Taps =========== */
     /* Dropdowns need to be drawn after anything they might cover, so do these last */
-    GuiProgressBar((Rectangle){115, 450, 100, 10}, "Power Taps:", NULL, &tap_bat.level, 0.0, 1.0);
-    GuiProgressBar((Rectangle){235, 450, 200, 10}, NULL, NULL, &tap_1.level, 0.0, 1.0);
-    GuiProgressBar((Rectangle){455, 450, 200, 10}, NULL, NULL, &tap_2.level, 0.0, 1.0);
-    GuiProgressBar((Rectangle){675, 450, 200, 10}, NULL, NULL, &tap_3.level, 0.0, 1.0);
+    GuiProgressBar((Rectangle){115, 450, 100, 10}, "Power Taps:", NULL, &view.tap_bat.level, 0.0, 1.0);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	GuiProgressBar((Rectangle){TAP_PANEL_X(i), 450, 200, 10}, NULL, NULL, &view.taps[i].level, 0.0, 1.0);
 
     GuiLabel((Rectangle){50, 465, 80, 15}, "Routed to:");
     GuiLabel((Rectangle){115, 465, 100, 15}, "      Battery");
-    if (GuiDropdownBox((Rectangle){235, 465, 200, 15}, POWER_TAP_DEST_STRING, (int *)&tap_1.selected_dest, tap_1.edit_mode))
-	tap_1.edit_mode = !tap_1.edit_mode;
-    if (GuiDropdownBox((Rectangle){455, 465, 200, 15}, POWER_TAP_DEST_STRING, (int *)&tap_2.selected_dest, tap_2.edit_mode))
-	tap_2.edit_mode = !tap_2.edit_mode;
-    if (GuiDropdownBox((Rectangle){675, 465, 200, 15}, POWER_TAP_DEST_STRING, (int *)&tap_3.selected_dest, tap_3.edit_mode))
-	tap_3.edit_mode = !tap_3.edit_mode;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	if (GuiDropdownBox((Rectangle){TAP_PANEL_X(i), 465, 200, 15}, POWER_TAP_DEST_STRING, (int *)&view.taps[i].dest, tap_edit_mode[i]))
+	    tap_edit_mode[i] = !tap_edit_mode[i];
+
+    GuiLabel((Rectangle){880, 5, 40, 15}, "Warp");
+    if (GuiDropdownBox((Rectangle){920, 5, 90, 15}, WARP_STRING, &warp_choice, warp_edit_mode))
+	warp_edit_mode = !warp_edit_mode;
+    atomic_store(&sim_link.warp, warp_choice);
 
 
 
     /* =========== Power Drains ========== */
     GuiLabel((Rectangle){125, WIN_HEIGHT -15, 85, 10}, "Power Usage:");
-    GuiProgressBar((Rectangle){295, WIN_HEIGHT - 15, 115, 10}, "Thrusters", NULL, &drain_thrust.rate, 0.0, 1.0);
-    GuiProgressBar((Rectangle){505, WIN_HEIGHT - 15, 115, 10}, "Shields", NULL, &drain_shields.rate, 0.0, 1.0);
-    GuiProgressBar((Rectangle){735, WIN_HEIGHT - 15, 115, 10}, "Weapons", NULL, &drain_weapons.rate, 0.0, 1.0);
-    GuiCheckBox((Rectangle){415, WIN_HEIGHT - 18, 15, 15}, NULL, &drain_thrust.enabled);
-    GuiCheckBox((Rectangle){625, WIN_HEIGHT - 18, 15, 15}, NULL, &drain_shields.enabled);
-    GuiCheckBox((Rectangle){855, WIN_HEIGHT - 18, 15, 15}, NULL, &drain_weapons.enabled);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	GuiProgressBar((Rectangle){DRAIN_X(i), WIN_HEIGHT - 15, 115, 10}, drain_names[i], NULL, &view.drains[i].rate, 0.0, 1.0);
+	GuiCheckBox((Rectangle){DRAIN_X(i) + 120, WIN_HEIGHT - 18, 15, 15}, NULL, &view.drains[i].enabled);
+    }
 
     if (GuiButton((Rectangle){900, WIN_HEIGHT - 18, 80, 16}, "Randomize"))
     {
-	randomize_drains();
+	sim_send(SIM_CMD_RANDOMIZE_DRAINS, 0, 0);
     }
 
+    /* The dropdowns and checkboxes wrote into view, hand the sim whatever they changed */
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	if (view.taps[i].dest != cur->taps[i].dest)
+	    sim_send(SIM_CMD_TAP_DEST, i, view.taps[i].dest);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	if (view.drains[i].enabled != cur->drains[i].enabled)
+	    sim_send(SIM_CMD_DRAIN_ENABLE, i, view.drains[i].enabled);
 
+    /* What-if: whatever was changed, run ahead. A widget held still is run again now and then, from the newer steps. */
+    if (forecast_changed)
+	forecast_held = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+    else if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+	forecast_held = false;
+    if (forecast_changed || (forecast_held && now_sec() - forecast_asked > FORECAST_REFRESH))
+	forecast_ask();
+    if ((fc = forecast_view()) != NULL)
+	draw_forecast(fc);
 
     EndDrawing();
 }
 
-void audio_damage_engine(void)
-{
-    /* This is called from the audio processing thread, which means it happens thousands of times per second.
-     * It is not suitable for use in the main thread.
-     */
-
-    /* Update damage counter bar and add a hefty bump to heat output */
-    engine_health -= 0.000002;
-    if (engine_health < 0)
-	engine_health = 0;
-
-    cooler_add_heat(0.01);
-}
-
 /* Sound rendering function. Sound wave is combined, examined, normalized, and sent to sound card here */
 void data_callback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount)
 {
     /* This functions makes the assumption that we're dealing with only a single channel. It will
      * break if that is ever not the case.
      */
-    sine_sources_t  *srcs;
-    float	    *output;
-    int		    i;
-    float	    max_signal = 0;
+    sine_sources_t	*srcs;
+    dsp_block_stats_t	stats;
 
     srcs = (sine_sources_t *)pDevice->pUserData;
-    output = (float *)pOutput;
-
-    ma_waveform_read_pcm_frames(&srcs->rootwave, srcs->rootbuf, frameCount, NULL);
-    ma_waveform_read_pcm_frames(&srcs->qwave, srcs->qbuf, frameCount, NULL);
-    ma_waveform_read_pcm_frames(&srcs->rwave, srcs->rbuf, frameCount, NULL);
-    ma_waveform_read_pcm_frames(&srcs->swave, srcs->sbuf, frameCount, NULL);
-
-    for (i=0; i < frameCount; i++)
-    {
-	float t = srcs->rootbuf[i] + srcs->qbuf[i] + srcs->rbuf[i] + srcs->sbuf[i];
-	output[i] = t;
-
-	t = fabsf(t);
-	if (t > max_signal)
-	    max_signal = t;
-
-	if (max_signal > 1.0)
-	{
-	    engine_overload = true;
-	    audio_damage_engine();
-	}
-	else
-	    engine_overload = false;
-
-	total_output_power = max_signal;
-    }
-}
-
-static void update_engine(void)
-{
-    if (engine_health <= 0)
-    {
-	waveforms.rootwave_vol = 0.0;
-	set_root_power(0.0);
-	set_q_power(waveforms.qwave_vol * waveforms.rootwave_vol);
-	set_r_power(waveforms.rwave_vol * waveforms.rootwave_vol);
-	set_s_power(waveforms.swave_vol * waveforms.rootwave_vol);
-    }
-
-}
-
-static void damage_engine(float f)
-{
-    engine_health -= f;
-    if (engine_health < 0)
-	engine_health = 0;
-}
-
-static void cooler_add_heat(float d)
-{
-    cooler_temp += d;
-}
-
-static void cooler_dissipate_heat(void)
-{
-    cooler_temp -= COOLER_COOL_RATE(cooler_temp);
-
-    if (cooler_temp < 0)
-	cooler_temp = 0;
-}
-
-static void update_engine_heat(void)
-{
-    float f;
-    f = waveforms.rootwave_vol;
-
-    f += POWER_TO_TEMP(waveforms.qwave_vol) * 0.4;
-    f += POWER_TO_TEMP(waveforms.rwave_vol) * 0.3;
-    f += POWER_TO_TEMP(waveforms.swave_vol) * 0.2;
-
-    f *= waveforms.rootwave_vol;
-    cooler_add_heat(f/12);
-    cooler_dissipate_heat();
-    if (cooler_temp > MAX_COOLER_TEMP)
-    {
-	    damage_engine(0.0001 * (cooler_temp - MAX_COOLER_TEMP));
-    }
-}
-
-static void update_fuel(void)
-{
-    float frame_time;
-
-    frame_time = GetFrameTime();
-    fuel_rate = FUEL_CONSUME_RATE(waveforms.rootwave_vol);
-    fuel_level += frame_time * fuel_rate;
-    if (fuel_level < 0)
-    {
-	fuel_level = 0.0;
-
-	waveforms.rootwave_vol = 0.0;
-	set_root_power(0.0);
-
-	set_q_power(waveforms.qwave_vol * waveforms.rootwave_vol);
-	set_r_power(waveforms.rwave_vol * waveforms.rootwave_vol);
-	set_s_power(waveforms.swave_vol * waveforms.rootwave_vol);
-    }
-    else if (fuel_level > MAX_FUEL_LEVEL)
-	fuel_level = MAX_FUEL_LEVEL;
-}
-
-static power_drain_t *tap_sel_to_drain(tap_dest_e d)
-{
-    switch(d)
-    {
-    case TAP_DEST_THRUST:
-	return &drain_thrust;
-    case TAP_DEST_SHIELD:
-	return &drain_shields;
-    case TAP_DEST_WEAPON:
-	return &drain_weapons;
-    default:
-	printf("bad item selection\n");
-	quitting = true;
-    }
-    return NULL;
-}
-
-static void update_drains(void)
-{
-    /* Thrusters get a pretty sinusoidal power usage, with a low degree of variance. */
-    static float thrust_freq;
-    if (thrust_freq == 0.0)
-	thrust_freq = 1.0 * (GetRandomValue(1, 100) / 100.0);
-
-    if (drain_thrust.enabled)
-    {
-	drain_thrust.rate = (sin(GetTime() * thrust_freq) + 1) / 2.0;
-	if ((GetRandomValue(1, 100) / 100.0) <= drain_thrust.spike_probability)
-	{
-	    thrust_freq = 1.0 * (GetRandomValue(1, 100) / 100.0);
-	}
-    }
-    else
-	drain_thrust.rate = 0;
-
-
-    /* Shields get large spikes that gradually drain away */
-    if (drain_shields.enabled)
-    {
-	if (GetRandomValue(1, 100) / 100.0 <= drain_shields.spike_probability)
-	{
-	    drain_shields.rate += (GetRandomValue(1, 30) / 100.0);
-	}
-	drain_shields.rate -= drain_shields.rate * 0.1;
-	if (drain_shields.rate > 1.0) drain_shields.rate = 1.0;
-	if (drain_shields.rate < 0) drain_shields.rate = 0;
-    }
-    else
-	drain_shields.rate = 0;
-
-
-    /* Weapons gradually, quickly, build up, then drop to nothing */
-    if (drain_weapons.enabled)
-    {
-	static int weapons_charging;
-
-	if (weapons_charging || GetRandomValue(1,100) / 100.0 <= drain_weapons.spike_probability)
-	{
-	    weapons_charging++;
-	}
-	if (weapons_charging > 60 || GetRandomValue(1,100)/100.0 < drain_weapons.spike_probability)
-	{
-	    weapons_charging = 0;
-	    drain_weapons.rate -= 0.2;
-	}
-
-	if (weapons_charging)
-	    drain_weapons.rate += 0.01 + (drain_weapons.rate * 0.1);
-	else
-	    drain_weapons.rate -= 0.2;
-
-	if (drain_weapons.rate > 1.0) drain_weapons.rate = 1.0;
-	if (drain_weapons.rate < 0) drain_weapons.rate = 0;
-    }
-    else
-	drain_weapons.rate = 0;
-
-}
-
-static void update_power_taps(void)
-{
-    /* Bottom 10% goes to battery, remaining 90% divided evenly in 3*/
-    if (total_output_power <= 0.1)
-    {
-	tap_bat.level = total_output_power / 0.1;
-	tap_1.level = 0.0;
-	tap_2.level = 0.0;
-	tap_3.level = 0.0;
-    }
-    else if (total_output_power <= 0.4)
-    {
-	tap_bat.level = 1.0;
-	tap_1.level = (total_output_power - 0.1) / 0.3;
-	tap_2.level = 0.0;
-	tap_3.level = 0.0;
-    }
-    else if (total_output_power <= .7)
-    {
-	tap_bat.level = 1.0;
-	tap_1.level = 1.0;
-	tap_2.level = (total_output_power - 0.4) / 0.3;
-	tap_3.level = 0.0;
-    }
-    else if (total_output_power <= 1.0)
-    {
-	tap_bat.level = 1.0;
-	tap_1.level = 1.0;
-	tap_2.level = 1.0;
-	tap_3.level = (total_output_power - 0.7) / 0.3;
-    }
-    else
-    {
-	tap_bat.level = 1.0;
-	tap_1.level = 1.0;
-	tap_2.level = 1.0;
-	tap_3.level = 1.0;
-    }
-
-
-    tap_1.drain = tap_sel_to_drain(tap_1.selected_dest);
-    tap_2.drain = tap_sel_to_drain(tap_2.selected_dest);
-    tap_3.drain = tap_sel_to_drain(tap_3.selected_dest);
-
-    return;
-}
-
-static void fill_capacitor(power_tap_t *tap, float strength)
-{
-    float f = tap->level * cap_grade_dmg_factor[(int)tap->cap.grade];
-
-    if (tap->cap.charge > tap->cap.full_limit)
-	strength *= (2 * cap_grade_dmg_factor[(int)tap->cap.grade]);
-
-    if (tap->cap.health > 0)
-    {
-	tap->cap.charge +=  strength *
-			    (tap->level / cap_max_charges[(int)tap->cap.size]) *
-			    cap_grade_chrg_rate[(int)tap->cap.grade] *
-			    tap->cap.health;
-    }
-
-    if (tap->cap.charge > tap->cap.max_charge)
-    {
-	tap->cap.health -= 0.0001 * tap->level * f;
-	cooler_add_heat(1.0 * f);
-	if (tap->cap.health < 0)
-	    tap->cap.health = 0;
-
-	if (tap->cap.health == 0)
-	    tap->cap.charge = 0;
-	else
-	    tap->cap.charge = tap->cap.max_charge;
-    }
-    else
-	cooler_add_heat(0.1 * (tap->cap.charge / tap->cap.max_charge) * f);
-}
-
-static void drain_battery(power_drain_t *d, float pct)
-{
-    tap_bat.cap.charge -= (d->rate * d->factor * pct);
-    cooler_add_heat(d->rate * 4.3 * pct);
-    if (tap_bat.cap.charge < 0)
-    {
-	d->enabled = 0;
-	tap_bat.cap.charge = 0;
-    }
-}
-
-static void drain_capacitor(power_tap_t *tap)
-{
-    /* This assumes that fill_capacitor has been called this frame */
-
-    power_drain_t   *d = tap->drain;
-    float	    rate;
-    int		    num_connected = 0; /* The number of drains that this tap shares */
-
-    if (tap->cap.charge > tap->cap.full_limit)
-    {
-	/* Based on grade, the capacitor charge will decay until it reaches its full limit. Higher grade capacitors will discharge more slowly. The less
-	 * charge currently feeding this tap, the more quickly it will will discharge.
-	 */
-	float decay = 0.1;
-
-	decay *= cap_grade_dmg_factor[(int)tap->cap.grade];
-	if (tap->level <= 0)
-	    tap->cap.charge -= decay;
-	//decay *= 1.0 - tap->level;
-	//tap->cap.charge -= decay;
-	if (tap->cap.charge < tap->cap.full_limit)
-	    tap->cap.charge = tap->cap.full_limit;
-
-    }
-
-    if (tap_1.drain == tap->drain && tap_1.cap.charge > 0) num_connected++;
-    if (tap_2.drain == tap->drain && tap_2.cap.charge > 0) num_connected++;
-    if (tap_3.drain == tap->drain && tap_3.cap.charge > 0) num_connected++;
-
-    if (num_connected == 0)
-    {
-	/* Drain battery instead */
-	drain_battery(tap->drain, 1.0);
-    }
-    else
-    {
-	float diff;
-	rate = d->rate / num_connected;
-	rate *= d->factor;
-	if (rate > tap->cap.charge)
-	{
-	    diff = rate - tap->cap.charge;
-	    drain_battery(tap->drain, diff/rate);
-	}
-	tap->cap.charge -= rate;
-	if (tap->cap.charge < 0)
-	    tap->cap.charge = 0;
 
+    engine_audio_process(&srcs->audio, (float *)pOutput, frameCount, &stats);
 
-    }
-
-}
-/* TODO: Implement power delivered progress bars below Power Usage (change to Power Requested) to show how much power is actually getting to the
- *	 thrusters/shields/weapons. Make it so that power delivered is less if it's coming from batteries. */
-/* TODO: Add a route to battery option for the power taps */
-/* TODO: Tune and balance */
-
-static void update_capacitors(void)
-{
-    drain_capacitor(&tap_1);
-    drain_capacitor(&tap_2);
-    drain_capacitor(&tap_3);
-
-    if (tap_1.drain != &drain_shields && tap_2.drain != &drain_shields && tap_3.drain != &drain_shields)
-    {
-	drain_battery(&drain_shields, 1.0);
-    }
-    if (tap_1.drain != &drain_weapons && tap_2.drain != &drain_weapons && tap_3.drain != &drain_weapons)
-    {
-	drain_battery(&drain_weapons, 1.0);
-    }
-    if (tap_1.drain != &drain_thrust && tap_2.drain != &drain_thrust && tap_3.drain != &drain_thrust)
-    {
-	drain_battery(&drain_thrust, 1.0);
-    }
-
-    fill_capacitor(&tap_1, 0.1);
-    fill_capacitor(&tap_2, 0.2);
-    fill_capacitor(&tap_3, 0.6);
-
-}
-
-static void update_battery(void)
-{
-    tap_bat.cap.charge += 0.03 * (tap_bat.level / MAX_BAT_CHARGE);
-    if (tap_bat.cap.charge > MAX_BAT_CHARGE)
-	tap_bat.cap.charge = MAX_BAT_CHARGE;
+    /* The sim picks these up on its next step */
+    if (stats.overloads)
+	atomic_fetch_add(&sim_link.overloads, stats.overloads);
+    atomic_store(&sim_link.overload, stats.overloads > 0);
+    atomic_store(&sim_link.peak, stats.peak);
 }
 
 void main_loop__em()
 {
 
+#ifdef __EMSCRIPTEN__
+	sim_run_due(now_sec()); /* No sim thread here, step whatever came due since the last frame */
+#endif
 	draw_gui();
-
-
-	update_engine();
-	update_fuel();
-	update_drains();
-	update_power_taps();
-	update_battery();
-	update_capacitors();
-	update_engine_heat();
+#ifdef __EMSCRIPTEN__
+	if (!forecast_held)
+	    beat_due(); /* Nor a worker to build beat tables, so a frame does once the widget's let go */
+	forecast_slice(); /* Or forecasts, it's ready a few frames on */
+#endif
 
 }
 
@@ -906,17 +801,48 @@ int main(int argc, char *argv[])
 #endif
 
     ma_result res;
+#ifndef __EMSCRIPTEN__
+    pthread_t sim_tid;
+    pthread_t forecast_tid;
+    sim_save_t save;
+#endif
+    const sim_save_t *saved;
+    double ring_phase[SIM_RING_COUNT] = {0};
+    int i;
 
     InitWindow(WIN_WIDTH, WIN_HEIGHT, "SCPulseEngine");
 
-    waveforms.rootwave_vol = 0;
-    waveforms.qwave_vol = 0;
-    waveforms.rwave_vol = 0;
-    waveforms.swave_vol = 0;
-    waveforms.rootwave_freq = ROOT_FREQ;
-    waveforms.qwave_freq = ROOT_FREQ;
-    waveforms.rwave_freq = ROOT_FREQ;
-    waveforms.swave_freq = ROOT_FREQ;
+    if ((saved = sim_save_map(SAVE_PATH)) != NULL)
+    {
+	sim_save_restore(saved, &sim, ring_phase);
+	sim_save_unmap(saved);
+    }
+    else
+	sim_init(&sim, (uint64_t)time(NULL));
+    sim_prev = sim;
+    sim_clock = now_sec();
+    spsc_init(&sim_link.cmds);
+    for (i = 0; i < 3; i++)
+    {
+	sim_link.snaps[i].prev = sim;
+	sim_link.snaps[i].cur = sim;
+	sim_link.snaps[i].time = sim_clock;
+    }
+    sim_link.back = 0;
+    atomic_init(&sim_link.mid, 1);
+    sim_link.front = 2;
+    forecast_link.ask_back = 0;
+    atomic_init(&forecast_link.ask_mid, 1);
+    forecast_link.ask_front = 2;
+    forecast_link.result_back = 0;
+    atomic_init(&forecast_link.result_mid, 1);
+    forecast_link.result_front = 2;
+    beat_link.ask_back = 0;
+    atomic_init(&beat_link.ask_mid, 1);
+    beat_link.ask_front = 2;
+    beat_link.result_back = 0;
+    atomic_init(&beat_link.result_mid, 1);
+    beat_link.result_front = 2;
 
     res = ma_context_init(NULL, 0, NULL, &context);
     if (res != MA_SUCCESS)
@@ -949,26 +875,65 @@ int main(int argc, char *argv[])
 
 
 
-    waveforms.rootwave_cfg = ma_waveform_config_init(device.playback.format, device.playback.channels,
-						     device.sampleRate, ma_waveform_type_sine,
-						     waveforms.rootwave_vol, waveforms.rootwave_freq);
-    waveforms.qwave_cfg = ma_waveform_config_init(device.playback.format, device.playback.channels,
-						     device.sampleRate, ma_waveform_type_sine,
-						     waveforms.qwave_vol, waveforms.qwave_freq);
-    waveforms.rwave_cfg = ma_waveform_config_init(device.playback.format, device.playback.channels,
-						     device.sampleRate, ma_waveform_type_sine,
-						     waveforms.rwave_vol, waveforms.rwave_freq);
-    waveforms.swave_cfg = ma_waveform_config_init(device.playback.format, device.playback.channels,
-						     device.sampleRate, ma_waveform_type_sine,
-						     waveforms.swave_vol, waveforms.swave_freq);
+    if (!engine_audio_init(&waveforms.audio, device.sampleRate, ENGINE_RATE_DIVIDER, device.playback.internalPeriodSizeInFrames))
+    {
+	fprintf(stderr, "Failed to allocate engine audio scratch\n");
+	return -1;
+    }
+    osc_bank_set_mode(&waveforms.audio.bank, OSC_MODE_PHASOR);
+    for (i = 0; i < SIM_RING_COUNT; i++) /* Straight to the sim's frequencies, no ramp, so a resumed session's beat carries on */
+    {
+	osc_bank_set_freq(&waveforms.audio.bank, i, sim.ring_freq[i]);
+	osc_bank_set_phase(&waveforms.audio.bank, i, ring_phase[i]);
+    }
+    osc_bank_set_ramp(&waveforms.audio.bank, waveforms.audio.bank.sample_rate * RING_RAMP_MS / 1000);
+    post_rings(SIM_CHANGED_POWER | SIM_CHANGED_FREQ);
 
-    ma_waveform_init(&waveforms.rootwave_cfg, &waveforms.rootwave);
-    ma_waveform_init(&waveforms.qwave_cfg, &waveforms.qwave);
-    ma_waveform_init(&waveforms.rwave_cfg, &waveforms.rwave);
-    ma_waveform_init(&waveforms.swave_cfg, &waveforms.swave);
+    if (!envelope_cache_init(&beats, 1.0 / SIM_RATE, BEAT_PERIOD, DSP_OVERLOAD_LEVEL, BEAT_CACHE_BYTES))
+    {
+	fprintf(stderr, "Failed to allocate the beat envelope cache\n");
+	return -1;
+    }
+    for (i = 0; i < 3; i++)
+    {
+	if (!envelope_table_alloc(&beats, &beat_link.results[i]))
+	{
+	    fprintf(stderr, "Failed to allocate the beat envelope tables\n");
+	    return -1;
+	}
+    }
+    post_beat();
+    sim_warp_init(&warp, 1.0 / SIM_RATE, warp_audio, NULL);
+    if (!sim_journal_init(&journal, &sim, SIM_RATE, MY_SAMPLE_RATE, BEAT_PERIOD, DSP_OVERLOAD_LEVEL))
+    {
+	fprintf(stderr, "Failed to allocate the input journal\n");
+	return -1;
+    }
+    if (!sim_forecaster_init(&forecaster, 1.0 / SIM_RATE, MY_SAMPLE_RATE, BEAT_PERIOD, DSP_OVERLOAD_LEVEL, BEAT_CACHE_BYTES))
+    {
+	fprintf(stderr, "Failed to allocate the forecast's beat envelope cache\n");
+	return -1;
+    }
 
     ma_device_start(&device);
 
+#ifndef __EMSCRIPTEN__
+    /* From here on only the sim thread touches sim and posts to the audio */
+    sim_clock = now_sec();
+    atomic_store(&sim_link.running, true);
+    if (pthread_create(&sim_tid, NULL, sim_thread, NULL) != 0)
+    {
+	fprintf(stderr, "Failed to start the sim thread\n");
+	return -1;
+    }
+    atomic_store(&forecast_link.running, true);
+    if (pthread_create(&forecast_tid, NULL, forecast_thread, NULL) != 0)
+    {
+	fprintf(stderr, "Failed to start the forecast thread\n");
+	return -1;
+    }
+#endif
+
 
 #if 0
     res = ma_sound_init_from_file(&engine, "resources/clank_s.wav",
@@ -1005,43 +970,6 @@ int main(int argc, char *argv[])
     ma_sound_uninit(&snd_clank_s);
 #endif
 
-    /* Init "Game" elements */
-    engine_health = 1.0;
-    fuel_level = MAX_FUEL_LEVEL;
-    tap_1.selected_dest = TAP_DEST_THRUST;
-    tap_1.drain = tap_sel_to_drain(tap_1.selected_dest);
-    tap_1.cap.size = CAP_SIZE_SMALL;
-    tap_1.cap.grade = CAP_GRADE_CON;
-    capacitor_reset(&tap_1.cap);
-
-    tap_2.selected_dest = TAP_DEST_SHIELD;
-    tap_2.drain = tap_sel_to_drain(tap_2.selected_dest);
-    tap_2.cap.size = CAP_SIZE_SMALL;
-    tap_2.cap.grade = CAP_GRADE_CON;
-    capacitor_reset(&tap_2.cap);
-
-    tap_3.selected_dest = TAP_DEST_WEAPON;
-    tap_3.drain = tap_sel_to_drain(tap_3.selected_dest);
-    tap_3.cap.size = CAP_SIZE_SMALL;
-    tap_3.cap.grade = CAP_GRADE_CON;
-    capacitor_reset(&tap_3.cap);
-
-    tap_bat.cap.charge = 50.0;
-
-    drain_shields.rate = 0.5;
-    drain_weapons.rate = 0.5;
-    drain_thrust.rate = 0.5;
-
-    drain_shields.factor = 0.04;
-    drain_weapons.factor = 0.01;
-    drain_thrust.factor = 0.0078;
-
-    drain_shields.enabled = false;
-    drain_weapons.enabled = false;
-    drain_thrust.enabled = false;
-    randomize_drains();
-
-
 #ifdef __EMSCRIPTEN__
     GuiLoadStyleCyber();
     emscripten_set_main_loop(main_loop__em, 0, 1);
@@ -1049,7 +977,7 @@ int main(int argc, char *argv[])
 
     GuiLoadStyle(GUI_THEME_RGS);
 
-    while (!WindowShouldClose() && !quitting)
+    while (!WindowShouldClose())
     {
 	float frame_time;
 	main_loop__em();
@@ -1060,8 +988,28 @@ int main(int argc, char *argv[])
 
     CloseWindow();
 
+#ifndef __EMSCRIPTEN__
+    atomic_store(&sim_link.running, false);
+    pthread_join(sim_tid, NULL);
+    atomic_store(&forecast_link.running, false);
+    atomic_store(&forecast_link.latest, 0); /* Whatever it's running, it stops */
+    pthread_join(forecast_tid, NULL);
+#endif
+    envelope_cache_free(&beats);
+    for (i = 0; i < 3; i++)
+	envelope_table_free(&beat_link.results[i]);
+    sim_forecaster_free(&forecaster);
     ma_device_stop(&device);
+#ifndef __EMSCRIPTEN__
+    sim_save_fill(&save, &sim, waveforms.audio.bank.phase);
+    if (!sim_save_write(&save, SAVE_PATH))
+	perror(SAVE_PATH);
+    if (!sim_journal_write(&journal, JOURNAL_PATH))
+	perror(JOURNAL_PATH);
+#endif
+    sim_journal_free(&journal);
     ma_device_uninit(&device);
+    engine_audio_uninit(&waveforms.audio);
 
     ma_engine_uninit(&engine);
     return 0;
@@ -0,0 +1,2782 @@
+/* Headless DSP and simulation benchmarks. No window, no audio device.
+ *
+ *   scpulse-bench [osc|phase|queue|upsample|sim|batch|math|envelope|warp|save|replay|seek|flow|thermal|forecast] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define MINIAUDIO_IMPLEMENTATION
+#define MA_NO_DEVICE_IO
+#define MA_NO_ENCODING
+#define MA_NO_DECODING
+#include "miniaudio.h"
+
+#include "dsp.h"
+#include "sim.h"
+#include "sim_batch.h"
+#include "sim_math.h"
+#include "envelope.h"
+#include "sim_warp.h"
+#include "sim_save.h"
+#include "sim_journal.h"
+#include "sim_flow.h"
+#include "sim_thermal.h"
+#include "sim_forecast.h"
+
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_PERIOD 441 /* 10ms, what miniaudio usually hands the callback */
+#define PERIODS_PER_SEC (BENCH_SAMPLE_RATE / BENCH_PERIOD)
+
+#define ROOT_FREQ   40.0
+
+static const float bench_freqs[OSC_COUNT] = {ROOT_FREQ, ROOT_FREQ + 1.3, ROOT_FREQ - 0.45, ROOT_FREQ + 0.21};
+static const float bench_amps[OSC_COUNT] = {0.5, 0.25, 0.15, 0.1};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ==================== Oscillator bank ==================== */
+
+typedef struct ma_path_s
+{
+    ma_waveform wave[OSC_COUNT];
+    float	buf[OSC_COUNT][BENCH_PERIOD];
+} ma_path_t;
+
+static void ma_path_init(ma_path_t *p)
+{
+    ma_waveform_config cfg;
+    int o;
+
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	cfg = ma_waveform_config_init(ma_format_f32, 1, BENCH_SAMPLE_RATE, ma_waveform_type_sine, bench_amps[o], bench_freqs[o]);
+	ma_waveform_init(&cfg, &p->wave[o]);
+    }
+}
+
+/* What data_callback used to do: four ma_waveform reads, then a scalar sum */
+static void ma_path_render(ma_path_t *p, float *out, ma_uint32 frames)
+{
+    ma_uint32 i;
+    int o;
+
+    for (o = 0; o < OSC_COUNT; o++)
+	ma_waveform_read_pcm_frames(&p->wave[o], p->buf[o], frames, NULL);
+
+    for (i = 0; i < frames; i++)
+	out[i] = p->buf[0][i] + p->buf[1][i] + p->buf[2][i] + p->buf[3][i];
+}
+
+static void osc_bank_setup(osc_bank_t *bank, dsp_isa_e isa, osc_mode_e mode)
+{
+    int o;
+
+    osc_bank_init(bank, BENCH_SAMPLE_RATE);
+    osc_bank_set_isa(bank, isa);
+    osc_bank_set_mode(bank, mode);
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	osc_bank_set_freq(bank, o, bench_freqs[o]);
+	osc_bank_set_amplitude(bank, o, bench_amps[o]);
+    }
+}
+
+static void bench_osc(double seconds)
+{
+    static ma_path_t	ma;
+    osc_bank_t		bank;
+    float		ref[BENCH_PERIOD];
+    float		out[BENCH_PERIOD];
+    dsp_block_stats_t	stats;
+    long		periods = (long)(seconds * BENCH_SAMPLE_RATE / BENCH_PERIOD);
+    double		samples = (double)periods * BENCH_PERIOD;
+    double		t0, ma_ns;
+    long		n;
+    int			isa, mode, i;
+    volatile float	sink = 0;
+
+    printf("== oscillator bank: %.0f s of audio, %d frame periods ==\n", seconds, BENCH_PERIOD);
+
+    ma_path_init(&ma);
+    t0 = now_sec();
+    for (n = 0; n < periods; n++)
+    {
+	ma_path_render(&ma, out, BENCH_PERIOD);
+	sink += out[0];
+    }
+    ma_ns = (now_sec() - t0) * 1e9 / samples;
+    printf("%-10s %8.2f ns/sample\n", "ma_waveform", ma_ns);
+
+    for (isa = DSP_ISA_SCALAR; isa <= dsp_detect_isa(); isa++)
+    {
+	for (mode = OSC_MODE_POLY; mode <= OSC_MODE_PHASOR; mode++)
+	{
+	    double ns;
+	    float max_err = 0;
+
+	    /* Agreement with the old path over the first minute */
+	    ma_path_init(&ma);
+	    osc_bank_setup(&bank, isa, mode);
+	    for (n = 0; n < 60 * PERIODS_PER_SEC; n++)
+	    {
+		ma_path_render(&ma, ref, BENCH_PERIOD);
+		osc_bank_render(&bank, out, BENCH_PERIOD, &stats);
+		for (i = 0; i < BENCH_PERIOD; i++)
+		    if (fabsf(out[i] - ref[i]) > max_err)
+			max_err = fabsf(out[i] - ref[i]);
+	    }
+
+	    osc_bank_setup(&bank, isa, mode);
+	    t0 = now_sec();
+	    for (n = 0; n < periods; n++)
+	    {
+		osc_bank_render(&bank, out, BENCH_PERIOD, &stats);
+		sink += out[0];
+	    }
+	    ns = (now_sec() - t0) * 1e9 / samples;
+	    printf("%-6s %-6s %8.2f ns/sample  %5.1fx  max |diff| vs ma_waveform %.2e\n",
+		   dsp_isa_name(isa), osc_mode_name(mode), ns, ma_ns / ns, max_err);
+	}
+    }
+}
+
+/* ==================== Long-run phase accuracy ==================== */
+
+#define PHASE_TOLERANCE 1e-5
+
+/* Render hours of audio through the bank and compare one period per second against sines of a double precision phase
+ * computed directly from the sample index. Any drift in the recursive phasor or the wrapped phase shows up here.
+ */
+static int bench_phase(double hours)
+{
+    osc_bank_t		bank;
+    float		out[BENCH_PERIOD];
+    dsp_block_stats_t	stats;
+    double		advance[OSC_COUNT];
+    long		periods = (long)(hours * 3600 * BENCH_SAMPLE_RATE / BENCH_PERIOD);
+    long		n;
+    int			mode, o, i;
+    int			failed = 0;
+
+    printf("== phase accuracy: %.1f hours, %s, tolerance %.0e ==\n", hours, dsp_isa_name(dsp_detect_isa()), PHASE_TOLERANCE);
+
+    for (o = 0; o < OSC_COUNT; o++)
+	advance[o] = (double)bench_freqs[o] / BENCH_SAMPLE_RATE;
+
+    for (mode = OSC_MODE_POLY; mode <= OSC_MODE_PHASOR; mode++)
+    {
+	double	max_err = 0, hour_err = 0;
+	double	t0 = now_sec();
+
+	osc_bank_setup(&bank, dsp_detect_isa(), mode);
+	for (n = 0; n < periods; n++)
+	{
+	    osc_bank_render(&bank, out, BENCH_PERIOD, &stats);
+	    if (n % PERIODS_PER_SEC)
+		continue;
+
+	    for (i = 0; i < BENCH_PERIOD; i++)
+	    {
+		double idx = (double)n * BENCH_PERIOD + i;
+		double ref = 0, err;
+		for (o = 0; o < OSC_COUNT; o++)
+		{
+		    double p = idx * advance[o];
+		    ref += sin(6.283185307179586 * (p - floor(p))) * bench_amps[o];
+		}
+		err = fabs(out[i] - ref);
+		if (err > hour_err)
+		    hour_err = err;
+	    }
+
+	    if (n + PERIODS_PER_SEC >= periods || (n + PERIODS_PER_SEC) * BENCH_PERIOD / (3600L * BENCH_SAMPLE_RATE) != n * BENCH_PERIOD / (3600L * BENCH_SAMPLE_RATE))
+	    {
+		/* Last check of this hour */
+		printf("%-6s hour %3ld  max |err| %.2e\n", osc_mode_name(mode), n * BENCH_PERIOD / (3600L * BENCH_SAMPLE_RATE) + 1, hour_err);
+		if (hour_err > max_err)
+		    max_err = hour_err;
+		hour_err = 0;
+	    }
+	}
+	printf("%-6s %s (max |err| %.2e, rendered at %.0fx realtime)\n", osc_mode_name(mode), max_err <= PHASE_TOLERANCE ? "PASS" : "FAIL",
+	       max_err, hours * 3600 / (now_sec() - t0));
+	failed |= max_err > PHASE_TOLERANCE;
+    }
+    return failed;
+}
+
+/* ==================== Parameter queue ==================== */
+
+#define QUEUE_MSGS 200000
+
+typedef struct queue_bench_s
+{
+    osc_bank_t	    bank;
+    spsc_queue_t    params;
+    double	    push_sec;
+} queue_bench_t;
+
+static void *queue_producer(void *arg)
+{
+    queue_bench_t   *qb = arg;
+    double	    t0 = now_sec();
+    long	    n;
+
+    for (n = 0; n < QUEUE_MSGS; n++)
+    {
+	while (!osc_bank_post(&qb->bank, &qb->params, OSC_PARAM_FREQ, OSC_Q, ROOT_FREQ + (n & 1), 0))
+	    sched_yield();
+    }
+    qb->push_sec = now_sec() - t0;
+    return NULL;
+}
+
+static void bench_queue(void)
+{
+    static queue_bench_t    qb;
+    float		    out[BENCH_PERIOD];
+    dsp_block_stats_t	    stats;
+    pthread_t		    producer;
+    uint64_t		    first = 0;
+    long		    periods = 0;
+    int			    i;
+
+    printf("== parameter queue ==\n");
+
+    /* A change scheduled for a given frame has to land on exactly that frame, even mid-block */
+    spsc_init(&qb.params);
+    osc_bank_setup(&qb.bank, dsp_detect_isa(), OSC_MODE_PHASOR);
+    osc_bank_set_amplitude(&qb.bank, OSC_ROOT, 0.0f);
+    osc_bank_set_amplitude(&qb.bank, OSC_Q, 0.0f);
+    osc_bank_set_amplitude(&qb.bank, OSC_R, 0.0f);
+    osc_bank_set_amplitude(&qb.bank, OSC_S, 0.0f);
+    osc_bank_post(&qb.bank, &qb.params, OSC_PARAM_AMPLITUDE, OSC_ROOT, 1.0f, 12345);
+    while (!first)
+    {
+	osc_bank_process(&qb.bank, &qb.params, out, BENCH_PERIOD, &stats);
+	for (i = 0; i < BENCH_PERIOD && !first; i++)
+	    if (out[i] != 0.0f)
+		first = osc_bank_clock(&qb.bank) - BENCH_PERIOD + i;
+    }
+    printf("change scheduled for frame 12345 took effect at frame %llu\n", (unsigned long long)first);
+
+    /* GUI thread hammering the audio thread */
+    spsc_init(&qb.params);
+    osc_bank_setup(&qb.bank, dsp_detect_isa(), OSC_MODE_PHASOR);
+    pthread_create(&producer, NULL, queue_producer, &qb);
+    while (qb.bank.params_applied < QUEUE_MSGS)
+    {
+	osc_bank_process(&qb.bank, &qb.params, out, BENCH_PERIOD, &stats);
+	periods++;
+    }
+    pthread_join(producer, NULL);
+
+    printf("%d messages over %ld periods: %.1f ns/push, latency mean %.1f max %llu frames, %u pushes refused while full\n",
+	   QUEUE_MSGS, periods, qb.push_sec * 1e9 / QUEUE_MSGS, (double)qb.bank.param_latency_total / qb.bank.params_applied,
+	   (unsigned long long)qb.bank.param_latency_max, qb.params.dropped);
+}
+
+/* ==================== Reduced-rate synthesis ==================== */
+
+static void engine_audio_setup(engine_audio_t *ea, uint32_t divider, float gain)
+{
+    int o;
+
+    if (!engine_audio_init(ea, BENCH_SAMPLE_RATE, divider, BENCH_PERIOD))
+    {
+	fprintf(stderr, "Failed to allocate engine audio scratch\n");
+	exit(1);
+    }
+    osc_bank_set_mode(&ea->bank, OSC_MODE_PHASOR);
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	osc_bank_set_freq(&ea->bank, o, bench_freqs[o]);
+	osc_bank_set_amplitude(&ea->bank, o, bench_amps[o] * gain);
+    }
+}
+
+/* Rings are louder than the overload level here so there is something to count */
+#define UPSAMPLE_GAIN 1.15f
+
+static void bench_upsample(double seconds)
+{
+    static const uint32_t   dividers[] = {1, 4, 8, 16, 32};
+    static engine_audio_t   ea;
+    float		    out[BENCH_PERIOD];
+    dsp_block_stats_t	    stats;
+    long		    periods = (long)(seconds * PERIODS_PER_SEC);
+    double		    full_ns = 0;
+    uint64_t		    full_overloads = 0;
+    float		    full_peak = 0;
+    volatile float	    sink = 0;
+    unsigned		    d;
+    long		    n;
+    int			    i, o;
+
+    printf("== reduced-rate synthesis: %.0f s of audio, phasor mode, %s ==\n", seconds, dsp_isa_name(dsp_detect_isa()));
+
+    for (d = 0; d < sizeof(dividers) / sizeof(dividers[0]); d++)
+    {
+	uint64_t    overloads = 0;
+	float	    peak = 0;
+	double	    max_err = 0;
+	double	    delay;
+	double	    ns, t0;
+
+	/* Fidelity against sines of a double precision phase, shifted by the interpolator's delay */
+	engine_audio_setup(&ea, dividers[d], 1.0f);
+	delay = dividers[d] > 1 ? dividers[d] * UPSAMPLE_TAPS / 2 : 0;
+	for (n = 0; n < 10 * PERIODS_PER_SEC; n++)
+	{
+	    engine_audio_process(&ea, out, BENCH_PERIOD, &stats);
+	    for (i = 0; n > 0 && i < BENCH_PERIOD; i++)
+	    {
+		double t = ((double)n * BENCH_PERIOD + i - delay) / BENCH_SAMPLE_RATE;
+		double ref = 0;
+		for (o = 0; o < OSC_COUNT; o++)
+		    ref += sin(6.283185307179586 * bench_freqs[o] * t) * bench_amps[o];
+		if (fabs(out[i] - ref) > max_err)
+		    max_err = fabs(out[i] - ref);
+	    }
+	}
+	engine_audio_uninit(&ea);
+
+	engine_audio_setup(&ea, dividers[d], UPSAMPLE_GAIN);
+	t0 = now_sec();
+	for (n = 0; n < periods; n++)
+	{
+	    engine_audio_process(&ea, out, BENCH_PERIOD, &stats);
+	    overloads += stats.overloads;
+	    if (stats.peak > peak)
+		peak = stats.peak;
+	    sink += out[0];
+	}
+	ns = (now_sec() - t0) * 1e9 / ((double)periods * BENCH_PERIOD);
+	engine_audio_uninit(&ea);
+	if (dividers[d] == 1)
+	{
+	    full_ns = ns;
+	    full_overloads = overloads;
+	    full_peak = peak;
+	}
+
+	printf("internal %6.0f Hz  %6.2f ns/sample  %5.1fx  max |err| %.1e  peak %+.1e  overloads %+.3f%%\n",
+	       (double)BENCH_SAMPLE_RATE / dividers[d], ns, full_ns / ns, max_err, peak - full_peak,
+	       full_overloads ? 100.0 * ((double)overloads - full_overloads) / full_overloads : 0.0);
+    }
+}
+
+/* ==================== Simulation ==================== */
+
+#define SIM_INSTANCES 1000
+#define SIM_DT (1.0f / 240) /* The game's SIM_RATE */
+
+/* Instance i of every sim test: seeded with i, input power spread across the instances, all drains on */
+static void sim_setup(sim_state_t *sim, int i, int count)
+{
+    sim_init(sim, i);
+    sim->ring_power[SIM_RING_ROOT] = 0.2 + 0.6 * i / count;
+    sim->ring_power[SIM_RING_Q] = 0.5;
+    sim->ring_power[SIM_RING_R] = 0.3;
+    sim->ring_power[SIM_RING_S] = 0.2;
+    sim->total_output_power = sim->ring_power[SIM_RING_ROOT];
+    sim->drains[TAP_DEST_THRUST].enabled = true;
+    sim->drains[TAP_DEST_SHIELD].enabled = true;
+    sim->drains[TAP_DEST_WEAPON].enabled = true;
+}
+
+static void bench_sim(double seconds)
+{
+    static sim_state_t	sims[SIM_INSTANCES];
+    long		steps = (long)(seconds / SIM_DT);
+    double		t0, elapsed;
+    float		sink = 0;
+    long		n;
+    int			i;
+
+    printf("== simulation: %d instances, %.0f s of game time each ==\n", SIM_INSTANCES, seconds);
+
+    for (i = 0; i < SIM_INSTANCES; i++)
+	sim_setup(&sims[i], i, SIM_INSTANCES);
+
+    t0 = now_sec();
+    for (i = 0; i < SIM_INSTANCES; i++)
+    {
+	for (n = 0; n < steps; n++)
+	    sim_step(&sims[i], SIM_DT);
+	sink += sims[i].cooler_temp;
+    }
+    elapsed = now_sec() - t0;
+
+    printf("%.0f steps/s, %.0f ns/step, %.0fx realtime per instance (mean cooler %.1f C)\n",
+	   (double)SIM_INSTANCES * steps / elapsed, elapsed * 1e9 / ((double)SIM_INSTANCES * steps),
+	   seconds * SIM_INSTANCES / elapsed, sink / SIM_INSTANCES);
+
+    /* Rates are per second, so the step size should only change the answer by the integration error. Drains off, since
+     * their random events are rolled per step.
+     */
+    {
+	static const float  rates[] = {30, 60, 240, 1000};
+	sim_state_t	    s;
+	unsigned	    r;
+
+	for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+	{
+	    sim_init(&s, 1);
+	    s.ring_power[SIM_RING_ROOT] = 0.4;
+	    s.ring_power[SIM_RING_Q] = 0.5;
+	    s.total_output_power = 0.4;
+	    for (n = 0; n < (long)(60 * rates[r]); n++)
+		sim_step(&s, 1.0f / rates[r]);
+	    printf("%4.0f Hz steps, 60 s: cooler %7.2f C  fuel %8.1f L  battery %5.2f  tap 1 charge %5.2f\n",
+		   rates[r], s.cooler_temp, s.fuel_level, s.tap_bat.cap.charge, s.taps[0].cap.charge);
+	}
+    }
+}
+
+#define DETERMINISM_INSTANCES 64
+#define DETERMINISM_STEPS (60 * 240) /* A minute at the game's rate */
+#define DETERMINISM_MAX_THREADS 8
+
+typedef struct trace_job_s
+{
+    uint64_t	*hashes;    /* One per instance */
+    int		first;
+    int		stride;
+} trace_job_t;
+
+/* FNV-1a over the bits of what the drains and the heat they cause look like after every step */
+static uint64_t sim_trace(int i)
+{
+    sim_state_t	sim;
+    uint64_t	h = 0xcbf29ce484222325ULL;
+    int		n, d;
+
+    sim_setup(&sim, i, DETERMINISM_INSTANCES);
+    for (n = 0; n < DETERMINISM_STEPS; n++)
+    {
+	float	 v[SIM_DRAIN_COUNT + 2];
+	uint32_t bits;
+
+	sim_step(&sim, SIM_DT);
+	for (d = 0; d < SIM_DRAIN_COUNT; d++)
+	    v[d] = sim.drains[d].rate;
+	v[SIM_DRAIN_COUNT] = sim.cooler_temp;
+	v[SIM_DRAIN_COUNT + 1] = sim.tap_bat.cap.charge;
+	for (d = 0; d < SIM_DRAIN_COUNT + 2; d++)
+	{
+	    memcpy(&bits, &v[d], sizeof(bits));
+	    h = (h ^ bits) * 0x100000001b3ULL;
+	}
+    }
+    return h;
+}
+
+static void *trace_worker(void *arg)
+{
+    trace_job_t	*job = arg;
+    int		i;
+
+    for (i = job->first; i < DETERMINISM_INSTANCES; i += job->stride)
+	job->hashes[i] = sim_trace(i);
+    return NULL;
+}
+
+/* Same seeds, traced on 1 to DETERMINISM_MAX_THREADS threads: every trace has to come out bit-identical */
+static int bench_sim_determinism(void)
+{
+    static uint64_t ref[DETERMINISM_INSTANCES], got[DETERMINISM_INSTANCES];
+    pthread_t	    tids[DETERMINISM_MAX_THREADS];
+    trace_job_t	    jobs[DETERMINISM_MAX_THREADS];
+    int		    threads, t, i, mismatches, distinct = 0;
+
+    printf("== simulation determinism: %d seeds, %d steps each ==\n", DETERMINISM_INSTANCES, DETERMINISM_STEPS);
+
+    for (i = 0; i < DETERMINISM_INSTANCES; i++)
+	ref[i] = sim_trace(i);
+    for (i = 1; i < DETERMINISM_INSTANCES; i++)
+	distinct += ref[i] != ref[i - 1];
+
+    for (threads = 1; threads <= DETERMINISM_MAX_THREADS; threads *= 2)
+    {
+	memset(got, 0, sizeof(got));
+	for (t = 0; t < threads; t++)
+	{
+	    jobs[t].hashes = got;
+	    jobs[t].first = t;
+	    jobs[t].stride = threads;
+	    pthread_create(&tids[t], NULL, trace_worker, &jobs[t]);
+	}
+	for (t = 0; t < threads; t++)
+	    pthread_join(tids[t], NULL);
+
+	mismatches = 0;
+	for (i = 0; i < DETERMINISM_INSTANCES; i++)
+	    mismatches += got[i] != ref[i];
+	printf("%d thread%s: %d/%d traces differ from the first run\n", threads, threads == 1 ? " " : "s", mismatches,
+	       DETERMINISM_INSTANCES);
+	if (mismatches)
+	    return 1;
+    }
+
+    /* And different seeds really do give different runs */
+    printf("%d/%d neighbouring seeds give different traces\n", distinct, DETERMINISM_INSTANCES - 1);
+    return distinct != DETERMINISM_INSTANCES - 1;
+}
+
+/* ==================== Batch simulation ==================== */
+
+#define BATCH_CHECK_SHIPS 1000 /* Not a whole number of blocks, so the spare lanes get stepped too */
+#define BATCH_CHECK_STEPS (60 * 240)
+#define BATCH_SHIPS 4096
+#define BATCH_MAX_THREADS 64
+
+/* Ship i of the batch tests: sim_setup, then routing, capacitors and output power spread around so every branch of the
+ * step gets taken by somebody
+ */
+static void batch_setup(sim_state_t *sim, int i, int count)
+{
+    int t;
+
+    sim_setup(sim, i, count);
+    sim->total_output_power = 1.2 * i / count;
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+    {
+	sim_apply(sim, SIM_CMD_TAP_DEST, t, (i / (t + 1)) % SIM_DRAIN_COUNT);
+	sim_apply(sim, SIM_CMD_CAP_SIZE, t, (i + t) % 3);
+	sim_apply(sim, SIM_CMD_CAP_GRADE, t, (i / 3 + t) % 3);
+    }
+    if (i % 7 == 0)
+	sim->drains[i % SIM_DRAIN_COUNT].enabled = false;
+    if (i % 11 == 0)
+	sim->engine_health = 0.001;
+}
+
+static int float_same(float a, float b)
+{
+    return !memcmp(&a, &b, sizeof(a));
+}
+
+/* Everything sim_step touches, bit for bit */
+static int sim_same(const sim_state_t *a, const sim_state_t *b)
+{
+    int same = 1, i;
+
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	same &= float_same(a->ring_power[i], b->ring_power[i]);
+    same &= float_same(a->cooler_temp, b->cooler_temp) && float_same(a->fuel_level, b->fuel_level) &&
+	    float_same(a->fuel_rate, b->fuel_rate) && float_same(a->engine_health, b->engine_health);
+    same &= float_same(a->tap_bat.level, b->tap_bat.level) && float_same(a->tap_bat.cap.charge, b->tap_bat.cap.charge);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	same &= float_same(a->taps[i].level, b->taps[i].level) && float_same(a->taps[i].cap.charge, b->taps[i].cap.charge) &&
+		float_same(a->taps[i].cap.health, b->taps[i].cap.health) && a->taps[i].dest == b->taps[i].dest;
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	same &= float_same(a->drains[i].rate, b->drains[i].rate) && float_same(a->drains[i].delivered, b->drains[i].delivered) &&
+		a->drains[i].enabled == b->drains[i].enabled && float_same(a->drains[i].wave_freq, b->drains[i].wave_freq) &&
+		float_same(a->drains[i].charging, b->drains[i].charging);
+    for (i = 0; i < SIM_HEAT_NODES; i++)
+	same &= float_same(a->heat_temp[i], b->heat_temp[i]);
+    same &= a->time == b->time && !memcmp(&a->rng, &b->rng, sizeof(a->rng));
+    return same;
+}
+
+static const char *const math_names[SIM_MATH_COUNT] = {"powf", "table", "poly"};
+
+/* The batch against sim_step, ship by ship, after every step. Halfway through, every ship gets a couple of commands. */
+static int batch_check(bool avx2, sim_math_e math)
+{
+    static sim_state_t	sims[BATCH_CHECK_SHIPS];
+    sim_batch_t		batch;
+    sim_state_t		got;
+    int			i, n, bad = 0, first = -1;
+
+    sim_batch_init(&batch, BATCH_CHECK_SHIPS);
+    batch.avx2 = avx2;
+    for (i = 0; i < BATCH_CHECK_SHIPS; i++)
+    {
+	batch_setup(&sims[i], i, BATCH_CHECK_SHIPS);
+	sims[i].math = math;
+	sims[i].thermal = i % 5 < 2 ? SIM_THERMAL_GRAPH : SIM_THERMAL_COOLER; /* Blocks of both, mixed */
+	sim_batch_add(&batch, &sims[i]);
+    }
+
+    for (n = 0; n < BATCH_CHECK_STEPS && !bad; n++)
+    {
+	if (n == BATCH_CHECK_STEPS / 2)
+	{
+	    for (i = 0; i < BATCH_CHECK_SHIPS; i++)
+	    {
+		sim_apply(&sims[i], SIM_CMD_TAP_DEST, i % SIM_TAP_COUNT, (i + 1) % SIM_DRAIN_COUNT);
+		sim_batch_apply(&batch, i, SIM_CMD_TAP_DEST, i % SIM_TAP_COUNT, (i + 1) % SIM_DRAIN_COUNT);
+		sim_apply(&sims[i], SIM_CMD_REPAIR, 0, 0);
+		sim_batch_apply(&batch, i, SIM_CMD_REPAIR, 0, 0);
+	    }
+	}
+
+	sim_batch_step(&batch, 0, SIM_BATCH_BLOCKS(batch.count), SIM_DT);
+	for (i = 0; i < BATCH_CHECK_SHIPS; i++)
+	{
+	    unsigned changed = sim_step(&sims[i], SIM_DT);
+
+	    sim_batch_get(&batch, i, &got);
+	    if (!sim_same(&sims[i], &got) || changed != batch.blocks[i / SIM_BATCH_BLOCK].changed[i % SIM_BATCH_BLOCK])
+	    {
+		bad++;
+		if (first < 0)
+		    first = i;
+	    }
+	}
+    }
+
+    printf("%s, %s: %d ships, %d steps: ", avx2 ? "avx2" : "default", math_names[math], BATCH_CHECK_SHIPS, n);
+    if (bad)
+	printf("ship %d differs from sim_step at step %d\n", first, n);
+    else
+	printf("bit-identical to sim_step\n");
+    sim_batch_free(&batch);
+    return bad != 0;
+}
+
+typedef struct batch_job_s
+{
+    sim_batch_t		*batch;
+    pthread_barrier_t	*tick;
+    uint32_t		first;	/* Blocks */
+    uint32_t		count;
+    long		steps;
+} batch_job_t;
+
+static void *batch_worker(void *arg)
+{
+    batch_job_t *job = arg;
+    long	n;
+
+    for (n = 0; n < job->steps; n++)
+    {
+	sim_batch_step(job->batch, job->first, job->count, SIM_DT);
+	pthread_barrier_wait(job->tick); /* Every ship is on the same tick before any moves to the next */
+    }
+    return NULL;
+}
+
+/* Ship-ticks per second for the batch stepped on threads threads, each with its own run of blocks */
+static double batch_rate(sim_batch_t *batch, int threads, long steps)
+{
+    pthread_t		tids[BATCH_MAX_THREADS];
+    batch_job_t		jobs[BATCH_MAX_THREADS];
+    pthread_barrier_t	tick;
+    uint32_t		blocks = SIM_BATCH_BLOCKS(batch->count);
+    double		t0;
+    int			t;
+
+    pthread_barrier_init(&tick, NULL, threads);
+    t0 = now_sec();
+    for (t = 0; t < threads; t++)
+    {
+	jobs[t].batch = batch;
+	jobs[t].tick = &tick;
+	jobs[t].first = blocks * t / threads;
+	jobs[t].count = blocks * (t + 1) / threads - jobs[t].first;
+	jobs[t].steps = steps;
+	pthread_create(&tids[t], NULL, batch_worker, &jobs[t]);
+    }
+    for (t = 0; t < threads; t++)
+	pthread_join(tids[t], NULL);
+    pthread_barrier_destroy(&tick);
+    return (double)batch->count * steps / (now_sec() - t0);
+}
+
+static int bench_batch(double seconds)
+{
+    static sim_state_t	sims[BATCH_SHIPS];
+    long		steps = (long)(seconds / SIM_DT);
+    sim_batch_t		batch;
+    bool		avx2;
+    double		t0, scalar, rate, base = 0;
+    int			failed = 0, i, threads;
+    long		n;
+
+    printf("== batch simulation: %d ships, %.0f s of game time each ==\n", BATCH_SHIPS, seconds);
+
+    sim_batch_init(&batch, BATCH_SHIPS);
+    avx2 = batch.avx2;
+    failed |= batch_check(false, batch.math);
+    if (avx2)
+	failed |= batch_check(true, batch.math);
+
+    for (i = 0; i < BATCH_SHIPS; i++)
+    {
+	batch_setup(&sims[i], i, BATCH_SHIPS);
+	sim_batch_add(&batch, &sims[i]);
+    }
+
+    t0 = now_sec();
+    for (i = 0; i < BATCH_SHIPS; i++)
+	for (n = 0; n < steps; n++)
+	    sim_step(&sims[i], SIM_DT);
+    scalar = (double)BATCH_SHIPS * steps / (now_sec() - t0);
+    printf("sim_step:      %6.2fM ship-ticks/s\n", scalar * 1e-6);
+
+    batch.avx2 = false;
+    rate = batch_rate(&batch, 1, steps);
+    printf("batch default: %6.2fM ship-ticks/s, %.1fx sim_step\n", rate * 1e-6, rate / scalar);
+    batch.avx2 = avx2;
+    if (avx2)
+    {
+	rate = batch_rate(&batch, 1, steps);
+	printf("batch avx2:    %6.2fM ship-ticks/s, %.1fx sim_step\n", rate * 1e-6, rate / scalar);
+    }
+
+    /* Blocks are independent, so this should scale with cores until the threads outnumber them */
+    for (threads = 1; threads <= BATCH_MAX_THREADS; threads *= 2)
+    {
+	rate = batch_rate(&batch, threads, steps);
+	if (threads == 1)
+	    base = rate;
+	printf("%2d thread%s %7.2fM ship-ticks/s, %.2fx one thread\n", threads, threads == 1 ? ": " : "s:", rate * 1e-6,
+	       rate / base);
+    }
+
+    sim_batch_free(&batch);
+    return failed;
+}
+
+/* ==================== Cooler math ==================== */
+
+#define MATH_SAMPLES 4096
+#define MATH_CALLS 20000000
+#define MATH_SWEEP_STRIDE 61 /* Float bit patterns between samples of the accuracy sweep */
+#define MATH_SWEEP_MIN 0x1p-100f /* Of MAX_COOLER_TEMP. x^1.2 is still a normal float. */
+#define MATH_SWEEP_MAX 2.0f /* About as hot as the cooler gets before the engine dies */
+#define MATH_TOLERANCE 1e-5 /* Of x^1.2. powf's own is about 3e-6, since 1.2 isn't a float. */
+#define MATH_RUNS 3 /* Whole steps differ by a few percent between the modes, less than runs do, so the best of these */
+
+static float math_pow12(sim_math_e math, float x)
+{
+    switch (math)
+    {
+    case SIM_MATH_TABLE:
+	return sim_pow12_table(x);
+    case SIM_MATH_POLY:
+	return sim_pow12_poly(x);
+    default:
+	return powf(x, 1.2); /* As COOLER_COOL_RATE has it */
+    }
+}
+
+/* ns per x^1.2 over a spread of cooler temperatures. Into an array, not a running sum, so the polynomial can vectorize
+ * the way it does in the batch.
+ */
+static double math_ns(sim_math_e math, const float *x, float *out)
+{
+    long    n, rounds = MATH_CALLS / MATH_SAMPLES;
+    double  t0 = now_sec();
+    int	    i;
+    volatile float sink = 0;
+
+    for (n = 0; n < rounds; n++)
+    {
+	switch (math)
+	{
+	case SIM_MATH_TABLE:
+	    for (i = 0; i < MATH_SAMPLES; i++)
+		out[i] = sim_pow12_table(x[i]);
+	    break;
+	case SIM_MATH_POLY:
+	    for (i = 0; i < MATH_SAMPLES; i++)
+		out[i] = sim_pow12_poly(x[i]);
+	    break;
+	default:
+	    for (i = 0; i < MATH_SAMPLES; i++)
+		out[i] = powf(x[i], 1.2);
+	    break;
+	}
+	sink += out[n % MATH_SAMPLES];
+    }
+    return (now_sec() - t0) * 1e9 / ((double)rounds * MATH_SAMPLES);
+}
+
+static int bench_math(double seconds)
+{
+    static sim_state_t	sims[BATCH_SHIPS];
+    static float	x[MATH_SAMPLES], out[MATH_SAMPLES];
+    long		steps = (long)(seconds / SIM_DT);
+    double		err[SIM_MATH_COUNT] = {0}, rate_err[SIM_MATH_COUNT] = {0}, ns[SIM_MATH_COUNT];
+    double		t0, scalar[SIM_MATH_COUNT];
+    sim_batch_t		batch;
+    bool		avx2;
+    int			failed = 0, math, i;
+    float		xf;
+    long		n;
+
+    printf("== cooler math: x^1.2 in COOLER_COOL_RATE, %.0f s of game time for the batch ==\n", seconds);
+
+    /* Against x^1.2 in double, over every temperature the cooler gets to */
+    for (xf = MATH_SWEEP_MIN; xf <= MATH_SWEEP_MAX; xf = sim_bits_float(sim_float_bits(xf) + MATH_SWEEP_STRIDE))
+    {
+	double	ref = pow(xf, 1.2);
+
+	for (math = 0; math < SIM_MATH_COUNT; math++)
+	{
+	    double got = math_pow12(math, xf);
+
+	    err[math] = fmax(err[math], fabs(got / ref - 1));
+	    rate_err[math] = fmax(rate_err[math], fabs(got - ref) * (MAX_COOLER_TEMP * 0.6));
+	}
+    }
+
+    for (i = 0; i < MATH_SAMPLES; i++)
+	x[i] = MATH_SWEEP_MAX * (i + 0.5f) / MATH_SAMPLES;
+    for (math = 0; math < SIM_MATH_COUNT; math++)
+	ns[math] = math_ns(math, x, out);
+    for (math = 0; math < SIM_MATH_COUNT; math++)
+    {
+	bool ok = err[math] <= MATH_TOLERANCE;
+
+	printf("%-6s %.2e of x^1.2, %.2e degrees/s, %6.2f ns/call, %.1fx powf: %s\n", math_names[math], err[math],
+	       rate_err[math], ns[math], ns[SIM_MATH_POWF] / ns[math], ok ? "PASS" : "FAIL");
+	failed |= !ok;
+    }
+
+    /* Each kernel still steps exactly like sim_step with the same math */
+    sim_batch_init(&batch, BATCH_SHIPS);
+    avx2 = batch.avx2;
+    for (math = SIM_MATH_TABLE; math < SIM_MATH_COUNT; math++)
+    {
+	failed |= batch_check(false, math);
+	if (avx2)
+	    failed |= batch_check(true, math);
+    }
+
+    /* And what it's worth to a whole step */
+    for (math = 0; math < SIM_MATH_COUNT; math++)
+    {
+	double	batch_best[2] = {0, 0};
+	int	run, k;
+
+	scalar[math] = 0;
+	for (run = 0; run < MATH_RUNS; run++)
+	{
+	    for (i = 0; i < BATCH_SHIPS; i++)
+	    {
+		batch_setup(&sims[i], i, BATCH_SHIPS);
+		sims[i].math = math;
+		sim_batch_put(&batch, i, &sims[i]);
+	    }
+	    batch.count = BATCH_SHIPS;
+	    batch.math = math;
+
+	    t0 = now_sec();
+	    for (i = 0; i < BATCH_SHIPS; i++)
+		for (n = 0; n < steps; n++)
+		    sim_step(&sims[i], SIM_DT);
+	    scalar[math] = fmax(scalar[math], (double)BATCH_SHIPS * steps / (now_sec() - t0));
+	    for (k = 0; k <= avx2; k++)
+	    {
+		batch.avx2 = k;
+		batch_best[k] = fmax(batch_best[k], batch_rate(&batch, 1, steps));
+	    }
+	}
+	printf("%-6s sim_step %6.2fM ship-ticks/s, %.2fx powf; batch default %6.2fM", math_names[math], scalar[math] * 1e-6,
+	       scalar[math] / scalar[SIM_MATH_POWF], batch_best[0] * 1e-6);
+	if (avx2)
+	    printf(", avx2 %6.2fM", batch_best[1] * 1e-6);
+	printf("\n");
+    }
+    sim_batch_free(&batch);
+    return failed;
+}
+
+/* ==================== Beat envelope ==================== */
+
+#define ENVELOPE_SETUPS 100
+#define ENVELOPE_TOLERANCE 5e-5 /* Peaks between samples are up to about 1e-5 above the sampled ones at 44.1kHz */
+#define ENVELOPE_OVER_TOLERANCE 0.01 /* Of the overloaded samples */
+
+/* Random rings, a few Hz either side of the root like the game's, louder than the overload level about half the time.
+ * A random stretch is rendered first so the phases are anything at all.
+ */
+static void envelope_setup(osc_bank_t *bank, osc_mode_e mode, envelope_t *env, rng_t *rng)
+{
+    float   root = 0.2 + 0.8 * rng_uniform(rng);
+    float   out[BENCH_PERIOD];
+    int	    o, n;
+    dsp_block_stats_t stats;
+
+    osc_bank_init(bank, BENCH_SAMPLE_RATE);
+    osc_bank_set_mode(bank, mode);
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	osc_bank_set_freq(bank, o, o == OSC_ROOT ? ROOT_FREQ : ROOT_FREQ - 5 + 10 * rng_uniform(rng));
+	osc_bank_set_amplitude(bank, o, o == OSC_ROOT ? root : root * rng_uniform(rng));
+    }
+    for (n = rng_range(rng, 0, 100); n > 0; n--)
+	osc_bank_render(bank, out, BENCH_PERIOD, &stats);
+
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	env->freq[o] = bank->advance[o] * BENCH_SAMPLE_RATE;
+	env->phase[o] = bank->phase[o];
+	env->amp[o] = bank->amplitude[o];
+    }
+}
+
+#define CACHE_TICK (1.0 / 240) /* The game's SIM_RATE */
+#define CACHE_PERIOD 20.0
+#define CACHE_BYTES (1 << 20)
+#define CACHE_SETTINGS 64 /* Distinct ring settings, more than fit in CACHE_BYTES */
+#define CACHE_CHANGES 2000
+#define CACHE_HOLD 240 /* Ticks between changes */
+#define CACHE_DRAG 0.1 /* Of the root's amplitude, dragged over a second */
+
+/* Tables against envelope_measure of the same rounded setting, a period or more later, and what a player nudging the
+ * sliders back and forth costs: one setting after another, mostly near the last one. Then a slider dragged the way the
+ * game's sim sees it: a lookup a tick that builds nothing, the tick measured on its own on a miss, and the table built
+ * by the worker in time for the next tick.
+ */
+static int bench_envelope_cache(void)
+{
+    envelope_cache_t	    cache;
+    const envelope_table_t  *table;
+    envelope_table_t	    built;
+    envelope_t		    settings[CACHE_SETTINGS], env = {{0}}, asked;
+    envelope_stats_t	    measured;
+    envelope_tick_t	    alone;
+    rng_t		    rng;
+    volatile float	    sink = 0;
+    double		    max_err = 0, max_over_err = 0, lookup_sec, measure_sec, drag_sec_max = 0, t0, sec;
+    uint64_t		    n, hits, misses;
+    int			    k, o, i, ok, same = 1, builds = 0;
+    bool		    pending = false;
+
+    if (!envelope_cache_init(&cache, CACHE_TICK, CACHE_PERIOD, DSP_OVERLOAD_LEVEL, CACHE_BYTES))
+    {
+	printf("Failed to allocate the envelope cache\n");
+	return 1;
+    }
+    printf("== envelope cache: %u ticks of %.2f ms per table, %zu KB bound (%u tables) ==\n", cache.ticks, CACHE_TICK * 1e3,
+	   (size_t)CACHE_BYTES >> 10, cache.capacity);
+
+    rng_seed(&rng, 1);
+    for (k = 0; k < CACHE_SETTINGS; k++)
+    {
+	float root = 0.2 + 0.8 * rng_uniform(&rng);
+
+	memset(&settings[k], 0, sizeof(settings[k]));
+	for (o = 0; o < OSC_COUNT; o++)
+	{
+	    settings[k].freq[o] = o == OSC_ROOT ? ROOT_FREQ : ROOT_FREQ - 5 + 10 * rng_uniform(&rng);
+	    settings[k].amp[o] = o == OSC_ROOT ? root : root * rng_uniform(&rng);
+	}
+    }
+
+    /* Accuracy, on a handful of ticks per setting */
+    for (k = 0; k < CACHE_SETTINGS; k++)
+    {
+	table = envelope_cache_get(&cache, &settings[k]);
+	for (o = 0; o < OSC_COUNT; o++)
+	{
+	    env.freq[o] = table->key.freq[o] / cache.period;
+	    env.amp[o] = (float)table->key.amp[o] / ENVELOPE_AMP_STEPS;
+	}
+	for (i = 0; i < 16; i++)
+	{
+	    const envelope_tick_t *tick;
+
+	    n = rng_next(&rng) % (4 * cache.ticks);
+	    tick = envelope_table_at(&cache, table, n);
+	    envelope_measure(&env, n * CACHE_TICK, (n + 1) * CACHE_TICK, DSP_OVERLOAD_LEVEL, &measured);
+	    if (fabs(tick->peak - measured.peak) > max_err)
+		max_err = fabs(tick->peak - measured.peak);
+	    if (fabs(tick->over - measured.over) > max_over_err)
+		max_over_err = fabs(tick->over - measured.over);
+	    envelope_cache_measure(&cache, &settings[k], n, &alone);
+	    same &= !memcmp(&alone, tick, sizeof(alone));
+	}
+    }
+    ok = max_err <= ENVELOPE_TOLERANCE && max_over_err <= ENVELOPE_OVER_TOLERANCE * CACHE_TICK;
+    printf("cache  %s  max |err| %.2e peak, %.2e s over per tick, against envelope_measure up to 3 periods on\n",
+	   ok ? "PASS" : "FAIL", max_err, max_over_err);
+    printf("cache  %s  envelope_cache_measure against the tables' entries, to the bit\n", same ? "PASS" : "FAIL");
+    ok &= same;
+
+    /* Slider nudging: a random walk over the settings, held for a second each */
+    envelope_cache_free(&cache);
+    envelope_cache_init(&cache, CACHE_TICK, CACHE_PERIOD, DSP_OVERLOAD_LEVEL, CACHE_BYTES);
+    k = 0;
+    n = 0;
+    lookup_sec = 0;
+    for (i = 0; i < CACHE_CHANGES; i++)
+    {
+	int h;
+
+	k = (k + CACHE_SETTINGS + rng_range(&rng, -3, 3)) % CACHE_SETTINGS;
+	table = envelope_cache_get(&cache, &settings[k]);
+	t0 = now_sec();
+	for (h = 0; h < CACHE_HOLD; h++, n++)
+	    sink += envelope_table_at(&cache, table, n)->peak;
+	lookup_sec += now_sec() - t0;
+    }
+
+    /* The same ticks measured directly, for scale */
+    env = settings[0];
+    t0 = now_sec();
+    for (n = 0; n < 100000; n++)
+    {
+	envelope_measure(&env, n * CACHE_TICK, (n + 1) * CACHE_TICK, DSP_OVERLOAD_LEVEL, &measured);
+	sink += measured.peak;
+    }
+    measure_sec = (now_sec() - t0) / 100000;
+
+    printf("cache  %d changes: %llu hits, %llu misses, %llu evictions, %zu KB in tables\n", CACHE_CHANGES,
+	   (unsigned long long)cache.hits, (unsigned long long)cache.misses, (unsigned long long)cache.evictions,
+	   envelope_cache_bytes(&cache) >> 10);
+    printf("cache  build %.2f ms mean, %.2f ms max; per tick: lookup %.1f ns, envelope_measure %.0f ns\n",
+	   cache.build_sec / cache.misses * 1e3, cache.build_sec_max * 1e3, lookup_sec / ((double)CACHE_CHANGES * CACHE_HOLD) * 1e9,
+	   measure_sec * 1e9);
+
+    /* Dragging the root from settings[0] down by CACHE_DRAG over a second */
+    if (!envelope_table_alloc(&cache, &built))
+    {
+	printf("Failed to allocate an envelope table\n");
+	envelope_cache_free(&cache);
+	return 1;
+    }
+    hits = cache.hits;
+    misses = cache.misses;
+    for (n = 0; n < (uint64_t)(1 / CACHE_TICK); n++)
+    {
+	if (pending)
+	{
+	    envelope_table_build(&cache, &asked, &built); /* The worker's, between ticks */
+	    envelope_cache_put(&cache, &built);
+	    builds++;
+	    pending = false;
+	}
+
+	env = settings[0];
+	for (o = 0; o < OSC_COUNT; o++)
+	    env.amp[o] *= 1 - CACHE_DRAG * n * CACHE_TICK;
+	t0 = now_sec();
+	if ((table = envelope_cache_find(&cache, &env)) != NULL)
+	    sink += envelope_table_at(&cache, table, n)->peak;
+	else
+	{
+	    envelope_cache_measure(&cache, &env, n, &alone);
+	    sink += alone.peak;
+	    asked = env;
+	    pending = true;
+	}
+	sec = now_sec() - t0;
+	if (sec > drag_sec_max)
+	    drag_sec_max = sec;
+    }
+    printf("drag   %.0f%% of the root over a second: %llu hits, %llu misses, %d tables built off the sim; "
+	   "sim side %.1f us a tick at most\n", CACHE_DRAG * 100, (unsigned long long)(cache.hits - hits),
+	   (unsigned long long)(cache.misses - misses), builds, drag_sec_max * 1e6);
+    envelope_table_free(&built);
+    envelope_cache_free(&cache);
+    return !ok;
+}
+
+/* Each period's peak and overload count from the envelope against what the bank renders */
+static int bench_envelope(double seconds)
+{
+    osc_bank_t		bank;
+    envelope_t		env;
+    rng_t		rng;
+    float		out[BENCH_PERIOD];
+    dsp_block_stats_t	stats;
+    envelope_stats_t	measured;
+    long		periods = (long)(seconds * PERIODS_PER_SEC);
+    int			failed = 0, mode, k;
+    long		n;
+
+    printf("== beat envelope: %d ring setups, %.0f s each, tolerance %.0e ==\n", ENVELOPE_SETUPS, seconds, ENVELOPE_TOLERANCE);
+
+    for (mode = OSC_MODE_POLY; mode <= OSC_MODE_PHASOR; mode++)
+    {
+	double	max_err = 0, long_err = 0, render_sec = 0, peak_sec = 0, measure_sec = 0, t0;
+	double	rendered = 0, predicted = 0;
+	int	ok;
+
+	rng_seed(&rng, 1);
+	for (k = 0; k < ENVELOPE_SETUPS; k++)
+	{
+	    float whole = 0, peak;
+
+	    envelope_setup(&bank, mode, &env, &rng);
+	    for (n = 0; n < periods; n++)
+	    {
+		double	first = (double)n * BENCH_PERIOD / BENCH_SAMPLE_RATE;
+		double	last = (double)(n * BENCH_PERIOD + BENCH_PERIOD - 1) / BENCH_SAMPLE_RATE;
+
+		t0 = now_sec();
+		osc_bank_render(&bank, out, BENCH_PERIOD, &stats);
+		render_sec += now_sec() - t0;
+
+		t0 = now_sec();
+		peak = envelope_peak(&env, first, last);
+		peak_sec += now_sec() - t0;
+
+		/* A sample stands for the 1/rate seconds that start at it */
+		t0 = now_sec();
+		envelope_measure(&env, first, first + (double)BENCH_PERIOD / BENCH_SAMPLE_RATE, DSP_OVERLOAD_LEVEL, &measured);
+		measure_sec += now_sec() - t0;
+		predicted += measured.over * BENCH_SAMPLE_RATE;
+		rendered += stats.overloads;
+
+		if (fabs(peak - stats.peak) > max_err)
+		    max_err = fabs(peak - stats.peak);
+		if (stats.peak > whole)
+		    whole = stats.peak;
+	    }
+
+	    /* The whole run in one window */
+	    peak = envelope_peak(&env, 0, (double)(periods * BENCH_PERIOD - 1) / BENCH_SAMPLE_RATE);
+	    if (fabs(peak - whole) > long_err)
+		long_err = fabs(peak - whole);
+	}
+
+	ok = max_err <= ENVELOPE_TOLERANCE && long_err <= ENVELOPE_TOLERANCE && fabs(predicted - rendered) <= ENVELOPE_OVER_TOLERANCE * rendered;
+	printf("%-6s %s  peak max |err| %.2e per period, %.2e whole run  overloads %.0f rendered, %.0f predicted\n",
+	       osc_mode_name(mode), ok ? "PASS" : "FAIL", max_err, long_err, rendered, predicted);
+	printf("%-6s per %d-frame period: render %.2f us, envelope_peak %.2f us, envelope_measure %.2f us\n", osc_mode_name(mode),
+	       BENCH_PERIOD, render_sec / (ENVELOPE_SETUPS * periods) * 1e6, peak_sec / (ENVELOPE_SETUPS * periods) * 1e6,
+	       measure_sec / (ENVELOPE_SETUPS * periods) * 1e6);
+	failed |= !ok;
+    }
+    return failed | bench_envelope_cache();
+}
+
+/* ==================== Time warp ==================== */
+
+#define WARP_CONFIGS 24
+#define WARP_SEEDS 8
+#define WARP_QUANTITIES 5
+#define WARP_TOLERANCE 0.01 /* Share of each quantity's range */
+/* With the drains on, jumps heat the cooler with the mean of their spikes, which it sheds a little differently */
+#define WARP_SEED_TOLERANCE 0.02
+/* With the drains on, one battery running dry at the wrong moment can cost the engine all its health, so a config's
+ * runs split into survivors and wrecks. Seed means that far apart are allowed to differ by this many standard errors.
+ */
+#define WARP_SIGMAS 4.0
+
+static const char *warp_quantities[WARP_QUANTITIES] = {"temp", "health", "fuel", "battery", "caps"};
+
+/* The audio held steady: the same output power and overloaded samples every step */
+typedef struct warp_audio_s
+{
+    float	power;
+    uint32_t	overloads;
+    double	overheat_time;	/* First time the cooler was over MAX_COOLER_TEMP, < 0 if never */
+    double	dead_time;
+} warp_audio_t;
+
+static void warp_watch(warp_audio_t *a, const sim_state_t *sim)
+{
+    if (a->overheat_time < 0 && sim->cooler_temp > MAX_COOLER_TEMP)
+	a->overheat_time = sim->time;
+    if (a->dead_time < 0 && sim->engine_health <= 0)
+	a->dead_time = sim->time;
+}
+
+static uint32_t warp_audio(sim_state_t *sim, unsigned changed, void *ctx)
+{
+    warp_audio_t *a = ctx;
+
+    (void)changed;
+    warp_watch(a, sim);
+    sim->total_output_power = a->power;
+    sim->engine_overload = a->overloads > 0;
+    return a->overloads;
+}
+
+/* A random config that runs for hours: low enough input power that the fuel lasts a while, sometimes overloading */
+static void warp_setup(sim_state_t *sim, warp_audio_t *audio, rng_t *rng, uint64_t seed, bool drains)
+{
+    int i;
+
+    sim_init(sim, seed);
+    sim->ring_power[SIM_RING_ROOT] = 0.05 + 0.3 * rng_uniform(rng);
+    for (i = SIM_RING_Q; i < SIM_RING_COUNT; i++)
+	sim->ring_power[i] = rng_uniform(rng);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	sim_apply(sim, SIM_CMD_CAP_SIZE, i, rng_range(rng, 0, 2));
+	sim_apply(sim, SIM_CMD_CAP_GRADE, i, rng_range(rng, 0, 2));
+	sim_apply(sim, SIM_CMD_TAP_DEST, i, rng_range(rng, 0, SIM_DRAIN_COUNT - 1));
+    }
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	sim->drains[i].enabled = drains;
+
+    audio->power = 1.2 * rng_uniform(rng);
+    audio->overloads = rng_range(rng, 0, 3) == 0 ? rng_range(rng, 1, 60) : 0;
+    audio->overheat_time = -1;
+    audio->dead_time = -1;
+}
+
+static void warp_fine(sim_state_t *sim, warp_audio_t *audio, double seconds)
+{
+    long	n, steps = lround(seconds / SIM_DT);
+    unsigned	changed = 0;
+
+    for (n = 0; n < steps; n++)
+    {
+	uint32_t o = warp_audio(sim, changed, audio);
+
+	if (o)
+	    sim_audio_overload(sim, o);
+	changed = sim_step(sim, SIM_DT);
+    }
+    warp_watch(audio, sim);
+}
+
+static void warp_run(sim_state_t *sim, warp_audio_t *audio, double seconds, sim_warp_t *w)
+{
+    double end = sim->time + seconds;
+
+    while (sim->time < end - SIM_DT / 2)
+    {
+	unsigned events = sim_warp(sim, end - sim->time, w);
+
+	/* A jump only stops on the far side of the event, so this is when it happened */
+	if (events & SIM_WARP_OVERHEAT && audio->overheat_time < 0)
+	    audio->overheat_time = sim->time;
+	if (events & SIM_WARP_DEAD && audio->dead_time < 0)
+	    audio->dead_time = sim->time;
+    }
+    warp_watch(audio, sim);
+}
+
+/* Seconds between two event times, or the whole run if only one of them happened */
+static double event_err(double a, double b, double seconds)
+{
+    if ((a < 0) != (b < 0))
+	return seconds;
+    return a < 0 ? 0 : fabs(a - b);
+}
+
+/* A capacitor ground down by overfilling ends up frozen at ~0.001 health or dead depending on the last few float roundings
+ * of its health, and which one moves the cooler a few percent. The warp can't promise to make the same call.
+ */
+static bool warp_cap_call(const sim_state_t *a, const sim_state_t *b)
+{
+    int k;
+
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+	if ((a->taps[k].cap.health > 0) != (b->taps[k].cap.health > 0))
+	    return true;
+    return false;
+}
+
+/* Warped runs against stepped ones, over hours of game time. With the drains off everything is deterministic and has to
+ * agree run for run, other than warp_cap_call. With them on the two are different draws of the same random run, so only
+ * the averages over seeds are compared.
+ */
+static int bench_warp(double hours)
+{
+    double	seconds = hours * 3600;
+    int		failed = 0, drains;
+
+    printf("== time warp: %d configs, %.1f game-hours each, burst %.1f s, jumps up to %.0f s ==\n", WARP_CONFIGS, hours,
+	   SIM_WARP_BURST, SIM_WARP_MAX_JUMP);
+
+    for (drains = 0; drains <= 1; drains++)
+    {
+	int	seeds = drains ? WARP_SEEDS : 1;
+	double	fine_sec = 0, warp_sec = 0, t0;
+	double	errs[WARP_QUANTITIES] = {0}, sigmas[WARP_QUANTITIES] = {0}, event_max = 0;
+	double	rk_steps = 0, jumped = 0;
+	int	overheats[2] = {0, 0}, deaths[2] = {0, 0}, calls = 0, c, k, m, q, ok = 1;
+	rng_t	rng;
+
+	rng_seed(&rng, 3);
+	for (c = 0; c < WARP_CONFIGS; c++)
+	{
+	    double  sums[2][WARP_QUANTITIES] = {{0}}, squares[2][WARP_QUANTITIES] = {{0}};
+	    bool    called = false;
+	    uint64_t config = rng_next(&rng);
+
+	    for (k = 0; k < seeds; k++)
+	    {
+		sim_state_t	sims[2];
+		warp_audio_t	audio[2];
+		sim_warp_t	w;
+		rng_t		r;
+
+		for (m = 0; m < 2; m++)
+		{
+		    rng_seed(&r, config);
+		    warp_setup(&sims[m], &audio[m], &r, k + 1, drains);
+		}
+
+		t0 = now_sec();
+		warp_fine(&sims[0], &audio[0], seconds);
+		fine_sec += now_sec() - t0;
+
+		sim_warp_init(&w, SIM_DT, warp_audio, &audio[1]);
+		t0 = now_sec();
+		warp_run(&sims[1], &audio[1], seconds, &w);
+		warp_sec += now_sec() - t0;
+		rk_steps += w.rk_steps;
+		jumped += w.jumped;
+
+		for (m = 0; m < 2; m++)
+		{
+		    const sim_state_t *s = &sims[m];
+		    double  x[WARP_QUANTITIES];
+
+		    x[0] = s->cooler_temp / MAX_COOLER_TEMP;
+		    x[1] = s->engine_health;
+		    x[2] = s->fuel_level / MAX_FUEL_LEVEL;
+		    x[3] = s->tap_bat.cap.charge / MAX_BAT_CHARGE;
+		    x[4] = (s->taps[0].cap.health + s->taps[1].cap.health + s->taps[2].cap.health) / 3;
+		    for (q = 0; q < WARP_QUANTITIES; q++)
+		    {
+			sums[m][q] += x[q];
+			squares[m][q] += x[q] * x[q];
+		    }
+		    overheats[m] += audio[m].overheat_time >= 0;
+		    deaths[m] += audio[m].dead_time >= 0;
+		}
+		if (!drains)
+		{
+		    called = warp_cap_call(&sims[0], &sims[1]);
+		    event_max = fmax(event_max, event_err(audio[0].overheat_time, audio[1].overheat_time, seconds));
+		    event_max = fmax(event_max, event_err(audio[0].dead_time, audio[1].dead_time, seconds));
+		}
+	    }
+
+	    calls += called;
+	    if (called)
+		continue;
+
+	    /* Shares of each quantity's range, and for the seed means, standard errors */
+	    for (q = 0; q < WARP_QUANTITIES; q++)
+	    {
+		double	err = fabs(sums[0][q] - sums[1][q]) / seeds, spread = 0, sigma;
+
+		for (m = 0; m < 2; m++)
+		    spread += fmax(0, squares[m][q] / seeds - (sums[m][q] / seeds) * (sums[m][q] / seeds)) / seeds;
+		sigma = err > 0 ? err / sqrt(spread) : 0;
+		errs[q] = fmax(errs[q], err);
+		if (err > (drains ? WARP_SEED_TOLERANCE : WARP_TOLERANCE))
+		{
+		    sigmas[q] = fmax(sigmas[q], sigma);
+		    ok &= drains && sigma <= WARP_SIGMAS;
+		}
+	    }
+	}
+
+	ok &= event_max <= 0.001 * seconds;
+	printf("%-10s %s  max |err|", drains ? "drains on" : "drains off", ok ? "PASS" : "FAIL");
+	for (q = 0; q < WARP_QUANTITIES; q++)
+	    printf(drains && sigmas[q] > 0 ? " %s %.4f (%.1f sigma)" : " %s %.4f", warp_quantities[q], errs[q], sigmas[q]);
+	printf("%s  overheated %d/%d, died %d/%d\n", drains ? " of seed means" : "", overheats[0], overheats[1], deaths[0],
+	       deaths[1]);
+	if (!drains)
+	    printf("%-10s events within %.2f s, %d configs left out where a capacitor froze in one run and died in the other\n", "",
+		   event_max, calls);
+	printf("%-10s stepped %.1f ms, warped %.2f ms per run (%.0fx), %.1f%% of game time jumped, %.0f RK steps per run\n", "",
+	       fine_sec / (WARP_CONFIGS * seeds) * 1e3, warp_sec / (WARP_CONFIGS * seeds) * 1e3, fine_sec / warp_sec,
+	       jumped / (seconds * WARP_CONFIGS * seeds) * 100, rk_steps / (WARP_CONFIGS * seeds));
+	failed |= !ok;
+    }
+    return failed;
+}
+
+/* ==================== Saved sessions ==================== */
+
+#define SAVE_SHIPS 256
+#define SAVE_STEPS (30 * 240) /* Before the save and again after it */
+#define SAVE_SEEDED (64 * 1024) /* Ships seeded from one save */
+#define SAVE_TIMED 1000
+
+/* A ship saved partway, restored, and both stepped on: they have to stay the same ship. Then the ways a file can be
+ * bad, and what saving, loading and seeding a batch from one save cost.
+ */
+static int bench_save(void)
+{
+    static sim_state_t	a[SAVE_SHIPS], b[SAVE_SHIPS];
+    char		path[] = "/tmp/scpulse-bench-XXXXXX";
+    sim_save_t		save, again, bad;
+    const sim_save_t	*mapped;
+    sim_batch_t		batch;
+    double		phase[SIM_RING_COUNT], got_phase[SIM_RING_COUNT];
+    double		t0, write_us, map_us, restore_ns;
+    int			failed = 0, differ = 0, rejected = 0, i, n, k, fd;
+    FILE		*f;
+
+    printf("== saved sessions: %d ships saved after %d steps and stepped %d more ==\n", SAVE_SHIPS, SAVE_STEPS, SAVE_STEPS);
+
+    if ((fd = mkstemp(path)) < 0)
+    {
+	perror(path);
+	return 1;
+    }
+    close(fd);
+
+    for (i = 0; i < SAVE_SHIPS; i++)
+    {
+	batch_setup(&a[i], i, SAVE_SHIPS);
+	a[i].math = (sim_math_e)(i % SIM_MATH_COUNT);
+	a[i].power = (sim_power_e)(i / SIM_MATH_COUNT % SIM_POWER_COUNT);
+	a[i].thermal = (sim_thermal_e)(i / (SIM_MATH_COUNT * SIM_POWER_COUNT) % SIM_THERMAL_COUNT);
+	for (n = 0; n < SAVE_STEPS; n++)
+	    sim_step(&a[i], SIM_DT);
+	for (k = 0; k < SIM_RING_COUNT; k++)
+	    phase[k] = (i * SIM_RING_COUNT + k) / (double)(SAVE_SHIPS * SIM_RING_COUNT);
+
+	sim_save_fill(&save, &a[i], phase);
+	if (!sim_save_write(&save, path) || (mapped = sim_save_map(path)) == NULL)
+	{
+	    printf("ship %d: couldn't write and map %s\n", i, path);
+	    failed = 1;
+	    break;
+	}
+	sim_save_restore(mapped, &b[i], got_phase);
+	sim_save_unmap(mapped);
+
+	/* Every field back as it was, then the same steps from there */
+	sim_save_fill(&again, &b[i], got_phase);
+	if (memcmp(&save, &again, sizeof(save)) || memcmp(phase, got_phase, sizeof(phase)) || b[i].math != a[i].math ||
+	    b[i].power != a[i].power || b[i].thermal != a[i].thermal)
+	    differ++;
+	else
+	    for (n = 0; n < SAVE_STEPS; n++)
+		if (sim_step(&a[i], SIM_DT) != sim_step(&b[i], SIM_DT) || !sim_same(&a[i], &b[i]))
+		{
+		    differ++;
+		    break;
+		}
+    }
+    printf("round trip: %d/%d ships differ from the ones never saved\n", differ, SAVE_SHIPS);
+    failed |= differ != 0;
+
+    /* Damaged in the body, from another version, the wrong size, or cut short on disk */
+    sim_save_fill(&save, &a[0], NULL);
+    bad = save;
+    ((uint8_t *)&bad)[sizeof(bad) / 2] ^= 1;
+    rejected += !sim_save_valid(&bad, sizeof(bad));
+    bad = save;
+    bad.version++;
+    rejected += !sim_save_valid(&bad, sizeof(bad));
+    rejected += !sim_save_valid(&save, sizeof(save) - 1);
+    if ((f = fopen(path, "wb")) != NULL)
+    {
+	fwrite(&save, sizeof(save) / 2, 1, f);
+	fclose(f);
+    }
+    rejected += (mapped = sim_save_map(path)) == NULL;
+    sim_save_unmap(mapped);
+    printf("bad files: %d/4 turned down, the good one %s\n", rejected, sim_save_valid(&save, sizeof(save)) ? "taken" : "turned down");
+    failed |= rejected != 4 || !sim_save_valid(&save, sizeof(save));
+
+    /* Costs */
+    t0 = now_sec();
+    for (i = 0; i < SAVE_TIMED; i++)
+	sim_save_write(&save, path);
+    write_us = (now_sec() - t0) * 1e6 / SAVE_TIMED;
+    t0 = now_sec();
+    for (i = 0; i < SAVE_TIMED; i++)
+    {
+	if ((mapped = sim_save_map(path)) == NULL)
+	    break;
+	sim_save_restore(mapped, &b[0], NULL);
+	sim_save_unmap(mapped);
+    }
+    map_us = (now_sec() - t0) * 1e6 / SAVE_TIMED;
+
+    /* One save, many futures: a whole batch from the same moment with a generator each */
+    mapped = sim_save_map(path);
+    if (mapped == NULL || !sim_batch_init(&batch, SAVE_SEEDED))
+    {
+	printf("couldn't map %s for seeding\n", path);
+	remove(path);
+	return 1;
+    }
+    t0 = now_sec();
+    for (i = 0; i < SAVE_SEEDED; i++)
+    {
+	sim_save_restore(mapped, &b[0], NULL);
+	rng_seed(&b[0].rng, i);
+	b[0].power = SIM_POWER_TAPS; /* The save's ship may route with the flow network, which the batch doesn't */
+	sim_batch_add(&batch, &b[0]);
+    }
+    restore_ns = (now_sec() - t0) * 1e9 / SAVE_SEEDED;
+    sim_batch_free(&batch);
+    sim_save_unmap(mapped);
+    remove(path);
+
+    printf("%zu bytes: write %.1f us, map and restore %.1f us, %.0f ns a ship seeding a batch of %d from one save\n",
+	   sizeof(save), write_us, map_us, restore_ns, SAVE_SEEDED);
+    return failed;
+}
+
+/* ==================== Input journal ==================== */
+
+#define REPLAY_RATE 240 /* The game's SIM_RATE */
+#define REPLAY_DIVIDER 16
+#define REPLAY_RAMP_MS 20
+#define REPLAY_BEAT_PERIOD 20.0
+#define REPLAY_CMD_ODDS 240 /* A command every this many ticks on average, a busy player */
+#define REPLAY_WARP_TICKS (30 * 240) /* Warps come and go this often */
+#define REPLAY_RUNS 5
+
+static const int replay_warp_factors[] = {1, 10, 1, 100}; /* In turn, REPLAY_WARP_TICKS each */
+
+/* The game's sim thread and audio without the window or the threads: what sim_tick and warp_audio do in scpulse.c,
+ * with the audio rendered a tick's worth at a time the way scpulse-sweep does, and the worker's beat tables built
+ * between ticks
+ */
+typedef struct replay_game_s
+{
+    sim_state_t		sim;
+    engine_audio_t	ea;
+    envelope_cache_t	beats;
+    envelope_t		beat_env;
+    const envelope_table_t *beat_table;
+    envelope_table_t	beat_built;
+    bool		beat_asked;
+    sim_warp_t		warp;
+    double		warp_over;
+    sim_journal_t	journal;
+
+    float		peak;	    /* What the audio posts to sim_link */
+    bool		overload;
+    uint32_t		overloads;
+} replay_game_t;
+
+static void replay_post(replay_game_t *g, unsigned changed)
+{
+    int r;
+
+    for (r = 0; r < SIM_RING_COUNT; r++)
+    {
+	if (changed & SIM_CHANGED_POWER)
+	    osc_bank_post(&g->ea.bank, &g->ea.params, OSC_PARAM_AMPLITUDE, r, sim_ring_amplitude(&g->sim, r), 0);
+	if ((changed & SIM_CHANGED_FREQ) && r != SIM_RING_ROOT)
+	    osc_bank_post(&g->ea.bank, &g->ea.params, OSC_PARAM_FREQ, r, g->sim.ring_freq[r], 0);
+    }
+    envelope_set_rings(&g->beat_env, &g->sim);
+    g->beat_table = envelope_cache_find(&g->beats, &g->beat_env);
+    g->beat_asked |= g->beat_table == NULL;
+}
+
+/* beat_take, with the worker's build of the setting asked for */
+static void replay_game_take(replay_game_t *g)
+{
+    if (!g->beat_asked)
+	return;
+    envelope_table_build(&g->beats, &g->beat_env, &g->beat_built);
+    envelope_cache_put(&g->beats, &g->beat_built);
+    g->beat_table = envelope_cache_find(&g->beats, &g->beat_env);
+    g->beat_asked = false;
+}
+
+static uint32_t replay_game_warp_audio(sim_state_t *s, unsigned changed, void *ctx)
+{
+    replay_game_t   *g = ctx;
+    envelope_tick_t tick;
+    uint64_t	    n = (uint64_t)llround(s->time * REPLAY_RATE);
+    uint32_t	    overloads;
+
+    if (changed)
+	replay_post(g, changed);
+    if (g->beat_table != NULL)
+	tick = *envelope_table_at(&g->beats, g->beat_table, n);
+    else
+	envelope_cache_measure(&g->beats, &g->beat_env, n, &tick);
+
+    g->warp_over += tick.over * BENCH_SAMPLE_RATE;
+    overloads = (uint32_t)g->warp_over;
+    g->warp_over -= overloads;
+    s->engine_overload = overloads > 0;
+    s->total_output_power = tick.peak;
+    return overloads;
+}
+
+static bool replay_game_init(replay_game_t *g, uint64_t seed)
+{
+    int i;
+
+    memset(g, 0, sizeof(*g));
+    sim_init(&g->sim, seed);
+    g->peak = g->sim.total_output_power;
+    g->overload = g->sim.engine_overload;
+
+    if (!engine_audio_init(&g->ea, BENCH_SAMPLE_RATE, REPLAY_DIVIDER, BENCH_PERIOD))
+	return false;
+    osc_bank_set_mode(&g->ea.bank, OSC_MODE_PHASOR);
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	osc_bank_set_freq(&g->ea.bank, i, g->sim.ring_freq[i]);
+    osc_bank_set_ramp(&g->ea.bank, g->ea.bank.sample_rate * REPLAY_RAMP_MS / 1000);
+    if (!envelope_cache_init(&g->beats, 1.0 / REPLAY_RATE, REPLAY_BEAT_PERIOD, DSP_OVERLOAD_LEVEL, 1 << 20) ||
+	!envelope_table_alloc(&g->beats, &g->beat_built))
+	return false;
+    replay_post(g, SIM_CHANGED_POWER | SIM_CHANGED_FREQ);
+    sim_warp_init(&g->warp, 1.0 / REPLAY_RATE, replay_game_warp_audio, g);
+    return sim_journal_init(&g->journal, &g->sim, REPLAY_RATE, BENCH_SAMPLE_RATE, REPLAY_BEAT_PERIOD, DSP_OVERLOAD_LEVEL);
+}
+
+static void replay_game_free(replay_game_t *g)
+{
+    engine_audio_uninit(&g->ea);
+    envelope_cache_free(&g->beats);
+    envelope_table_free(&g->beat_built);
+    sim_journal_free(&g->journal);
+}
+
+/* Something a player might do: mostly working the rings, now and then the taps, the drains, fuel and repairs */
+static void replay_player(replay_game_t *g, rng_t *rng, sim_cmd_e *cmd, int *index, float *value)
+{
+    switch (rng_range(rng, 0, 9))
+    {
+    case 0:
+    case 1:
+    case 2:
+	*cmd = SIM_CMD_POWER;
+	*index = rng_range(rng, 0, SIM_RING_COUNT - 1);
+	*value = *index == SIM_RING_ROOT ? 0.1 + 0.3 * rng_uniform(rng) : rng_uniform(rng);
+	break;
+    case 3:
+    case 4:
+	*cmd = SIM_CMD_FREQ;
+	*index = rng_range(rng, SIM_RING_Q, SIM_RING_COUNT - 1);
+	*value = g->sim.ring_freq[SIM_RING_ROOT] + 4 * rng_uniform(rng) - 2;
+	break;
+    case 5:
+	*cmd = SIM_CMD_CAP_SIZE + rng_range(rng, 0, 2);
+	*index = rng_range(rng, 0, SIM_TAP_COUNT - 1);
+	*value = rng_range(rng, 0, 2);
+	break;
+    case 6:
+	*cmd = SIM_CMD_DRAIN_ENABLE;
+	*index = rng_range(rng, 0, SIM_DRAIN_COUNT - 1);
+	*value = rng_range(rng, 0, 1);
+	break;
+    case 7:
+	*cmd = SIM_CMD_REFUEL;
+	*index = 0;
+	*value = 0;
+	break;
+    case 8:
+	*cmd = SIM_CMD_REPAIR;
+	*index = 0;
+	*value = 0;
+	break;
+    default:
+	*cmd = SIM_CMD_RANDOMIZE_DRAINS;
+	*index = 0;
+	*value = 0;
+	break;
+    }
+}
+
+/* One of sim_tick's ticks, with the audio that played up to it */
+static void replay_game_tick(replay_game_t *g, rng_t *player, uint64_t n)
+{
+    uint64_t		due = (n + 1) * BENCH_SAMPLE_RATE / REPLAY_RATE;
+    uint64_t		rendered = n * BENCH_SAMPLE_RATE / REPLAY_RATE;
+    float		out[BENCH_PERIOD];
+    dsp_block_stats_t	stats;
+    unsigned		changed = 0;
+    uint32_t		overloads;
+    int			factor = replay_warp_factors[n / REPLAY_WARP_TICKS % (sizeof(replay_warp_factors) / sizeof(int))];
+
+    /* The audio thread's side. Blocks end between ticks; close enough to the callback's timing for a bench. */
+    for (; rendered < due; rendered += BENCH_PERIOD)
+    {
+	engine_audio_process(&g->ea, out, BENCH_PERIOD, &stats);
+	g->peak = stats.peak;
+	g->overload = stats.overloads > 0;
+	g->overloads += stats.overloads;
+    }
+
+    replay_game_take(g);
+    if (rng_range(player, 0, REPLAY_CMD_ODDS - 1) == 0)
+    {
+	sim_cmd_e   cmd;
+	int	    index;
+	float	    value;
+
+	replay_player(g, player, &cmd, &index, &value);
+	changed |= sim_apply(&g->sim, cmd, index, value);
+	sim_journal_cmd(&g->journal, cmd, index, value);
+	g->warp.averaged = 0;
+    }
+    sim_journal_warp(&g->journal, factor);
+    g->sim.engine_overload = g->overload;
+    g->sim.total_output_power = g->peak;
+    overloads = g->overloads;
+    g->overloads = 0;
+
+    if (factor > 1)
+    {
+	sim_journal_audio(&g->journal, g->sim.total_output_power, g->sim.engine_overload, 0);
+	sim_warp(&g->sim, (double)factor / REPLAY_RATE, &g->warp);
+	changed |= g->warp.changed;
+	g->warp.changed = 0;
+    }
+    else
+    {
+	sim_journal_audio(&g->journal, g->sim.total_output_power, g->sim.engine_overload, overloads);
+	if (overloads)
+	    sim_audio_overload(&g->sim, overloads);
+	changed |= sim_step(&g->sim, 1.0 / REPLAY_RATE);
+    }
+    if (changed)
+	replay_post(g, changed);
+    sim_journal_tick(&g->journal);
+}
+
+/* A replay of head to its end, false if it didn't get there */
+static bool replay_run(sim_replay_t *r, const sim_journal_header_t *head, const uint8_t *events)
+{
+    if (!sim_replay_init(r, head, events))
+	return false;
+    while (sim_replay_tick(r))
+	;
+    return !r->bad && r->tick == head->ticks;
+}
+
+/* A session played with the audio rendered and a player at the controls, warping now and then, recorded as it goes. Its
+ * replay, from memory and from the file, has to end on exactly the sim the session did.
+ */
+static int bench_replay(double minutes)
+{
+    static replay_game_t    g;
+    static sim_replay_t	    r;
+    char		    path[] = "/tmp/scpulse-bench-XXXXXX";
+    const sim_journal_header_t *mapped;
+    rng_t		    player;
+    uint64_t		    ticks = (uint64_t)(minutes * 60 * REPLAY_RATE), n;
+    double		    t0, record_sec, replay_sec = 0, game_sec;
+    int			    failed = 0, fd, i;
+    bool		    memory_same, file_same, rejected;
+    FILE		    *f;
+
+    printf("== input journal: %.1f minutes of play, warps of %ds every %ds, replayed ==\n", minutes,
+	   REPLAY_WARP_TICKS / REPLAY_RATE, (int)(sizeof(replay_warp_factors) / sizeof(int)) * REPLAY_WARP_TICKS / REPLAY_RATE);
+
+    if ((fd = mkstemp(path)) < 0)
+    {
+	perror(path);
+	return 1;
+    }
+    close(fd);
+    if (!replay_game_init(&g, 7))
+    {
+	fprintf(stderr, "Failed to allocate the session\n");
+	return 1;
+    }
+    rng_seed(&player, 11);
+
+    t0 = now_sec();
+    for (n = 0; n < ticks; n++)
+	replay_game_tick(&g, &player, n);
+    record_sec = now_sec() - t0;
+    game_sec = g.sim.time - g.journal.head.start.time;
+
+    /* From memory, then from the file, REPLAY_RUNS times for the timing */
+    memory_same = replay_run(&r, &g.journal.head, g.journal.events) && sim_same(&r.sim, &g.sim);
+    sim_replay_free(&r);
+    if (!sim_journal_write(&g.journal, path) || (mapped = sim_journal_map(path)) == NULL)
+    {
+	printf("couldn't write and map %s\n", path);
+	remove(path);
+	replay_game_free(&g);
+	return 1;
+    }
+    file_same = true;
+    for (i = 0; i < REPLAY_RUNS; i++)
+    {
+	t0 = now_sec();
+	file_same &= replay_run(&r, mapped, sim_journal_events(mapped)) && sim_same(&r.sim, &g.sim);
+	replay_sec += now_sec() - t0;
+	sim_replay_free(&r);
+    }
+    replay_sec /= REPLAY_RUNS;
+    sim_journal_unmap(mapped);
+    printf("replay ends on the session's sim: from memory %s, from the file %s\n", memory_same ? "yes" : "NO",
+	   file_same ? "yes" : "NO");
+    failed |= !memory_same || !file_same;
+
+    /* A flipped bit in the events */
+    if ((f = fopen(path, "r+b")) != NULL)
+    {
+	fseek(f, sizeof(sim_journal_header_t) + g.journal.head.bytes / 2, SEEK_SET);
+	fputc(~g.journal.events[g.journal.head.bytes / 2], f);
+	fclose(f);
+    }
+    rejected = (mapped = sim_journal_map(path)) == NULL;
+    sim_journal_unmap(mapped);
+    printf("damaged file: %s\n", rejected ? "turned down" : "TAKEN");
+    failed |= !rejected;
+    remove(path);
+
+    printf("%llu ticks, %.1f game-minutes: %llu bytes, %.0f bytes a game-minute of real time\n",
+	   (unsigned long long)ticks, game_sec / 60, (unsigned long long)g.journal.head.bytes,
+	   g.journal.head.bytes / minutes);
+    printf("recorded with audio in %.2f s, replayed in %.3f s: %.0f ticks/s, %.0fx realtime\n", record_sec, replay_sec,
+	   ticks / replay_sec, game_sec / replay_sec);
+
+    replay_game_free(&g);
+    return failed;
+}
+
+/* ==================== Seeking ==================== */
+
+#define SEEK_TARGETS 64
+#define SEEK_BYTES (64 << 20)
+#define SEEK_TIGHT_BYTES (256 << 10) /* Too little for 1 s keyframes over the bench's session, so they thin out */
+
+typedef struct seek_config_s
+{
+    double	interval;   /* Seconds of the session, 0 for no keyframes but the start */
+    size_t	bytes;
+} seek_config_t;
+
+static const seek_config_t seek_configs[] = {
+    {0, SEEK_BYTES}, {60, SEEK_BYTES}, {10, SEEK_BYTES}, {1, SEEK_BYTES}, {1, SEEK_TIGHT_BYTES},
+};
+
+/* A recorded session, seeked to random ticks in random order with keyframes at different intervals. Every seek has to
+ * land on the sim a straight replay had at that tick.
+ */
+static int bench_seek(double minutes)
+{
+    static replay_game_t    g;
+    static sim_replay_t	    r;
+    static sim_seek_t	    sk;
+    static sim_state_t	    want[SEEK_TARGETS];
+    uint64_t		    targets[SEEK_TARGETS], sorted[SEEK_TARGETS], t;
+    uint64_t		    ticks = (uint64_t)(minutes * 60 * REPLAY_RATE), n;
+    rng_t		    player, pick;
+    double		    t0, index_sec, seek_sec, seek_max;
+    int			    failed = 0, c, i, j, wrong;
+
+    printf("== replay seeking: %.0f minutes of play, %d seeks, %zu-byte keyframes ==\n", minutes, SEEK_TARGETS,
+	   sizeof(sim_keyframe_t));
+
+    if (!replay_game_init(&g, 5))
+    {
+	fprintf(stderr, "Failed to allocate the session\n");
+	return 1;
+    }
+    rng_seed(&player, 13);
+    for (n = 0; n < ticks; n++)
+	replay_game_tick(&g, &player, n);
+
+    /* Where a straight replay was at each target */
+    rng_seed(&pick, 17);
+    for (i = 0; i < SEEK_TARGETS; i++)
+	targets[i] = sorted[i] = (uint64_t)(rng_uniform(&pick) * ticks);
+    for (i = 1; i < SEEK_TARGETS; i++)
+	for (j = i; j > 0 && sorted[j - 1] > sorted[j]; j--)
+	{
+	    t = sorted[j];
+	    sorted[j] = sorted[j - 1];
+	    sorted[j - 1] = t;
+	}
+    if (!sim_replay_init(&r, &g.journal.head, g.journal.events))
+    {
+	fprintf(stderr, "Failed to allocate the beat envelope cache\n");
+	return 1;
+    }
+    for (i = 0; i < SEEK_TARGETS; i++)
+    {
+	while (r.tick < sorted[i])
+	    sim_replay_tick(&r);
+	for (j = 0; j < SEEK_TARGETS; j++)
+	    if (targets[j] == sorted[i])
+		want[j] = r.sim;
+    }
+    sim_replay_free(&r);
+
+    for (c = 0; c < (int)(sizeof(seek_configs) / sizeof(seek_configs[0])); c++)
+    {
+	const seek_config_t *cfg = &seek_configs[c];
+	uint64_t interval = cfg->interval > 0 ? (uint64_t)(cfg->interval * REPLAY_RATE) : ticks;
+
+	if (!sim_seek_init(&sk, &g.journal.head, g.journal.events, interval, cfg->bytes))
+	{
+	    fprintf(stderr, "Failed to set up seeking\n");
+	    return 1;
+	}
+	t0 = now_sec();
+	sim_seek_index(&sk);
+	index_sec = now_sec() - t0;
+
+	wrong = 0;
+	seek_sec = seek_max = 0;
+	sk.replayed = 0;
+	for (i = 0; i < SEEK_TARGETS; i++)
+	{
+	    double s;
+
+	    t0 = now_sec();
+	    sim_seek(&sk, targets[i]);
+	    s = now_sec() - t0;
+	    seek_sec += s;
+	    if (s > seek_max)
+		seek_max = s;
+	    wrong += !sim_same(&sk.replay.sim, &want[i]) || sk.replay.tick != targets[i];
+	}
+
+	if (cfg->interval > 0)
+	    printf("keyframes every %4.0f s, %5.0f KB max: %5zu kept, every %5.0f s, %6.0f KB, indexed in %.2f s; ",
+		   cfg->interval, cfg->bytes / 1024.0, sk.count, (double)sk.interval / REPLAY_RATE,
+		   sk.count * sizeof(sim_keyframe_t) / 1024.0, index_sec);
+	else
+	    printf("%-93s", "no keyframes but the start: ");
+	printf("seek %7.2f ms mean, %7.2f ms max, %7.0f ticks replayed a seek, %d/%d wrong\n", seek_sec * 1e3 / SEEK_TARGETS,
+	       seek_max * 1e3, (double)sk.replayed / SEEK_TARGETS, wrong, SEEK_TARGETS);
+	failed |= wrong != 0;
+	sim_seek_free(&sk);
+    }
+
+    replay_game_free(&g);
+    return failed;
+}
+
+/* ==================== Power routing ==================== */
+
+#define FLOW_NETS 10000
+#define FLOW_SHIPS 256
+#define FLOW_FLEET_SOLVES (FLOW_SHIPS / 4)
+#define FLOW_BIG_SHIPS 4096
+#define FLOW_BIG_CAPS 24 /* Per ship: two to each drain, the next drain's two as a second tier, then the battery */
+#define FLOW_BIG_DRAINS 12
+#define FLOW_BIG_TICKS 2400
+#define FLOW_BIG_SOLVES (FLOW_BIG_SHIPS / 4) /* A flow_budget_t's full solves a tick */
+#define FLOW_BIG_LATE (FLOW_BIG_TICKS / 100) /* Ticks over budget a run may have: what the scheduler takes */
+#define FLOW_TOLERANCE 1e-4 /* Relative, what float sums in a different order come to */
+
+static const float flow_thresholds[] = {0, 0.005, 0.02, 0.05, 0.2};
+
+static bool flow_near(double a, double b)
+{
+    return fabs(a - b) <= FLOW_TOLERANCE * (fabs(b) > 1e-3 ? fabs(b) : 1e-3);
+}
+
+/* Random shapes and numbers. A solution never gives more than a source has or a sink wants, and hands out exactly what
+ * it says it did. Sinks left short with charge still on one of their edges are down to FLOW_ROUNDS, and only counted.
+ */
+static int flow_check_nets(void)
+{
+    static flow_net_t	net;
+    rng_t		rng;
+    double		given[FLOW_MAX_SOURCES];
+    int			bad = 0, starved = 0, i, s, e, k;
+
+    rng_seed(&rng, 17);
+    for (i = 0; i < FLOW_NETS; i++)
+    {
+	int sources = 1 + rng_range(&rng, 0, FLOW_MAX_SOURCES - 1);
+	int sinks = 1 + rng_range(&rng, 0, FLOW_MAX_SINKS - 1);
+
+	flow_init(&net);
+	for (s = 0; s < sources; s++)
+	    flow_source(&net, rng_range(&rng, 0, 3) == 0 ? 0 : rng_range(&rng, 0, 1000) / 100.0f);
+	for (s = 0; s < sinks; s++)
+	{
+	    int edges = rng_range(&rng, 1, 4), tier = 0;
+
+	    flow_sink(&net, rng_range(&rng, 0, 1000) / 100.0f);
+	    for (e = 0; e < edges && net.edges < FLOW_MAX_EDGES; e++)
+	    {
+		tier += rng_range(&rng, 0, 2) == 0;
+		flow_edge(&net, rng_range(&rng, 0, sources - 1), tier);
+	    }
+	}
+	flow_solve(&net);
+
+	memset(given, 0, sizeof(given));
+	for (s = 0; s < net.sinks; s++)
+	{
+	    double got = 0;
+	    bool   live = false;
+
+	    for (e = net.first[s]; e < net.first[s + 1]; e++)
+	    {
+		bad += net.flow[e] < 0;
+		got += net.flow[e];
+		given[net.edge[e].source] += net.flow[e];
+	    }
+	    bad += !flow_near(got + net.unmet[s], net.demand[s]) && net.unmet[s] > 0;
+	    bad += got > net.demand[s] * (1 + FLOW_TOLERANCE);
+	    for (e = net.first[s]; e < net.first[s + 1]; e++)
+		live |= net.left[net.edge[e].source] > 0;
+	    starved += net.unmet[s] > 0 && live;
+	}
+	for (k = 0; k < net.sources; k++)
+	    bad += net.left[k] < 0 || !flow_near(given[k] + net.left[k], net.supply[k]);
+    }
+    printf("%d random networks: %d broken constraints, %d sinks short with charge in reach after %d rounds\n", FLOW_NETS,
+	   bad, starved, FLOW_ROUNDS);
+    return bad != 0;
+}
+
+/* One step from the same state each way, with a full battery so nothing goes short. The router has to deliver what the
+ * taps do, drawing no more from the battery. Only where each drain has one tap at most: taps sharing a drain between
+ * them can be handed more than it asked for, which the router doesn't copy.
+ */
+static int flow_check_taps(void)
+{
+    sim_state_t a, b;
+    int		differ = 0, checked = 0, i, n, d, t;
+
+    for (i = 0; i < FLOW_SHIPS; i++)
+    {
+	batch_setup(&a, i, FLOW_SHIPS);
+	for (t = 0; t < SIM_TAP_COUNT; t++)
+	    sim_apply(&a, SIM_CMD_TAP_DEST, t, (t + i) % SIM_DRAIN_COUNT);
+	for (d = 0; d < SIM_DRAIN_COUNT; d++)
+	    if (a.route_first[d + 1] - a.route_first[d] > 1)
+		break;
+	if (d < SIM_DRAIN_COUNT)
+	    continue; /* More taps than drains */
+	checked++;
+	for (n = 0; n < i * 37; n++)
+	    sim_step(&a, SIM_DT);
+	a.tap_bat.cap.charge = MAX_BAT_CHARGE;
+	b = a;
+	b.power = SIM_POWER_FLOW;
+	b.flow.memo.threshold = 0;
+	sim_step(&a, SIM_DT);
+	sim_step(&b, SIM_DT);
+
+	for (d = 0; d < SIM_DRAIN_COUNT; d++)
+	    differ += !flow_near(b.drains[d].delivered, a.drains[d].delivered) || b.drains[d].enabled != a.drains[d].enabled;
+	differ += b.tap_bat.cap.charge < a.tap_bat.cap.charge - FLOW_TOLERANCE;
+    }
+    printf("against the taps, battery full, a tap a drain: %d/%d ships differ\n", differ, checked);
+    return differ != 0;
+}
+
+/* Whole ships in SIM_POWER_FLOW: how often each threshold solves, what a step costs, and how far the ships end up from
+ * ones that solved every step
+ */
+static void flow_thresholds_run(double seconds)
+{
+    static sim_state_t	sims[FLOW_SHIPS], exact[FLOW_SHIPS];
+    long		steps = (long)(seconds / SIM_DT), n;
+    double		t0, ns, taps_ns = 0;
+    unsigned		c;
+    int			i;
+
+    for (c = 0; c <= sizeof(flow_thresholds) / sizeof(flow_thresholds[0]); c++)
+    {
+	double	battery = 0, caps = 0, cooler = 0;
+	long	solves = 0, reuses = 0;
+	bool	taps = c == 0;
+
+	for (i = 0; i < FLOW_SHIPS; i++)
+	{
+	    batch_setup(&sims[i], i, FLOW_SHIPS);
+	    sims[i].power = taps ? SIM_POWER_TAPS : SIM_POWER_FLOW;
+	    sims[i].flow.memo.threshold = taps ? 0 : flow_thresholds[c - 1];
+	}
+	t0 = now_sec();
+	for (i = 0; i < FLOW_SHIPS; i++)
+	    for (n = 0; n < steps; n++)
+		sim_step(&sims[i], SIM_DT);
+	ns = (now_sec() - t0) * 1e9 / ((double)FLOW_SHIPS * steps);
+	if (taps)
+	{
+	    taps_ns = ns;
+	    printf("taps:            %6.1f ns/step\n", ns);
+	    continue;
+	}
+
+	if (c == 1)
+	    memcpy(exact, sims, sizeof(exact));
+	for (i = 0; i < FLOW_SHIPS; i++)
+	{
+	    solves += sims[i].flow.memo.solves;
+	    reuses += sims[i].flow.memo.reuses;
+	    battery += fabs(sims[i].tap_bat.cap.charge - exact[i].tap_bat.cap.charge);
+	    caps += fabs(sims[i].taps[0].cap.charge - exact[i].taps[0].cap.charge);
+	    cooler += fabs(sims[i].cooler_temp - exact[i].cooler_temp);
+	}
+	printf("flow, within %4.1f%%: %6.1f ns/step (%+5.1f), %5.1f%% of steps solved; after %.0f s, mean |diff| from "
+	       "solving every step: battery %.4f, tap 1 %.4f, cooler %.3f C\n",
+	       flow_thresholds[c - 1] * 100, ns, ns - taps_ns, 100.0 * solves / (solves + reuses), seconds,
+	       battery / FLOW_SHIPS, caps / FLOW_SHIPS, cooler / FLOW_SHIPS);
+    }
+}
+
+/* The same ships a tick at a time, sharing FLOW_FLEET_SOLVES full solves a tick through flow.budget the way a server's
+ * fleet would. No tick past the first, where every memo is new, may solve more than that.
+ */
+static int flow_fleet(double seconds)
+{
+    static sim_state_t	sims[FLOW_SHIPS];
+    flow_budget_t	budget;
+    long		steps = (long)(seconds / SIM_DT), n;
+    uint64_t		solves = 0, reuses = 0, was, now;
+    double		t0, ns;
+    int			over = 0, i;
+
+    flow_budget_init(&budget, FLOW_FLEET_SOLVES);
+    for (i = 0; i < FLOW_SHIPS; i++)
+    {
+	batch_setup(&sims[i], i, FLOW_SHIPS);
+	sims[i].power = SIM_POWER_FLOW;
+	sims[i].flow.budget = &budget;
+    }
+    t0 = now_sec();
+    for (n = 0, was = 0; n < steps; n++, was = now)
+    {
+	flow_budget_tick(&budget);
+	for (i = 0; i < FLOW_SHIPS; i++)
+	    sim_step(&sims[i], SIM_DT);
+	for (i = 0, now = 0; i < FLOW_SHIPS; i++)
+	    now += sims[i].flow.memo.solves;
+	over += n > 0 && now - was > FLOW_FLEET_SOLVES;
+    }
+    ns = (now_sec() - t0) * 1e9 / ((double)FLOW_SHIPS * steps);
+    for (i = 0; i < FLOW_SHIPS; i++)
+    {
+	solves += sims[i].flow.memo.solves;
+	reuses += sims[i].flow.memo.reuses;
+    }
+    printf("flow, within %4.1f%%, %d solves a tick for the fleet: %6.1f ns/step, %5.1f%% of steps solved, %5.1f%% past "
+	   "the cap, %d ticks over it\n", SIM_FLOW_THRESHOLD * 100, FLOW_FLEET_SOLVES, ns,
+	   100.0 * solves / (solves + reuses), 100.0 * budget.deferred / (solves + reuses), over);
+    return over != 0;
+}
+
+typedef struct flow_ship_s
+{
+    float	caps[FLOW_BIG_CAPS];	    /* This tick's, set up outside the timing */
+    float	drains[FLOW_BIG_DRAINS];
+    flow_memo_t	memo;
+    float	supply[FLOW_BIG_CAPS + 1];  /* The latest full solve */
+    float	demand[FLOW_BIG_DRAINS];
+    float	flow[FLOW_MAX_EDGES];
+} flow_ship_t;
+
+/* Bigger ships than the game's, as many as a busy server: FLOW_BIG_CAPS + FLOW_BIG_DRAINS + 1 nodes each, built every
+ * tick the way sim_step does it and routed with flow_route, as route_flow does, against a 240 Hz tick. A threshold past
+ * 0 also shares a flow_budget_t of FLOW_BIG_SOLVES a tick between them, which has to keep all but FLOW_BIG_LATE ticks
+ * inside the tick.
+ */
+static int flow_scale(void)
+{
+    static flow_ship_t	ships[FLOW_BIG_SHIPS];
+    flow_net_t		net;
+    flow_budget_t	budget;
+    rng_t		rng;
+    double		ms, worst;
+    float		sink = 0;
+    unsigned		c;
+    int			i, k, d, n, failed = 0;
+
+    for (c = 0; c < sizeof(flow_thresholds) / sizeof(flow_thresholds[0]); c++)
+    {
+	double	demand = 0, unmet = 0;
+	long	solves = 0;
+	int	late = 0;
+
+	memset(ships, 0, sizeof(ships));
+	for (i = 0; i < FLOW_BIG_SHIPS; i++)
+	    ships[i].memo.threshold = flow_thresholds[c];
+	flow_budget_init(&budget, FLOW_BIG_SOLVES);
+	rng_seed(&rng, 3);
+	worst = 0;
+	ms = 0;
+	for (n = 0; n < FLOW_BIG_TICKS; n++)
+	{
+	    double tick;
+
+	    for (i = 0; i < FLOW_BIG_SHIPS; i++)
+	    {
+		float phase = (n + i) * SIM_DT;
+
+		/* Charged about as fast as they're drawn on, so some run dry at the bottom of the wave */
+		for (k = 0; k < FLOW_BIG_CAPS; k++)
+		    ships[i].caps[k] = (0.5f + 0.5f * sinf(phase * 0.3f + k)) * SIM_DT;
+		/* A spike every so often, like the shields' */
+		for (d = 0; d < FLOW_BIG_DRAINS; d++)
+		    ships[i].drains[d] = (0.5f + 0.2f * sinf(phase + d) + (rng_range(&rng, 0, 999) == 0)) * SIM_DT;
+	    }
+
+	    tick = now_sec();
+	    flow_budget_tick(&budget);
+	    for (i = 0; i < FLOW_BIG_SHIPS; i++)
+	    {
+		flow_ship_t *s = &ships[i];
+
+		flow_init(&net);
+		for (k = 0; k < FLOW_BIG_CAPS; k++)
+		    flow_source(&net, s->caps[k]);
+		flow_source(&net, 50);
+		for (d = 0; d < FLOW_BIG_DRAINS; d++)
+		{
+		    flow_sink(&net, s->drains[d]);
+		    flow_edge(&net, 2 * d, 0);
+		    flow_edge(&net, 2 * d + 1, 0);
+		    flow_edge(&net, 2 * ((d + 1) % FLOW_BIG_DRAINS), 1);
+		    flow_edge(&net, 2 * ((d + 1) % FLOW_BIG_DRAINS) + 1, 1);
+		    flow_edge(&net, FLOW_BIG_CAPS, 2);
+		}
+
+		solves += flow_route(&net, &s->memo, s->supply, s->demand, s->flow, c == 0 ? NULL : &budget);
+		sink += net.flow[0];
+		for (d = 0; d < net.sinks; d++)
+		{
+		    demand += net.demand[d];
+		    unmet += net.unmet[d];
+		}
+	    }
+	    tick = now_sec() - tick;
+	    worst = tick > worst ? tick : worst;
+	    late += tick > SIM_DT;
+	    ms += tick * 1e3 / FLOW_BIG_TICKS;
+	}
+	printf("%d ships of %d nodes, within %4.1f%%: %6.3f ms/tick mean, %6.3f ms worst, %5.1f%% of a %.2f ms tick, "
+	       "%4d ticks over it; %5.1f%% solved, %5.1f%% past the cap; %.4f%% of demand unmet\n",
+	       FLOW_BIG_SHIPS, FLOW_BIG_CAPS + FLOW_BIG_DRAINS + 1, flow_thresholds[c] * 100, ms, worst * 1e3,
+	       100 * ms / (SIM_DT * 1e3), SIM_DT * 1e3, late, 100.0 * solves / ((double)FLOW_BIG_SHIPS * FLOW_BIG_TICKS),
+	       100.0 * budget.deferred / ((double)FLOW_BIG_SHIPS * FLOW_BIG_TICKS), 100 * unmet / demand);
+	failed |= flow_thresholds[c] > 0 && late > FLOW_BIG_LATE;
+    }
+    if (sink < 0)
+	printf("%f\n", sink);
+    return failed;
+}
+
+static int bench_flow(double seconds)
+{
+    int failed = 0;
+
+    printf("== power routing: flow networks against the taps, %.0f s of game time ==\n", seconds);
+    failed |= flow_check_nets();
+    failed |= flow_check_taps();
+    flow_thresholds_run(seconds);
+    failed |= flow_fleet(seconds);
+    failed |= flow_scale();
+    return failed;
+}
+
+/* ==================== Heat conduction ==================== */
+
+#define THERMAL_SHIPS 4096
+#define THERMAL_TICKS 240
+#define THERMAL_GRID_MAX 32
+#define THERMAL_CHECKED 64 /* Ships of the fleet also stepped alone */
+
+static const int thermal_grids[] = {3, 4, 8, 16, 32};
+
+/* An n by n plate, each cell linked to the ones right and below it: the five-point stencil */
+static thermal_net_t thermal_grid(int n, float *capacity, thermal_link_t *link)
+{
+    thermal_net_t   net = {n * n, 0, capacity, link};
+    int		    x, y;
+
+    for (y = 0; y < n; y++)
+	for (x = 0; x < n; x++)
+	{
+	    capacity[y * n + x] = 1;
+	    if (x + 1 < n)
+		link[net.links++] = (thermal_link_t){y * n + x, y * n + x + 1, 40};
+	    if (y + 1 < n)
+		link[net.links++] = (thermal_link_t){y * n + x, (y + 1) * n + x, 40};
+	}
+    return net;
+}
+
+static double thermal_energy(const thermal_net_t *net, const float *temp, int lanes, int lane)
+{
+    double  e = 0;
+    int	    i;
+
+    for (i = 0; i < net->nodes; i++)
+	e += (double)net->capacity[i] * temp[i * lanes + lane];
+    return e;
+}
+
+/* A fleet stepped together has to give each ship what stepping it alone does, and conduction has to keep the heat it
+ * moves
+ */
+static int thermal_check(const thermal_net_t *net, float *temp, float *one, float *flow, rng_t *rng)
+{
+    double  before[THERMAL_CHECKED], leak = 0;
+    int	    differ = 0, i, k, n;
+
+    for (i = 0; i < net->nodes * THERMAL_SHIPS; i++)
+	temp[i] = rng_range(rng, 0, 100000) / 100.0f;
+    for (k = 0; k < THERMAL_CHECKED; k++)
+    {
+	before[k] = thermal_energy(net, temp, THERMAL_SHIPS, k);
+	for (i = 0; i < net->nodes; i++)
+	    one[k * net->nodes + i] = temp[i * THERMAL_SHIPS + k];
+	for (n = 0; n < THERMAL_TICKS; n++)
+	    thermal_step(net, &one[k * net->nodes], flow, 1, SIM_DT);
+    }
+    for (n = 0; n < THERMAL_TICKS; n++)
+	thermal_step(net, temp, flow, THERMAL_SHIPS, SIM_DT);
+
+    for (k = 0; k < THERMAL_CHECKED; k++)
+    {
+	leak = fmax(leak, fabs(thermal_energy(net, temp, THERMAL_SHIPS, k) - before[k]) / before[k]);
+	for (i = 0; i < net->nodes; i++)
+	    differ += !float_same(one[k * net->nodes + i], temp[i * THERMAL_SHIPS + k]);
+    }
+    printf("%4d nodes: %d ships stepped alone, %d temperatures differ from the fleet's; heat kept to %.1e\n", net->nodes,
+	   THERMAL_CHECKED, differ, leak);
+    return differ != 0 || leak > 1e-5;
+}
+
+/* The sim with every component's heat on its own node against all of it in the cooler */
+static void thermal_sims(double seconds)
+{
+    static sim_state_t	sims[FLOW_SHIPS];
+    long		steps = (long)(seconds / SIM_DT), n;
+    int			mode, i, t;
+
+    for (mode = 0; mode < SIM_THERMAL_COUNT; mode++)
+    {
+	double	t0, ns, cooler = 0, cap_temp = 0, cap_health = 0, engine = 0, hottest = 0;
+
+	for (i = 0; i < FLOW_SHIPS; i++)
+	{
+	    batch_setup(&sims[i], i, FLOW_SHIPS);
+	    sims[i].thermal = (sim_thermal_e)mode;
+	}
+	t0 = now_sec();
+	for (i = 0; i < FLOW_SHIPS; i++)
+	    for (n = 0; n < steps; n++)
+		sim_step(&sims[i], SIM_DT);
+	ns = (now_sec() - t0) * 1e9 / ((double)FLOW_SHIPS * steps);
+
+	for (i = 0; i < FLOW_SHIPS; i++)
+	{
+	    cooler += sims[i].cooler_temp / FLOW_SHIPS;
+	    engine += sims[i].engine_health / FLOW_SHIPS;
+	    for (t = 0; t < SIM_TAP_COUNT; t++)
+	    {
+		cap_temp += sims[i].heat_temp[SIM_HEAT_CAP(t)] / (FLOW_SHIPS * SIM_TAP_COUNT);
+		cap_health += sims[i].taps[t].cap.health / (FLOW_SHIPS * SIM_TAP_COUNT);
+		hottest = fmax(hottest, sims[i].heat_temp[SIM_HEAT_CAP(t)]);
+	    }
+	}
+	printf("%-6s %6.1f ns/step; after %.0f s, mean cooler %7.1f C, capacitors %7.1f C (hottest %7.1f C), "
+	       "capacitor health %.4f, engine health %.4f\n",
+	       mode == SIM_THERMAL_GRAPH ? "graph:" : "cooler:", ns, seconds, cooler, cap_temp, hottest, cap_health, engine);
+    }
+}
+
+static int bench_thermal(double seconds)
+{
+    static float	temp[THERMAL_GRID_MAX * THERMAL_GRID_MAX * THERMAL_SHIPS];
+    static float	flow[THERMAL_GRID_MAX * THERMAL_GRID_MAX * THERMAL_SHIPS];
+    static float	one[THERMAL_CHECKED * THERMAL_GRID_MAX * THERMAL_GRID_MAX];
+    float		capacity[THERMAL_GRID_MAX * THERMAL_GRID_MAX];
+    thermal_link_t	link[2 * THERMAL_GRID_MAX * THERMAL_GRID_MAX];
+    thermal_net_t	net;
+    rng_t		rng;
+    unsigned		g;
+    int			failed = 0, i, n;
+
+    printf("== heat conduction: %d ships, %.0f s of game time ==\n", THERMAL_SHIPS, seconds);
+    rng_seed(&rng, 23);
+
+    net = *sim_heat_net();
+    failed |= thermal_check(&net, temp, one, flow, &rng);
+    for (g = 0; g < sizeof(thermal_grids) / sizeof(thermal_grids[0]); g++)
+    {
+	net = thermal_grid(thermal_grids[g], capacity, link);
+	failed |= thermal_check(&net, temp, one, flow, &rng);
+    }
+
+    thermal_sims(seconds);
+
+    /* Grid size against ticks per second, the whole fleet a lane each and one ship at a time */
+    for (g = 0; g <= sizeof(thermal_grids) / sizeof(thermal_grids[0]); g++)
+    {
+	double t0, fleet, alone;
+
+	if (g == 0)
+	    net = *sim_heat_net();
+	else
+	    net = thermal_grid(thermal_grids[g - 1], capacity, link);
+	for (i = 0; i < net.nodes * THERMAL_SHIPS; i++)
+	    temp[i] = rng_range(&rng, 0, 100000) / 100.0f;
+
+	t0 = now_sec();
+	for (n = 0; n < THERMAL_TICKS; n++)
+	    thermal_step(&net, temp, flow, THERMAL_SHIPS, SIM_DT);
+	fleet = (double)THERMAL_SHIPS * THERMAL_TICKS / (now_sec() - t0);
+
+	t0 = now_sec();
+	for (n = 0; n < THERMAL_TICKS / 8; n++)
+	    for (i = 0; i < THERMAL_SHIPS; i++)
+		thermal_step(&net, &temp[i * net.nodes], flow, 1, SIM_DT);
+	alone = (double)THERMAL_SHIPS * (THERMAL_TICKS / 8) / (now_sec() - t0);
+
+	printf("%-9s %4d nodes %4d links, %d substeps: fleet %8.2fM ship-ticks/s (%7.1f ns), %5.1fx one ship at a time, "
+	       "%7.0f ships at 240 Hz\n",
+	       g == 0 ? "ship" : "grid", net.nodes, net.links, thermal_substeps(&net, SIM_DT), fleet * 1e-6, 1e9 / fleet,
+	       fleet / alone, fleet / 240);
+    }
+    return failed;
+}
+
+/* ==================== What-if forecasts ==================== */
+
+#define FORECAST_SECONDS 120.0 /* The game's horizon */
+#define FORECAST_CONFIGS 16
+#define FORECAST_SLACK 0.01 /* Of each quantity's range, besides what drains alone move a stepped run by */
+#define FORECAST_FRAME (1.0 / 60)
+#define FORECAST_DRAG_FRAMES 240 /* Four seconds of a slider being dragged, a new request every frame */
+#define FORECAST_HORIZONS 4
+#define FORECAST_SLICE 16 /* The web build's points a frame */
+
+static const double forecast_horizons[FORECAST_HORIZONS] = {30, 120, 600, 3600};
+
+/* A running engine somewhere in the game's slider ranges, drains on */
+static void forecast_setup(sim_state_t *sim, rng_t *rng, uint64_t seed)
+{
+    int i;
+
+    sim_init(sim, seed);
+    sim->ring_power[SIM_RING_ROOT] = 0.05 + 0.3 * rng_uniform(rng);
+    for (i = SIM_RING_Q; i < SIM_RING_COUNT; i++)
+	sim->ring_power[i] = rng_uniform(rng);
+    sim->ring_freq[SIM_RING_Q] = ROOT_FREQ + 0.07 + 2.63 * rng_uniform(rng);
+    sim->ring_freq[SIM_RING_R] = ROOT_FREQ - 0.81 + 0.7 * rng_uniform(rng);
+    sim->ring_freq[SIM_RING_S] = ROOT_FREQ + (rng_range(rng, 0, 1) ? 1 : -1) * (0.02 + 0.51 * rng_uniform(rng));
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	sim_apply(sim, SIM_CMD_CAP_SIZE, i, rng_range(rng, 0, 2));
+	sim_apply(sim, SIM_CMD_CAP_GRADE, i, rng_range(rng, 0, 2));
+	sim_apply(sim, SIM_CMD_TAP_DEST, i, rng_range(rng, 0, SIM_DRAIN_COUNT - 1));
+    }
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	sim->drains[i].enabled = true;
+}
+
+/* What a forecast stands in for: every step of it, with the same envelope audio */
+static void forecast_stepped(const sim_state_t *from, double seconds, envelope_cache_t *cache, sim_forecast_t *out)
+{
+    sim_state_t		    sim = *from;
+    envelope_t		    env = {{0}};
+    const envelope_table_t  *table = NULL;
+    unsigned		    changed = SIM_CHANGED_POWER;
+    double		    over = 0;
+    long		    n, steps = lround(seconds / SIM_DT);
+    int			    p = 1, i;
+
+    for (n = 0; n < steps; n++)
+    {
+	const envelope_tick_t *tick;
+
+	if (changed & (SIM_CHANGED_POWER | SIM_CHANGED_FREQ))
+	{
+	    envelope_set_rings(&env, &sim);
+	    table = envelope_cache_get(cache, &env);
+	}
+	if (table != NULL)
+	{
+	    tick = envelope_table_at(cache, table, (uint64_t)llround(sim.time / SIM_DT));
+	    over += tick->over * BENCH_SAMPLE_RATE;
+	    sim.engine_overload = (uint32_t)over > 0;
+	    sim.total_output_power = tick->peak;
+	    if ((uint32_t)over)
+		sim_audio_overload(&sim, (uint32_t)over);
+	    over -= (uint32_t)over;
+	}
+	changed = sim_step(&sim, SIM_DT);
+
+	if ((n + 1) * SIM_FORECAST_POINTS == steps * p)
+	{
+	    out->cooler_temp[p] = sim.cooler_temp;
+	    out->battery[p] = sim.tap_bat.cap.charge;
+	    for (i = 0; i < SIM_TAP_COUNT; i++)
+		out->cap_health[i][p] = sim.taps[i].cap.health;
+	    p++;
+	}
+    }
+}
+
+/* Furthest apart two forecasts' curves get, as a share of each one's range */
+static double forecast_err(const sim_forecast_t *a, const sim_forecast_t *b)
+{
+    double  err = 0;
+    int	    p, i;
+
+    for (p = 1; p <= SIM_FORECAST_POINTS; p++)
+    {
+	err = fmax(err, fabs(a->cooler_temp[p] - b->cooler_temp[p]) / MAX_COOLER_TEMP);
+	err = fmax(err, fabs(a->battery[p] - b->battery[p]) / MAX_BAT_CHARGE);
+	for (i = 0; i < SIM_TAP_COUNT; i++)
+	    err = fmax(err, fabs(a->cap_health[i][p] - b->cap_health[i][p]));
+    }
+    return err;
+}
+
+static bool forecaster_setup(sim_forecaster_t *f)
+{
+    if (sim_forecaster_init(f, SIM_DT, BENCH_SAMPLE_RATE, REPLAY_BEAT_PERIOD, DSP_OVERLOAD_LEVEL, 1 << 20))
+	return true;
+    fprintf(stderr, "Failed to allocate the forecast's envelope tables\n");
+    return false;
+}
+
+/* Forecasts against stepping all of it, and what one costs cold (new ring setting) and warm, per horizon. Run in
+ * slices, the first one is cold, and must come out the same as the whole.
+ */
+static int forecast_check(void)
+{
+    static sim_forecast_t   fc, again, sliced, ref, other;
+    _Atomic uint64_t	    latest = 1;
+    sim_forecaster_t	    f;
+    envelope_cache_t	    cache;
+    sim_state_t		    sim, reseeded;
+    rng_t		    rng;
+    double		    err = 0, spread = 0, worst = 0, slice_max = 0;
+    int			    c, h, differ = 0;
+
+    if (!forecaster_setup(&f) || !envelope_cache_init(&cache, SIM_DT, REPLAY_BEAT_PERIOD, DSP_OVERLOAD_LEVEL, 1 << 20))
+	return 1;
+    rng_seed(&rng, 25);
+    for (c = 0; c < FORECAST_CONFIGS; c++)
+    {
+	double	t0;
+	bool	done;
+
+	forecast_setup(&sim, &rng, 2500 + c);
+	t0 = now_sec();
+	sim_forecast_start(&f, &sim, FORECAST_SECONDS, &sliced, 1);
+	do
+	{
+	    done = sim_forecast_more(&f, FORECAST_SLICE);
+	    slice_max = fmax(slice_max, now_sec() - t0);
+	    t0 = now_sec();
+	} while (!done);
+	sim_forecast(&f, &sim, FORECAST_SECONDS, &fc, &latest, 1);
+	sim_forecast(&f, &sim, FORECAST_SECONDS, &again, &latest, 1);
+	differ += memcmp(&fc, &again, sizeof(fc)) != 0 || memcmp(&fc, &sliced, sizeof(fc)) != 0;
+
+	/* Drains flicker at random and the cooler follows them within a second, so a forecast is only as close to the
+	 * stepped run as another seed of it is
+	 */
+	reseeded = sim;
+	rng_seed(&reseeded.rng, 2500 + FORECAST_CONFIGS + c);
+	forecast_stepped(&sim, FORECAST_SECONDS, &cache, &ref);
+	forecast_stepped(&reseeded, FORECAST_SECONDS, &cache, &other);
+	err += forecast_err(&fc, &ref) / FORECAST_CONFIGS;
+	spread += forecast_err(&other, &ref) / FORECAST_CONFIGS;
+	worst = fmax(worst, forecast_err(&fc, &ref));
+    }
+    printf("%d configs, %.0f s ahead: %d of them differ run to run or in slices; against stepping, %.4f of range mean "
+	   "(%.4f worst), another seed %.4f\n", FORECAST_CONFIGS, FORECAST_SECONDS, differ, err, worst, spread);
+    printf("in slices of %d points: %.2f ms worst, the first with the new setting's table; a frame is %.1f ms\n",
+	   FORECAST_SLICE, slice_max * 1e3, FORECAST_FRAME * 1e3);
+
+    for (h = 0; h < FORECAST_HORIZONS; h++)
+    {
+	double cold = 0, warm = 0, cold_max = 0, warm_max = 0;
+
+	for (c = 0; c < FORECAST_CONFIGS; c++)
+	{
+	    double t0;
+
+	    forecast_setup(&sim, &rng, 2600 + c);
+	    t0 = now_sec();
+	    sim_forecast(&f, &sim, forecast_horizons[h], &fc, &latest, 1);
+	    t0 = now_sec() - t0;
+	    cold += t0;
+	    cold_max = fmax(cold_max, t0);
+
+	    t0 = now_sec();
+	    sim_forecast(&f, &sim, forecast_horizons[h], &fc, &latest, 1);
+	    t0 = now_sec() - t0;
+	    warm += t0;
+	    warm_max = fmax(warm_max, t0);
+	}
+	printf("%5.0f s ahead: new ring setting %6.2f ms mean, %6.2f ms worst; setting seen before %6.2f ms mean, "
+	       "%6.2f ms worst; a frame is %.1f ms\n", forecast_horizons[h], cold * 1e3 / FORECAST_CONFIGS,
+	       cold_max * 1e3, warm * 1e3 / FORECAST_CONFIGS, warm_max * 1e3, FORECAST_FRAME * 1e3);
+    }
+    envelope_cache_free(&cache);
+    sim_forecaster_free(&f);
+    return differ > 0 || err > spread + FORECAST_SLACK;
+}
+
+/* The game's worker on its own thread, and a player dragging a slider: one request a frame, only the newest wanted */
+typedef struct forecast_drag_s
+{
+    pthread_mutex_t	lock;
+    sim_state_t		from;	    /* Of the newest request */
+    double		asked[FORECAST_DRAG_FRAMES + 1]; /* now_sec() each request was made, by id */
+    _Atomic uint64_t	latest;
+    _Atomic bool	running;
+    sim_forecaster_t	f;
+
+    int			answered;
+    int			cancelled;
+    double		answer[FORECAST_DRAG_FRAMES + 1]; /* Seconds from request to forecast, by id, 0 if none came */
+    double		cancel_max; /* Seconds from being superseded to giving up */
+} forecast_drag_t;
+
+static void *forecast_worker(void *arg)
+{
+    static sim_forecast_t   fc;
+    forecast_drag_t	    *d = arg;
+    uint64_t		    done = 0;
+
+    while (atomic_load(&d->running))
+    {
+	uint64_t    id = atomic_load(&d->latest);
+	sim_state_t from;
+
+	if (id == done)
+	{
+	    usleep(200);
+	    continue;
+	}
+	pthread_mutex_lock(&d->lock);
+	id = atomic_load(&d->latest);
+	from = d->from;
+	pthread_mutex_unlock(&d->lock);
+
+	done = id;
+	if (sim_forecast(&d->f, &from, FORECAST_SECONDS, &fc, &d->latest, id))
+	{
+	    d->answer[id] = now_sec() - d->asked[id];
+	    d->answered++;
+	}
+	else
+	{
+	    d->cancel_max = fmax(d->cancel_max, now_sec() - d->asked[id + 1]);
+	    d->cancelled++;
+	}
+    }
+    return NULL;
+}
+
+static int forecast_drag(void)
+{
+    static forecast_drag_t  d;
+    pthread_t		    tid;
+    sim_state_t		    sim;
+    rng_t		    rng;
+    double		    next, worst = 0;
+    int			    n, within[2] = {0};
+
+    memset(&d, 0, sizeof(d));
+    if (!forecaster_setup(&d.f))
+	return 1;
+    pthread_mutex_init(&d.lock, NULL);
+    rng_seed(&rng, 26);
+    forecast_setup(&sim, &rng, 2700);
+    atomic_store(&d.running, true);
+    pthread_create(&tid, NULL, forecast_worker, &d);
+
+    /* The Q-ring's frequency slider from one end to the other, every frame a new setting the tables haven't seen */
+    next = now_sec();
+    for (n = 1; n <= FORECAST_DRAG_FRAMES; n++)
+    {
+	sim_apply(&sim, SIM_CMD_FREQ, SIM_RING_Q, ROOT_FREQ + 0.07 + 2.63 * n / FORECAST_DRAG_FRAMES);
+	pthread_mutex_lock(&d.lock);
+	d.from = sim;
+	d.asked[n] = now_sec();
+	atomic_store(&d.latest, n);
+	pthread_mutex_unlock(&d.lock);
+
+	next += FORECAST_FRAME;
+	if (next > now_sec())
+	    usleep((next - now_sec()) * 1e6);
+    }
+    usleep(FORECAST_FRAME * 4 * 1e6);
+    atomic_store(&d.running, false);
+    pthread_join(tid, NULL);
+
+    for (n = 1; n <= FORECAST_DRAG_FRAMES; n++)
+    {
+	if (d.answer[n] == 0)
+	    continue;
+	within[0] += d.answer[n] <= FORECAST_FRAME;
+	within[1] += d.answer[n] <= 2 * FORECAST_FRAME;
+	worst = fmax(worst, d.answer[n]);
+    }
+    printf("dragging: %d requests, %d answered (%d within a frame, %d within two, %.2f ms worst), %d given up "
+	   "(%.2f ms at most after being superseded), %d never started\n",
+	   FORECAST_DRAG_FRAMES, d.answered, within[0], within[1], worst * 1e3, d.cancelled, d.cancel_max * 1e3,
+	   FORECAST_DRAG_FRAMES - d.answered - d.cancelled);
+    sim_forecaster_free(&d.f);
+    pthread_mutex_destroy(&d.lock);
+    /* The last request was never superseded, so it must have come back */
+    return d.answer[FORECAST_DRAG_FRAMES] == 0;
+}
+
+static int bench_forecast(void)
+{
+    int failed = 0;
+
+    printf("== what-if forecasts: %d points over %.0f s ahead ==\n", SIM_FORECAST_POINTS, FORECAST_SECONDS);
+    failed |= forecast_check();
+    failed |= forecast_drag();
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *which = argc > 1 ? argv[1] : "all";
+    double seconds = argc > 2 ? atof(argv[2]) : 600.0;
+
+    int failed = 0;
+
+    if (!strcmp(which, "all") || !strcmp(which, "osc"))
+	bench_osc(seconds);
+    if (!strcmp(which, "all") || !strcmp(which, "phase"))
+	failed |= bench_phase(argc > 2 ? seconds / 3600 : 3.0);
+    if (!strcmp(which, "all") || !strcmp(which, "queue"))
+	bench_queue();
+    if (!strcmp(which, "all") || !strcmp(which, "upsample"))
+	bench_upsample(seconds);
+    if (!strcmp(which, "all") || !strcmp(which, "sim"))
+    {
+	bench_sim(seconds);
+	failed |= bench_sim_determinism();
+    }
+    if (!strcmp(which, "all") || !strcmp(which, "batch"))
+	failed |= bench_batch(argc > 2 ? seconds : 10.0);
+    if (!strcmp(which, "all") || !strcmp(which, "math"))
+	failed |= bench_math(argc > 2 ? seconds : 10.0);
+    if (!strcmp(which, "all") || !strcmp(which, "envelope"))
+	failed |= bench_envelope(argc > 2 ? seconds : 10.0);
+    if (!strcmp(which, "all") || !strcmp(which, "warp"))
+	failed |= bench_warp(argc > 2 ? seconds / 3600 : 2.0);
+    if (!strcmp(which, "all") || !strcmp(which, "save"))
+	failed |= bench_save();
+    if (!strcmp(which, "all") || !strcmp(which, "replay"))
+	failed |= bench_replay(argc > 2 ? seconds / 60 : 10.0);
+    if (!strcmp(which, "all") || !strcmp(which, "seek"))
+	failed |= bench_seek(argc > 2 ? seconds / 60 : 10.0);
+    if (!strcmp(which, "all") || !strcmp(which, "flow"))
+	failed |= bench_flow(argc > 2 ? seconds : 60.0);
+    if (!strcmp(which, "all") || !strcmp(which, "thermal"))
+	failed |= bench_thermal(argc > 2 ? seconds : 60.0);
+    if (!strcmp(which, "all") || !strcmp(which, "forecast"))
+	failed |= bench_forecast();
+
+    return failed;
+}
@@ -0,0 +1,189 @@
+/* Offline render of the engine audio to a WAV file. No window, no audio device: the same DSP the audio callback runs, in
+ * a loop as fast as it will go.
+ *
+ *   scpulse-render [-t seconds] [-r rate] [-d divider] [-p power] [-q freq,power] [-R freq,power] [-s freq,power] out.wav
+ *
+ * power is the input power slider (0-1). Each ring's power is relative to it, like the sliders in the game.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MINIAUDIO_IMPLEMENTATION
+#define MA_NO_DEVICE_IO /* Not MA_NO_DECODING: miniaudio only compiles its WAV writer in with decoding enabled */
+#include "miniaudio.h"
+
+#include "dsp.h"
+
+#define ROOT_FREQ   40.0
+
+#define RENDER_SAMPLE_RATE 44100
+#define RENDER_PERIOD 441 /* Frames per engine_audio_process call, what miniaudio usually hands the callback */
+#define RENDER_RATE_DIVIDER 16
+#define RENDER_RAMP_MS 20
+
+typedef struct render_config_s
+{
+    double	seconds;
+    uint32_t	sample_rate;
+    uint32_t	divider;
+    float	power;
+    float	freq[OSC_COUNT];
+    float	vol[OSC_COUNT];	/* Relative to power, except for the root which is power itself */
+} render_config_t;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-r rate] [-d divider] [-p power] [-q freq,power] [-R freq,power] [-s freq,power] out.wav\n", prog);
+}
+
+static int parse_ring(const char *arg, render_config_t *cfg, osc_id_e osc)
+{
+    return sscanf(arg, "%f,%f", &cfg->freq[osc], &cfg->vol[osc]) == 2 ? 0 : -1;
+}
+
+static const char *format_duration(double seconds, char *buf, size_t len)
+{
+    if (seconds >= 3600)
+	snprintf(buf, len, "%.3g hour%s", seconds / 3600, seconds == 3600 ? "" : "s");
+    else if (seconds >= 60)
+	snprintf(buf, len, "%.3g min", seconds / 60);
+    else
+	snprintf(buf, len, "%.3g s", seconds);
+    return buf;
+}
+
+int main(int argc, char *argv[])
+{
+    static engine_audio_t   ea;
+    render_config_t	    cfg;
+    ma_encoder_config	    enc_config;
+    ma_encoder		    encoder;
+    ma_result		    res;
+    dsp_block_stats_t	    stats;
+    float		    out[RENDER_PERIOD];
+    uint64_t		    frames, done;
+    uint64_t		    overloads = 0;
+    float		    peak = 0;
+    double		    t0, dsp_time = 0, wall;
+    char		    dur[32];
+    int			    opt, o;
+
+    cfg.seconds = 10;
+    cfg.sample_rate = RENDER_SAMPLE_RATE;
+    cfg.divider = RENDER_RATE_DIVIDER;
+    cfg.power = 0.5;
+    cfg.freq[OSC_ROOT] = ROOT_FREQ;
+    cfg.vol[OSC_ROOT] = 1.0;
+    cfg.freq[OSC_Q] = ROOT_FREQ + 1.3;
+    cfg.vol[OSC_Q] = 0.5;
+    cfg.freq[OSC_R] = ROOT_FREQ - 0.45;
+    cfg.vol[OSC_R] = 0.3;
+    cfg.freq[OSC_S] = ROOT_FREQ + 0.21;
+    cfg.vol[OSC_S] = 0.2;
+
+    while ((opt = getopt(argc, argv, "t:r:d:p:q:R:s:")) != -1)
+    {
+	switch (opt)
+	{
+	case 't':
+	    cfg.seconds = atof(optarg);
+	    break;
+	case 'r':
+	    cfg.sample_rate = atoi(optarg);
+	    break;
+	case 'd':
+	    cfg.divider = atoi(optarg);
+	    break;
+	case 'p':
+	    cfg.power = atof(optarg);
+	    break;
+	case 'q':
+	    if (parse_ring(optarg, &cfg, OSC_Q))
+		goto bad_args;
+	    break;
+	case 'R':
+	    if (parse_ring(optarg, &cfg, OSC_R))
+		goto bad_args;
+	    break;
+	case 's':
+	    if (parse_ring(optarg, &cfg, OSC_S))
+		goto bad_args;
+	    break;
+	default:
+	    goto bad_args;
+	}
+    }
+    if (optind != argc - 1 || cfg.seconds <= 0 || cfg.sample_rate == 0)
+	goto bad_args;
+
+    enc_config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, 1, cfg.sample_rate);
+    res = ma_encoder_init_file(argv[optind], &enc_config, &encoder);
+    if (res != MA_SUCCESS)
+    {
+	fprintf(stderr, "Failed to open %s - %s\n", argv[optind], ma_result_description(res));
+	return 1;
+    }
+
+    /* Set up exactly the way the game does once its device is open */
+    if (!engine_audio_init(&ea, cfg.sample_rate, cfg.divider, RENDER_PERIOD))
+    {
+	fprintf(stderr, "Failed to allocate engine audio scratch\n");
+	ma_encoder_uninit(&encoder);
+	return 1;
+    }
+    osc_bank_set_mode(&ea.bank, OSC_MODE_PHASOR);
+    osc_bank_set_ramp(&ea.bank, ea.bank.sample_rate * RENDER_RAMP_MS / 1000);
+    for (o = 0; o < OSC_COUNT; o++)
+    {
+	osc_bank_set_freq(&ea.bank, o, cfg.freq[o]);
+	osc_bank_post(&ea.bank, &ea.params, OSC_PARAM_AMPLITUDE, o, o == OSC_ROOT ? cfg.power : cfg.vol[o] * cfg.power, 0);
+    }
+
+    frames = (uint64_t)(cfg.seconds * cfg.sample_rate);
+    wall = now_sec();
+    for (done = 0; done < frames; done += RENDER_PERIOD)
+    {
+	uint32_t n = frames - done < RENDER_PERIOD ? frames - done : RENDER_PERIOD;
+
+	t0 = now_sec();
+	engine_audio_process(&ea, out, n, &stats);
+	dsp_time += now_sec() - t0;
+
+	overloads += stats.overloads;
+	if (stats.peak > peak)
+	    peak = stats.peak;
+
+	res = ma_encoder_write_pcm_frames(&encoder, out, n, NULL);
+	if (res != MA_SUCCESS)
+	{
+	    fprintf(stderr, "Failed to write %s - %s\n", argv[optind], ma_result_description(res));
+	    ma_encoder_uninit(&encoder);
+	    engine_audio_uninit(&ea);
+	    return 1;
+	}
+    }
+    ma_encoder_uninit(&encoder);
+    engine_audio_uninit(&ea);
+    wall = now_sec() - wall;
+
+    printf("%s rendered in %.2f s, %.0fx realtime (DSP alone %.2f s, %.0fx)\n",
+	   format_duration(cfg.seconds, dur, sizeof(dur)), wall, cfg.seconds / wall, dsp_time, cfg.seconds / dsp_time);
+    printf("%s at %u Hz, internal rate %.0f Hz, peak %.3f, %llu overloaded samples\n",
+	   argv[optind], cfg.sample_rate, ea.bank.sample_rate, peak, (unsigned long long)overloads);
+    return 0;
+
+bad_args:
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,192 @@
+/* Runs a recorded session again, headless and as fast as the machine allows: the game's input journal (sim_journal.h,
+ * the game leaves one in scpulse.jrn) from its start to its last tick.
+ *
+ *   scpulse-replay [-r repeats] [-t seconds [-k seconds] [-m KB]] [-c final.sav] [-o final.sav] journal
+ *
+ * The replay takes the same inputs on the same ticks as the game did, so it ends where the game ended, bit for bit.
+ * -c checks that against a save of the end, like the scpulse.sav the game writes next to the journal; -o writes the
+ * replay's end as one. -r replays that many times, for timing.
+ *
+ * -t stops at that many seconds into the session instead, by seeking (sim_seek_t), with keyframes every -k seconds of
+ * the session in at most -m KB. With -r it seeks there that many times from the end, which is what a seek costs once
+ * the journal is indexed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sim_save.h"
+#include "sim_journal.h"
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-r repeats] [-t seconds [-k seconds] [-m KB]] [-c final.sav] [-o final.sav] journal\n"
+		    "       -t: stop that far into the session, by seeking\n"
+		    "       -k: seconds of the session between keyframes (default 10)\n"
+		    "       -m: memory for keyframes (default 65536)\n"
+		    "       -c: check the end against a saved session, like the game's scpulse.sav\n"
+		    "       -o: save the end\n", prog);
+}
+
+/* The sims as a save holds them, less the ring phases, which the replay has no audio for */
+static bool same_sim(const sim_save_t *a, const sim_save_t *b)
+{
+    sim_save_t x = *a, y = *b;
+
+    memset(x.ring_phase, 0, sizeof(x.ring_phase));
+    memset(y.ring_phase, 0, sizeof(y.ring_phase));
+    x.checksum = y.checksum = 0;
+    return !memcmp(&x, &y, sizeof(x));
+}
+
+/* Seeks to tick repeats times, from the journal's end each time, and returns the mean time of one */
+static double seek(sim_seek_t *s, uint64_t tick, int repeats)
+{
+    double  t0, wall = 0;
+    int	    i;
+
+    sim_seek_index(s);
+    for (i = 0; i < repeats; i++)
+    {
+	sim_seek(s, s->replay.head->ticks);
+	t0 = now_sec();
+	sim_seek(s, tick);
+	wall += now_sec() - t0;
+    }
+    return wall / repeats;
+}
+
+int main(int argc, char *argv[])
+{
+    static sim_seek_t		sk;
+    static sim_replay_t		r_full;
+    sim_replay_t		*r = &r_full;
+    const sim_journal_header_t	*head;
+    const sim_save_t		*check = NULL;
+    const char			*out_path = NULL;
+    sim_save_t			end;
+    double			t0, wall, at = -1, interval = 10, kb = 65536;
+    int				repeats = 1, i, opt;
+
+    while ((opt = getopt(argc, argv, "r:t:k:m:c:o:")) != -1)
+    {
+	switch (opt)
+	{
+	case 'r':
+	    repeats = atoi(optarg);
+	    break;
+	case 't':
+	    at = atof(optarg);
+	    break;
+	case 'k':
+	    interval = atof(optarg);
+	    break;
+	case 'm':
+	    kb = atof(optarg);
+	    break;
+	case 'c':
+	    sim_save_unmap(check);
+	    if ((check = sim_save_map(optarg)) == NULL)
+	    {
+		fprintf(stderr, "%s isn't a saved session this build can read\n", optarg);
+		return 1;
+	    }
+	    break;
+	case 'o':
+	    out_path = optarg;
+	    break;
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind != argc - 1 || repeats < 1 || interval <= 0 || kb <= 0)
+    {
+	usage(argv[0]);
+	return 2;
+    }
+    if ((head = sim_journal_map(argv[optind])) == NULL)
+    {
+	fprintf(stderr, "%s isn't a journal this build can read\n", argv[optind]);
+	return 1;
+    }
+
+    if (at >= 0)
+    {
+	uint64_t ticks = interval * head->rate > 1 ? (uint64_t)(interval * head->rate) : 1;
+
+	if (!sim_seek_init(&sk, head, sim_journal_events(head), ticks, (size_t)(kb * 1024)))
+	{
+	    fprintf(stderr, "Failed to set up seeking: out of memory, or -m too small for 2 keyframes\n");
+	    return 1;
+	}
+	r = &sk.replay;
+	wall = seek(&sk, (uint64_t)(at * head->rate), repeats);
+    }
+    else
+    {
+	t0 = now_sec();
+	for (i = 0; i < repeats; i++)
+	{
+	    if (i > 0)
+		sim_replay_free(r);
+	    if (!sim_replay_init(r, head, sim_journal_events(head)))
+	    {
+		fprintf(stderr, "Failed to allocate the beat envelope cache\n");
+		return 1;
+	    }
+	    while (sim_replay_tick(r))
+		;
+	}
+	wall = (now_sec() - t0) / repeats;
+    }
+
+    if (r->bad)
+    {
+	fprintf(stderr, "%s: events stop decoding before tick %llu\n", argv[optind], (unsigned long long)r->tick);
+	return 1;
+    }
+    if (at >= 0)
+	fprintf(stderr, "Seeked to tick %llu of %llu in %.2f ms, %zu keyframes every %.0f s in %.0f KB\n",
+		(unsigned long long)r->tick, (unsigned long long)head->ticks, wall * 1e3, sk.count,
+		(double)sk.interval / head->rate, sk.count * sizeof(sim_keyframe_t) / 1024.0);
+    else
+	fprintf(stderr, "%llu ticks, %.1f game-minutes in %.3f s, %.0fx realtime, %llu bytes of events\n",
+		(unsigned long long)r->tick, (r->sim.time - head->start.time) / 60, wall,
+		(r->sim.time - head->start.time) / wall, (unsigned long long)head->bytes);
+
+    sim_save_fill(&end, &r->sim, NULL);
+    if (out_path != NULL && !sim_save_write(&end, out_path))
+    {
+	perror(out_path);
+	return 1;
+    }
+    if (check != NULL)
+    {
+	if (!same_sim(&end, check))
+	{
+	    fprintf(stderr, "The replay's end differs from the save's\n");
+	    return 1;
+	}
+	fprintf(stderr, "The replay's end matches the save's\n");
+    }
+
+    if (at >= 0)
+	sim_seek_free(&sk);
+    else
+	sim_replay_free(r);
+    sim_save_unmap(check);
+    sim_journal_unmap(head);
+    return 0;
+}
@@ -0,0 +1,726 @@
+/* Monte Carlo balance sweep. Every combination of the given parameter values is run for a number of seeds, headless and
+ * as fast as the machine allows, and the per-configuration statistics are written out as CSV.
+ *
+ *   scpulse-sweep [-t seconds] [-n seeds] [-S first seed] [-j threads] [-e] [-m MB] [-s save] [-a axis=values]... [-o out.csv]
+ *
+ * values is either a list, 0.2,0.5,0.8, or min:max:count, 0:1:11. Axes that aren't given keep the game's defaults; run
+ * with -a help for the list. Every configuration is run with the same seeds, so differences between configurations
+ * aren't drowned out by differences between their random drain events.
+ *
+ * Each run is the game minus the window: the sim at its fixed rate and the ring audio it drives, rendered block by block
+ * and measured the same way the audio callback does, so overloads and output power are the real thing. With -e the
+ * audio isn't rendered at all: each step's output power and overloads come from the beat envelope of the rings instead,
+ * which leaves out the ramps between ring settings and the callback's block timing. The envelope is looked up in a cache
+ * of per-step tables, one per ring setting, with frequencies rounded to SWEEP_ENVELOPE_PERIOD's resolution; -m bounds
+ * each thread's tables, and runs that share their rings' settings share the tables.
+ *
+ * With -s every run starts from a saved session (sim_save.h, the game leaves one in scpulse.sav) instead of a new engine:
+ * its state, its ring phases and, for axes that aren't given, its settings. Only the random generator is reseeded, so
+ * the seeds are different futures of the same moment. Fuel, health and times are then counted from that moment.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "dsp.h"
+#include "sim.h"
+#include "envelope.h"
+#include "sim_save.h"
+
+#define ROOT_FREQ   40.0
+
+#define SWEEP_SAMPLE_RATE 44100
+#define SWEEP_PERIOD 441 /* Frames per engine_audio_process call, what miniaudio usually hands the callback */
+#define SWEEP_RATE_DIVIDER 16
+#define SWEEP_RAMP_MS 20
+#define SWEEP_SIM_RATE 240 /* The game's SIM_RATE */
+
+#define SWEEP_ENVELOPE_PERIOD 100.0 /* Seconds before a cached envelope repeats, so frequencies are good to 0.01 Hz */
+#define SWEEP_ENVELOPE_MB 32 /* Per thread */
+
+#define SWEEP_MAX_THREADS 256
+#define SWEEP_MAX_JOBS (1u << 26)
+#define SWEEP_CACHE_LINE 64
+
+typedef enum {
+    AXIS_ROOT_POWER = 0,
+    AXIS_Q_FREQ,
+    AXIS_Q_POWER,
+    AXIS_R_FREQ,
+    AXIS_R_POWER,
+    AXIS_S_FREQ,
+    AXIS_S_POWER,
+    AXIS_CAP_SIZE_1,
+    AXIS_CAP_SIZE_2,
+    AXIS_CAP_SIZE_3,
+    AXIS_CAP_GRADE_1,
+    AXIS_CAP_GRADE_2,
+    AXIS_CAP_GRADE_3,
+    AXIS_DEST_1,
+    AXIS_DEST_2,
+    AXIS_DEST_3,
+    AXIS_SPIKE_THRUST,
+    AXIS_SPIKE_SHIELD,
+    AXIS_SPIKE_WEAPON,
+    AXIS_COUNT
+} axis_e;
+
+/* An axis per tap and per drain of the default layout */
+_Static_assert(AXIS_CAP_SIZE_2 - AXIS_CAP_SIZE_1 == 1 && SIM_TAP_COUNT == 3 && SIM_DRAIN_COUNT == 3,
+	       "the sweep's tap and drain axes are sim.h's layout");
+
+static const char *axis_names[AXIS_COUNT] = {
+    "root_power", "q_freq", "q_power", "r_freq", "r_power", "s_freq", "s_power",
+    "cap_size1", "cap_size2", "cap_size3", "cap_grade1", "cap_grade2", "cap_grade3",
+    "dest1", "dest2", "dest3",
+    "spike_thrust", "spike_shield", "spike_weapon",
+};
+
+/* Spike probabilities below 0 keep the seeded random ones sim_init picks */
+static const float axis_defaults[AXIS_COUNT] = {
+    0.5, ROOT_FREQ + 1.3, 0.5, ROOT_FREQ - 0.45, 0.3, ROOT_FREQ + 0.21, 0.2,
+    CAP_SIZE_SMALL, CAP_SIZE_SMALL, CAP_SIZE_SMALL, CAP_GRADE_CON, CAP_GRADE_CON, CAP_GRADE_CON,
+    TAP_DEST_THRUST, TAP_DEST_SHIELD, TAP_DEST_WEAPON,
+    -1, -1, -1,
+};
+
+typedef struct axis_s
+{
+    float	*values;
+    uint32_t	count;
+    uint32_t	stride; /* Configurations between one value and the next */
+    bool	given;	/* On the command line. With -s, axes that weren't keep the save's setting. */
+} axis_t;
+
+/* What one seeded run of one configuration came to */
+typedef struct run_result_s
+{
+    float	output;		    /* Mean engine output peak */
+    float	overload;	    /* Share of audio samples over the overload level */
+    float	demand;		    /* Mean charge/s the drains asked for, all three together */
+    float	delivered;	    /* Mean charge/s they got */
+    float	overheat_time;	    /* Seconds until the cooler first went over MAX_COOLER_TEMP, < 0 if it never did */
+    float	fuel_burned;	    /* Liters */
+    float	cap_health_lost;    /* Summed over the three capacitors, 0-3 */
+    float	engine_health_lost;
+    float	dead_time;	    /* Seconds until the engine died, < 0 if it didn't */
+} run_result_t;
+
+typedef struct sweep_s sweep_t;
+
+/* Jobs are handed out as one contiguous range per worker. The owner takes from the front, and a worker that runs dry
+ * steals the back half of someone else's. Both ends live in one word so a single CAS moves either.
+ */
+typedef struct worker_s
+{
+    _Atomic uint64_t	range;	/* Next job in the low 32 bits, end in the high 32 */
+    pthread_t		tid;
+    sweep_t		*sw;
+    int			id;
+    uint32_t		runs;
+    uint32_t		steals;
+    envelope_cache_t	cache;	/* -e only */
+    char		pad[SWEEP_CACHE_LINE];
+} worker_t;
+
+struct sweep_s
+{
+    axis_t	    axes[AXIS_COUNT];
+    uint32_t	    configs;
+    uint32_t	    seeds;
+    uint64_t	    first_seed;
+    double	    seconds;
+    bool	    envelope;	/* Output power and overloads from envelope.h rather than rendered audio */
+    size_t	    cache_bytes; /* Per worker, for the envelope tables */
+    const sim_save_t *start;	/* -s, mapped */
+
+    uint32_t	    jobs;	/* configs * seeds, job j is configuration j / seeds with seed j % seeds */
+    run_result_t    *results;	/* One per job, so the output doesn't depend on who ran what */
+    _Atomic uint32_t done;
+
+    worker_t	    *workers;
+    int		    threads;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float axis_value(const sweep_t *sw, axis_e a, uint32_t config)
+{
+    const axis_t *axis = &sw->axes[a];
+
+    return axis->values[(config / axis->stride) % axis->count];
+}
+
+/* Whether the run's setup applies the axis, or leaves the save's setting */
+static bool axis_applies(const sweep_t *sw, axis_e a)
+{
+    return sw->start == NULL || sw->axes[a].given;
+}
+
+/* ==================== Running one configuration ==================== */
+
+static void post_rings(engine_audio_t *ea, const sim_state_t *sim, unsigned changed)
+{
+    int r;
+
+    for (r = 0; r < SIM_RING_COUNT; r++)
+    {
+	if (changed & SIM_CHANGED_POWER)
+	    osc_bank_post(&ea->bank, &ea->params, OSC_PARAM_AMPLITUDE, r, sim_ring_amplitude(sim, r), 0);
+	if (changed & SIM_CHANGED_FREQ)
+	    osc_bank_post(&ea->bank, &ea->params, OSC_PARAM_FREQ, r, sim->ring_freq[r], 0);
+    }
+}
+
+static void sweep_setup(const sweep_t *sw, uint32_t config, sim_state_t *sim, uint64_t seed)
+{
+    static const sim_ring_e rings[] = {SIM_RING_Q, SIM_RING_R, SIM_RING_S};
+    int i;
+
+    if (sw->start != NULL)
+    {
+	sim_save_restore(sw->start, sim, NULL);
+	rng_seed(&sim->rng, seed);
+    }
+    else
+	sim_init(sim, seed);
+
+    if (axis_applies(sw, AXIS_ROOT_POWER))
+	sim_apply(sim, SIM_CMD_POWER, SIM_RING_ROOT, axis_value(sw, AXIS_ROOT_POWER, config));
+    for (i = 0; i < 3; i++)
+    {
+	if (axis_applies(sw, AXIS_Q_FREQ + 2 * i))
+	    sim_apply(sim, SIM_CMD_FREQ, rings[i], axis_value(sw, AXIS_Q_FREQ + 2 * i, config));
+	if (axis_applies(sw, AXIS_Q_POWER + 2 * i))
+	    sim_apply(sim, SIM_CMD_POWER, rings[i], axis_value(sw, AXIS_Q_POWER + 2 * i, config));
+    }
+
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	if (axis_applies(sw, AXIS_CAP_SIZE_1 + i))
+	    sim_apply(sim, SIM_CMD_CAP_SIZE, i, axis_value(sw, AXIS_CAP_SIZE_1 + i, config));
+	if (axis_applies(sw, AXIS_CAP_GRADE_1 + i))
+	    sim_apply(sim, SIM_CMD_CAP_GRADE, i, axis_value(sw, AXIS_CAP_GRADE_1 + i, config));
+	if (axis_applies(sw, AXIS_DEST_1 + i))
+	    sim_apply(sim, SIM_CMD_TAP_DEST, i, axis_value(sw, AXIS_DEST_1 + i, config));
+    }
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	float p = axis_value(sw, AXIS_SPIKE_THRUST + i, config);
+
+	if (p >= 0 && axis_applies(sw, AXIS_SPIKE_THRUST + i))
+	    sim->drains[i].spike_probability = p;
+	if (sw->start == NULL)
+	    sim_apply(sim, SIM_CMD_DRAIN_ENABLE, i, 1); /* A save keeps whichever were on */
+    }
+}
+
+/* The table for the sim's rings, or the end of the sweep if there's no memory for it */
+static const envelope_table_t *ring_table(envelope_cache_t *cache, envelope_t *env, const sim_state_t *sim)
+{
+    const envelope_table_t *table;
+
+    envelope_set_rings(env, sim);
+    if ((table = envelope_cache_get(cache, env)) == NULL)
+    {
+	fprintf(stderr, "Failed to allocate an envelope table\n");
+	exit(1);
+    }
+    return table;
+}
+
+static void sweep_run(const sweep_t *sw, envelope_cache_t *cache, uint32_t job, run_result_t *res)
+{
+    static const float	dt = 1.0f / SWEEP_SIM_RATE;
+    engine_audio_t	ea;
+    sim_state_t		sim;
+    dsp_block_stats_t	stats = {0};
+    envelope_t		env = {{0}};
+    const envelope_table_t *table = NULL;
+    float		out[SWEEP_PERIOD];
+    float		peak;
+    uint32_t		config = job / sw->seeds;
+    uint64_t		steps = (uint64_t)(sw->seconds * SWEEP_SIM_RATE);
+    uint64_t		rendered = 0, overloads_total = 0, n;
+    double		output = 0, demand = 0, delivered = 0, over = 0;
+    double		start_time;
+    float		start_fuel, start_health, start_cap_health[SIM_TAP_COUNT];
+    int			i;
+
+    sweep_setup(sw, config, &sim, sw->first_seed + job % sw->seeds);
+    start_time = sim.time;
+    start_fuel = sim.fuel_level;
+    start_health = sim.engine_health;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	start_cap_health[i] = sim.taps[i].cap.health;
+
+    /* The game's audio setup, see scpulse.c */
+    if (sw->envelope)
+	table = ring_table(cache, &env, &sim);
+    else
+    {
+	engine_audio_init(&ea, SWEEP_SAMPLE_RATE, SWEEP_RATE_DIVIDER, SWEEP_PERIOD);
+	osc_bank_set_mode(&ea.bank, OSC_MODE_PHASOR);
+	osc_bank_set_ramp(&ea.bank, ea.bank.sample_rate * SWEEP_RAMP_MS / 1000);
+	for (i = 0; i < SIM_RING_COUNT; i++)
+	{
+	    osc_bank_set_freq(&ea.bank, i, sim.ring_freq[i]);
+	    if (sw->start != NULL)
+		osc_bank_set_phase(&ea.bank, i, sw->start->ring_phase[i]);
+	}
+	post_rings(&ea, &sim, SIM_CHANGED_POWER);
+    }
+
+    res->overheat_time = -1;
+    res->dead_time = -1;
+
+    for (n = 0; n < steps; n++)
+    {
+	uint64_t    due = (n + 1) * SWEEP_SAMPLE_RATE / SWEEP_SIM_RATE;
+	uint32_t    overloads = 0;
+	unsigned    changed;
+
+	if (sw->envelope)
+	{
+	    /* The step's worth of audio, measured without rendering it. Fractions of an overloaded sample carry over. */
+	    const envelope_tick_t *tick = envelope_table_at(cache, table, n);
+
+	    over += tick->over * SWEEP_SAMPLE_RATE;
+	    overloads = (uint32_t)over;
+	    over -= overloads;
+	    peak = tick->peak;
+	    rendered = due;
+	    sim.engine_overload = overloads > 0;
+	}
+	else
+	{
+	    /* Audio runs ahead of the sim by up to a block, like the callback does */
+	    while (rendered < due)
+	    {
+		engine_audio_process(&ea, out, SWEEP_PERIOD, &stats);
+		rendered += SWEEP_PERIOD;
+		overloads += stats.overloads;
+	    }
+	    peak = stats.peak;
+	    sim.engine_overload = stats.overloads > 0;
+	}
+
+	sim.total_output_power = peak;
+	if (overloads)
+	    sim_audio_overload(&sim, overloads);
+	overloads_total += overloads;
+
+	changed = sim_step(&sim, dt);
+	if (changed && sw->envelope)
+	    table = ring_table(cache, &env, &sim);
+	else if (changed)
+	    post_rings(&ea, &sim, changed);
+
+	output += peak;
+	for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	{
+	    demand += sim.drains[i].rate * sim.drains[i].factor;
+	    delivered += sim.drains[i].delivered;
+	}
+	if (res->overheat_time < 0 && sim.cooler_temp > MAX_COOLER_TEMP)
+	    res->overheat_time = sim.time - start_time;
+	if (res->dead_time < 0 && sim.engine_health <= 0)
+	    res->dead_time = sim.time - start_time;
+    }
+
+    if (!sw->envelope)
+	engine_audio_uninit(&ea);
+
+    res->output = output / steps;
+    res->overload = (double)overloads_total / rendered;
+    res->demand = demand / steps;
+    res->delivered = delivered / steps;
+    res->fuel_burned = (double)start_fuel - sim.fuel_level;
+    res->cap_health_lost = 0;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	res->cap_health_lost += (double)start_cap_health[i] - sim.taps[i].cap.health;
+    res->engine_health_lost = (double)start_health - sim.engine_health;
+}
+
+/* ==================== Work stealing ==================== */
+
+#define RANGE(next, end) (((uint64_t)(end) << 32) | (next))
+#define RANGE_NEXT(r) ((uint32_t)(r))
+#define RANGE_END(r) ((uint32_t)((r) >> 32))
+
+static bool take_job(worker_t *w, uint32_t *job)
+{
+    uint64_t r = atomic_load(&w->range);
+
+    while (RANGE_NEXT(r) < RANGE_END(r))
+    {
+	if (atomic_compare_exchange_weak(&w->range, &r, RANGE(RANGE_NEXT(r) + 1, RANGE_END(r))))
+	{
+	    *job = RANGE_NEXT(r);
+	    return true;
+	}
+    }
+    return false;
+}
+
+/* Take the back half of the first victim, after this one, that has at least two jobs left */
+static bool steal_jobs(worker_t *w)
+{
+    sweep_t *sw = w->sw;
+    int	    i;
+
+    for (i = 1; i < sw->threads; i++)
+    {
+	worker_t    *victim = &sw->workers[(w->id + i) % sw->threads];
+	uint64_t    r = atomic_load(&victim->range);
+
+	while (RANGE_END(r) - RANGE_NEXT(r) >= 2)
+	{
+	    uint32_t mid = RANGE_NEXT(r) + (RANGE_END(r) - RANGE_NEXT(r)) / 2;
+
+	    if (atomic_compare_exchange_weak(&victim->range, &r, RANGE(RANGE_NEXT(r), mid)))
+	    {
+		/* Our own range is empty, so nobody can be stealing from it */
+		atomic_store(&w->range, RANGE(mid, RANGE_END(r)));
+		w->steals++;
+		return true;
+	    }
+	}
+    }
+    return false;
+}
+
+static void *sweep_worker(void *arg)
+{
+    worker_t	*w = arg;
+    uint32_t	job;
+
+    for (;;)
+    {
+	while (take_job(w, &job))
+	{
+	    sweep_run(w->sw, &w->cache, job, &w->sw->results[job]);
+	    w->runs++;
+	    atomic_fetch_add(&w->sw->done, 1);
+	}
+	if (!steal_jobs(w))
+	    break;
+    }
+    return NULL;
+}
+
+/* ==================== Output ==================== */
+
+static void write_csv(const sweep_t *sw, FILE *f)
+{
+    uint32_t	c, s;
+    int		a;
+
+    for (a = 0; a < AXIS_COUNT; a++)
+	if (sw->axes[a].count > 1)
+	    fprintf(f, "%s,", axis_names[a]);
+    fprintf(f, "runs,output_mean,overload_frac,demand_mean,delivered_mean,delivered_frac,overheat_frac,overheat_time_mean,"
+	       "fuel_burned_mean,fuel_burned_sd,cap_health_lost_mean,engine_health_lost_mean,dead_frac\n");
+
+    for (c = 0; c < sw->configs; c++)
+    {
+	const run_result_t  *runs = &sw->results[(uint64_t)c * sw->seeds];
+	double		    output = 0, overload = 0, demand = 0, delivered = 0, fuel = 0, fuel_sq = 0, caps = 0, engine = 0;
+	double		    overheat_time = 0, fuel_sd;
+	uint32_t	    overheats = 0, deaths = 0;
+
+	for (s = 0; s < sw->seeds; s++)
+	{
+	    output += runs[s].output;
+	    overload += runs[s].overload;
+	    demand += runs[s].demand;
+	    delivered += runs[s].delivered;
+	    fuel += runs[s].fuel_burned;
+	    fuel_sq += (double)runs[s].fuel_burned * runs[s].fuel_burned;
+	    caps += runs[s].cap_health_lost;
+	    engine += runs[s].engine_health_lost;
+	    if (runs[s].overheat_time >= 0)
+	    {
+		overheats++;
+		overheat_time += runs[s].overheat_time;
+	    }
+	    deaths += runs[s].dead_time >= 0;
+	}
+	fuel /= sw->seeds;
+	fuel_sd = sqrt(fmax(fuel_sq / sw->seeds - fuel * fuel, 0));
+
+	for (a = 0; a < AXIS_COUNT; a++)
+	    if (sw->axes[a].count > 1)
+		fprintf(f, "%g,", axis_value(sw, a, c));
+	fprintf(f, "%u,%.4f,%.3e,%.4f,%.4f,%.4f,%.4f,", sw->seeds, output / sw->seeds, overload / sw->seeds,
+		demand / sw->seeds, delivered / sw->seeds, demand > 0 ? delivered / demand : 1.0, (double)overheats / sw->seeds);
+	if (overheats)
+	    fprintf(f, "%.2f,", overheat_time / overheats);
+	else
+	    fprintf(f, ",");
+	fprintf(f, "%.1f,%.1f,%.4f,%.4f,%.4f\n", fuel, fuel_sd, caps / sw->seeds, engine / sw->seeds, (double)deaths / sw->seeds);
+    }
+}
+
+/* ==================== Command line ==================== */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-n seeds] [-S first seed] [-j threads] [-e] [-m MB] [-s save] [-a axis=values]... [-o out.csv]\n"
+		    "       values: v1,v2,... or min:max:count\n"
+		    "       -e: output power from the rings' beat envelope, no audio rendered\n"
+		    "       -m: envelope tables per thread, in MB (%d)\n"
+		    "       -s: start every run from a saved session, like the game's scpulse.sav\n", prog, SWEEP_ENVELOPE_MB);
+}
+
+static void list_axes(void)
+{
+    int a;
+
+    fprintf(stderr, "axes (default):\n");
+    for (a = 0; a < AXIS_COUNT; a++)
+	fprintf(stderr, "  %-14s %g\n", axis_names[a], axis_defaults[a]);
+    fprintf(stderr, "cap_size: 0 small, 1 medium, 2 large. cap_grade: 0 consumer, 1 professional, 2 military.\n"
+		    "dest: 0 thrusters, 1 shields, 2 weapons. spike_*: chance per 1/60 s, < 0 for seeded random.\n");
+}
+
+/* name=v1,v2,... or name=min:max:count */
+static int parse_axis(sweep_t *sw, const char *arg)
+{
+    const char	*eq = strchr(arg, '=');
+    axis_t	*axis = NULL;
+    float	min, max;
+    unsigned	count, i;
+    int		a;
+
+    if (eq == NULL)
+	return -1;
+    for (a = 0; a < AXIS_COUNT; a++)
+	if (strlen(axis_names[a]) == (size_t)(eq - arg) && !strncmp(arg, axis_names[a], eq - arg))
+	    axis = &sw->axes[a];
+    if (axis == NULL)
+	return -1;
+    eq++;
+
+    if (sscanf(eq, "%f:%f:%u", &min, &max, &count) == 3)
+    {
+	if (count == 0)
+	    return -1;
+	free(axis->values);
+	axis->values = malloc(count * sizeof(float));
+	for (i = 0; i < count; i++)
+	    axis->values[i] = count == 1 ? min : min + (max - min) * i / (count - 1);
+	axis->count = count;
+	axis->given = true;
+	return 0;
+    }
+
+    count = 1;
+    for (i = 0; eq[i]; i++)
+	count += eq[i] == ',';
+    free(axis->values);
+    axis->values = malloc(count * sizeof(float));
+    for (i = 0; i < count; i++)
+    {
+	char *end;
+
+	axis->values[i] = strtof(eq, &end);
+	if (end == eq || (*end != ',' && *end != '\0'))
+	    return -1;
+	eq = end + 1;
+    }
+    axis->count = count;
+    axis->given = true;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static sweep_t  sw;
+    const char	    *out_path = NULL;
+    FILE	    *out = stdout;
+    double	    t0, wall;
+    uint64_t	    configs = 1;
+    uint32_t	    per, steals = 0, c;
+    uint64_t	    hits = 0, misses = 0, evictions = 0;
+    double	    build_sec = 0, build_sec_max = 0;
+    size_t	    bytes = 0;
+    int		    opt, a, t;
+
+    sw.seconds = 600;
+    sw.seeds = 8;
+    sw.first_seed = 1;
+    sw.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    sw.cache_bytes = (size_t)SWEEP_ENVELOPE_MB << 20;
+    for (a = 0; a < AXIS_COUNT; a++)
+    {
+	sw.axes[a].values = malloc(sizeof(float));
+	sw.axes[a].values[0] = axis_defaults[a];
+	sw.axes[a].count = 1;
+    }
+
+    while ((opt = getopt(argc, argv, "t:n:S:j:em:s:a:o:")) != -1)
+    {
+	switch (opt)
+	{
+	case 't':
+	    sw.seconds = atof(optarg);
+	    break;
+	case 'n':
+	    sw.seeds = atoi(optarg);
+	    break;
+	case 'S':
+	    sw.first_seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'j':
+	    sw.threads = atoi(optarg);
+	    break;
+	case 'e':
+	    sw.envelope = true;
+	    break;
+	case 'm':
+	    sw.cache_bytes = (size_t)(atof(optarg) * (1 << 20));
+	    break;
+	case 's':
+	    sim_save_unmap(sw.start);
+	    if ((sw.start = sim_save_map(optarg)) == NULL)
+	    {
+		fprintf(stderr, "%s isn't a saved session this build can read\n", optarg);
+		return 1;
+	    }
+	    break;
+	case 'a':
+	    if (!strcmp(optarg, "help"))
+	    {
+		list_axes();
+		return 0;
+	    }
+	    if (parse_axis(&sw, optarg))
+	    {
+		fprintf(stderr, "Bad axis %s\n", optarg);
+		list_axes();
+		return 2;
+	    }
+	    break;
+	case 'o':
+	    out_path = optarg;
+	    break;
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind != argc || sw.seconds <= 0 || sw.seeds == 0)
+    {
+	usage(argv[0]);
+	return 2;
+    }
+    if (sw.threads < 1)
+	sw.threads = 1;
+    if (sw.threads > SWEEP_MAX_THREADS)
+	sw.threads = SWEEP_MAX_THREADS;
+
+    /* Last axis changes fastest */
+    for (a = AXIS_COUNT - 1; a >= 0; a--)
+    {
+	sw.axes[a].stride = configs;
+	configs *= sw.axes[a].count;
+    }
+    if (configs * sw.seeds > SWEEP_MAX_JOBS)
+    {
+	fprintf(stderr, "%llu runs is too many, the limit is %u\n", (unsigned long long)(configs * sw.seeds), SWEEP_MAX_JOBS);
+	return 2;
+    }
+    sw.configs = configs;
+    sw.jobs = sw.configs * sw.seeds;
+
+    sw.results = calloc(sw.jobs, sizeof(run_result_t));
+    sw.workers = calloc(sw.threads, sizeof(worker_t));
+    if (sw.results == NULL || sw.workers == NULL)
+    {
+	fprintf(stderr, "Failed to allocate %u results\n", sw.jobs);
+	return 1;
+    }
+
+    if (out_path != NULL && (out = fopen(out_path, "w")) == NULL)
+    {
+	perror(out_path);
+	return 1;
+    }
+
+    fprintf(stderr, "%u configurations x %u seeds, %.0f s of game time each, %d threads\n", sw.configs, sw.seeds, sw.seconds,
+	    sw.threads);
+
+    t0 = now_sec();
+    per = sw.jobs / sw.threads;
+    for (t = 0; t < sw.threads; t++)
+    {
+	worker_t *w = &sw.workers[t];
+
+	w->sw = &sw;
+	w->id = t;
+	atomic_init(&w->range, RANGE(t * per, t == sw.threads - 1 ? sw.jobs : (t + 1) * per));
+	if (sw.envelope && !envelope_cache_init(&w->cache, 1.0 / SWEEP_SIM_RATE, SWEEP_ENVELOPE_PERIOD, DSP_OVERLOAD_LEVEL, sw.cache_bytes))
+	{
+	    fprintf(stderr, "Failed to allocate the envelope cache\n");
+	    return 1;
+	}
+    }
+    for (t = 0; t < sw.threads; t++)
+	pthread_create(&sw.workers[t].tid, NULL, sweep_worker, &sw.workers[t]);
+
+    /* Progress while they run */
+    while ((c = atomic_load(&sw.done)) < sw.jobs)
+    {
+	fprintf(stderr, "\r%u/%u runs", c, sw.jobs);
+	usleep(200000);
+    }
+    for (t = 0; t < sw.threads; t++)
+    {
+	const envelope_cache_t *cache = &sw.workers[t].cache;
+
+	pthread_join(sw.workers[t].tid, NULL);
+	steals += sw.workers[t].steals;
+	hits += cache->hits;
+	misses += cache->misses;
+	evictions += cache->evictions;
+	build_sec += cache->build_sec;
+	if (cache->build_sec_max > build_sec_max)
+	    build_sec_max = cache->build_sec_max;
+	if (envelope_cache_bytes(cache) > bytes)
+	    bytes = envelope_cache_bytes(cache);
+    }
+    wall = now_sec() - t0;
+
+    write_csv(&sw, out);
+    if (out != stdout)
+	fclose(out);
+
+    fprintf(stderr, "\r%u runs, %.1f game-hours in %.1f s, %.0fx realtime, %u steals\n", sw.jobs,
+	    sw.jobs * sw.seconds / 3600, wall, sw.jobs * sw.seconds / wall, steals);
+    if (sw.envelope)
+	fprintf(stderr, "envelope tables: %llu hits, %llu misses, %llu evictions, %.1f ms building (%.1f ms at most), %.1f MB in the fullest thread\n",
+		(unsigned long long)hits, (unsigned long long)misses, (unsigned long long)evictions, build_sec * 1e3,
+		build_sec_max * 1e3, (double)bytes / (1 << 20));
+
+    for (a = 0; a < AXIS_COUNT; a++)
+	free(sw.axes[a].values);
+    for (t = 0; t < sw.threads; t++)
+	envelope_cache_free(&sw.workers[t].cache);
+    free(sw.results);
+    free(sw.workers);
+    sim_save_unmap(sw.start);
+    return 0;
+}
@@ -0,0 +1,613 @@
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+#include "sim_rules.h"
+#include "sim_flow.h"
+
+void sim_capacitor_reset(capacitor_t *cap)
+{
+    cap->charge = 0.0;
+    cap->health = 1.0;
+    cap->max_charge = cap_max_charges[(int)cap->size];
+    cap->full_limit = cap->max_charge - cap_full_limits[(int)cap->size];
+}
+
+void sim_randomize_drains(sim_state_t *sim)
+{
+    int i;
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	sim->drains[i].spike_probability = rng_range(&sim->rng, 1, drain_spike_max[drain_kinds[i]]) / 1000.0;
+}
+
+void sim_route(sim_state_t *sim)
+{
+    int n[SIM_DRAIN_COUNT] = {0};
+    int i, t;
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+    {
+	if ((unsigned)sim->taps[t].dest >= SIM_DRAIN_COUNT)
+	    sim->taps[t].dest = 0;
+	n[sim->taps[t].dest]++;
+    }
+
+    sim->route_first[0] = 0;
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	sim->route_first[i + 1] = sim->route_first[i] + n[i];
+	n[i] = sim->route_first[i];
+    }
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+	sim->route_taps[n[sim->taps[t].dest]++] = t;
+    sim->flow.memo.valid = false;
+}
+
+void sim_init(sim_state_t *sim, uint64_t seed)
+{
+    int i;
+
+    memset(sim, 0, sizeof(*sim));
+    rng_seed(&sim->rng, seed);
+
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	sim->ring_freq[i] = SIM_ROOT_FREQ;
+
+    sim->engine_health = 1.0;
+    sim->fuel_level = MAX_FUEL_LEVEL;
+    sim->math = SIM_MATH_DEFAULT;
+    sim->power = SIM_POWER_DEFAULT;
+    sim->flow.memo.threshold = SIM_FLOW_THRESHOLD;
+    sim->thermal = SIM_THERMAL_DEFAULT;
+
+    /* Tap i to drain i, round and round if there are more taps */
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	sim->taps[i].dest = (tap_dest_e)(i % SIM_DRAIN_COUNT);
+	sim->taps[i].cap.size = CAP_SIZE_SMALL;
+	sim->taps[i].cap.grade = CAP_GRADE_CON;
+	sim_capacitor_reset(&sim->taps[i].cap);
+    }
+    sim_route(sim);
+
+    sim->tap_bat.cap.charge = 50.0;
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	sim->drains[i].rate = 0.5;
+	sim->drains[i].factor = drain_factors[drain_kinds[i]];
+    }
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	if (drain_kinds[i] == DRAIN_KIND_THRUST)
+	    sim->drains[i].wave_freq = rng_range(&sim->rng, 1, 100) / 100.0;
+    sim_randomize_drains(sim);
+}
+
+/* Into the node's own temperature with SIM_THERMAL_GRAPH, straight into the cooler otherwise */
+static void add_heat(sim_state_t *sim, int node, float d)
+{
+    if (sim->thermal == SIM_THERMAL_GRAPH)
+	sim->heat_temp[node] += d / heat_capacities[node];
+    else
+	sim->cooler_temp += d;
+}
+
+static void cooler_dissipate_heat(sim_state_t *sim, float dt)
+{
+    sim->cooler_temp -= cooler_cool_rate(sim->cooler_temp, sim->math) * dt;
+
+    if (sim->cooler_temp < 0)
+	sim->cooler_temp = 0;
+}
+
+static void damage_engine(sim_state_t *sim, float f)
+{
+    sim->engine_health -= f;
+    if (sim->engine_health < 0)
+	sim->engine_health = 0;
+}
+
+void sim_audio_overload(sim_state_t *sim, uint32_t overloads)
+{
+    /* Damage and heat are per overloaded sample, so it still adds up to thousands of bumps per second of overload */
+
+    /* Update damage counter bar and add a hefty bump to heat output */
+    damage_engine(sim, OVERLOAD_DAMAGE * overloads);
+    add_heat(sim, SIM_HEAT_RING(SIM_RING_ROOT), OVERLOAD_HEAT * overloads);
+}
+
+float sim_ring_amplitude(const sim_state_t *sim, sim_ring_e ring)
+{
+    if (ring == SIM_RING_ROOT)
+	return sim->ring_power[SIM_RING_ROOT];
+    return sim->ring_power[ring] * sim->ring_power[SIM_RING_ROOT];
+}
+
+/* Cut the input power, which takes the rings with it */
+static unsigned cut_power(sim_state_t *sim)
+{
+    unsigned changed = sim->ring_power[SIM_RING_ROOT] != 0.0 ? SIM_CHANGED_POWER : 0;
+
+    sim->ring_power[SIM_RING_ROOT] = 0.0;
+    return changed;
+}
+
+unsigned sim_apply(sim_state_t *sim, sim_cmd_e cmd, int index, float value)
+{
+    switch (cmd)
+    {
+    case SIM_CMD_POWER:
+	if (index < 0 || index >= SIM_RING_COUNT)
+	    break;
+	/* There is no input power to be had without fuel */
+	if (index == SIM_RING_ROOT && sim->fuel_level <= 0)
+	    break;
+	sim->ring_power[index] = value;
+	return SIM_CHANGED_POWER;
+
+    case SIM_CMD_FREQ:
+	if (index < 0 || index >= SIM_RING_COUNT)
+	    break;
+	sim->ring_freq[index] = value;
+	return SIM_CHANGED_FREQ;
+
+    case SIM_CMD_REFUEL:
+	sim->fuel_level = MAX_FUEL_LEVEL;
+	break;
+
+    case SIM_CMD_REPAIR:
+	sim->engine_health = 1.0;
+	break;
+
+    case SIM_CMD_RANDOMIZE_DRAINS:
+	sim_randomize_drains(sim);
+	break;
+
+    case SIM_CMD_CAP_SIZE:
+    case SIM_CMD_CAP_GRADE:
+	if (index < 0 || index >= SIM_TAP_COUNT || value < 0 || value > 2)
+	    break;
+	if (cmd == SIM_CMD_CAP_SIZE)
+	    sim->taps[index].cap.size = (capacitor_size_e)value;
+	else
+	    sim->taps[index].cap.grade = (capacitor_grade_e)value;
+	sim_capacitor_reset(&sim->taps[index].cap);
+	break;
+
+    case SIM_CMD_TAP_DEST:
+	if (index < 0 || index >= SIM_TAP_COUNT || value < 0 || value >= SIM_DRAIN_COUNT)
+	    break;
+	sim->taps[index].dest = (tap_dest_e)value;
+	sim_route(sim);
+	break;
+
+    case SIM_CMD_DRAIN_ENABLE:
+	if (index < 0 || index >= SIM_DRAIN_COUNT)
+	    break;
+	sim->drains[index].enabled = value != 0;
+	break;
+    }
+    return 0;
+}
+
+static unsigned update_engine(sim_state_t *sim)
+{
+    if (sim->engine_health <= 0)
+	return cut_power(sim);
+    return 0;
+}
+
+/* Filled before main, so any number of threads can step from the start */
+static thermal_link_t heat_links[HEAT_LINKS];
+static const thermal_net_t heat_net = {SIM_HEAT_NODES, HEAT_LINKS, heat_capacities, heat_links};
+
+__attribute__((constructor)) static void heat_links_init(void)
+{
+    int n = 0, i;
+
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	heat_links[n++] = (thermal_link_t){SIM_HEAT_RING(i), SIM_HEAT_COOLER, HEAT_RING_COOLER};
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	if (i != SIM_RING_ROOT)
+	    heat_links[n++] = (thermal_link_t){SIM_HEAT_RING(SIM_RING_ROOT), SIM_HEAT_RING(i), HEAT_ROOT_RING};
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	heat_links[n++] = (thermal_link_t){SIM_HEAT_CAP(i), SIM_HEAT_COOLER, HEAT_CAP_COOLER};
+    for (i = 0; i + 1 < SIM_TAP_COUNT; i++)
+	heat_links[n++] = (thermal_link_t){SIM_HEAT_CAP(i), SIM_HEAT_CAP(i + 1), HEAT_CAP_CAP};
+    heat_links[n++] = (thermal_link_t){SIM_HEAT_BATTERY, SIM_HEAT_COOLER, HEAT_BATTERY_COOLER};
+}
+
+const thermal_net_t *sim_heat_net(void)
+{
+    return &heat_net;
+}
+
+/* SIM_THERMAL_GRAPH: the heat the step put on each node spreads over the links, and a capacitor left too hot is damaged */
+static void conduct_heat(sim_state_t *sim, float dt)
+{
+    float   flow[SIM_HEAT_NODES];
+    int	    t;
+
+    sim->heat_temp[SIM_HEAT_COOLER] = sim->cooler_temp;
+    thermal_step(&heat_net, sim->heat_temp, flow, 1, dt);
+    sim->cooler_temp = sim->heat_temp[SIM_HEAT_COOLER];
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+    {
+	capacitor_t *cap = &sim->taps[t].cap;
+
+	if (sim->heat_temp[SIM_HEAT_CAP(t)] > CAP_MAX_TEMP)
+	{
+	    cap->health -= CAP_OVERHEAT_DAMAGE * (sim->heat_temp[SIM_HEAT_CAP(t)] - CAP_MAX_TEMP) * dt;
+	    if (cap->health < 0)
+		cap->health = 0;
+	}
+    }
+}
+
+static void update_engine_heat(sim_state_t *sim, float dt)
+{
+    const float *power = sim->ring_power;
+    float f;
+
+    if (sim->thermal == SIM_THERMAL_GRAPH)
+    {
+	/* The same terms as below, each on its own ring */
+	f = power[SIM_RING_ROOT] * 5 * dt;
+	add_heat(sim, SIM_HEAT_RING(SIM_RING_ROOT), power[SIM_RING_ROOT] * f);
+	add_heat(sim, SIM_HEAT_RING(SIM_RING_Q), POWER_TO_TEMP(power[SIM_RING_Q]) * 0.4 * f);
+	add_heat(sim, SIM_HEAT_RING(SIM_RING_R), POWER_TO_TEMP(power[SIM_RING_R]) * 0.3 * f);
+	add_heat(sim, SIM_HEAT_RING(SIM_RING_S), POWER_TO_TEMP(power[SIM_RING_S]) * 0.2 * f);
+	conduct_heat(sim, dt);
+    }
+    else
+    {
+	f = power[SIM_RING_ROOT];
+
+	f += POWER_TO_TEMP(power[SIM_RING_Q]) * 0.4;
+	f += POWER_TO_TEMP(power[SIM_RING_R]) * 0.3;
+	f += POWER_TO_TEMP(power[SIM_RING_S]) * 0.2;
+
+	f *= power[SIM_RING_ROOT];
+	add_heat(sim, SIM_HEAT_COOLER, f * 5 * dt);
+    }
+    cooler_dissipate_heat(sim, dt);
+    if (sim->cooler_temp > MAX_COOLER_TEMP)
+    {
+	    damage_engine(sim, ENGINE_OVERHEAT_DAMAGE * (sim->cooler_temp - MAX_COOLER_TEMP) * dt);
+    }
+}
+
+static unsigned update_fuel(sim_state_t *sim, float dt)
+{
+    sim->fuel_rate = FUEL_CONSUME_RATE(sim->ring_power[SIM_RING_ROOT]);
+    sim->fuel_level += dt * sim->fuel_rate;
+    if (sim->fuel_level < 0)
+    {
+	sim->fuel_level = 0.0;
+	return cut_power(sim);
+    }
+    else if (sim->fuel_level > MAX_FUEL_LEVEL)
+	sim->fuel_level = MAX_FUEL_LEVEL;
+    return 0;
+}
+
+/* u is the drain's DRAW_PER_DRAIN uniforms */
+static void update_drain(sim_state_t *sim, power_drain_t *d, drain_kind_e kind, const float *u, float dt)
+{
+    if (!d->enabled)
+    {
+	d->rate = 0;
+	return;
+    }
+
+    switch (kind)
+    {
+    case DRAIN_KIND_THRUST:
+	/* Thrusters get a pretty sinusoidal power usage, with a low degree of variance. */
+	d->rate = (sin(sim->time * d->wave_freq) + 1) / 2.0;
+	if (chance(u[DRAW_SPIKE], d->spike_probability, dt))
+	{
+	    d->wave_freq = 1.0 * (uniform_range(u[DRAW_AMOUNT], 1, 100) / 100.0);
+	}
+	break;
+
+    case DRAIN_KIND_SHIELD:
+	/* Shields get large spikes that gradually drain away, losing 10% every 1/60 s */
+	if (chance(u[DRAW_SPIKE], d->spike_probability, dt))
+	{
+	    d->rate += (uniform_range(u[DRAW_AMOUNT], 1, 30) / 100.0);
+	}
+	d->rate *= powf(0.9, SIM_TUNED_HZ * dt);
+	if (d->rate > 1.0) d->rate = 1.0;
+	if (d->rate < 0) d->rate = 0;
+	break;
+
+    default:
+	/* Weapons gradually, quickly, build up for up to a second, then drop to nothing */
+	if (d->charging > 0 || chance(u[DRAW_SPIKE], d->spike_probability, dt))
+	{
+	    d->charging += dt;
+	}
+	if (d->charging > 1.0 || chance(u[DRAW_AMOUNT], d->spike_probability, dt))
+	{
+	    d->charging = 0;
+	    d->rate -= 0.2;
+	}
+
+	if (d->charging > 0)
+	    d->rate += (0.6 + (d->rate * 6)) * dt;
+	else
+	    d->rate -= 12 * dt;
+
+	if (d->rate > 1.0) d->rate = 1.0;
+	if (d->rate < 0) d->rate = 0;
+	break;
+    }
+}
+
+static void update_drains(sim_state_t *sim, float dt)
+{
+    float   u[DRAW_COUNT];
+    int	    i;
+
+    rng_fill_uniform(&sim->rng, u, DRAW_COUNT);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	update_drain(sim, &sim->drains[i], drain_kinds[i], &u[DRAW_PER_DRAIN * i], dt);
+}
+
+static void update_power_taps(sim_state_t *sim)
+{
+    float   p = sim->total_output_power;
+    int	    i;
+
+    /* Bottom 10% goes to battery, remaining 90% divided between the taps by tap_bands. The battery's level has no floor. */
+    sim->tap_bat.level = p / BAT_BAND < 1.0 ? p / BAT_BAND : 1.0;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	sim->taps[i].level = level_clamp((p - tap_bands[i].lo) / tap_bands[i].width);
+}
+
+static void fill_capacitor(sim_state_t *sim, power_tap_t *tap, float strength, float dt)
+{
+    float f = tap->level * cap_grade_dmg_factor[(int)tap->cap.grade];
+
+    if (tap->cap.charge > tap->cap.full_limit)
+	strength *= (2 * cap_grade_dmg_factor[(int)tap->cap.grade]);
+
+    if (tap->cap.health > 0)
+    {
+	tap->cap.charge +=  strength *
+			    (tap->level / cap_max_charges[(int)tap->cap.size]) *
+			    cap_grade_chrg_rate[(int)tap->cap.grade] *
+			    tap->cap.health * dt;
+    }
+
+    if (tap->cap.charge > tap->cap.max_charge)
+    {
+	tap->cap.health -= 0.006 * tap->level * f * dt;
+	add_heat(sim, SIM_HEAT_CAP(tap - sim->taps), 60.0 * f * dt);
+	if (tap->cap.health < 0)
+	    tap->cap.health = 0;
+
+	if (tap->cap.health == 0)
+	    tap->cap.charge = 0;
+	else
+	    tap->cap.charge = tap->cap.max_charge;
+    }
+    else
+	add_heat(sim, SIM_HEAT_CAP(tap - sim->taps), 6.0 * (tap->cap.charge / tap->cap.max_charge) * f * dt);
+}
+
+/* pct is the share of this step's draw the battery has to cover */
+static void drain_battery(sim_state_t *sim, power_drain_t *d, float pct, float dt)
+{
+    float want = d->rate * d->factor * pct * dt;
+
+    d->delivered += (want < sim->tap_bat.cap.charge ? want : sim->tap_bat.cap.charge) / dt;
+    sim->tap_bat.cap.charge -= want;
+    add_heat(sim, SIM_HEAT_BATTERY, d->rate * 258 * pct * dt);
+    if (sim->tap_bat.cap.charge < 0)
+    {
+	d->enabled = 0;
+	sim->tap_bat.cap.charge = 0;
+    }
+}
+
+static void decay_capacitor(power_tap_t *tap, float dt)
+{
+    if (tap->cap.charge > tap->cap.full_limit)
+    {
+	/* Based on grade, the capacitor charge will decay until it reaches its full limit. Higher grade capacitors will discharge more slowly. The less
+	 * charge currently feeding this tap, the more quickly it will will discharge.
+	 */
+	float decay = 6.0;
+
+	decay *= cap_grade_dmg_factor[(int)tap->cap.grade];
+	if (tap->level <= 0)
+	    tap->cap.charge -= decay * dt;
+	//decay *= 1.0 - tap->level;
+	//tap->cap.charge -= decay;
+	if (tap->cap.charge < tap->cap.full_limit)
+	    tap->cap.charge = tap->cap.full_limit;
+
+    }
+}
+
+static void drain_capacitor(sim_state_t *sim, power_tap_t *tap, float dt)
+{
+    /* This assumes that fill_capacitor has been called this frame */
+
+    power_drain_t   *d = &sim->drains[tap->dest];
+    float	    rate;
+    int		    num_connected = 0; /* The number of drains that this tap shares */
+    int		    k;
+
+    decay_capacitor(tap, dt);
+
+    for (k = sim->route_first[tap->dest]; k < sim->route_first[tap->dest + 1]; k++)
+	if (sim->taps[sim->route_taps[k]].cap.charge > 0)
+	    num_connected++;
+
+    if (num_connected == 0)
+    {
+	/* Drain battery instead */
+	drain_battery(sim, d, 1.0, dt);
+    }
+    else
+    {
+	float diff;
+	rate = d->rate / num_connected;
+	rate *= d->factor * dt; /* What this tap gives up this step */
+	if (rate > tap->cap.charge)
+	{
+	    diff = rate - tap->cap.charge;
+	    drain_battery(sim, d, diff/rate, dt);
+	}
+	d->delivered += (rate < tap->cap.charge ? rate : tap->cap.charge) / dt;
+	tap->cap.charge -= rate;
+	if (tap->cap.charge < 0)
+	    tap->cap.charge = 0;
+
+
+    }
+
+}
+/* TODO: Implement power delivered progress bars below Power Usage (change to Power Requested) to show how much power is actually getting to the
+ *	 thrusters/shields/weapons. Make it so that power delivered is less if it's coming from batteries. */
+/* TODO: Add a route to battery option for the power taps */
+/* TODO: Tune and balance */
+
+_Static_assert(SIM_FLOW_SOURCES <= FLOW_MAX_SOURCES && SIM_DRAIN_COUNT <= FLOW_MAX_SINKS &&
+	       SIM_FLOW_EDGES <= FLOW_MAX_EDGES, "Layout too big for a flow_net_t");
+_Static_assert(SIM_FLOW_SOURCES <= 32, "Too many sources for sim_save_t's flow_bound_sources");
+
+/* SIM_POWER_FLOW's take on drain_capacitor and drain_battery for every drain at once */
+static void route_flow(sim_state_t *sim, float dt)
+{
+    flow_net_t	net;
+    int		i, k, e, t;
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+    {
+	decay_capacitor(&sim->taps[t], dt);
+	sim->taps[t].cap.charge = sim->taps[t].cap.charge > 0 ? sim->taps[t].cap.charge : 0;
+    }
+
+    flow_init(&net);
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+	flow_source(&net, sim->taps[t].cap.charge);
+    flow_source(&net, sim->tap_bat.cap.charge);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	power_drain_t *d = &sim->drains[battery_order[i]];
+
+	flow_sink(&net, d->rate * d->factor * dt);
+	for (k = sim->route_first[battery_order[i]]; k < sim->route_first[battery_order[i] + 1]; k++)
+	    flow_edge(&net, sim->route_taps[k], 0);
+	flow_edge(&net, SIM_TAP_COUNT, 1);
+    }
+
+    flow_route(&net, &sim->flow.memo, sim->flow.supply, sim->flow.demand, sim->flow.flow, sim->flow.budget);
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+	sim->taps[t].cap.charge = net.left[t];
+    sim->tap_bat.cap.charge = net.left[SIM_TAP_COUNT];
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	power_drain_t *d = &sim->drains[battery_order[i]];
+
+	d->delivered = (net.demand[i] - net.unmet[i]) / dt;
+	for (e = net.first[i]; e < net.first[i + 1]; e++)
+	    if (net.edge[e].source == SIM_TAP_COUNT && net.flow[e] > 0)
+		add_heat(sim, SIM_HEAT_BATTERY, 258 * net.flow[e] / d->factor); /* As drain_battery, per unit drawn */
+	if (net.unmet[i] > 0)
+	    d->enabled = 0; /* The battery ran dry under it */
+    }
+}
+
+static void update_capacitors(sim_state_t *sim, float dt)
+{
+    int		i, t;
+
+    if (sim->power == SIM_POWER_FLOW)
+    {
+	route_flow(sim, dt);
+	for (t = 0; t < SIM_TAP_COUNT; t++)
+	    fill_capacitor(sim, &sim->taps[t], tap_fill_strengths[t], dt);
+	return;
+    }
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	sim->drains[i].delivered = 0;
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+	drain_capacitor(sim, &sim->taps[t], dt);
+
+    /* Drains no tap is routed to run straight off the battery */
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	if (sim->route_first[battery_order[i]] == sim->route_first[battery_order[i] + 1])
+	    drain_battery(sim, &sim->drains[battery_order[i]], 1.0, dt);
+
+    for (t = 0; t < SIM_TAP_COUNT; t++)
+	fill_capacitor(sim, &sim->taps[t], tap_fill_strengths[t], dt);
+
+}
+
+static void update_battery(sim_state_t *sim, float dt)
+{
+    sim->tap_bat.cap.charge += 1.8 * (sim->tap_bat.level / MAX_BAT_CHARGE) * dt;
+    if (sim->tap_bat.cap.charge > MAX_BAT_CHARGE)
+	sim->tap_bat.cap.charge = MAX_BAT_CHARGE;
+}
+
+unsigned sim_step(sim_state_t *sim, float dt)
+{
+    unsigned changed;
+
+    sim->time += dt;
+
+    changed = update_engine(sim);
+    changed |= update_fuel(sim, dt);
+    update_drains(sim, dt);
+    update_power_taps(sim);
+    update_battery(sim, dt);
+    update_capacitors(sim, dt);
+    update_engine_heat(sim, dt);
+
+    return changed;
+}
+
+static float lerp(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+static void lerp_tap(power_tap_t *out, const power_tap_t *a, const power_tap_t *b, float t)
+{
+    out->level = lerp(a->level, b->level, t);
+    out->cap.charge = lerp(a->cap.charge, b->cap.charge, t);
+    out->cap.health = lerp(a->cap.health, b->cap.health, t);
+}
+
+void sim_lerp(sim_state_t *out, const sim_state_t *a, const sim_state_t *b, float alpha)
+{
+    int i;
+
+    *out = *b;
+
+    out->cooler_temp = lerp(a->cooler_temp, b->cooler_temp, alpha);
+    out->fuel_level = lerp(a->fuel_level, b->fuel_level, alpha);
+    out->fuel_rate = lerp(a->fuel_rate, b->fuel_rate, alpha);
+    out->engine_health = lerp(a->engine_health, b->engine_health, alpha);
+
+    lerp_tap(&out->tap_bat, &a->tap_bat, &b->tap_bat, alpha);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	lerp_tap(&out->taps[i], &a->taps[i], &b->taps[i], alpha);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+	out->drains[i].rate = lerp(a->drains[i].rate, b->drains[i].rate, alpha);
+    for (i = 0; i < SIM_HEAT_NODES; i++)
+	out->heat_temp[i] = lerp(a->heat_temp[i], b->heat_temp[i], alpha);
+}
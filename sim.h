@@ -0,0 +1,266 @@
+#ifndef SCPULSE_SIM_H
+#define SCPULSE_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rng.h"
+#include "sim_flow.h"
+
+/* Engine simulation: fuel, heat, power taps, capacitors, battery and drains. Nothing in here depends on raylib or
+ * miniaudio, and all of it lives in a sim_state_t, so any number of them can be stepped side by side with no window or
+ * audio device.
+ */
+
+#define FUEL_RESTORE_RATE 50 /* Liters/s */
+#define MAX_FUEL_LEVEL 100000.0 /* Liters */
+#define MAX_COOLER_TEMP 1400 /* Degrees C */
+#define COOLER_COOL_RATE(x) ((powf((x / MAX_COOLER_TEMP), 1.2) * (MAX_COOLER_TEMP * 0.6))) /* Degrees/s */
+#define MAX_INPUT_POWER 2980 /* Amps */
+#define FUEL_CONSUME_RATE(x) ((-1 * ((x)*20) * ((x)*20) * ((x)*20)) + FUEL_RESTORE_RATE) /* Multiplies, not powf, so it vectorizes */
+#define POWER_TO_TEMP(x) (((x)*33) * ((x)*33)) /* 0 < x < 1.0 */
+
+#define MAX_BAT_CHARGE 100.0
+
+/* How COOLER_COOL_RATE's x^1.2 gets worked out. powf is what the game was tuned with. The other two are in sim_math.h,
+ * cheaper, and within a few millionths of x^1.2, closer than powf of a float 1.2 gets.
+ */
+typedef enum {
+    SIM_MATH_POWF = 0,
+    SIM_MATH_TABLE = 1,	/* Interpolated table */
+    SIM_MATH_POLY = 2,	/* Polynomial */
+    SIM_MATH_COUNT
+} sim_math_e;
+
+#ifndef SIM_MATH_DEFAULT
+#define SIM_MATH_DEFAULT SIM_MATH_POWF /* What sim_init and sim_batch_init pick */
+#endif
+
+/* How the capacitors and battery share out what the drains draw. SIM_POWER_TAPS is what the game was tuned with and
+ * what the batch steps: each charged tap routed to a drain gives it an even share, and the battery covers whatever a tap
+ * is short. SIM_POWER_FLOW solves a flow network (sim_flow.h) with the taps' capacitors as the first tier and the
+ * battery as the second, so a drain's taps top each other up before the battery is touched, drains are served in
+ * battery_order, and the network is only solved again when a supply it used up, or the demand of a drain drawing on one,
+ * has moved more than flow.memo.threshold, and flow.budget has a solve for it.
+ */
+typedef enum {
+    SIM_POWER_TAPS = 0,
+    SIM_POWER_FLOW = 1,
+    SIM_POWER_COUNT
+} sim_power_e;
+
+#ifndef SIM_POWER_DEFAULT
+#define SIM_POWER_DEFAULT SIM_POWER_TAPS /* What sim_init picks */
+#endif
+
+#define SIM_FLOW_THRESHOLD 0.02 /* What sim_init sets flow.memo.threshold to */
+
+/* Where heat goes. SIM_THERMAL_COOLER is what the game was tuned with and what the batch steps: everything goes straight
+ * into cooler_temp. SIM_THERMAL_GRAPH gives each ring, capacitor and the battery a temperature of its own (heat_temp),
+ * warmed by its own heat and conducting to its neighbours and the cooler over the links in sim_rules.h (sim_thermal.h
+ * solves them). The cooler is still what sheds heat and what overheats the engine, and a capacitor hotter than
+ * CAP_MAX_TEMP loses health.
+ */
+typedef enum {
+    SIM_THERMAL_COOLER = 0,
+    SIM_THERMAL_GRAPH = 1,
+    SIM_THERMAL_COUNT
+} sim_thermal_e;
+
+#ifndef SIM_THERMAL_DEFAULT
+#define SIM_THERMAL_DEFAULT SIM_THERMAL_COOLER /* What sim_init picks */
+#endif
+
+/* Every rate in the sim is per second. They were originally per frame, tuned at about this many frames per second, and
+ * the probabilities of the random drain events still are.
+ */
+#define SIM_TUNED_HZ 60.0
+
+#define SIM_ROOT_FREQ 40.0 /* Hz, every ring starts here */
+
+/* Same order as osc_id_e */
+typedef enum {
+    SIM_RING_ROOT = 0,
+    SIM_RING_Q = 1,
+    SIM_RING_R = 2,
+    SIM_RING_S = 3,
+    SIM_RING_COUNT
+} sim_ring_e;
+
+/* The ship's layout: how many power taps it has, not counting the battery's, and how many drains. Any tap can be routed
+ * to any drain. What kind each drain is, where each tap's band of the output starts and how hard it fills are tables in
+ * sim_rules.h with one entry per tap or drain, so a different ship is these two counts and those tables.
+ */
+#define SIM_TAP_COUNT 3
+#define SIM_DRAIN_COUNT 3
+
+/* The default layout's drains, and what SIM_CMD_TAP_DEST takes */
+typedef enum {
+    TAP_DEST_THRUST = 0,
+    TAP_DEST_SHIELD = 1,
+    TAP_DEST_WEAPON = 2,
+} tap_dest_e;
+
+/* How a drain draws its power */
+typedef enum {
+    DRAIN_KIND_THRUST = 0,	/* A sine, its frequency changed now and then */
+    DRAIN_KIND_SHIELD = 1,	/* Spikes that decay */
+    DRAIN_KIND_WEAPON = 2,	/* Builds up for up to a second, then drops to nothing */
+    DRAIN_KIND_COUNT
+} drain_kind_e;
+
+typedef enum {
+    CAP_SIZE_SMALL = 0,
+    CAP_SIZE_MED = 1,
+    CAP_SIZE_LARGE = 2,
+} capacitor_size_e;
+
+typedef enum {
+    CAP_GRADE_CON = 0,
+    CAP_GRADE_PRO = 1,
+    CAP_GRADE_MIL = 2,
+} capacitor_grade_e;
+
+typedef struct capacitor_s
+{
+    /* Capacitors have:
+	- sizes (small, medium, large)
+	- Quality (low, average, high)
+
+	- frequency tolerance?
+
+	smaller capacitors can't hold as much charge, so they are required to have power drawn from them in order to not over-charge, over-heat, and incur damage
+
+    */
+    float		health;
+    float		charge;
+    float		max_charge;
+    float		full_limit;
+
+
+    capacitor_grade_e	grade;
+    capacitor_size_e	size;
+} capacitor_t;
+
+typedef struct power_drain_s
+{
+    float   rate;
+    float   spike_probability; /* random chance of power draw/peak */
+    bool    enabled;
+    float   factor; /* multiplier for how quickly the source gets drained, per second */
+    float   delivered; /* Charge per second the capacitors and battery actually handed over in the latest step */
+    float   wave_freq; /* DRAIN_KIND_THRUST's */
+    float   charging; /* DRAIN_KIND_WEAPON's seconds charging, 0 when it isn't */
+} power_drain_t;
+
+typedef struct power_tap_s
+{
+    float	    level; /* This is the instantaneous level of input power based on overall power output. Range: 0 - 1.0 */
+    capacitor_t	    cap; /* The amount of power available for the drain is stored in the capacitor */
+    tap_dest_e	    dest; /* Index into sim_state_t.drains. Set with sim_apply, or call sim_route after. */
+
+    float	    charge_mult;
+} power_tap_t;
+
+/* SIM_THERMAL_GRAPH's nodes: the rings, the taps' capacitors, the battery, and the cooler last */
+#define SIM_HEAT_RING(r) (r)
+#define SIM_HEAT_CAP(t) (SIM_RING_COUNT + (t))
+#define SIM_HEAT_BATTERY (SIM_RING_COUNT + SIM_TAP_COUNT)
+#define SIM_HEAT_COOLER (SIM_HEAT_BATTERY + 1)
+#define SIM_HEAT_NODES (SIM_HEAT_COOLER + 1)
+
+#define SIM_FLOW_SOURCES (SIM_TAP_COUNT + 1) /* The taps' capacitors, then the battery */
+#define SIM_FLOW_EDGES (SIM_TAP_COUNT + SIM_DRAIN_COUNT) /* Each tap to its drain, and the battery to every drain */
+
+/* SIM_POWER_FLOW's latest full solve, which steps whose bound supplies and demands are within threshold of reuse.
+ * sim_route clears memo.valid, the network's shape changed.
+ */
+typedef struct sim_flow_s
+{
+    flow_memo_t	memo;
+    float	supply[SIM_FLOW_SOURCES];
+    float	demand[SIM_DRAIN_COUNT];    /* In battery_order */
+    float	flow[SIM_FLOW_EDGES];
+
+    /* Full solves a fleet of these gets a tick, shared by ships stepped on one thread, which calls flow_budget_tick
+     * before each tick's. NULL is no cap. Not saved, and a copy of the state shares it, so a copy stepped elsewhere
+     * wants it set to its own or NULL.
+     */
+    flow_budget_t *budget;
+} sim_flow_t;
+
+typedef struct sim_state_s
+{
+    /* Ring sliders. The root's power is the input power, the others' are relative to it. */
+    float	    ring_power[SIM_RING_COUNT];
+    float	    ring_freq[SIM_RING_COUNT];
+
+    float	    cooler_temp;
+    float	    fuel_level;
+    float	    fuel_rate;
+    float	    total_output_power; /* Fed in from the audio: peak of the latest block */
+    float	    engine_health;
+    bool	    engine_overload;	/* Fed in from the audio: the latest block overloaded */
+
+    power_tap_t	    tap_bat;
+    power_tap_t	    taps[SIM_TAP_COUNT];
+    power_drain_t   drains[SIM_DRAIN_COUNT];
+
+    /* The taps routed to drain d are route_taps[route_first[d]] up to route_taps[route_first[d + 1]], in tap order.
+     * sim_route builds it from the taps' dests, so only a routing change pays for it.
+     */
+    uint8_t	    route_first[SIM_DRAIN_COUNT + 1];
+    uint8_t	    route_taps[SIM_TAP_COUNT];
+
+    rng_t	    rng;	    /* Everything random in the sim comes from here, so a seed replays exactly */
+    double	    time;	    /* Seconds simulated */
+    sim_math_e	    math;	    /* For cooler_dissipate_heat */
+    sim_power_e	    power;
+    sim_flow_t	    flow;
+    sim_thermal_e   thermal;
+    float	    heat_temp[SIM_HEAT_NODES]; /* SIM_THERMAL_GRAPH's, degrees C. The cooler's is cooler_temp. */
+} sim_state_t;
+
+/* Changes from the player. Whoever owns the sim applies them between steps, so they can be queued from another thread. */
+typedef enum {
+    SIM_CMD_POWER = 0,		/* index: sim_ring_e, value: 0-1 */
+    SIM_CMD_FREQ = 1,		/* index: sim_ring_e, value: Hz */
+    SIM_CMD_REFUEL = 2,
+    SIM_CMD_REPAIR = 3,
+    SIM_CMD_RANDOMIZE_DRAINS = 4,
+    SIM_CMD_CAP_SIZE = 5,	/* index: tap, value: capacitor_size_e */
+    SIM_CMD_CAP_GRADE = 6,	/* index: tap, value: capacitor_grade_e */
+    SIM_CMD_TAP_DEST = 7,	/* index: tap, value: drain */
+    SIM_CMD_DRAIN_ENABLE = 8,	/* index: drain, value: 0 or 1 */
+} sim_cmd_e;
+
+/* What sim_apply and sim_step changed that the audio needs to hear about */
+#define SIM_CHANGED_POWER 0x1
+#define SIM_CHANGED_FREQ 0x2
+
+/* Two sims with the same seed given the same commands and audio stay bit-identical */
+void sim_init(sim_state_t *sim, uint64_t seed);
+void sim_randomize_drains(sim_state_t *sim);
+void sim_capacitor_reset(capacitor_t *cap); /* Empty and repaired, with the limits of its size */
+
+/* Rebuilds the routing index from the taps' dests, any out of range going to drain 0. sim_apply does this itself. */
+void sim_route(sim_state_t *sim);
+
+/* Returns SIM_CHANGED_* flags */
+unsigned sim_apply(sim_state_t *sim, sim_cmd_e cmd, int index, float value);
+
+/* Advance by dt seconds. Returns SIM_CHANGED_POWER when the sim cut the input power itself (engine dead or out of fuel). */
+unsigned sim_step(sim_state_t *sim, float dt);
+
+/* What the ring's oscillator amplitude should be: its power, scaled by the input power for all but the root */
+float sim_ring_amplitude(const sim_state_t *sim, sim_ring_e ring);
+
+/* Called with the number of samples over the overload level the audio has produced since the last call */
+void sim_audio_overload(sim_state_t *sim, uint32_t overloads);
+
+/* out = a moved alpha (0-1) of the way to b, for drawing between two steps. Only what is shown on screen is blended, the
+ * rest is b's.
+ */
+void sim_lerp(sim_state_t *out, const sim_state_t *a, const sim_state_t *b, float alpha);
+
+#endif
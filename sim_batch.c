@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim_batch.h"
+#include "sim_rules.h"
+
+#define SIM_BATCH_LANES 4
+#include "sim_batch_step.h"
+
+bool sim_batch_init(sim_batch_t *batch, uint32_t capacity)
+{
+    uint32_t	blocks = SIM_BATCH_BLOCKS(capacity);
+    sim_state_t	idle;
+    uint32_t	i;
+
+    memset(batch, 0, sizeof(*batch));
+    if (blocks == 0)
+	return false;
+    batch->blocks = aligned_alloc(64, (size_t)blocks * sizeof(sim_block_t));
+    batch->cold = calloc((size_t)blocks * SIM_BATCH_BLOCK, sizeof(sim_state_t));
+    if (batch->blocks == NULL || batch->cold == NULL)
+    {
+	sim_batch_free(batch);
+	return false;
+    }
+    batch->capacity = blocks * SIM_BATCH_BLOCK;
+    batch->math = SIM_MATH_DEFAULT;
+
+#if defined(SIM_BATCH_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    batch->avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    /* Idle ships in every lane, so the spare ones step like any other */
+    sim_init(&idle, 0);
+    for (i = 0; i < batch->capacity; i++)
+	sim_batch_put(batch, i, &idle);
+    return true;
+}
+
+void sim_batch_free(sim_batch_t *batch)
+{
+    free(batch->blocks);
+    free(batch->cold);
+    memset(batch, 0, sizeof(*batch));
+}
+
+int sim_batch_add(sim_batch_t *batch, const sim_state_t *sim)
+{
+    if (batch->count == batch->capacity || sim->power != SIM_POWER_TAPS)
+	return -1;
+    if (batch->count == 0)
+	batch->math = sim->math;
+    else if (sim->math != batch->math)
+	return -1;
+    sim_batch_put(batch, batch->count, sim);
+    return batch->count++;
+}
+
+void sim_batch_put(sim_batch_t *batch, uint32_t ship, const sim_state_t *sim)
+{
+    sim_block_t	*b = &batch->blocks[ship / SIM_BATCH_BLOCK];
+    uint32_t	l = ship % SIM_BATCH_BLOCK;
+    int		i;
+
+    batch->cold[ship] = *sim;
+
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	b->ring_power[i][l] = sim->ring_power[i];
+    b->cooler_temp[l] = sim->cooler_temp;
+    b->fuel_level[l] = sim->fuel_level;
+    b->fuel_rate[l] = sim->fuel_rate;
+    b->total_output_power[l] = sim->total_output_power;
+    b->engine_health[l] = sim->engine_health;
+    b->graph[l] = sim->thermal == SIM_THERMAL_GRAPH;
+    for (i = 0; i < SIM_HEAT_NODES; i++)
+	b->heat_temp[i][l] = sim->heat_temp[i];
+
+    b->bat_level[l] = sim->tap_bat.level;
+    b->bat_charge[l] = sim->tap_bat.cap.charge;
+
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	const capacitor_t *cap = &sim->taps[i].cap;
+
+	b->tap_level[i][l] = sim->taps[i].level;
+	b->cap_charge[i][l] = cap->charge;
+	b->cap_health[i][l] = cap->health;
+	b->cap_max[i][l] = cap->max_charge;
+	b->cap_full[i][l] = cap->full_limit;
+	b->cap_size_max[i][l] = cap_max_charges[(int)cap->size];
+	b->cap_dmg[i][l] = cap_grade_dmg_factor[(int)cap->grade];
+	b->cap_chrg[i][l] = cap_grade_chrg_rate[(int)cap->grade];
+	b->tap_dest[i][l] = (unsigned)sim->taps[i].dest < SIM_DRAIN_COUNT ? sim->taps[i].dest : 0; /* As sim_route has it */
+    }
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	b->drain_rate[i][l] = sim->drains[i].rate;
+	b->drain_spike[i][l] = sim->drains[i].spike_probability;
+	b->drain_factor[i][l] = sim->drains[i].factor;
+	b->drain_delivered[i][l] = sim->drains[i].delivered;
+	b->drain_on[i][l] = sim->drains[i].enabled;
+	b->drain_freq[i][l] = sim->drains[i].wave_freq;
+	b->drain_charging[i][l] = sim->drains[i].charging;
+    }
+
+    b->time[l] = sim->time;
+    for (i = 0; i < 4; i++)
+	b->rng[i][l] = sim->rng.s[i];
+    b->changed[l] = 0;
+}
+
+void sim_batch_get(const sim_batch_t *batch, uint32_t ship, sim_state_t *sim)
+{
+    const sim_block_t	*b = &batch->blocks[ship / SIM_BATCH_BLOCK];
+    uint32_t		l = ship % SIM_BATCH_BLOCK;
+    int			i;
+
+    *sim = batch->cold[ship];
+
+    for (i = 0; i < SIM_RING_COUNT; i++)
+	sim->ring_power[i] = b->ring_power[i][l];
+    sim->cooler_temp = b->cooler_temp[l];
+    sim->fuel_level = b->fuel_level[l];
+    sim->fuel_rate = b->fuel_rate[l];
+    sim->total_output_power = b->total_output_power[l];
+    sim->engine_health = b->engine_health[l];
+    for (i = 0; i < SIM_HEAT_NODES; i++)
+	sim->heat_temp[i] = b->heat_temp[i][l];
+
+    sim->tap_bat.level = b->bat_level[l];
+    sim->tap_bat.cap.charge = b->bat_charge[l];
+
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+    {
+	capacitor_t *cap = &sim->taps[i].cap;
+
+	sim->taps[i].level = b->tap_level[i][l];
+	cap->charge = b->cap_charge[i][l];
+	cap->health = b->cap_health[i][l];
+	cap->max_charge = b->cap_max[i][l];
+	cap->full_limit = b->cap_full[i][l];
+	sim->taps[i].dest = (tap_dest_e)b->tap_dest[i][l];
+    }
+    sim_route(sim);
+
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	sim->drains[i].rate = b->drain_rate[i][l];
+	sim->drains[i].spike_probability = b->drain_spike[i][l];
+	sim->drains[i].factor = b->drain_factor[i][l];
+	sim->drains[i].delivered = b->drain_delivered[i][l];
+	sim->drains[i].enabled = b->drain_on[i][l] != 0;
+	sim->drains[i].wave_freq = b->drain_freq[i][l];
+	sim->drains[i].charging = b->drain_charging[i][l];
+    }
+
+    sim->time = b->time[l];
+    for (i = 0; i < 4; i++)
+	sim->rng.s[i] = b->rng[i][l];
+}
+
+unsigned sim_batch_apply(sim_batch_t *batch, uint32_t ship, sim_cmd_e cmd, int index, float value)
+{
+    sim_state_t sim;
+    unsigned	changed;
+
+    /* Commands are rare next to steps, so they go through a whole sim_state_t rather than a second sim_apply */
+    sim_batch_get(batch, ship, &sim);
+    changed = sim_apply(&sim, cmd, index, value);
+    sim_batch_put(batch, ship, &sim);
+    return changed;
+}
+
+/* ==================== Step ==================== */
+
+static void step_default(sim_block_t *restrict b, sim_math_e math, float shield_decay, float dt)
+{
+    block_step(b, math, shield_decay, dt);
+}
+
+void sim_batch_step(sim_batch_t *batch, uint32_t first, uint32_t count, float dt)
+{
+    float	shield_decay = powf(0.9, SIM_TUNED_HZ * dt); /* Same for every ship */
+    uint32_t	i;
+
+#ifdef SIM_BATCH_X86
+    if (batch->avx2)
+    {
+	for (i = first; i < first + count; i++)
+	    sim_batch_step_avx2(&batch->blocks[i], batch->math, shield_decay, dt);
+	return;
+    }
+#endif
+    for (i = first; i < first + count; i++)
+	step_default(&batch->blocks[i], batch->math, shield_decay, dt);
+}
@@ -0,0 +1,101 @@
+#ifndef SCPULSE_SIM_BATCH_H
+#define SCPULSE_SIM_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SIM_BATCH_X86 1 /* There's an AVX2 build of the step to pick at runtime */
+#endif
+
+/* Many ships stepped together. Ships are kept in blocks of SIM_BATCH_BLOCK, and inside a block every field is an array
+ * over its ships (all the cooler temperatures together, all the tap 1 charges together, and so on), so a step is a few
+ * straight loops over the block instead of one ship's fields at a time. Stepping a ship in a batch gives bit for bit
+ * what sim_step gives it.
+ *
+ * Only what a step reads or writes lives in the blocks. Everything else about a ship stays in a sim_state_t on the side
+ * and comes back with sim_batch_get.
+ *
+ * The blocks share power out the SIM_POWER_TAPS way only. sim_batch_add turns down SIM_POWER_FLOW ships: the router
+ * solves a network per ship, with nothing to do a vector of ships at a time.
+ *
+ * Heat goes either way, per ship. SIM_THERMAL_GRAPH ships keep their node temperatures in the block, node-major like
+ * thermal_step wants them, and a block with any such ship conducts all its lanes at once, keeping the GRAPH ships'.
+ */
+
+#define SIM_BATCH_BLOCK 64 /* Ships per block. A block is about 16KB, it stays in L1 for the whole step. */
+
+typedef struct sim_block_s
+{
+    float	ring_power[SIM_RING_COUNT][SIM_BATCH_BLOCK];
+    float	cooler_temp[SIM_BATCH_BLOCK];
+    float	fuel_level[SIM_BATCH_BLOCK];
+    float	fuel_rate[SIM_BATCH_BLOCK];
+    float	total_output_power[SIM_BATCH_BLOCK];	/* Input, like sim_state_t's */
+    float	engine_health[SIM_BATCH_BLOCK];
+    float	graph[SIM_BATCH_BLOCK];				/* thermal is SIM_THERMAL_GRAPH, 1 or 0 */
+    float	heat_temp[SIM_HEAT_NODES][SIM_BATCH_BLOCK];
+
+    float	bat_level[SIM_BATCH_BLOCK];
+    float	bat_charge[SIM_BATCH_BLOCK];
+
+    float	tap_level[SIM_TAP_COUNT][SIM_BATCH_BLOCK];
+    float	cap_charge[SIM_TAP_COUNT][SIM_BATCH_BLOCK];
+    float	cap_health[SIM_TAP_COUNT][SIM_BATCH_BLOCK];
+    float	cap_max[SIM_TAP_COUNT][SIM_BATCH_BLOCK];
+    float	cap_full[SIM_TAP_COUNT][SIM_BATCH_BLOCK];
+    float	cap_size_max[SIM_TAP_COUNT][SIM_BATCH_BLOCK];	/* cap_max_charges of its size */
+    float	cap_dmg[SIM_TAP_COUNT][SIM_BATCH_BLOCK];	/* cap_grade_dmg_factor of its grade */
+    float	cap_chrg[SIM_TAP_COUNT][SIM_BATCH_BLOCK];	/* cap_grade_chrg_rate of its grade */
+    float	tap_dest[SIM_TAP_COUNT][SIM_BATCH_BLOCK];	/* Drain, always in range */
+
+    float	drain_rate[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];
+    float	drain_spike[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];
+    float	drain_factor[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];
+    float	drain_delivered[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];
+    float	drain_on[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];	/* enabled, 1 or 0 */
+    float	drain_freq[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];	/* wave_freq */
+    float	drain_charging[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK];
+
+    double	time[SIM_BATCH_BLOCK];
+    uint32_t	rng[4][SIM_BATCH_BLOCK];		/* rng_t.s, one word at a time */
+
+    uint32_t	changed[SIM_BATCH_BLOCK];		/* SIM_CHANGED_* from the latest step */
+} sim_block_t;
+
+typedef struct sim_batch_s
+{
+    sim_block_t	*blocks;
+    sim_state_t	*cold;	    /* Per ship, the fields the blocks don't hold */
+    uint32_t	count;	    /* Ships */
+    uint32_t	capacity;   /* Ships, a whole number of blocks */
+    bool	avx2;	    /* Step with the AVX2 build of the kernels, set when the cpu has it */
+    sim_math_e	math;	    /* For every ship: the first one added's, SIM_MATH_DEFAULT before that */
+} sim_batch_t;
+
+#define SIM_BATCH_BLOCKS(ships) (((ships) + SIM_BATCH_BLOCK - 1) / SIM_BATCH_BLOCK)
+
+/* Returns false if the blocks couldn't be allocated */
+bool sim_batch_init(sim_batch_t *batch, uint32_t capacity);
+void sim_batch_free(sim_batch_t *batch);
+
+/* Returns the ship's index, or -1 if the batch is full, the ship's math isn't the batch's or its power isn't
+ * SIM_POWER_TAPS
+ */
+int sim_batch_add(sim_batch_t *batch, const sim_state_t *sim);
+
+/* Overwrite a ship in place. Nothing is checked: its math is the caller's to keep the batch's. */
+void sim_batch_put(sim_batch_t *batch, uint32_t ship, const sim_state_t *sim);
+void sim_batch_get(const sim_batch_t *batch, uint32_t ship, sim_state_t *sim);
+
+/* sim_apply for one ship of the batch */
+unsigned sim_batch_apply(sim_batch_t *batch, uint32_t ship, sim_cmd_e cmd, int index, float value);
+
+/* Advance blocks [first, first + count) by dt. Blocks are independent, so threads can each step their own range. Spare
+ * lanes past the last ship are stepped too, they just hold an idle ship.
+ */
+void sim_batch_step(sim_batch_t *batch, uint32_t first, uint32_t count, float dt);
+
+#endif
@@ -0,0 +1,19 @@
+#include "sim_batch.h"
+
+/* The batch step built for AVX2, eight ships at a time. sim_batch_step only calls it when the cpu has AVX2. No fma: it
+ * would round once where sim.c rounds twice.
+ */
+
+#ifdef SIM_BATCH_X86
+
+#pragma GCC target("avx2")
+
+#define SIM_BATCH_LANES 8
+#include "sim_batch_step.h"
+
+void sim_batch_step_avx2(sim_block_t *restrict b, sim_math_e math, float shield_decay, float dt)
+{
+    block_step(b, math, shield_decay, dt);
+}
+
+#endif
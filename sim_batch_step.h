@@ -0,0 +1,488 @@
+#ifndef SCPULSE_SIM_BATCH_STEP_H
+#define SCPULSE_SIM_BATCH_STEP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim_batch.h"
+#include "sim_rules.h"
+
+/* The batch step, private to the sim. It works on SIM_BATCH_LANES ships at a time in GCC's generic vectors, and each
+ * file that includes this picks the count that fills its registers: sim_batch.c 4 for SSE2, sim_batch_avx2.c 8 for AVX2.
+ * The vectorizer could in principle get there by itself from plain loops, but not through this many selects.
+ *
+ * Every expression is sim.c's, including where it goes through double, so a lane comes out exactly as sim_step would
+ * leave the ship. Only sin and powf are left to libm, each in a loop of its own. With SIM_MATH_POLY the cooler's x^1.2
+ * is sim_pow12_poly done a vector at a time instead; the table's lookups go one ship at a time like powf's would.
+ */
+
+#ifdef SIM_BATCH_X86
+void sim_batch_step_avx2(sim_block_t *restrict b, sim_math_e math, float shield_decay, float dt);
+#endif
+
+typedef float	 vf_t __attribute__((vector_size(SIM_BATCH_LANES * sizeof(float))));
+typedef int32_t	 vi_t __attribute__((vector_size(SIM_BATCH_LANES * sizeof(int32_t))));	/* Also the masks: -1 or 0 */
+typedef uint32_t vu_t __attribute__((vector_size(SIM_BATCH_LANES * sizeof(uint32_t))));
+typedef double	 vd_t __attribute__((vector_size(SIM_BATCH_LANES * sizeof(double))));
+
+#define LOAD(a, i) (*(const vf_t *)&(a)[i])
+#define STORE(a, i, v) (*(vf_t *)&(a)[i] = (v))
+
+#define D(v) __builtin_convertvector((v), vd_t)
+#define F(v) __builtin_convertvector((v), vf_t)
+
+/* The doubles take two registers. The compiler splits arithmetic on them by itself, but a compare it does one lane at a
+ * time unless it fits a register whole, so compares of doubles go half at a time.
+ */
+typedef int32_t	 vih_t __attribute__((vector_size(SIM_BATCH_LANES / 2 * sizeof(int32_t))));
+typedef int64_t	 vlh_t __attribute__((vector_size(SIM_BATCH_LANES / 2 * sizeof(int64_t))));
+
+#if SIM_BATCH_LANES == 8
+#define HALF(v, n) __builtin_shufflevector((v), (v), 4 * (n), 4 * (n) + 1, 4 * (n) + 2, 4 * (n) + 3)
+#define JOIN(lo, hi) __builtin_shufflevector((lo), (hi), 0, 1, 2, 3, 4, 5, 6, 7)
+#elif SIM_BATCH_LANES == 4
+#define HALF(v, n) __builtin_shufflevector((v), (v), 2 * (n), 2 * (n) + 1)
+#define JOIN(lo, hi) __builtin_shufflevector((lo), (hi), 0, 1, 2, 3)
+#else
+#error "SIM_BATCH_LANES must be 4 or 8"
+#endif
+
+#define HMASK(m) __builtin_convertvector((vlh_t)(m), vih_t)
+
+/* a op b on doubles, either of which can be a scalar. x - 0 is x, so that only broadcasts. */
+#define DCMP(a, op, b) ({ vd_t a_ = (a) - (vd_t){0}, b_ = (b) - (vd_t){0}; \
+			  JOIN(HMASK(HALF(a_, 0) op HALF(b_, 0)), HMASK(HALF(a_, 1) op HALF(b_, 1))); })
+
+static inline __attribute__((always_inline)) vf_t sel(vi_t m, vf_t a, vf_t b)
+{
+    return (vf_t)(((vi_t)a & m) | ((vi_t)b & ~m));
+}
+
+static inline __attribute__((always_inline)) vf_t splat(float x)
+{
+    return (vf_t){0} + x;
+}
+
+static inline __attribute__((always_inline)) vi_t seli(vi_t m, vi_t a, vi_t b)
+{
+    return (a & m) | (b & ~m);
+}
+
+static inline __attribute__((always_inline)) vf_t clamp01(vf_t x)
+{
+    x = sel(x > 1.0f, splat(1.0f), x);
+    return sel(x < 0, splat(0), x);
+}
+
+/* level_clamp() */
+static inline __attribute__((always_inline)) vf_t level_clamps(vf_t x)
+{
+    x = sel(x < 1.0f, x, splat(1));
+    return sel(x > 0, x, splat(0));
+}
+
+/* rng_uniform for every lane's generator */
+static inline __attribute__((always_inline)) vf_t uniform(vu_t *s)
+{
+    vu_t result = s[0] + s[3];
+    vu_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 11) | (s[3] >> (32 - 11));
+
+    /* Under 2^24, so converting it signed is the same as unsigned */
+    return __builtin_convertvector((vi_t)(result >> 8), vf_t) * (1.0f / 16777216.0f);
+}
+
+/* chance() */
+static inline __attribute__((always_inline)) vi_t chances(vf_t u, vf_t p, float dt)
+{
+    return DCMP(D(u), <, D(p) * SIM_TUNED_HZ * dt);
+}
+
+/* uniform_range(), as a double since that's where every caller takes it */
+static inline __attribute__((always_inline)) vd_t uniform_ranges(vf_t u, int min, int max)
+{
+    return __builtin_convertvector(min + __builtin_convertvector(u * (float)(max - min + 1), vi_t), vd_t);
+}
+
+/* One group of lanes' drains, battery and heat while the capacitors work through them */
+typedef struct lanes_s
+{
+    vf_t    rate[SIM_DRAIN_COUNT];
+    vf_t    factor[SIM_DRAIN_COUNT];
+    vf_t    delivered[SIM_DRAIN_COUNT];
+    vf_t    on[SIM_DRAIN_COUNT];
+    vf_t    routed[SIM_DRAIN_COUNT];	/* Taps routed to each drain */
+    vf_t    bat;
+    vf_t    temp;
+    bool    graphs;		/* The block has SIM_THERMAL_GRAPH ships, so node is loaded and graph may be set */
+    vi_t    graph;
+    vf_t    node[SIM_HEAT_NODES];
+} lanes_t;
+
+/* add_heat, where: on the node of lanes that are SIM_THERMAL_GRAPH, into the cooler of the others */
+static inline __attribute__((always_inline)) void add_heat(lanes_t *l, int node, vi_t where, vf_t d)
+{
+    if (l->graphs)
+    {
+	l->node[node] = sel(where & l->graph, l->node[node] + d / heat_capacities[node], l->node[node]);
+	where &= ~l->graph;
+    }
+    l->temp = sel(where, l->temp + d, l->temp);
+}
+
+/* What drains[dest] would have been in sim.c */
+static inline __attribute__((always_inline)) vf_t pick(vf_t dest, const vf_t *v)
+{
+    vf_t    r = v[0];
+    int	    k;
+
+    for (k = 1; k < SIM_DRAIN_COUNT; k++)
+	r = sel(dest == (float)k, v[k], r);
+    return r;
+}
+
+/* delivered[dest] += got, where take */
+static inline __attribute__((always_inline)) void deliver(lanes_t *l, vf_t dest, vi_t take, vf_t got)
+{
+    int k;
+
+    for (k = 0; k < SIM_DRAIN_COUNT; k++)
+	l->delivered[k] = sel(take & (dest == (float)k), l->delivered[k] + got, l->delivered[k]);
+}
+
+/* drain_battery, where take */
+static inline __attribute__((always_inline)) void drain_battery(lanes_t *l, vf_t dest, vi_t take, vf_t pct, float dt)
+{
+    vf_t    rate = pick(dest, l->rate);
+    vf_t    want = rate * pick(dest, l->factor) * pct * dt;
+    vf_t    left = l->bat - want;
+    vi_t    flat = take & (left < 0);
+    int	    k;
+
+    deliver(l, dest, take, sel(want < l->bat, want, l->bat) / dt);
+    add_heat(l, SIM_HEAT_BATTERY, take, rate * 258.0f * pct * dt);
+    for (k = 0; k < SIM_DRAIN_COUNT; k++)
+	l->on[k] = sel(flat & (dest == (float)k), splat(0), l->on[k]);
+    l->bat = sel(take, sel(flat, splat(0), left), l->bat);
+}
+
+/* drain_capacitor for tap t of the group at lane i */
+static inline __attribute__((always_inline)) void drain_capacitor(lanes_t *l, sim_block_t *restrict b, int t, int i, float dt)
+{
+    vf_t    dest = LOAD(b->tap_dest[t], i);
+    vf_t    charge = LOAD(b->cap_charge[t], i);
+    vf_t    full = LOAD(b->cap_full[t], i);
+    vf_t    decay = 6.0f * LOAD(b->cap_dmg[t], i);
+    vf_t    connected = splat(0);
+    vf_t    decayed, rate;
+    vi_t    live;
+    int	    u;
+
+    /* Down to the full limit while nothing feeds the tap */
+    decayed = sel(LOAD(b->tap_level[t], i) <= 0, charge - decay * dt, charge);
+    decayed = sel(decayed < full, full, decayed);
+    charge = sel(charge > full, decayed, charge);
+
+    /* Charged taps on this one's drain as it comes to it, the earlier ones already drained */
+    for (u = 0; u < SIM_TAP_COUNT; u++)
+	connected += sel(((u == t ? charge : LOAD(b->cap_charge[u], i)) > 0) & (LOAD(b->tap_dest[u], i) == dest),
+			 splat(1), splat(0));
+
+    /* With none, the battery covers the whole drain */
+    live = connected > 0;
+    drain_battery(l, dest, ~live, splat(1), dt);
+    rate = pick(dest, l->rate) / sel(live, connected, splat(1));
+    rate *= pick(dest, l->factor) * dt;
+    drain_battery(l, dest, live & (rate > charge), (rate - charge) / rate, dt);
+    deliver(l, dest, live, sel(rate < charge, rate, charge) / dt);
+    charge = sel(live, charge - rate, charge);
+    STORE(b->cap_charge[t], i, sel(charge < 0, splat(0), charge));
+}
+
+/* fill_capacitor for tap t of the group at lane i */
+static inline __attribute__((always_inline)) void fill_capacitor(lanes_t *l, sim_block_t *restrict b, int t, int i, float dt)
+{
+    vf_t    level = LOAD(b->tap_level[t], i);
+    vf_t    dmg = LOAD(b->cap_dmg[t], i);
+    vf_t    max = LOAD(b->cap_max[t], i);
+    vf_t    c = LOAD(b->cap_charge[t], i);
+    vf_t    h = LOAD(b->cap_health[t], i);
+    vf_t    f = level * dmg;
+    vf_t    strength = splat(tap_fill_strengths[t]);
+    vf_t    hurt;
+    vi_t    over;
+
+    strength = sel(c > LOAD(b->cap_full[t], i), strength * (2.0f * dmg), strength);
+    c = sel(h > 0, c + strength * (level / LOAD(b->cap_size_max[t], i)) * LOAD(b->cap_chrg[t], i) * h * dt, c);
+
+    over = c > max;
+    hurt = F(D(h) - 0.006 * D(level) * D(f) * dt);
+    hurt = sel(hurt < 0, splat(0), hurt);
+    add_heat(l, SIM_HEAT_CAP(t), (vi_t){0} == 0, sel(over, F(60.0 * D(f) * dt), F(6.0 * D(c / max) * D(f) * dt)));
+    STORE(b->cap_charge[t], i, sel(over, sel(hurt == 0, splat(0), max), c));
+    STORE(b->cap_health[t], i, sel(over, hurt, h));
+}
+
+/* sim_pow12_poly, step for step */
+static inline __attribute__((always_inline)) vf_t pow12_poly(vf_t x)
+{
+    vu_t    bits = (vu_t)x;
+    vf_t    t = (vf_t)((bits & 0x7fffff) | 0x3f800000) - 1.5f;
+    vi_t    e = (vi_t)(bits >> 23) - 127;
+    vi_t    q = ((e + 130) * 205) >> 10;
+    vi_t    r = e + 130 - 5 * q;
+    vi_t    k = e + q - 26;
+    vf_t    step = splat(sim_pow12_steps[0]);
+    vf_t    p = splat(SIM_POW12_C6);
+    int	    j;
+
+    k = seli(k < -127, (vi_t){0} - 127, k);
+    k = seli(k > 128, (vi_t){0} + 128, k);
+    for (j = 1; j < 5; j++)
+	step = sel(r == j, splat(sim_pow12_steps[j]), step);
+
+    p = p * t + SIM_POW12_C5;
+    p = p * t + SIM_POW12_C4;
+    p = p * t + SIM_POW12_C3;
+    p = p * t + SIM_POW12_C2;
+    p = p * t + SIM_POW12_C1;
+    p = p * t + SIM_POW12_C0;
+    return sel(x >= FLT_MIN, p * (step * (vf_t)((vu_t)(k + 127) << 23)), splat(0));
+}
+
+/* conduct_heat, for the block's SIM_THERMAL_GRAPH ships. thermal_step goes over every lane, so it works on a copy and
+ * only theirs are kept.
+ */
+static void conduct_heat(sim_block_t *restrict b, float dt)
+{
+    float   temp[SIM_HEAT_NODES][SIM_BATCH_BLOCK];
+    float   flow[SIM_HEAT_NODES * SIM_BATCH_BLOCK];
+    int	    i, n, t;
+
+    memcpy(temp, b->heat_temp, sizeof(temp));
+    memcpy(temp[SIM_HEAT_COOLER], b->cooler_temp, sizeof(temp[SIM_HEAT_COOLER]));
+    thermal_step(sim_heat_net(), &temp[0][0], flow, SIM_BATCH_BLOCK, dt);
+
+    for (i = 0; i < SIM_BATCH_BLOCK; i++)
+    {
+	if (b->graph[i] == 0)
+	    continue;
+	for (n = 0; n < SIM_HEAT_NODES; n++)
+	    b->heat_temp[n][i] = temp[n][i];
+	b->cooler_temp[i] = temp[SIM_HEAT_COOLER][i];
+
+	for (t = 0; t < SIM_TAP_COUNT; t++)
+	{
+	    if (temp[SIM_HEAT_CAP(t)][i] > CAP_MAX_TEMP)
+	    {
+		b->cap_health[t][i] -= CAP_OVERHEAT_DAMAGE * (temp[SIM_HEAT_CAP(t)][i] - CAP_MAX_TEMP) * dt;
+		if (b->cap_health[t][i] < 0)
+		    b->cap_health[t][i] = 0;
+	    }
+	}
+    }
+}
+
+static inline __attribute__((always_inline)) void block_step(sim_block_t *restrict b, sim_math_e math, float shield_decay, float dt)
+{
+    float   wave[SIM_DRAIN_COUNT][SIM_BATCH_BLOCK] __attribute__((aligned(64)));
+    double  cool[SIM_BATCH_BLOCK] __attribute__((aligned(64)));
+    bool    graphs = false;
+    int	    d, i, k, n, t;
+
+    for (i = 0; i < SIM_BATCH_BLOCK; i++)
+	graphs |= b->graph[i] != 0;
+
+    /* The time, and the waves of the thrust drains. sin is most of a step, so like sim.c only where the drain is on. */
+    for (i = 0; i < SIM_BATCH_BLOCK; i++)
+	b->time[i] += dt;
+    for (d = 0; d < SIM_DRAIN_COUNT; d++)
+	if (drain_kinds[d] == DRAIN_KIND_THRUST)
+	    for (i = 0; i < SIM_BATCH_BLOCK; i++)
+		wave[d][i] = b->drain_on[d][i] ? (sin(b->time[i] * b->drain_freq[d][i]) + 1) / 2.0 : 0;
+
+    for (i = 0; i < SIM_BATCH_BLOCK; i += SIM_BATCH_LANES)
+    {
+	vf_t	u[DRAW_COUNT];
+	vu_t	s[4];
+
+	/* update_engine and update_fuel. Cutting the power only counts as a change where there was power to cut. */
+	{
+	    vf_t    was = LOAD(b->ring_power[SIM_RING_ROOT], i);
+	    vi_t    dead = LOAD(b->engine_health, i) <= 0;
+	    vf_t    root = sel(dead, splat(0), was);
+	    vf_t    rate = FUEL_CONSUME_RATE(root);
+	    vf_t    fuel = LOAD(b->fuel_level, i) + dt * rate;
+	    vi_t    cut = dead | (fuel < 0);
+
+	    fuel = sel(fuel < 0, splat(0), fuel);
+	    fuel = sel(fuel > (float)MAX_FUEL_LEVEL, splat(MAX_FUEL_LEVEL), fuel); /* A whole float, so sim.c's double compare */
+	    STORE(b->ring_power[SIM_RING_ROOT], i, sel(cut, splat(0), was));
+	    STORE(b->fuel_rate, i, rate);
+	    STORE(b->fuel_level, i, fuel);
+	    *(vi_t *)&b->changed[i] = cut & (was != 0) & SIM_CHANGED_POWER;
+	}
+
+	/* The step's uniforms */
+	for (k = 0; k < 4; k++)
+	    s[k] = *(const vu_t *)&b->rng[k][i];
+	for (k = 0; k < DRAW_COUNT; k++)
+	    u[k] = uniform(s);
+	for (k = 0; k < 4; k++)
+	    *(vu_t *)&b->rng[k][i] = s[k];
+
+	/* update_drains. The kinds are the layout's, the same for every ship, so each drain is only its own kind's code. */
+	for (d = 0; d < SIM_DRAIN_COUNT; d++)
+	{
+	    const vf_t *du = &u[DRAW_PER_DRAIN * d];
+	    vi_t    on = LOAD(b->drain_on[d], i) != 0;
+	    vf_t    p = LOAD(b->drain_spike[d], i);
+	    vf_t    rate = LOAD(b->drain_rate[d], i);
+
+	    if (drain_kinds[d] == DRAIN_KIND_THRUST)
+	    {
+		vi_t spike = chances(du[DRAW_SPIKE], p, dt);
+		vf_t freq = F(1.0 * (uniform_ranges(du[DRAW_AMOUNT], 1, 100) / 100.0));
+
+		STORE(b->drain_rate[d], i, sel(on, LOAD(wave[d], i), splat(0)));
+		STORE(b->drain_freq[d], i, sel(on & spike, freq, LOAD(b->drain_freq[d], i)));
+	    }
+	    else if (drain_kinds[d] == DRAIN_KIND_SHIELD)
+	    {
+		vi_t spike = chances(du[DRAW_SPIKE], p, dt);
+
+		rate = sel(spike, F(D(rate) + uniform_ranges(du[DRAW_AMOUNT], 1, 30) / 100.0), rate);
+		rate = clamp01(rate * shield_decay);
+		STORE(b->drain_rate[d], i, sel(on, rate, splat(0)));
+	    }
+	    else
+	    {
+		vf_t charging = LOAD(b->drain_charging[d], i);
+		vi_t stop;
+
+		charging = sel((charging > 0) | chances(du[DRAW_SPIKE], p, dt), charging + dt, charging);
+		stop = (charging > 1.0f) | chances(du[DRAW_AMOUNT], p, dt);
+		charging = sel(stop, splat(0), charging);
+		rate = sel(stop, F(D(rate) - 0.2), rate);
+		rate = sel(charging > 0, F(D(rate) + (0.6 + D(rate * 6.0f)) * dt), rate - 12 * dt);
+		rate = clamp01(rate);
+		STORE(b->drain_rate[d], i, sel(on, rate, splat(0)));
+		STORE(b->drain_charging[d], i, sel(on, charging, LOAD(b->drain_charging[d], i)));
+	    }
+	}
+
+	/* update_power_taps and update_battery. Bottom 10% goes to battery, remaining 90% divided by tap_bands. */
+	{
+	    vd_t p = D(LOAD(b->total_output_power, i));
+	    vf_t bat = F(p / BAT_BAND);
+
+	    bat = sel(bat < 1.0f, bat, splat(1));
+	    STORE(b->bat_level, i, bat);
+	    for (t = 0; t < SIM_TAP_COUNT; t++)
+		STORE(b->tap_level[t], i, level_clamps(F((p - tap_bands[t].lo) / tap_bands[t].width)));
+
+	    bat = F(D(LOAD(b->bat_charge, i)) + 1.8 * (D(bat) / MAX_BAT_CHARGE) * dt);
+	    STORE(b->bat_charge, i, sel(bat > (float)MAX_BAT_CHARGE, splat(MAX_BAT_CHARGE), bat));
+	}
+
+	/* update_capacitors, then the heat half of update_engine_heat. Any tap can feed any drain, so drains are picked
+	 * by dest rather than indexed by it.
+	 */
+	{
+	    lanes_t l;
+	    vf_t    f;
+
+	    for (k = 0; k < SIM_DRAIN_COUNT; k++)
+	    {
+		l.rate[k] = LOAD(b->drain_rate[k], i);
+		l.factor[k] = LOAD(b->drain_factor[k], i);
+		l.on[k] = LOAD(b->drain_on[k], i);
+		l.delivered[k] = splat(0);
+		l.routed[k] = splat(0);
+		for (t = 0; t < SIM_TAP_COUNT; t++)
+		    l.routed[k] += sel(LOAD(b->tap_dest[t], i) == (float)k, splat(1), splat(0));
+	    }
+	    l.bat = LOAD(b->bat_charge, i);
+	    l.temp = LOAD(b->cooler_temp, i);
+	    l.graphs = graphs;
+	    l.graph = (vi_t){0};
+	    if (graphs)
+	    {
+		l.graph = LOAD(b->graph, i) != 0;
+		for (n = 0; n < SIM_HEAT_NODES; n++)
+		    l.node[n] = LOAD(b->heat_temp[n], i);
+	    }
+
+	    for (t = 0; t < SIM_TAP_COUNT; t++)
+		drain_capacitor(&l, b, t, i, dt);
+
+	    /* Drains no tap is routed to run straight off the battery */
+	    for (k = 0; k < SIM_DRAIN_COUNT; k++)
+		drain_battery(&l, splat(battery_order[k]), l.routed[battery_order[k]] == 0, splat(1), dt);
+
+	    for (t = 0; t < SIM_TAP_COUNT; t++)
+		fill_capacitor(&l, b, t, i, dt);
+
+	    if (graphs)
+	    {
+		/* The same terms as below, each on its own ring */
+		vf_t root = LOAD(b->ring_power[SIM_RING_ROOT], i);
+
+		f = root * 5.0f * dt;
+		add_heat(&l, SIM_HEAT_RING(SIM_RING_ROOT), l.graph, root * f);
+		add_heat(&l, SIM_HEAT_RING(SIM_RING_Q), l.graph, F(D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_Q], i))) * 0.4 * D(f)));
+		add_heat(&l, SIM_HEAT_RING(SIM_RING_R), l.graph, F(D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_R], i))) * 0.3 * D(f)));
+		add_heat(&l, SIM_HEAT_RING(SIM_RING_S), l.graph, F(D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_S], i))) * 0.2 * D(f)));
+	    }
+	    f = LOAD(b->ring_power[SIM_RING_ROOT], i);
+	    f = F(D(f) + D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_Q], i))) * 0.4);
+	    f = F(D(f) + D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_R], i))) * 0.3);
+	    f = F(D(f) + D(POWER_TO_TEMP(LOAD(b->ring_power[SIM_RING_S], i))) * 0.2);
+	    f *= LOAD(b->ring_power[SIM_RING_ROOT], i);
+	    add_heat(&l, SIM_HEAT_COOLER, ~l.graph, f * 5.0f * dt);
+
+	    for (k = 0; k < SIM_DRAIN_COUNT; k++)
+	    {
+		STORE(b->drain_delivered[k], i, l.delivered[k]);
+		STORE(b->drain_on[k], i, l.on[k]);
+	    }
+	    STORE(b->bat_charge, i, l.bat);
+	    STORE(b->cooler_temp, i, l.temp);
+	    if (graphs)
+		for (n = 0; n < SIM_HEAT_NODES; n++)
+		    STORE(b->heat_temp[n], i, l.node[n]);
+	}
+    }
+
+    if (graphs)
+	conduct_heat(b, dt);
+
+    /* cooler_dissipate_heat and the damage it does */
+    if (math == SIM_MATH_POLY)
+	for (i = 0; i < SIM_BATCH_BLOCK; i += SIM_BATCH_LANES)
+	    *(vd_t *)&cool[i] = D(pow12_poly(LOAD(b->cooler_temp, i) / (float)MAX_COOLER_TEMP)) * (MAX_COOLER_TEMP * 0.6);
+    else
+	for (i = 0; i < SIM_BATCH_BLOCK; i++)
+	    cool[i] = b->cooler_temp[i] > 0 ? cooler_cool_rate(b->cooler_temp[i], math) : 0; /* Which is what powf gives at 0 */
+    for (i = 0; i < SIM_BATCH_BLOCK; i += SIM_BATCH_LANES)
+    {
+	vf_t	temp = F(D(LOAD(b->cooler_temp, i)) - *(const vd_t *)&cool[i] * dt);
+	vf_t	health = LOAD(b->engine_health, i);
+	vf_t	hurt;
+
+	temp = sel(temp < 0, splat(0), temp);
+	hurt = health - F(ENGINE_OVERHEAT_DAMAGE * D(temp - (float)MAX_COOLER_TEMP) * dt);
+	hurt = sel(hurt < 0, splat(0), hurt);
+	STORE(b->cooler_temp, i, temp);
+	STORE(b->engine_health, i, sel(temp > (float)MAX_COOLER_TEMP, hurt, health));
+    }
+}
+
+#endif
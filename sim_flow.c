@@ -0,0 +1,222 @@
+#include <string.h>
+#include <math.h>
+
+#include "sim_flow.h"
+
+static float unmet(float need, float demand)
+{
+    return need > demand * FLOW_SLACK ? need : 0;
+}
+
+/* Up to FLOW_ROUNDS even splits of need over edges [e, end), each capped by what its source has left */
+static float fill_tier(flow_net_t *net, int e, int end, float need)
+{
+    int round, i, live;
+
+    for (round = 0; round < FLOW_ROUNDS && need > 0; round++)
+    {
+	float share;
+
+	live = 0;
+	for (i = e; i < end; i++)
+	    live += net->left[net->edge[i].source] > 0;
+	if (live == 0)
+	    break;
+
+	share = need / live;
+	for (i = e; i < end; i++)
+	{
+	    float *left = &net->left[net->edge[i].source];
+	    float give;
+
+	    if (*left <= 0)
+		continue;
+	    give = share < *left ? share : *left;
+	    net->flow[i] += give;
+	    *left -= give;
+	    need -= give;
+	}
+    }
+    return need;
+}
+
+void flow_solve(flow_net_t *net)
+{
+    int s, e, end;
+
+    memcpy(net->left, net->supply, net->sources * sizeof(net->left[0]));
+    memset(net->flow, 0, net->edges * sizeof(net->flow[0]));
+
+    for (s = 0; s < net->sinks; s++)
+    {
+	float need = net->demand[s];
+
+	for (e = net->first[s]; e < net->first[s + 1]; e = end)
+	{
+	    for (end = e + 1; end < net->first[s + 1] && net->edge[end].tier == net->edge[e].tier; end++)
+		;
+	    need = fill_tier(net, e, end, need);
+	}
+	net->unmet[s] = unmet(need, net->demand[s]);
+    }
+}
+
+bool flow_reuse(flow_net_t *net, const float *flow, const float *demand)
+{
+    bool    met = true;
+    int	    s, e;
+
+    memcpy(net->left, net->supply, net->sources * sizeof(net->left[0]));
+
+    for (s = 0; s < net->sinks; s++)
+    {
+	float need = net->demand[s];
+	float scale = demand[s] > 0 ? net->demand[s] / demand[s] : 0;
+
+	for (e = net->first[s]; e < net->first[s + 1]; e++)
+	{
+	    float *left = &net->left[net->edge[e].source];
+	    float give = flow[e] * scale;
+
+	    give = give < *left ? give : *left;
+	    give = give < need ? give : need;
+	    give = give > 0 ? give : 0;
+	    net->flow[e] = give;
+	    *left -= give;
+	    need -= give;
+	}
+	net->unmet[s] = unmet(need, net->demand[s]);
+	met &= net->unmet[s] == 0;
+    }
+    return met;
+}
+
+bool flow_close(const float *a, const float *b, int n, float threshold)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (fabsf(a[i] - b[i]) > threshold * fabsf(b[i]))
+	    return false;
+    return true;
+}
+
+uint64_t flow_bound(const flow_net_t *net, uint32_t *sinks)
+{
+    uint64_t	sources = 0;
+    int		i, s, e;
+
+    for (i = 0; i < net->sources; i++)
+	if (net->left[i] <= net->supply[i] * FLOW_SLACK)
+	    sources |= 1ull << i;
+    *sinks = 0;
+    for (s = 0; s < net->sinks; s++)
+	for (e = net->first[s]; e < net->first[s + 1]; e++)
+	    if (sources >> net->edge[e].source & 1)
+		*sinks |= 1u << s;
+    return sources;
+}
+
+bool flow_bound_close(const flow_net_t *net, const float *supply, const float *demand, uint64_t sources, uint32_t sinks,
+		      float threshold)
+{
+    int i;
+
+    for (; sources != 0; sources &= sources - 1)
+    {
+	i = __builtin_ctzll(sources);
+	if (fabsf(net->supply[i] - supply[i]) > threshold * fabsf(supply[i]))
+	    return false;
+    }
+    for (; sinks != 0; sinks &= sinks - 1)
+    {
+	i = __builtin_ctz(sinks);
+	if (fabsf(net->demand[i] - demand[i]) > threshold * fabsf(demand[i]))
+	    return false;
+    }
+    return true;
+}
+
+/* ==================== Routing ==================== */
+
+void flow_budget_init(flow_budget_t *budget, uint32_t solves)
+{
+    memset(budget, 0, sizeof(*budget));
+    budget->solves = solves;
+    budget->left = solves;
+}
+
+void flow_budget_tick(flow_budget_t *budget)
+{
+    uint64_t admitted = budget->admitted + budget->solves;
+
+    admitted = admitted < budget->issued ? admitted : budget->issued;
+    budget->reserved = admitted - budget->admitted;
+    budget->admitted = admitted;
+    budget->left = budget->solves;
+}
+
+/* Whether a network wanting a solve gets one: an admitted one while any are left, anyone else only past the ones held
+ * back for those. Turned down, it keeps its place in the queue or takes the next.
+ */
+static bool budget_take(flow_budget_t *budget, flow_memo_t *memo)
+{
+    if (budget == NULL || budget->solves == 0)
+    {
+	memo->waiting = false;
+	return true;
+    }
+    if (memo->waiting && memo->place < budget->admitted && budget->left > 0)
+    {
+	budget->left--;
+	budget->reserved -= budget->reserved > 0;
+	memo->waiting = false;
+	return true;
+    }
+    if (!memo->waiting && budget->left > budget->reserved)
+    {
+	budget->left--;
+	return true;
+    }
+    if (!memo->waiting)
+    {
+	memo->waiting = true;
+	memo->place = budget->issued++;
+    }
+    budget->deferred++;
+    return false;
+}
+
+bool flow_route(flow_net_t *net, flow_memo_t *memo, float *supply, float *demand, float *flow, flow_budget_t *budget)
+{
+    bool close = memo->valid && memo->threshold > 0 &&
+		 flow_bound_close(net, supply, demand, memo->bound_sources, memo->bound_sinks, memo->threshold);
+
+    if (close && flow_reuse(net, flow, demand))
+    {
+	memo->waiting = false; /* Its place goes unused */
+	memo->reuses++;
+	return false;
+    }
+    if (!memo->valid)
+    {
+	if (budget != NULL && budget->left > 0)
+	    budget->left--;
+    }
+    else if (!budget_take(budget, memo))
+    {
+	if (!close)
+	    flow_reuse(net, flow, demand);
+	memo->reuses++;
+	return false;
+    }
+
+    flow_solve(net);
+    memcpy(supply, net->supply, net->sources * sizeof(supply[0]));
+    memcpy(demand, net->demand, net->sinks * sizeof(demand[0]));
+    memcpy(flow, net->flow, net->edges * sizeof(flow[0]));
+    memo->bound_sources = flow_bound(net, &memo->bound_sinks);
+    memo->valid = true;
+    memo->solves++;
+    return true;
+}
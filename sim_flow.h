@@ -0,0 +1,151 @@
+#ifndef SCPULSE_SIM_FLOW_H
+#define SCPULSE_SIM_FLOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Power allocation as a small flow network: sources that can give up to so much this step, sinks that want so much,
+ * and edges from sources to sinks in tiers. Sinks are served one after another in the order they were added. A sink
+ * takes what it wants from its first tier, split evenly between the edges whose source has anything left and topped up
+ * from the ones that still do when some run short, then whatever is still missing from the next tier, and so on. What
+ * no tier covers is the sink's unmet demand.
+ *
+ * A solve does at most FLOW_ROUNDS splits per tier, so it costs a fixed number of passes over the edges however the
+ * charge happens to be spread. Demand a tier's last round couldn't place falls through to the next tier, as it would
+ * if the tier had run dry.
+ *
+ * Nothing here knows about ships. sim.c builds the network for SIM_POWER_FLOW from the capacitors, battery and drains.
+ */
+
+#define FLOW_MAX_SOURCES 64
+#define FLOW_MAX_SINKS 32
+#define FLOW_MAX_EDGES 128
+#define FLOW_ROUNDS 4
+#define FLOW_SLACK 1e-5f /* Of a sink's demand: float rounding the solve doesn't count as unmet */
+
+_Static_assert(FLOW_MAX_SOURCES <= 64 && FLOW_MAX_SINKS <= 32, "flow_bound's masks are too narrow");
+
+typedef struct flow_edge_s
+{
+    uint8_t	source;
+    uint8_t	tier;	/* Lower first. A sink's edges are added in tier order. */
+} flow_edge_t;
+
+typedef struct flow_net_s
+{
+    int		sources;
+    int		sinks;
+    int		edges;
+
+    float	supply[FLOW_MAX_SOURCES];
+    float	demand[FLOW_MAX_SINKS];
+
+    /* Sink s's edges are edge[first[s]] up to edge[first[s + 1]] */
+    uint8_t	first[FLOW_MAX_SINKS + 1];
+    flow_edge_t	edge[FLOW_MAX_EDGES];
+
+    /* The solution */
+    float	flow[FLOW_MAX_EDGES];
+    float	unmet[FLOW_MAX_SINKS];
+    float	left[FLOW_MAX_SOURCES];	/* Supply no sink took */
+} flow_net_t;
+
+/* A network is built again every step, so these are inline. flow_source and flow_sink return the new one's index. A
+ * sink's edges are added right after it, before the next sink. The maximums are the caller's to stay under.
+ */
+static inline void flow_init(flow_net_t *net)
+{
+    net->sources = 0;
+    net->sinks = 0;
+    net->edges = 0;
+    net->first[0] = 0;
+}
+
+static inline int flow_source(flow_net_t *net, float supply)
+{
+    net->supply[net->sources] = supply;
+    return net->sources++;
+}
+
+static inline int flow_sink(flow_net_t *net, float demand)
+{
+    net->demand[net->sinks] = demand;
+    net->first[net->sinks + 1] = net->edges;
+    return net->sinks++;
+}
+
+static inline void flow_edge(flow_net_t *net, int source, int tier)
+{
+    net->edge[net->edges].source = source;
+    net->edge[net->edges].tier = tier;
+    net->edges++;
+    net->first[net->sinks] = net->edges;
+}
+
+void flow_solve(flow_net_t *net);
+
+/* The cheap way to a solution when supplies and demands have barely moved since a full solve: that solve's flows,
+ * scaled by how much each sink's demand changed and cut back wherever a source no longer has them. One pass over the
+ * edges. flow and demand are the earlier solve's, for a network of the same shape. False if that left a sink short,
+ * which only a full solve can say is really so.
+ */
+bool flow_reuse(flow_net_t *net, const float *flow, const float *demand);
+
+/* Whether every a[i] is within threshold of b[i], relative to b[i] */
+bool flow_close(const float *a, const float *b, int n, float threshold);
+
+/* What a solve turned on: the sources it used up, bit i for source i, and the sinks with an edge from one of them.
+ * Elsewhere each sink got its demand split evenly, which flow_reuse's scaling gives exactly, and flow_reuse fails if a
+ * source with charge to spare no longer covers its flows. Returns the sources, right after flow_solve.
+ */
+uint64_t flow_bound(const flow_net_t *net, uint32_t *sinks);
+
+/* What decides between flow_solve and flow_reuse: whether the supplies and demands flow_bound picked out of an earlier
+ * solve are within threshold of it. supply and demand are that solve's, for a network of the same shape.
+ */
+bool flow_bound_close(const flow_net_t *net, const float *supply, const float *demand, uint64_t sources, uint32_t sinks,
+		      float threshold);
+
+/* ==================== Routing ==================== */
+
+/* A fleet's full solves per tick. A network routed with it solves only while the tick has solves left; past that it
+ * takes flow_reuse's answer, short or not, and queues. Each tick admits the next solves networks of the queue, in the
+ * order they were turned down, and holds solves back for them, so each gets its turn however the fleet is ordered. That
+ * takes every network being routed once a tick. A budget is for one thread.
+ */
+typedef struct flow_budget_s
+{
+    uint32_t	solves;	    /* A tick. 0 is no cap. */
+    uint32_t	left;	    /* This tick's */
+    uint32_t	reserved;   /* Of left, held for the admitted networks still to come this tick */
+    uint64_t	issued;	    /* Places in the queue given out */
+    uint64_t	admitted;   /* Places below this solve when they come up */
+    uint64_t	deferred;   /* Solves put off, all told */
+} flow_budget_t;
+
+void flow_budget_init(flow_budget_t *budget, uint32_t solves);
+
+/* Before each tick's networks are routed */
+void flow_budget_tick(flow_budget_t *budget);
+
+/* What flow_route keeps of a network between steps, besides the latest full solve's supplies, demands and flows, which
+ * go in the caller's arrays as long as the network's sources, sinks and edges
+ */
+typedef struct flow_memo_s
+{
+    float	threshold;	/* Relative, for flow_bound_close. 0 solves every step the budget allows. */
+    bool	valid;		/* Clear it when the network's shape changes */
+    bool	waiting;	/* Wanted a solve the budget didn't have, and queued for one */
+    uint64_t	place;		/* In the budget's queue, while waiting */
+    uint32_t	solves;
+    uint32_t	reuses;		/* Those past the budget too */
+    uint64_t	bound_sources;	/* flow_bound's */
+    uint32_t	bound_sinks;
+} flow_memo_t;
+
+/* net's solution: the memo's reused when flow_bound_close and flow_reuse allow, else a full solve if budget has one for
+ * it, else the reuse regardless. A memo that isn't valid always solves. budget NULL is no cap. True if it solved.
+ */
+bool flow_route(flow_net_t *net, flow_memo_t *memo, float *supply, float *demand, float *flow, flow_budget_t *budget);
+
+#endif
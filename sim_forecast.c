@@ -0,0 +1,126 @@
+#include <string.h>
+#include <math.h>
+
+#include "sim_forecast.h"
+
+static void ring_table(sim_forecaster_t *f, const sim_state_t *sim)
+{
+    envelope_t env = {{0}};
+
+    envelope_set_rings(&env, sim);
+    f->table = envelope_cache_get(&f->beats, &env);
+}
+
+static void watch(sim_forecaster_t *f, const sim_state_t *sim)
+{
+    if (f->out->overheat < 0 && sim->cooler_temp > MAX_COOLER_TEMP)
+	f->out->overheat = sim->time - f->start;
+    if (f->out->dead < 0 && sim->engine_health <= 0)
+	f->out->dead = sim->time - f->start;
+}
+
+/* The warp's steps' audio, like the game's warp_audio, counting what it overloads for the points */
+static uint32_t forecast_audio(sim_state_t *sim, unsigned changed, void *ctx)
+{
+    sim_forecaster_t	    *f = ctx;
+    const envelope_tick_t   *tick;
+    uint32_t		    overloads;
+
+    watch(f, sim);
+    if (changed & (SIM_CHANGED_POWER | SIM_CHANGED_FREQ))
+	ring_table(f, sim);
+    f->stepped += f->dt;
+    if (f->table == NULL)
+	return 0;
+
+    tick = envelope_table_at(&f->beats, f->table, (uint64_t)llround(sim->time / f->dt));
+    f->overloaded += tick->over;
+    f->over += tick->over * f->sample_rate;
+    overloads = (uint32_t)f->over;
+    f->over -= overloads;
+    sim->engine_overload = overloads > 0;
+    sim->total_output_power = tick->peak;
+    return overloads;
+}
+
+static void record(sim_forecast_t *out, int p, const sim_state_t *sim, float overload)
+{
+    int i;
+
+    out->cooler_temp[p] = sim->cooler_temp;
+    out->battery[p] = sim->tap_bat.cap.charge;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	out->cap_health[i][p] = sim->taps[i].cap.health;
+    out->overload[p] = overload;
+}
+
+bool sim_forecaster_init(sim_forecaster_t *f, float dt, uint32_t sample_rate, double beat_period, float overload_level,
+			 size_t cache_bytes)
+{
+    memset(f, 0, sizeof(*f));
+    f->dt = dt;
+    f->sample_rate = sample_rate;
+    return envelope_cache_init(&f->beats, dt, beat_period, overload_level, cache_bytes);
+}
+
+void sim_forecaster_free(sim_forecaster_t *f)
+{
+    envelope_cache_free(&f->beats);
+}
+
+void sim_forecast_start(sim_forecaster_t *f, const sim_state_t *from, double seconds, sim_forecast_t *out, uint64_t id)
+{
+    out->id = id;
+    out->seconds = seconds;
+    out->overheat = -1;
+    out->dead = -1;
+    f->out = out;
+    f->sim = *from;
+    f->start = from->time;
+    f->over = 0;
+    sim_warp_init(&f->warp, f->dt, forecast_audio, f);
+
+    ring_table(f, &f->sim);
+    record(out, 0, &f->sim, f->table != NULL ? f->table->duty : 0);
+    f->point = 1;
+}
+
+bool sim_forecast_more(sim_forecaster_t *f, int points)
+{
+    sim_forecast_t  *out = f->out;
+    sim_state_t	    *sim = &f->sim;
+
+    for (; points > 0 && f->point <= SIM_FORECAST_POINTS; points--, f->point++)
+    {
+	double end = f->start + out->seconds * f->point / SIM_FORECAST_POINTS;
+
+	f->stepped = 0;
+	f->overloaded = 0;
+	while (sim->time < end - f->dt / 2)
+	{
+	    unsigned events = sim_warp(sim, end - sim->time, &f->warp);
+
+	    /* A jump only stops on the far side of the event, so this is when it happened */
+	    if (events & SIM_WARP_OVERHEAT && out->overheat < 0)
+		out->overheat = sim->time - f->start;
+	    if (events & SIM_WARP_DEAD && out->dead < 0)
+		out->dead = sim->time - f->start;
+	}
+	watch(f, sim);
+	/* A jump keeps the setting its burst stepped, so the stepped time's share stands for all of it */
+	record(out, f->point, sim, f->stepped > 0 ? f->overloaded / f->stepped : out->overload[f->point - 1]);
+    }
+    return f->point > SIM_FORECAST_POINTS;
+}
+
+bool sim_forecast(sim_forecaster_t *f, const sim_state_t *from, double seconds, sim_forecast_t *out,
+		  const _Atomic uint64_t *latest, uint64_t id)
+{
+    sim_forecast_start(f, from, seconds, out, id);
+    do
+    {
+	if (atomic_load_explicit(latest, memory_order_relaxed) != id)
+	    return false;
+    } while (!sim_forecast_more(f, 1));
+    return true;
+}
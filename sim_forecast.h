@@ -0,0 +1,76 @@
+#ifndef SCPULSE_SIM_FORECAST_H
+#define SCPULSE_SIM_FORECAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "sim.h"
+#include "sim_warp.h"
+#include "envelope.h"
+
+/* What-if: a copy of the sim run ahead under a setting the player is still dragging, so the GUI can show where it leads
+ * before it gets there. The copy's output power and overloads come from the rings' beat envelope, as the game's warped
+ * steps do, and sim_warp carries it over the horizon, so a couple of minutes ahead costs a few milliseconds.
+ *
+ * Forecasts are asked for far more often than they finish while a slider moves, and only the newest one matters. Each
+ * request has an id, and the asker keeps the newest id where the run can see it. A run looks between points and gives
+ * up as soon as its id is no longer the newest. Without a thread to run it on, a forecast can also be run a few points
+ * at a time, and comes out the same.
+ */
+
+#define SIM_FORECAST_POINTS 64 /* Evenly over the horizon, besides where it starts */
+
+typedef struct sim_forecast_s
+{
+    uint64_t	id;		/* Of the request it answers */
+    double	seconds;	/* Ahead of the start the last point is */
+
+    /* Point 0 is the start, point i is i * seconds / SIM_FORECAST_POINTS ahead of it */
+    float	cooler_temp[SIM_FORECAST_POINTS + 1];
+    float	battery[SIM_FORECAST_POINTS + 1];
+    float	cap_health[SIM_TAP_COUNT][SIM_FORECAST_POINTS + 1];
+    float	overload[SIM_FORECAST_POINTS + 1];  /* Share of the time since the previous point overloaded. Point 0's is
+						       the starting setting's beat duty. */
+
+    double	overheat;	/* Seconds ahead the cooler first goes over MAX_COOLER_TEMP, < 0 if it doesn't */
+    double	dead;		/* Seconds ahead the engine dies, < 0 if it doesn't */
+} sim_forecast_t;
+
+/* One per thread that runs forecasts: its envelope tables and warp aren't to be shared */
+typedef struct sim_forecaster_s
+{
+    float		    dt;
+    uint32_t		    sample_rate;    /* Of the audio the overloads stand in for */
+    envelope_cache_t	    beats;
+    const envelope_table_t  *table;	    /* Of the copy's rings, NULL if it couldn't be built */
+    sim_warp_t		    warp;
+
+    /* The running forecast */
+    sim_state_t		    sim;	    /* The copy */
+    int			    point;	    /* Next to fill */
+    double		    over;	    /* Overloaded samples not handed out yet, less than one */
+    double		    stepped;	    /* Seconds the warp stepped */
+    double		    overloaded;	    /* Of them, seconds the envelope was over the level */
+    double		    start;	    /* sim->time the forecast started at */
+    sim_forecast_t	    *out;
+} sim_forecaster_t;
+
+bool sim_forecaster_init(sim_forecaster_t *f, float dt, uint32_t sample_rate, double beat_period, float overload_level,
+			 size_t cache_bytes);
+void sim_forecaster_free(sim_forecaster_t *f);
+
+/* Run a copy of from seconds ahead into out, as request id. latest is the newest request's id; false if it moved on
+ * from id before the run was done, and out is only partly filled then.
+ */
+bool sim_forecast(sim_forecaster_t *f, const sim_state_t *from, double seconds, sim_forecast_t *out,
+		  const _Atomic uint64_t *latest, uint64_t id);
+
+/* The same in slices: start it, then run up to points more at a time until sim_forecast_more returns true. Starting
+ * another drops the one running. out is the caller's to leave alone until then.
+ */
+void sim_forecast_start(sim_forecaster_t *f, const sim_state_t *from, double seconds, sim_forecast_t *out, uint64_t id);
+bool sim_forecast_more(sim_forecaster_t *f, int points);
+
+#endif
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim_journal.h"
+
+/* The header is part of the file format, like sim_save_t */
+_Static_assert(sizeof(sim_journal_header_t) == 528, "sim_journal_header_t has padding");
+
+#define JOURNAL_FIRST_BYTES 4096
+#define JOURNAL_EVENT_MAX 16 /* Longest event: a 10 byte tick varint, the kind byte, a 5 byte value varint */
+
+/* A command's index goes in the kind byte's high 4 bits. More taps than that need a wider index, and a new version. */
+_Static_assert(SIM_TAP_COUNT <= 16 && SIM_DRAIN_COUNT <= 16 && SIM_RING_COUNT <= 16,
+	       "command indices don't fit the journal's 4 bits");
+
+static uint32_t events_checksum(const uint8_t *p, size_t n)
+{
+    uint32_t	h = 2166136261u;
+    size_t	i;
+
+    for (i = 0; i < n; i++)
+	h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+	p[n++] = (uint8_t)v | 0x80;
+	v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    int shift;
+
+    *v = 0;
+    for (shift = 0; *p < end && shift < 64; shift += 7)
+    {
+	uint8_t b = *(*p)++;
+
+	*v |= (uint64_t)(b & 0x7f) << shift;
+	if (!(b & 0x80))
+	    return true;
+    }
+    return false;
+}
+
+/* ==================== Recording ==================== */
+
+bool sim_journal_init(sim_journal_t *j, const sim_state_t *start, uint32_t rate, uint32_t sample_rate, double beat_period,
+		      float overload_level)
+{
+    memset(j, 0, sizeof(*j));
+    j->head.magic = SIM_JOURNAL_MAGIC;
+    j->head.version = SIM_JOURNAL_VERSION;
+    j->head.rate = rate;
+    j->head.sample_rate = sample_rate;
+    j->head.beat_period = beat_period;
+    j->head.overload_level = overload_level;
+    sim_save_fill(&j->head.start, start, NULL);
+
+    j->peak = start->total_output_power;
+    j->overload = start->engine_overload;
+    j->warp = 1;
+
+    j->events = malloc(JOURNAL_FIRST_BYTES);
+    j->capacity = j->events != NULL ? JOURNAL_FIRST_BYTES : 0;
+    return j->events != NULL;
+}
+
+void sim_journal_free(sim_journal_t *j)
+{
+    free(j->events);
+    memset(j, 0, sizeof(*j));
+}
+
+/* The ticks since the last event, the kind byte, then n bytes of value */
+static void journal_event(sim_journal_t *j, uint8_t kind, const uint8_t *value, size_t n)
+{
+    uint8_t ev[JOURNAL_EVENT_MAX];
+    size_t  len;
+
+    if (j->lost)
+	return;
+    len = put_varint(ev, j->head.ticks - j->last);
+    ev[len++] = kind;
+    memcpy(ev + len, value, n);
+    len += n;
+
+    if (j->head.bytes + len > j->capacity)
+    {
+	size_t	capacity = j->capacity * 2;
+	uint8_t	*events = realloc(j->events, capacity);
+
+	if (events == NULL)
+	{
+	    j->lost = true;
+	    return;
+	}
+	j->events = events;
+	j->capacity = capacity;
+    }
+    memcpy(j->events + j->head.bytes, ev, len);
+    j->head.bytes += len;
+    j->last = j->head.ticks;
+}
+
+void sim_journal_cmd(sim_journal_t *j, sim_cmd_e cmd, int index, float value)
+{
+    uint8_t v[sizeof(float)];
+
+    memcpy(v, &value, sizeof(v));
+    journal_event(j, (uint8_t)cmd | (uint8_t)(index << 4), v, sizeof(v));
+}
+
+void sim_journal_warp(sim_journal_t *j, uint32_t factor)
+{
+    uint8_t v[5];
+
+    if (factor == j->warp)
+	return;
+    j->warp = factor;
+    journal_event(j, JOURNAL_WARP, v, put_varint(v, factor));
+}
+
+void sim_journal_audio(sim_journal_t *j, float peak, bool overload, uint32_t overloads)
+{
+    uint8_t v[5];
+
+    /* Bits, not ==, so a peak of -0 or NaN still comes back as itself */
+    if (memcmp(&peak, &j->peak, sizeof(peak)) || overload != j->overload)
+    {
+	j->peak = peak;
+	j->overload = overload;
+	memcpy(v, &peak, sizeof(peak));
+	journal_event(j, JOURNAL_AUDIO | (overload << 4), v, sizeof(peak));
+    }
+    if (overloads)
+	journal_event(j, JOURNAL_OVERLOADS, v, put_varint(v, overloads));
+}
+
+bool sim_journal_write(const sim_journal_t *j, const char *path)
+{
+    sim_journal_header_t head = j->head;
+    char    tmp[4096];
+    FILE    *f;
+    bool    ok;
+
+    if (j->lost)
+    {
+	errno = ENOMEM;
+	return false;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    {
+	errno = ENAMETOOLONG;
+	return false;
+    }
+    head.checksum = events_checksum(j->events, head.bytes);
+    if ((f = fopen(tmp, "wb")) == NULL)
+	return false;
+    ok = fwrite(&head, sizeof(head), 1, f) == 1;
+    ok &= head.bytes == 0 || fwrite(j->events, head.bytes, 1, f) == 1;
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmp, path) == 0)
+	return true;
+    remove(tmp);
+    return false;
+}
+
+const sim_journal_header_t *sim_journal_map(const char *path)
+{
+    const sim_journal_header_t *head;
+    struct stat	st;
+    void	*p;
+    int		fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sim_journal_header_t))
+    {
+	close(fd);
+	return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+	return NULL;
+
+    head = p;
+    if (head->magic != SIM_JOURNAL_MAGIC || head->version != SIM_JOURNAL_VERSION || head->rate == 0 ||
+	head->bytes != st.st_size - sizeof(*head) || head->checksum != events_checksum(sim_journal_events(head), head->bytes) ||
+	!sim_save_valid(&head->start, sizeof(head->start)))
+    {
+	munmap(p, st.st_size);
+	return NULL;
+    }
+    return head;
+}
+
+void sim_journal_unmap(const sim_journal_header_t *head)
+{
+    if (head != NULL)
+	munmap((void *)head, sizeof(*head) + head->bytes);
+}
+
+/* ==================== Replay ==================== */
+
+/* What post_beat does in the game, but building the table there and then. The game's sim has the worker build it and
+ * measures each tick of the setting on its own till it's in, which comes to the same bits.
+ */
+static void replay_beat(sim_replay_t *r)
+{
+    envelope_t env = {{0}};
+
+    envelope_set_rings(&env, &r->sim);
+    r->beat_table = envelope_cache_get(&r->beats, &env);
+}
+
+/* warp_audio in the game, less the posting to the audio and the HUD */
+static uint32_t replay_warp_audio(sim_state_t *s, unsigned changed, void *ctx)
+{
+    sim_replay_t	    *r = ctx;
+    const envelope_tick_t   *tick;
+    uint32_t		    overloads;
+
+    if (changed)
+	replay_beat(r);
+    if (r->beat_table == NULL)
+	return 0;
+
+    tick = envelope_table_at(&r->beats, r->beat_table, (uint64_t)llround(s->time * r->head->rate));
+    r->warp_over += tick->over * r->head->sample_rate;
+    overloads = (uint32_t)r->warp_over;
+    r->warp_over -= overloads;
+    s->engine_overload = overloads > 0;
+    s->total_output_power = tick->peak;
+    return overloads;
+}
+
+/* The tick of the event at r->p */
+static void replay_next(sim_replay_t *r)
+{
+    uint64_t delta;
+
+    if (r->p == r->end)
+	return;
+    if (get_varint(&r->p, r->end, &delta) && r->p < r->end)
+	r->next += delta;
+    else
+	r->bad = true;
+}
+
+bool sim_replay_init(sim_replay_t *r, const sim_journal_header_t *head, const uint8_t *events)
+{
+    memset(r, 0, sizeof(*r));
+    r->head = head;
+    r->p = events;
+    r->end = events + head->bytes;
+
+    sim_save_restore(&head->start, &r->sim, NULL);
+    r->peak = r->sim.total_output_power;
+    r->overload = r->sim.engine_overload;
+    r->warp_factor = 1;
+
+    if (!envelope_cache_init(&r->beats, 1.0 / head->rate, head->beat_period, head->overload_level, SIM_REPLAY_BEAT_BYTES))
+	return false;
+    replay_beat(r);
+    sim_warp_init(&r->warp, 1.0 / head->rate, replay_warp_audio, r);
+
+    replay_next(r);
+    return true;
+}
+
+void sim_replay_free(sim_replay_t *r)
+{
+    envelope_cache_free(&r->beats);
+}
+
+bool sim_replay_tick(sim_replay_t *r)
+{
+    unsigned	changed = 0;
+    uint32_t	overloads = 0;
+
+    if (r->tick == r->head->ticks)
+	return false;
+
+    /* This tick's inputs */
+    while (!r->bad && r->p < r->end && r->next == r->tick)
+    {
+	uint8_t	    kind = *r->p & 0xf;
+	int	    index = *r->p >> 4;
+	uint64_t    v;
+	float	    f;
+
+	r->p++;
+	switch (kind)
+	{
+	case JOURNAL_AUDIO:
+	    if (r->end - r->p < (ptrdiff_t)sizeof(f))
+	    {
+		r->bad = true;
+		break;
+	    }
+	    memcpy(&r->peak, r->p, sizeof(r->peak));
+	    r->p += sizeof(r->peak);
+	    r->overload = index & 1;
+	    break;
+	case JOURNAL_OVERLOADS:
+	    r->bad = !get_varint(&r->p, r->end, &v);
+	    overloads += v;
+	    break;
+	case JOURNAL_WARP:
+	    r->bad = !get_varint(&r->p, r->end, &v) || v == 0;
+	    r->warp_factor = v;
+	    break;
+	default:
+	    if (kind > SIM_CMD_DRAIN_ENABLE || r->end - r->p < (ptrdiff_t)sizeof(f))
+	    {
+		r->bad = true;
+		break;
+	    }
+	    memcpy(&f, r->p, sizeof(f));
+	    r->p += sizeof(f);
+	    changed |= sim_apply(&r->sim, (sim_cmd_e)kind, index, f);
+	    r->warp.averaged = 0;
+	    break;
+	}
+	if (!r->bad)
+	    replay_next(r);
+    }
+
+    /* And sim_tick's step with them */
+    r->sim.engine_overload = r->overload;
+    r->sim.total_output_power = r->peak;
+    if (r->warp_factor > 1)
+    {
+	sim_warp(&r->sim, (double)r->warp_factor / r->head->rate, &r->warp);
+	changed |= r->warp.changed;
+	r->warp.changed = 0;
+    }
+    else
+    {
+	if (overloads)
+	    sim_audio_overload(&r->sim, overloads);
+	changed |= sim_step(&r->sim, 1.0 / r->head->rate);
+    }
+    if (changed)
+	replay_beat(r);
+
+    r->tick++;
+    return true;
+}
+
+/* ==================== Seeking ==================== */
+
+/* The replay as it is now, at tick count * interval */
+static void seek_keep(sim_seek_t *s)
+{
+    const sim_replay_t	*r = &s->replay;
+    sim_keyframe_t	*k;
+    size_t		i;
+
+    if (s->count == s->max)
+    {
+	/* Full: every other one, twice as far apart. With an odd count this tick isn't one of the new ones. */
+	for (i = 0; 2 * i < s->count; i++)
+	    s->keys[i] = s->keys[2 * i];
+	s->count = i;
+	s->interval *= 2;
+	if (r->tick != s->count * s->interval)
+	    return;
+    }
+
+    k = &s->keys[s->count++];
+    k->tick = r->tick;
+    k->next = r->next;
+    k->offset = r->p - s->events;
+    k->sim = r->sim;
+    k->peak = r->peak;
+    k->overload = r->overload;
+    k->warp_factor = r->warp_factor;
+    k->warp = r->warp;
+    k->warp_over = r->warp_over;
+}
+
+static void seek_restore(sim_seek_t *s, const sim_keyframe_t *k)
+{
+    sim_replay_t *r = &s->replay;
+
+    r->tick = k->tick;
+    r->next = k->next;
+    r->p = s->events + k->offset;
+    r->bad = false;
+    r->sim = k->sim;
+    r->peak = k->peak;
+    r->overload = k->overload;
+    r->warp_factor = k->warp_factor;
+    r->warp = k->warp;
+    r->warp_over = k->warp_over;
+    replay_beat(r); /* The table of the rings as they are between ticks, which is what the game had then */
+    s->restores++;
+}
+
+/* Replay up to tick, keeping keyframes on the way */
+static bool seek_run(sim_seek_t *s, uint64_t tick)
+{
+    sim_replay_t *r = &s->replay;
+
+    for (;;)
+    {
+	if (r->tick == s->count * s->interval)
+	    seek_keep(s);
+	if (r->tick == tick || r->bad)
+	    break;
+	sim_replay_tick(r);
+	s->replayed++;
+    }
+    return !r->bad;
+}
+
+bool sim_seek_init(sim_seek_t *s, const sim_journal_header_t *head, const uint8_t *events, uint64_t interval,
+		   size_t max_bytes)
+{
+    memset(s, 0, sizeof(*s));
+    s->max = max_bytes / sizeof(sim_keyframe_t);
+    if (interval == 0 || s->max < 2)
+	return false;
+    if (s->max > head->ticks / interval + 1)
+	s->max = head->ticks / interval + 1 < 2 ? 2 : head->ticks / interval + 1;
+    s->interval = interval;
+    s->events = events;
+
+    if ((s->keys = malloc(s->max * sizeof(*s->keys))) == NULL)
+	return false;
+    if (!sim_replay_init(&s->replay, head, events))
+    {
+	free(s->keys);
+	s->keys = NULL;
+	return false;
+    }
+    if (!seek_run(s, 0))
+    {
+	sim_seek_free(s);
+	return false;
+    }
+    return true;
+}
+
+void sim_seek_free(sim_seek_t *s)
+{
+    sim_replay_free(&s->replay);
+    free(s->keys);
+    memset(s, 0, sizeof(*s));
+}
+
+bool sim_seek(sim_seek_t *s, uint64_t tick)
+{
+    sim_replay_t    *r = &s->replay;
+    size_t	    k;
+
+    if (tick > r->head->ticks)
+	tick = r->head->ticks;
+    k = tick / s->interval;
+    if (k >= s->count)
+	k = s->count - 1;
+
+    if (r->bad || tick < r->tick || s->keys[k].tick > r->tick)
+	seek_restore(s, &s->keys[k]);
+    return seek_run(s, tick);
+}
+
+bool sim_seek_index(sim_seek_t *s)
+{
+    return sim_seek(s, s->replay.head->ticks);
+}
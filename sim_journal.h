@@ -0,0 +1,176 @@
+#ifndef SCPULSE_SIM_JOURNAL_H
+#define SCPULSE_SIM_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+#include "sim_save.h"
+#include "sim_warp.h"
+#include "envelope.h"
+
+/* A session as the inputs that drove it, so it can be run again bit for bit without a window, an audio device or a
+ * player. Everything that reaches the sim does so in the game's sim_tick, one fixed tick at a time: the player's commands,
+ * the warp factor, and from the audio the latest block's peak and overload flag and the overloaded samples since the
+ * last tick. The journal is where the session started (a sim_save_t) and those inputs, each stamped with its tick.
+ *
+ * Only changes are written. A command is written when it's applied, the warp factor and the audio's peak and flag when
+ * they differ from the last ones written, the overload count when it isn't 0. An event is the ticks since the previous
+ * one as a varint, a byte with its kind in the low 4 bits and an index or flag in the high 4, then its value: a float,
+ * or a varint for counts and factors. A session with the engine running writes about one event per audio block, six or
+ * so bytes each.
+ *
+ * Warped ticks take their audio from the beat envelope, as the game does, so the header carries what the replay needs
+ * to build the same tables.
+ */
+
+#define SIM_JOURNAL_MAGIC 0x4e524a50 /* "PJRN" */
+#define SIM_JOURNAL_VERSION 6
+
+/* Event kinds. sim_cmd_e are kinds of their own, with the index in the high 4 bits. */
+typedef enum {
+    JOURNAL_AUDIO = 12,	    /* Peak as a float, overload flag in the high 4 bits */
+    JOURNAL_OVERLOADS = 13, /* Count */
+    JOURNAL_WARP = 14,	    /* Factor */
+} journal_event_e;
+
+typedef struct sim_journal_header_s
+{
+    uint32_t	magic;
+    uint32_t	version;
+    uint32_t	rate;		/* Ticks per second of game time */
+    uint32_t	sample_rate;	/* Of the audio, for the overloads the warp's envelope stands in for */
+    double	beat_period;	/* Of the warp's envelope tables */
+    float	overload_level;
+    uint32_t	checksum;	/* FNV-1a of the events */
+    uint64_t	ticks;
+    uint64_t	bytes;		/* Of events, right after the header */
+    sim_save_t	start;
+} sim_journal_header_t;
+
+/* ==================== Recording ==================== */
+
+typedef struct sim_journal_s
+{
+    sim_journal_header_t head;
+    uint8_t	*events;
+    size_t	capacity;
+    bool	lost;	    /* An event couldn't be stored. Recording stopped there and the journal won't write. */
+
+    uint64_t	last;	    /* Tick of the latest event */
+    float	peak;	    /* As of the latest events */
+    bool	overload;
+    uint32_t	warp;
+} sim_journal_t;
+
+/* Recording from start at rate ticks per second. The warp's envelope is that of osc_bank_t's at sample_rate. */
+bool sim_journal_init(sim_journal_t *j, const sim_state_t *start, uint32_t rate, uint32_t sample_rate, double beat_period,
+		      float overload_level);
+void sim_journal_free(sim_journal_t *j);
+
+/* What the current tick took in, in the order sim_tick takes it */
+void sim_journal_cmd(sim_journal_t *j, sim_cmd_e cmd, int index, float value); /* index 0-15, which sim_journal.c asserts covers every command */
+void sim_journal_warp(sim_journal_t *j, uint32_t factor);
+void sim_journal_audio(sim_journal_t *j, float peak, bool overload, uint32_t overloads);
+
+/* The end of a tick */
+static inline void sim_journal_tick(sim_journal_t *j)
+{
+    j->head.ticks++;
+}
+
+/* Written next to path and renamed over it. False with errno set on failure, or if events were lost. */
+bool sim_journal_write(const sim_journal_t *j, const char *path);
+
+/* The journal in path, mapped read-only, its events right after the header. NULL if it can't be read or isn't valid. */
+const sim_journal_header_t *sim_journal_map(const char *path);
+void sim_journal_unmap(const sim_journal_header_t *head);
+
+static inline const uint8_t *sim_journal_events(const sim_journal_header_t *head)
+{
+    return (const uint8_t *)(head + 1);
+}
+
+/* ==================== Replay ==================== */
+
+#define SIM_REPLAY_BEAT_BYTES (1 << 20) /* Evicted tables come back the same, so any bound gives the same run */
+
+typedef struct sim_replay_s
+{
+    const sim_journal_header_t *head;
+    const uint8_t   *p;		/* Next event */
+    const uint8_t   *end;
+    uint64_t	    next;	/* Tick of the event at p */
+    bool	    bad;	/* The events stopped decoding before the end */
+
+    sim_state_t	    sim;
+    uint64_t	    tick;	/* Ticks run */
+    float	    peak;
+    bool	    overload;
+    uint32_t	    warp_factor;
+
+    sim_warp_t	    warp;
+    envelope_cache_t beats;
+    const envelope_table_t *beat_table;
+    double	    warp_over;
+} sim_replay_t;
+
+/* events are head->bytes long; the replay reads them in place. False if the beat cache couldn't be allocated. */
+bool sim_replay_init(sim_replay_t *r, const sim_journal_header_t *head, const uint8_t *events);
+void sim_replay_free(sim_replay_t *r);
+
+/* One tick, exactly as the game ran it. False once every recorded tick has run. */
+bool sim_replay_tick(sim_replay_t *r);
+
+/* ==================== Seeking ==================== */
+
+/* A replay that can jump to any tick. Like a video's key frames, it keeps the whole replay state every interval ticks,
+ * so a seek restores the nearest one at or before the target and replays at most interval ticks from there. Keyframes
+ * are taken the first time the replay passes their tick, so a seek past the furthest one so far replays the rest of
+ * the way and takes them as it goes; sim_seek_index takes them all up front.
+ *
+ * max_bytes bounds the keyframes. When they fill it, every other one is dropped and the interval doubles, so a session
+ * of any length fits in the same memory at the cost of longer seeks.
+ */
+
+typedef struct sim_keyframe_s
+{
+    uint64_t	    tick;
+    uint64_t	    next;
+    size_t	    offset;	/* Of the next event */
+    sim_state_t	    sim;
+    float	    peak;
+    bool	    overload;
+    uint32_t	    warp_factor;
+    sim_warp_t	    warp;
+    double	    warp_over;
+} sim_keyframe_t;
+
+typedef struct sim_seek_s
+{
+    sim_replay_t    replay;	/* Where seeks land, and what the caller reads */
+    const uint8_t   *events;
+    sim_keyframe_t  *keys;	/* keys[i] is at tick i * interval */
+    size_t	    count;
+    size_t	    max;
+    uint64_t	    interval;
+
+    uint64_t	    replayed;	/* Ticks run by seeks, for the benchmarks */
+    uint64_t	    restores;
+} sim_seek_t;
+
+/* interval in ticks. False if no memory, or not room for 2 keyframes in max_bytes. */
+bool sim_seek_init(sim_seek_t *s, const sim_journal_header_t *head, const uint8_t *events, uint64_t interval,
+		   size_t max_bytes);
+void sim_seek_free(sim_seek_t *s);
+
+/* To the start of tick, past the end of the journal is its end. Forward seeks closer than a keyframe just run on.
+ * False if the events stopped decoding before tick.
+ */
+bool sim_seek(sim_seek_t *s, uint64_t tick);
+
+/* Every keyframe of the journal, so no seek replays more than interval ticks */
+bool sim_seek_index(sim_seek_t *s);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SCPULSE_SIM_MATH_H
+#define SCPULSE_SIM_MATH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+
+/* x^1.2 without libm, for COOLER_COOL_RATE. Private to the sim library like sim_rules.h, bar the bench timing it.
+ *
+ * With x = m * 2^e, m in [1, 2), and e = 5q + r, r in 0-4:
+ *
+ *   x^1.2 = m^1.2 * 2^(r/5) * 2^(e + q)
+ *
+ * The last factor is exact, built straight from its exponent bits, and 2^(r/5) is one of five constants, so all the
+ * approximating is of m^1.2 on [1, 2). The table does that by interpolating between 129 samples (relative error about
+ * 2e-6), the polynomial with a degree 6 minimax fit (3e-8, 3e-7 with the float rounding). Both are plain float
+ * arithmetic in a fixed order, so the batch's vector versions give the same bits.
+ *
+ * Below FLT_MIN, zero and NaN included, they give 0. powf gives 0 only at 0, but the cooler is never that close to it.
+ */
+
+#define SIM_POW12_TABLE_BITS 7 /* Top mantissa bits that index the table */
+
+static const float sim_pow12_steps[5] = {1.0f, 1.14869835f, 1.31950791f, 1.51571657f, 1.74110113f}; /* 2^(r/5) */
+
+/* (1 + k/128)^1.2 */
+static const float sim_pow12_samples[(1 << SIM_POW12_TABLE_BITS) + 1] = {
+    1.0f, 1.00938231f, 1.01877918f, 1.02819051f, 1.03761622f, 1.04705623f,
+    1.05651044f, 1.06597878f, 1.07546115f, 1.08495748f, 1.09446768f, 1.10399167f,
+    1.11352938f, 1.12308072f, 1.13264562f, 1.142224f, 1.15181579f, 1.16142091f,
+    1.17103928f, 1.18067084f, 1.19031552f, 1.19997323f, 1.20964392f, 1.21932751f,
+    1.22902394f, 1.23873313f, 1.24845502f, 1.25818955f, 1.26793665f, 1.27769625f,
+    1.28746829f, 1.29725271f, 1.30704944f, 1.31685843f, 1.32667961f, 1.33651292f,
+    1.34635831f, 1.35621571f, 1.36608506f, 1.37596631f, 1.38585941f, 1.39576429f,
+    1.40568089f, 1.41560918f, 1.42554908f, 1.43550054f, 1.44546352f, 1.45543795f,
+    1.46542379f, 1.47542098f, 1.48542948f, 1.49544923f, 1.50548018f, 1.51552228f,
+    1.52557549f, 1.53563975f, 1.54571501f, 1.55580123f, 1.56589836f, 1.57600635f,
+    1.58612516f, 1.59625475f, 1.60639505f, 1.61654604f, 1.62670766f, 1.63687987f,
+    1.64706263f, 1.65725589f, 1.66745961f, 1.67767374f, 1.68789826f, 1.6981331f,
+    1.70837824f, 1.71863363f, 1.72889923f, 1.73917499f, 1.74946089f, 1.75975687f,
+    1.77006291f, 1.78037895f, 1.79070497f, 1.80104092f, 1.81138676f, 1.82174247f,
+    1.83210799f, 1.8424833f, 1.85286836f, 1.86326312f, 1.87366756f, 1.88408164f,
+    1.89450532f, 1.90493857f, 1.91538135f, 1.92583362f, 1.93629536f, 1.94676653f,
+    1.9572471f, 1.96773703f, 1.97823628f, 1.98874484f, 1.99926265f, 2.0097897f,
+    2.02032594f, 2.03087135f, 2.04142589f, 2.05198954f, 2.06256225f, 2.07314401f,
+    2.08373478f, 2.09433452f, 2.10494322f, 2.11556083f, 2.12618733f, 2.13682269f,
+    2.14746689f, 2.15811988f, 2.16878164f, 2.17945215f, 2.19013137f, 2.20081927f,
+    2.21151584f, 2.22222103f, 2.23293482f, 2.24365719f, 2.25438811f, 2.26512755f,
+    2.27587548f, 2.28663187f, 2.29739671f,
+};
+
+/* m^1.2 = sum of c[i] * (m - 1.5)^i on [1, 2), minimax for relative error */
+#define SIM_POW12_C0 1.62670767f
+#define SIM_POW12_C1 1.30136549f
+#define SIM_POW12_C2 0.0867603496f
+#define SIM_POW12_C3 -0.0154040726f
+#define SIM_POW12_C4 0.00459261378f
+#define SIM_POW12_C5 -0.00188316812f
+#define SIM_POW12_C6 0.000871963741f
+
+static inline uint32_t sim_float_bits(float x)
+{
+    uint32_t	u;
+
+    memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+static inline float sim_bits_float(uint32_t u)
+{
+    float	x;
+
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+/* 2^(r/5) * 2^(e + q) for x's exponent. The shift by 130 (26 fives) keeps the division on non-negative numbers, and
+ * times 205 over 1024 is a division by 5 for all of them. Past float's range the exponent field saturates to 0 or inf.
+ */
+static inline float sim_pow12_scale(uint32_t bits)
+{
+    int32_t	e = (int32_t)(bits >> 23) - 127;
+    int32_t	q = ((e + 130) * 205) >> 10;
+    int32_t	r = e + 130 - 5 * q;
+    int32_t	k = e + q - 26;
+
+    if (k < -127)
+	k = -127;
+    if (k > 128)
+	k = 128;
+    return sim_pow12_steps[r] * sim_bits_float((uint32_t)(k + 127) << 23);
+}
+
+static inline float sim_pow12_table(float x)
+{
+    uint32_t	bits = sim_float_bits(x);
+    uint32_t	index = (bits >> (23 - SIM_POW12_TABLE_BITS)) & ((1 << SIM_POW12_TABLE_BITS) - 1);
+    float	f = (float)(bits & ((1 << (23 - SIM_POW12_TABLE_BITS)) - 1)) * (1.0f / (1 << (23 - SIM_POW12_TABLE_BITS)));
+    float	a = sim_pow12_samples[index];
+    float	b = sim_pow12_samples[index + 1];
+    float	y = (a + (b - a) * f) * sim_pow12_scale(bits);
+
+    return x >= FLT_MIN ? y : 0;
+}
+
+static inline float sim_pow12_poly(float x)
+{
+    uint32_t	bits = sim_float_bits(x);
+    float	t = sim_bits_float((bits & 0x7fffff) | 0x3f800000) - 1.5f; /* Exact */
+    float	p = SIM_POW12_C6;
+
+    p = p * t + SIM_POW12_C5;
+    p = p * t + SIM_POW12_C4;
+    p = p * t + SIM_POW12_C3;
+    p = p * t + SIM_POW12_C2;
+    p = p * t + SIM_POW12_C1;
+    p = p * t + SIM_POW12_C0;
+    p = p * sim_pow12_scale(bits);
+    return x >= FLT_MIN ? p : 0;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SCPULSE_SIM_RULES_H
+#define SCPULSE_SIM_RULES_H
+
+#include "sim.h"
+#include "sim_math.h"
+#include "sim_thermal.h"
+
+/* Tables and helpers sim.c and sim_batch.c both step ships with. Private to the sim library: the two have to agree on
+ * them bit for bit.
+ */
+
+static const float cap_max_charges[] = {15.0, 30.0, 70.0}; /* Indexed by capacitor_size_e */
+static const float cap_full_limits[] = {5.0, 10.0, 20.0}; /* cap_max_charges - max_full is "full" */
+static const float cap_grade_chrg_rate[] = {1.0, 2.0, 3.0}; /* Indexed by capacitor_grade_e */
+static const float cap_grade_dmg_factor[] = {3.0, 2.0, 1.0}; /* Indexed by capacitor_grade_e */
+
+/* TODO: Add otehr tables for heat tolerance, damage multipliers, etc... */
+
+/* ==================== Layout ==================== */
+
+/* One entry per tap or drain of sim.h's layout. The asserts catch a count changed without its tables. */
+
+/* The bottom 10% of the output goes to the battery's tap, the rest is divided evenly between the others. A tap's level
+ * is (p - lo) / width clamped to 0-1: 0 up to lo, 1 past hi. width is hi - lo as written rather than as a double works
+ * it out, so the levels come out the same as they did when each band was its own branch.
+ */
+#define BAT_BAND 0.1
+
+typedef struct tap_band_s
+{
+    double  lo;
+    double  hi;
+    double  width;
+} tap_band_t;
+
+static const tap_band_t tap_bands[] = {{0.1, 0.4, 0.3}, {0.4, 0.7, 0.3}, {0.7, 1.0, 0.3}};
+
+static const float tap_fill_strengths[] = {6.0, 12.0, 36.0}; /* Per second */
+
+static const drain_kind_e drain_kinds[] = {DRAIN_KIND_THRUST, DRAIN_KIND_SHIELD, DRAIN_KIND_WEAPON};
+
+/* Order drains with no charged tap take from the battery in */
+static const int battery_order[] = {TAP_DEST_SHIELD, TAP_DEST_WEAPON, TAP_DEST_THRUST};
+
+/* SIM_THERMAL_GRAPH's nodes, by sim.h's SIM_HEAT_*. Heat goes in as degrees of cooler, so capacities are relative to
+ * the cooler's: a capacitor warms twenty times as fast from the same heat. Conductances are in the same units, per
+ * degree per second. The rings sit on the cooler and settle on it within a few hundredths of a second, the capacitors
+ * and battery are further off and take a tenth or so, so the heat they make shows up on them first.
+ */
+static const float heat_capacities[SIM_HEAT_NODES] = {
+    [SIM_HEAT_RING(0) ... SIM_HEAT_RING(SIM_RING_COUNT - 1)] = 0.1,
+    [SIM_HEAT_CAP(0) ... SIM_HEAT_CAP(SIM_TAP_COUNT - 1)] = 0.05,
+    [SIM_HEAT_BATTERY] = 0.2,
+    [SIM_HEAT_COOLER] = 1.0,
+};
+
+/* The links, which sim.c lays out per ring and per tap of the layout: every ring to the cooler, the root ring to each
+ * of the others, every capacitor to the cooler and to the next one along, and the battery to the cooler.
+ */
+#define HEAT_RING_COOLER 10
+#define HEAT_ROOT_RING 2
+#define HEAT_CAP_COOLER 0.5
+#define HEAT_CAP_CAP 0.2
+#define HEAT_BATTERY_COOLER 2
+#define HEAT_LINKS (2 * SIM_RING_COUNT - 1 + 2 * SIM_TAP_COUNT - 1 + 1)
+_Static_assert(sizeof(tap_bands) / sizeof(tap_bands[0]) == SIM_TAP_COUNT, "a band per tap");
+_Static_assert(sizeof(tap_fill_strengths) / sizeof(tap_fill_strengths[0]) == SIM_TAP_COUNT, "a fill strength per tap");
+_Static_assert(sizeof(drain_kinds) / sizeof(drain_kinds[0]) == SIM_DRAIN_COUNT, "a kind per drain");
+_Static_assert(sizeof(battery_order) / sizeof(battery_order[0]) == SIM_DRAIN_COUNT, "every drain in battery_order");
+_Static_assert(SIM_TAP_COUNT <= UINT8_MAX && SIM_DRAIN_COUNT < UINT8_MAX, "the routing index is bytes");
+
+/* By drain_kind_e */
+static const float drain_factors[DRAIN_KIND_COUNT] = {0.468, 2.4, 0.6}; /* How fast each drains its source, per second */
+static const int drain_spike_max[DRAIN_KIND_COUNT] = {60, 180, 100}; /* Spike probabilities go up to this / 1000 */
+
+/* ==================== Rules ==================== */
+
+#define ENGINE_OVERHEAT_DAMAGE 0.006 /* Engine health/s per degree the cooler is over MAX_COOLER_TEMP */
+#define OVERLOAD_DAMAGE 0.000002 /* Engine health per overloaded sample */
+#define OVERLOAD_HEAT 0.01 /* Degrees per overloaded sample */
+#define CAP_MAX_TEMP MAX_COOLER_TEMP /* SIM_THERMAL_GRAPH's capacitors lose health above it, hotter than the cooler lets itself get */
+#define CAP_OVERHEAT_DAMAGE 0.00001 /* Capacitor health/s per degree over CAP_MAX_TEMP */
+
+/* COOLER_COOL_RATE the way math says to. powf's is the macro exactly, in double like the macro's. */
+static inline double cooler_cool_rate(float temp, sim_math_e math)
+{
+    switch (math)
+    {
+    case SIM_MATH_TABLE:
+	return sim_pow12_table(temp / MAX_COOLER_TEMP) * (MAX_COOLER_TEMP * 0.6);
+    case SIM_MATH_POLY:
+	return sim_pow12_poly(temp / MAX_COOLER_TEMP) * (MAX_COOLER_TEMP * 0.6);
+    default:
+	return COOLER_COOL_RATE(temp);
+    }
+}
+
+/* The uniforms each drain draws every step, whether or not it's enabled, so toggling a drain doesn't shift every random
+ * number after it. Drain d's are DRAW_PER_DRAIN * d onward.
+ */
+typedef enum {
+    DRAW_SPIKE = 0,	/* Thrust and shield: whether it spikes. Weapon: whether it starts charging. */
+    DRAW_AMOUNT = 1,	/* Thrust: the new frequency. Shield: the spike's size. Weapon: whether it stops. */
+    DRAW_PER_DRAIN
+} drain_draw_e;
+
+#define DRAW_COUNT (DRAW_PER_DRAIN * SIM_DRAIN_COUNT)
+
+/* tap_level's clamp: 0 below, 1 above, and 1 for a NaN output like the branches it replaced gave. Both compares are
+ * min/max instructions, so there's no branch.
+ */
+static inline float level_clamp(float x)
+{
+    x = x < 1.0f ? x : 1.0f;
+    return x > 0 ? x : 0;
+}
+
+/* An event with probability p per 1/SIM_TUNED_HZ s, whatever dt is. u is one of the step's uniforms. */
+static inline bool chance(float u, float p, float dt)
+{
+    return u < p * SIM_TUNED_HZ * dt;
+}
+
+/* Same distribution as rng_range(rng, min, max), from a uniform that was already drawn */
+static inline int uniform_range(float u, int min, int max)
+{
+    return min + (int)(u * (max - min + 1));
+}
+
+#endif
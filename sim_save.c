@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim_save.h"
+
+/* The layout is the file format. If one of these trips, the record changed shape: fix it, and bump SIM_SAVE_VERSION. */
+_Static_assert(sizeof(sim_save_tap_t) == 36, "sim_save_tap_t has padding");
+_Static_assert(sizeof(sim_save_drain_t) == 28, "sim_save_drain_t has padding");
+_Static_assert(sizeof(sim_save_t) == 480, "sim_save_t has padding");
+_Static_assert(offsetof(sim_save_t, time) == 16, "sim_save_t header moved");
+
+#define SAVE_BODY offsetof(sim_save_t, time)
+
+static uint32_t save_checksum(const sim_save_t *save)
+{
+    const uint8_t   *p = (const uint8_t *)save + SAVE_BODY;
+    uint32_t	    h = 2166136261u;
+    size_t	    i;
+
+    for (i = 0; i < sizeof(*save) - SAVE_BODY; i++)
+	h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static void save_tap(sim_save_tap_t *out, const power_tap_t *tap)
+{
+    out->level = tap->level;
+    out->charge_mult = tap->charge_mult;
+    out->dest = tap->dest;
+    out->cap.health = tap->cap.health;
+    out->cap.charge = tap->cap.charge;
+    out->cap.max_charge = tap->cap.max_charge;
+    out->cap.full_limit = tap->cap.full_limit;
+    out->cap.grade = tap->cap.grade;
+    out->cap.size = tap->cap.size;
+}
+
+static void restore_tap(power_tap_t *tap, const sim_save_tap_t *in)
+{
+    tap->level = in->level;
+    tap->charge_mult = in->charge_mult;
+    tap->dest = (tap_dest_e)in->dest;
+    tap->cap.health = in->cap.health;
+    tap->cap.charge = in->cap.charge;
+    tap->cap.max_charge = in->cap.max_charge;
+    tap->cap.full_limit = in->cap.full_limit;
+    tap->cap.grade = (capacitor_grade_e)in->cap.grade;
+    tap->cap.size = (capacitor_size_e)in->cap.size;
+}
+
+static bool tap_valid(const sim_save_tap_t *tap)
+{
+    return tap->dest < SIM_DRAIN_COUNT && tap->cap.grade <= CAP_GRADE_MIL && tap->cap.size <= CAP_SIZE_LARGE;
+}
+
+void sim_save_fill(sim_save_t *save, const sim_state_t *sim, const double *ring_phase)
+{
+    int i;
+
+    memset(save, 0, sizeof(*save));
+    save->magic = SIM_SAVE_MAGIC;
+    save->version = SIM_SAVE_VERSION;
+    save->size = sizeof(*save);
+
+    save->time = sim->time;
+    for (i = 0; i < SIM_RING_COUNT; i++)
+    {
+	save->ring_phase[i] = ring_phase != NULL ? ring_phase[i] : 0;
+	save->ring_power[i] = sim->ring_power[i];
+	save->ring_freq[i] = sim->ring_freq[i];
+    }
+    memcpy(save->rng, sim->rng.s, sizeof(save->rng));
+
+    save->cooler_temp = sim->cooler_temp;
+    save->fuel_level = sim->fuel_level;
+    save->fuel_rate = sim->fuel_rate;
+    save->total_output_power = sim->total_output_power;
+    save->engine_health = sim->engine_health;
+    save->engine_overload = sim->engine_overload;
+    save->math = sim->math;
+
+    save_tap(&save->tap_bat, &sim->tap_bat);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	save_tap(&save->taps[i], &sim->taps[i]);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	save->drains[i].rate = sim->drains[i].rate;
+	save->drains[i].spike_probability = sim->drains[i].spike_probability;
+	save->drains[i].factor = sim->drains[i].factor;
+	save->drains[i].delivered = sim->drains[i].delivered;
+	save->drains[i].enabled = sim->drains[i].enabled;
+	save->drains[i].wave_freq = sim->drains[i].wave_freq;
+	save->drains[i].charging = sim->drains[i].charging;
+    }
+
+    save->power = sim->power;
+    save->flow_threshold = sim->flow.memo.threshold;
+    save->flow_valid = sim->flow.memo.valid;
+    save->flow_solves = sim->flow.memo.solves;
+    save->flow_reuses = sim->flow.memo.reuses;
+    memcpy(save->flow_supply, sim->flow.supply, sizeof(save->flow_supply));
+    memcpy(save->flow_demand, sim->flow.demand, sizeof(save->flow_demand));
+    memcpy(save->flow, sim->flow.flow, sizeof(save->flow));
+    save->flow_bound_sources = (uint32_t)sim->flow.memo.bound_sources;
+    save->flow_bound_sinks = sim->flow.memo.bound_sinks;
+    save->thermal = sim->thermal;
+    memcpy(save->heat_temp, sim->heat_temp, sizeof(save->heat_temp));
+
+    save->checksum = save_checksum(save);
+}
+
+bool sim_save_valid(const sim_save_t *save, size_t size)
+{
+    int i;
+
+    if (size != sizeof(*save) || save->magic != SIM_SAVE_MAGIC || save->version != SIM_SAVE_VERSION ||
+	save->size != sizeof(*save) || save->checksum != save_checksum(save))
+	return false;
+
+    /* The sim indexes tables with these */
+    if (save->math >= SIM_MATH_COUNT || save->power >= SIM_POWER_COUNT || save->thermal >= SIM_THERMAL_COUNT || !tap_valid(&save->tap_bat))
+	return false;
+    if (save->flow_bound_sources >> SIM_FLOW_SOURCES != 0 || save->flow_bound_sinks >> SIM_DRAIN_COUNT != 0)
+	return false;
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	if (!tap_valid(&save->taps[i]))
+	    return false;
+    return true;
+}
+
+void sim_save_restore(const sim_save_t *save, sim_state_t *sim, double *ring_phase)
+{
+    int i;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->time = save->time;
+    for (i = 0; i < SIM_RING_COUNT; i++)
+    {
+	if (ring_phase != NULL)
+	    ring_phase[i] = save->ring_phase[i];
+	sim->ring_power[i] = save->ring_power[i];
+	sim->ring_freq[i] = save->ring_freq[i];
+    }
+    memcpy(sim->rng.s, save->rng, sizeof(sim->rng.s));
+
+    sim->cooler_temp = save->cooler_temp;
+    sim->fuel_level = save->fuel_level;
+    sim->fuel_rate = save->fuel_rate;
+    sim->total_output_power = save->total_output_power;
+    sim->engine_health = save->engine_health;
+    sim->engine_overload = save->engine_overload != 0;
+    sim->math = (sim_math_e)save->math;
+
+    restore_tap(&sim->tap_bat, &save->tap_bat);
+    for (i = 0; i < SIM_TAP_COUNT; i++)
+	restore_tap(&sim->taps[i], &save->taps[i]);
+    for (i = 0; i < SIM_DRAIN_COUNT; i++)
+    {
+	sim->drains[i].rate = save->drains[i].rate;
+	sim->drains[i].spike_probability = save->drains[i].spike_probability;
+	sim->drains[i].factor = save->drains[i].factor;
+	sim->drains[i].delivered = save->drains[i].delivered;
+	sim->drains[i].enabled = save->drains[i].enabled != 0;
+	sim->drains[i].wave_freq = save->drains[i].wave_freq;
+	sim->drains[i].charging = save->drains[i].charging;
+    }
+    sim_route(sim);
+
+    /* After sim_route, which drops the memo */
+    sim->power = (sim_power_e)save->power;
+    sim->flow.memo.threshold = save->flow_threshold;
+    sim->flow.memo.valid = save->flow_valid != 0;
+    sim->flow.memo.solves = save->flow_solves;
+    sim->flow.memo.reuses = save->flow_reuses;
+    memcpy(sim->flow.supply, save->flow_supply, sizeof(sim->flow.supply));
+    memcpy(sim->flow.demand, save->flow_demand, sizeof(sim->flow.demand));
+    memcpy(sim->flow.flow, save->flow, sizeof(sim->flow.flow));
+    sim->flow.memo.bound_sources = save->flow_bound_sources;
+    sim->flow.memo.bound_sinks = save->flow_bound_sinks;
+    sim->thermal = (sim_thermal_e)save->thermal;
+    memcpy(sim->heat_temp, save->heat_temp, sizeof(sim->heat_temp));
+}
+
+bool sim_save_write(const sim_save_t *save, const char *path)
+{
+    char    tmp[4096];
+    FILE    *f;
+    bool    ok;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    {
+	errno = ENAMETOOLONG;
+	return false;
+    }
+    if ((f = fopen(tmp, "wb")) == NULL)
+	return false;
+    ok = fwrite(save, sizeof(*save), 1, f) == 1;
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmp, path) == 0)
+	return true;
+    remove(tmp);
+    return false;
+}
+
+const sim_save_t *sim_save_map(const char *path)
+{
+    struct stat	st;
+    void	*p;
+    int		fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size != sizeof(sim_save_t))
+    {
+	close(fd);
+	return NULL;
+    }
+    p = mmap(NULL, sizeof(sim_save_t), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping holds its own reference */
+    if (p == MAP_FAILED)
+	return NULL;
+    if (!sim_save_valid(p, sizeof(sim_save_t)))
+    {
+	munmap(p, sizeof(sim_save_t));
+	return NULL;
+    }
+    return p;
+}
+
+void sim_save_unmap(const sim_save_t *save)
+{
+    if (save != NULL)
+	munmap((void *)save, sizeof(*save));
+}
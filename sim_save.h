@@ -0,0 +1,112 @@
+#ifndef SCPULSE_SIM_SAVE_H
+#define SCPULSE_SIM_SAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+/* A whole session in one fixed-size record: everything in a sim_state_t, random generator included, plus the phase of
+ * each ring's oscillator so the engine's beat picks up where it left off. Every field is a fixed-width integer or an
+ * IEEE float at a fixed offset with no padding, so a file written on one build reads on any other little-endian one
+ * without parsing: sim_save_map maps it and the record is used in place. A big-endian machine reads the magic backwards
+ * and turns the file down.
+ *
+ * Anything that changes the layout bumps SIM_SAVE_VERSION. Older files are turned down rather than converted.
+ *
+ * The oscillators are restored settled on the sim's ring settings, without whatever ramp was under way, and a warp
+ * starts over. Both take a fraction of a second to come back by themselves.
+ */
+
+#define SIM_SAVE_MAGIC 0x56415350 /* "PSAV" */
+#define SIM_SAVE_VERSION 5
+
+typedef struct sim_save_cap_s
+{
+    float	health;
+    float	charge;
+    float	max_charge;
+    float	full_limit;
+    uint32_t	grade;	/* capacitor_grade_e */
+    uint32_t	size;	/* capacitor_size_e */
+} sim_save_cap_t;
+
+typedef struct sim_save_tap_s
+{
+    float	    level;
+    float	    charge_mult;
+    uint32_t	    dest;   /* tap_dest_e */
+    sim_save_cap_t  cap;
+} sim_save_tap_t;
+
+typedef struct sim_save_drain_s
+{
+    float	rate;
+    float	spike_probability;
+    float	factor;
+    float	delivered;
+    uint32_t	enabled;
+    float	wave_freq;
+    float	charging;
+} sim_save_drain_t;
+
+typedef struct sim_save_s
+{
+    uint32_t	    magic;
+    uint32_t	    version;
+    uint32_t	    size;	/* sizeof(sim_save_t) */
+    uint32_t	    checksum;	/* FNV-1a of everything after it */
+
+    double	    time;
+    double	    ring_phase[SIM_RING_COUNT];	/* Cycles, like osc_bank_t.phase */
+    uint32_t	    rng[4];
+
+    float	    ring_power[SIM_RING_COUNT];
+    float	    ring_freq[SIM_RING_COUNT];
+    float	    cooler_temp;
+    float	    fuel_level;
+    float	    fuel_rate;
+    float	    total_output_power;
+    float	    engine_health;
+    uint32_t	    engine_overload;
+    uint32_t	    math;	/* sim_math_e */
+
+    sim_save_tap_t  tap_bat;
+    sim_save_tap_t  taps[SIM_TAP_COUNT];
+    sim_save_drain_t drains[SIM_DRAIN_COUNT];
+
+    uint32_t	    power;	/* sim_power_e */
+    float	    flow_threshold;
+    uint32_t	    flow_valid;
+    uint32_t	    flow_solves;
+    uint32_t	    flow_reuses;
+    float	    flow_supply[SIM_FLOW_SOURCES];
+    float	    flow_demand[SIM_DRAIN_COUNT];
+    float	    flow[SIM_FLOW_EDGES];
+    uint32_t	    flow_bound_sources;
+    uint32_t	    flow_bound_sinks;
+
+    uint32_t	    thermal;	/* sim_thermal_e */
+    float	    heat_temp[SIM_HEAT_NODES];
+} sim_save_t;
+
+/* ring_phase can be NULL, for a sim with no audio. The phases are saved as 0 then. */
+void sim_save_fill(sim_save_t *save, const sim_state_t *sim, const double *ring_phase);
+
+/* Whether size bytes at save are a record of this version, intact and with every enum in range */
+bool sim_save_valid(const sim_save_t *save, size_t size);
+
+/* Into a sim_state_t, routing index and all, which then steps exactly as the saved one would have. ring_phase can be
+ * NULL.
+ */
+void sim_save_restore(const sim_save_t *save, sim_state_t *sim, double *ring_phase);
+
+/* Written next to path and renamed over it, so a crash halfway leaves the old file. False with errno set on failure. */
+bool sim_save_write(const sim_save_t *save, const char *path);
+
+/* The record in path, mapped read-only. NULL if it can't be read or isn't valid. Unmap with sim_save_unmap. */
+const sim_save_t *sim_save_map(const char *path);
+void sim_save_unmap(const sim_save_t *save);
+
+#endif
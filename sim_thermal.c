@@ -0,0 +1,100 @@
+#include <string.h>
+#include <math.h>
+
+#include "sim_thermal.h"
+
+/* Unaligned, a lane count needn't be a multiple of anything */
+typedef float tvf_t __attribute__((vector_size(THERMAL_VECTOR * sizeof(float)), aligned(sizeof(float))));
+
+int thermal_substeps(const thermal_net_t *net, float dt)
+{
+    float   rate[net->nodes];
+    float   fastest = 0;
+    int	    i;
+
+    memset(rate, 0, sizeof(rate));
+    for (i = 0; i < net->links; i++)
+    {
+	rate[net->link[i].a] += net->link[i].k;
+	rate[net->link[i].b] += net->link[i].k;
+    }
+    for (i = 0; i < net->nodes; i++)
+	if (rate[i] / net->capacity[i] > fastest)
+	    fastest = rate[i] / net->capacity[i];
+    return fastest * dt > THERMAL_STABLE ? (int)ceilf(fastest * dt / THERMAL_STABLE) : 1;
+}
+
+static void conduct(const thermal_link_t *link, const float *restrict temp, float *restrict flow, int lanes, float h)
+{
+    const float	*ta = temp + link->a * lanes, *tb = temp + link->b * lanes;
+    float	*fa = flow + link->a * lanes, *fb = flow + link->b * lanes;
+    float	kh = link->k * h;
+    int		i;
+
+    for (i = 0; i + THERMAL_VECTOR <= lanes; i += THERMAL_VECTOR)
+    {
+	tvf_t d = kh * (*(const tvf_t *)&ta[i] - *(const tvf_t *)&tb[i]);
+
+	*(tvf_t *)&fa[i] -= d;
+	*(tvf_t *)&fb[i] += d;
+    }
+    for (; i < lanes; i++)
+    {
+	float d = kh * (ta[i] - tb[i]);
+
+	fa[i] -= d;
+	fb[i] += d;
+    }
+}
+
+static void warm(float *restrict temp, const float *restrict flow, int lanes, float capacity)
+{
+    int i;
+
+    for (i = 0; i + THERMAL_VECTOR <= lanes; i += THERMAL_VECTOR)
+	*(tvf_t *)&temp[i] += *(const tvf_t *)&flow[i] / capacity;
+    for (; i < lanes; i++)
+	temp[i] += flow[i] / capacity;
+}
+
+/* A ship on its own, without the lane loops around every link */
+static void step_one(const thermal_net_t *net, float *restrict temp, float *restrict flow, int substeps, float h)
+{
+    int s, i;
+
+    for (s = 0; s < substeps; s++)
+    {
+	memset(flow, 0, net->nodes * sizeof(flow[0]));
+	for (i = 0; i < net->links; i++)
+	{
+	    const thermal_link_t *l = &net->link[i];
+	    float d = l->k * h * (temp[l->a] - temp[l->b]);
+
+	    flow[l->a] -= d;
+	    flow[l->b] += d;
+	}
+	for (i = 0; i < net->nodes; i++)
+	    temp[i] += flow[i] / net->capacity[i];
+    }
+}
+
+void thermal_step(const thermal_net_t *net, float *temp, float *flow, int lanes, float dt)
+{
+    int	    substeps = thermal_substeps(net, dt);
+    float   h = dt / substeps;
+    int	    s, i;
+
+    if (lanes == 1)
+    {
+	step_one(net, temp, flow, substeps, h);
+	return;
+    }
+    for (s = 0; s < substeps; s++)
+    {
+	memset(flow, 0, (size_t)net->nodes * lanes * sizeof(flow[0]));
+	for (i = 0; i < net->links; i++)
+	    conduct(&net->link[i], temp, flow, lanes, h);
+	for (i = 0; i < net->nodes; i++)
+	    warm(temp + i * lanes, flow + i * lanes, lanes, net->capacity[i]);
+    }
+}
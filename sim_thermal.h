@@ -0,0 +1,44 @@
+#ifndef SCPULSE_SIM_THERMAL_H
+#define SCPULSE_SIM_THERMAL_H
+
+#include <stdint.h>
+
+/* Heat conduction over a small graph: nodes with a heat capacity, links between pairs of them with a conductance. Each
+ * step moves k * (Ta - Tb) * dt from the hotter end of every link to the colder, all links at once from the temperatures
+ * at the start of the step, which is a stencil over whatever shape the links make. A 2D grid is the five-point one.
+ *
+ * Temperatures are node-major over lanes: node n's are temp[n * lanes] to temp[n * lanes + lanes - 1]. Each lane is an
+ * independent copy of the graph, a ship of a fleet, and the lanes go THERMAL_VECTOR at a time in GCC's generic vectors.
+ * One lane is one ship on its own. A lane comes out bit for bit the same however many are stepped beside it.
+ *
+ * Explicit steps are only stable while no node sheds more than it holds, so a step is cut into as many substeps as
+ * keep every node's dt * (sum of its links' k) / capacity under THERMAL_STABLE.
+ */
+
+#define THERMAL_VECTOR 8
+#define THERMAL_STABLE 0.5f
+
+typedef struct thermal_link_s
+{
+    uint16_t	a;
+    uint16_t	b;
+    float	k;	/* Heat per second per degree between them */
+} thermal_link_t;
+
+typedef struct thermal_net_s
+{
+    int			    nodes;
+    int			    links;
+    const float		    *capacity;	/* Heat per degree, per node */
+    const thermal_link_t    *link;
+} thermal_net_t;
+
+int thermal_substeps(const thermal_net_t *net, float dt);
+
+/* flow is scratch of nodes * lanes floats */
+void thermal_step(const thermal_net_t *net, float *temp, float *flow, int lanes, float dt);
+
+/* SIM_THERMAL_GRAPH's, the ship's own */
+const thermal_net_t *sim_heat_net(void);
+
+#endif
@@ -0,0 +1,395 @@
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "sim_warp.h"
+#include "sim_rules.h"
+
+#define COOLER_SHED (MAX_COOLER_TEMP * 0.6) /* Degrees/s COOLER_COOL_RATE sheds at MAX_COOLER_TEMP */
+
+#define WARP_RK_TOL 1e-8 /* Per Runge-Kutta step, in health and in MAX_COOLER_TEMPs */
+#define WARP_RK_FIRST 0.05 /* Seconds, about a twentieth of how fast the cooler settles */
+#define WARP_EVENT_ITERS 48
+#define WARP_ROUNDING_ULPS 4096 /* Steps of fewer ulps than this round off more than about 0.01% of themselves */
+
+void sim_warp_init(sim_warp_t *w, float dt, sim_warp_audio_f audio, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->dt = dt;
+    w->burst = SIM_WARP_BURST;
+    w->max_jump = SIM_WARP_MAX_JUMP;
+    w->tolerance = SIM_WARP_TOLERANCE;
+    w->audio = audio;
+    w->ctx = ctx;
+    w->jump = SIM_WARP_BURST;
+}
+
+static double cool_rate(double temp)
+{
+    return COOLER_SHED * pow(temp > 0 ? temp / MAX_COOLER_TEMP : 0, 1.2);
+}
+
+/* What went into the cooler during a step, from where it was before and after. A step adds its heat and then sheds
+ * COOLER_COOL_RATE of the sum, so the sum is the x with x - COOLER_COOL_RATE(x) * dt = after. The rate moves a small
+ * fraction of x per step, so a few rounds pin it down.
+ */
+static double step_heat(double before, double after, double dt)
+{
+    double  x = after;
+    int	    i;
+
+    if (after <= 0)
+	return 0; /* Clamped, whatever went in was shed */
+    for (i = 0; i < 3; i++)
+	x = after + cool_rate(x) * dt;
+    return x - before;
+}
+
+/* Where the steps settle under constant heat: shedding COOLER_COOL_RATE of temp + heat * dt as fast as it comes in */
+static double settled_temp(double heat, double dt)
+{
+    return MAX_COOLER_TEMP * pow(heat / COOLER_SHED, 1 / 1.2) - heat * dt;
+}
+
+/* ==================== Bursts ==================== */
+
+static unsigned warp_burst(sim_state_t *sim, sim_warp_t *w, long steps, sim_warp_rates_t *r)
+{
+    double	seconds = steps * (double)w->dt;
+    double	heat = 0, overheat = 0, settled, fuel = sim->fuel_level, battery = sim->tap_bat.cap.charge;
+    double	charge[SIM_TAP_COUNT], health[SIM_TAP_COUNT];
+    uint64_t	overloads = 0;
+    unsigned	changed = 0;
+    long	n;
+    int		k;
+
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+    {
+	charge[k] = sim->taps[k].cap.charge;
+	health[k] = sim->taps[k].cap.health;
+    }
+
+    for (n = 0; n < steps; n++)
+    {
+	double	    before = sim->cooler_temp;
+	uint32_t    o = w->audio(sim, w->changed, w->ctx);
+
+	if (o)
+	    sim_audio_overload(sim, o);
+	w->changed = sim_step(sim, w->dt);
+	changed |= w->changed;
+
+	heat += step_heat(before, sim->cooler_temp, w->dt);
+	if (sim->cooler_temp > MAX_COOLER_TEMP)
+	    overheat += ENGINE_OVERHEAT_DAMAGE * (sim->cooler_temp - MAX_COOLER_TEMP) * w->dt;
+	overloads += o;
+    }
+    w->steps += steps;
+
+    r->heat = heat / seconds;
+    /* Battery draws and overloads come in spikes of heat that can take the cooler over MAX_COOLER_TEMP when the mean heat
+     * wouldn't. The jumps only see the mean, so whatever the spikes did beyond it is damage at a rate of its own.
+     */
+    settled = settled_temp(r->heat, w->dt);
+    r->damage = OVERLOAD_DAMAGE * overloads / seconds;
+    r->damage += fmax(0, overheat / seconds - (settled > MAX_COOLER_TEMP ? ENGINE_OVERHEAT_DAMAGE * (settled - MAX_COOLER_TEMP) : 0));
+    /* What the steps actually moved, not fuel_rate: a step's worth of fuel is a few ulps of the level, so the steps' own
+     * rounding is a good share of it
+     */
+    r->fuel = (sim->fuel_level - fuel) / seconds;
+    r->battery = (sim->tap_bat.cap.charge - battery) / seconds;
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+    {
+	r->cap_charge[k] = (sim->taps[k].cap.charge - charge[k]) / seconds;
+	r->cap_health[k] = (sim->taps[k].cap.health - health[k]) / seconds;
+    }
+    return changed;
+}
+
+/* How far apart two bursts' rates would put the slow part after a jump, as a share of each quantity's range. The cooler
+ * settles within a jump whatever it's given, so its share is the heat's and doesn't grow with the jump.
+ */
+static double rates_drift(const sim_warp_rates_t *a, const sim_warp_rates_t *b, double jump)
+{
+    double  d = fabs(a->heat - b->heat) / COOLER_SHED;
+    int	    k;
+
+    d = fmax(d, fabs(a->damage - b->damage) * jump);
+    d = fmax(d, fabs(a->fuel - b->fuel) * jump / MAX_FUEL_LEVEL);
+    d = fmax(d, fabs(a->battery - b->battery) * jump / MAX_BAT_CHARGE);
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+    {
+	d = fmax(d, fabs(a->cap_charge[k] - b->cap_charge[k]) * jump / cap_max_charges[CAP_SIZE_LARGE]);
+	d = fmax(d, fabs(a->cap_health[k] - b->cap_health[k]) * jump);
+    }
+    return d;
+}
+
+/* Fold a burst standing for seconds of game time into the mean over the w->averaged seconds before it */
+static void rates_average(sim_warp_t *w, const sim_warp_rates_t *r, double seconds)
+{
+    sim_warp_rates_t	*m = &w->rates;
+    double		f = seconds / (w->averaged + seconds);
+    int			k;
+
+    m->heat += (r->heat - m->heat) * f;
+    m->damage += (r->damage - m->damage) * f;
+    m->fuel += (r->fuel - m->fuel) * f;
+    m->battery += (r->battery - m->battery) * f;
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+    {
+	m->cap_charge[k] += (r->cap_charge[k] - m->cap_charge[k]) * f;
+	m->cap_health[k] += (r->cap_health[k] - m->cap_health[k]) * f;
+    }
+    w->averaged += seconds;
+}
+
+/* Shorten *jump to a couple of bursts before level, moving at rate, would reach lo or hi, so the steps get there
+ * themselves. Returns whether it did.
+ *
+ * Where a step moves the level by only a few ulps, how the steps round, and with it their real rate, changes at every
+ * power of two. Those count as limits too.
+ */
+static bool clip_linear(const sim_warp_t *w, double *jump, double level, double rate, double lo, double hi)
+{
+    double  t = *jump, margin = 2 * w->burst;
+    int	    e;
+
+    if (level > 0)
+    {
+	frexp(level, &e);
+	if (fabs(rate) * w->dt < ldexp(WARP_ROUNDING_ULPS, e - FLT_MANT_DIG))
+	{
+	    lo = fmax(lo, ldexp(level == ldexp(0.5, e) ? 0.25 : 0.5, e));
+	    hi = fmin(hi, ldexp(1, e));
+	}
+    }
+
+    if (rate < 0 && level > lo)
+	t = (lo - level) / rate - margin;
+    else if (rate > 0 && level < hi)
+	t = (hi - level) / rate - margin;
+    if (t >= *jump)
+	return false;
+    *jump = t > 0 ? t : 0;
+    return true;
+}
+
+/* ==================== Jumps ==================== */
+
+/* The cooler and the engine's health under constant heat. Stepped, the cooler sheds COOLER_COOL_RATE of where a step's
+ * heat takes it rather than of where it is, so it settles heat * dt lower than the continuous version would. Shedding at
+ * temp + heat * dt here settles exactly where the steps do.
+ */
+typedef struct warp_ode_s
+{
+    double  heat;
+    double  damage;
+    double  dt;
+} warp_ode_t;
+
+enum { ODE_TEMP, ODE_HEALTH, ODE_DIM };
+
+static void ode_rates(const warp_ode_t *o, const double y[ODE_DIM], double dy[ODE_DIM])
+{
+    dy[ODE_TEMP] = o->heat - cool_rate(y[ODE_TEMP] + o->heat * o->dt);
+    dy[ODE_HEALTH] = -o->damage - (y[ODE_TEMP] > MAX_COOLER_TEMP ? ENGINE_OVERHEAT_DAMAGE * (y[ODE_TEMP] - MAX_COOLER_TEMP) : 0);
+}
+
+/* One Dormand-Prince 5(4) step of h seconds. err is the difference from the embedded 4th order solution. */
+static void ode_step(const warp_ode_t *o, const double y[ODE_DIM], double h, double out[ODE_DIM], double err[ODE_DIM])
+{
+    double  k1[ODE_DIM], k2[ODE_DIM], k3[ODE_DIM], k4[ODE_DIM], k5[ODE_DIM], k6[ODE_DIM], k7[ODE_DIM], t[ODE_DIM];
+    int	    i;
+
+    ode_rates(o, y, k1);
+    for (i = 0; i < ODE_DIM; i++)
+	t[i] = y[i] + h * (1.0 / 5 * k1[i]);
+    ode_rates(o, t, k2);
+    for (i = 0; i < ODE_DIM; i++)
+	t[i] = y[i] + h * (3.0 / 40 * k1[i] + 9.0 / 40 * k2[i]);
+    ode_rates(o, t, k3);
+    for (i = 0; i < ODE_DIM; i++)
+	t[i] = y[i] + h * (44.0 / 45 * k1[i] - 56.0 / 15 * k2[i] + 32.0 / 9 * k3[i]);
+    ode_rates(o, t, k4);
+    for (i = 0; i < ODE_DIM; i++)
+	t[i] = y[i] + h * (19372.0 / 6561 * k1[i] - 25360.0 / 2187 * k2[i] + 64448.0 / 6561 * k3[i] - 212.0 / 729 * k4[i]);
+    ode_rates(o, t, k5);
+    for (i = 0; i < ODE_DIM; i++)
+	t[i] = y[i] + h * (9017.0 / 3168 * k1[i] - 355.0 / 33 * k2[i] + 46732.0 / 5247 * k3[i] + 49.0 / 176 * k4[i]
+			   - 5103.0 / 18656 * k5[i]);
+    ode_rates(o, t, k6);
+    for (i = 0; i < ODE_DIM; i++)
+	out[i] = y[i] + h * (35.0 / 384 * k1[i] + 500.0 / 1113 * k3[i] + 125.0 / 192 * k4[i] - 2187.0 / 6784 * k5[i]
+			     + 11.0 / 84 * k6[i]);
+    ode_rates(o, out, k7);
+    for (i = 0; i < ODE_DIM; i++)
+	err[i] = h * (71.0 / 57600 * k1[i] - 71.0 / 16695 * k3[i] + 71.0 / 1920 * k4[i] - 17253.0 / 339200 * k5[i]
+		      + 22.0 / 525 * k6[i] - 1.0 / 40 * k7[i]);
+}
+
+/* Which SIM_WARP_* event happens between y and next, if any */
+static unsigned ode_event(const double y[ODE_DIM], const double next[ODE_DIM])
+{
+    if (next[ODE_HEALTH] <= 0 && y[ODE_HEALTH] > 0)
+	return SIM_WARP_DEAD;
+    if (next[ODE_TEMP] > MAX_COOLER_TEMP && y[ODE_TEMP] <= MAX_COOLER_TEMP)
+	return SIM_WARP_OVERHEAT;
+    return 0;
+}
+
+/* Integrate y over up to *seconds, stopping just past the first event. Returns the event, and *seconds how far it got. */
+static unsigned ode_solve(sim_warp_t *w, const warp_ode_t *o, double y[ODE_DIM], double *seconds)
+{
+    double  t = 0, h = fmin(WARP_RK_FIRST, *seconds);
+    double  next[ODE_DIM], err[ODE_DIM];
+    int	    i;
+
+    while (t < *seconds)
+    {
+	double	e;
+	unsigned event;
+
+	h = fmin(h, *seconds - t);
+	ode_step(o, y, h, next, err);
+	w->rk_steps++;
+	e = fmax(fabs(err[ODE_TEMP]) / MAX_COOLER_TEMP, fabs(err[ODE_HEALTH])) / WARP_RK_TOL;
+	if (e > 1)
+	{
+	    h *= fmax(0.2, 0.9 * pow(e, -0.2));
+	    continue;
+	}
+
+	if ((event = ode_event(y, next)) != 0)
+	{
+	    /* Bisect the step down to where it happens, ending on the far side */
+	    double lo = 0, hi = h, mid[ODE_DIM];
+
+	    for (i = 0; i < WARP_EVENT_ITERS; i++)
+	    {
+		double m = (lo + hi) / 2;
+
+		ode_step(o, y, m, mid, err);
+		if (ode_event(y, mid))
+		{
+		    hi = m;
+		    memcpy(next, mid, sizeof(next));
+		}
+		else
+		    lo = m;
+	    }
+	    memcpy(y, next, sizeof(next));
+	    *seconds = t + hi;
+	    return event;
+	}
+
+	memcpy(y, next, sizeof(next));
+	t += h;
+	h *= fmin(5.0, 0.9 * pow(fmax(e, 1e-10), -0.2));
+    }
+    return 0;
+}
+
+static double clamp(double x, double lo, double hi)
+{
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+/* Carry the slow part forward by up to seconds at the burst's rates */
+static unsigned warp_jump(sim_state_t *sim, sim_warp_t *w, const sim_warp_rates_t *r, double seconds)
+{
+    warp_ode_t	o = {r->heat, r->damage, w->dt};
+    double	y[ODE_DIM] = {sim->cooler_temp, sim->engine_health};
+    unsigned	event;
+    int		k;
+
+    event = ode_solve(w, &o, y, &seconds);
+
+    /* The components settle on the cooler in a fraction of a second, so they keep their lead on it */
+    if (sim->thermal == SIM_THERMAL_GRAPH)
+	for (k = 0; k < SIM_HEAT_COOLER; k++)
+	    sim->heat_temp[k] += (y[ODE_TEMP] > 0 ? y[ODE_TEMP] : 0) - sim->cooler_temp;
+    sim->cooler_temp = y[ODE_TEMP] > 0 ? y[ODE_TEMP] : 0;
+    sim->engine_health = y[ODE_HEALTH] > 0 ? y[ODE_HEALTH] : 0;
+    sim->fuel_level = clamp(sim->fuel_level + r->fuel * seconds, 0, MAX_FUEL_LEVEL);
+    sim->tap_bat.cap.charge = clamp(sim->tap_bat.cap.charge + r->battery * seconds, 0, MAX_BAT_CHARGE);
+    for (k = 0; k < SIM_TAP_COUNT; k++)
+    {
+	capacitor_t *cap = &sim->taps[k].cap;
+
+	cap->charge = clamp(cap->charge + r->cap_charge[k] * seconds, 0, cap->max_charge);
+	cap->health = clamp(cap->health + r->cap_health[k] * seconds, 0, 1);
+    }
+    sim->time += seconds;
+
+    w->jumps++;
+    w->jumped += seconds;
+    w->unsampled += seconds;
+    return event;
+}
+
+unsigned sim_warp(sim_state_t *sim, double seconds, sim_warp_t *w)
+{
+    double	    end = sim->time + seconds;
+    sim_warp_rates_t r, before;
+    unsigned	    changed = 0;
+
+    for (;;)
+    {
+	long	    steps = (long)floor(fmin(end - sim->time, w->burst) / w->dt + 0.5);
+	double	    jump;
+	bool	    clipped = false;
+	unsigned    stepped, event;
+	int	    k;
+
+	if (steps <= 0)
+	    break;
+	stepped = warp_burst(sim, w, steps, &r);
+	changed |= stepped;
+	if (stepped & SIM_CHANGED_POWER)
+	    w->averaged = 0; /* Power was cut partway through, the burst is two regimes at once */
+
+	/* As long as the burst hardly moved the average, with a longer jump every time it doesn't */
+	before = w->rates;
+	jump = w->averaged > 0 ? w->jump : 0;
+	rates_average(w, &r, steps * (double)w->dt + w->unsampled);
+	w->unsampled = 0;
+	while (jump > 0 && rates_drift(&before, &w->rates, jump) > w->tolerance)
+	    jump = jump / 2 >= w->burst ? jump / 2 : 0;
+	if (jump == 0)
+	    w->jump = w->burst;
+	else if (jump == w->jump)
+	    w->jump = fmin(2 * jump, w->max_jump);
+	else
+	    w->jump = jump;
+	r = w->rates;
+
+	/* Short of anywhere the rules change, so the steps get there themselves */
+	clipped |= clip_linear(w, &jump, sim->fuel_level, r.fuel, 0, MAX_FUEL_LEVEL);
+	clipped |= clip_linear(w, &jump, sim->tap_bat.cap.charge, r.battery, 0, MAX_BAT_CHARGE);
+	for (k = 0; k < SIM_TAP_COUNT; k++)
+	{
+	    const capacitor_t *cap = &sim->taps[k].cap;
+
+	    if (cap->charge > cap->full_limit)
+		clipped |= clip_linear(w, &jump, cap->charge, r.cap_charge[k], cap->full_limit, cap->max_charge);
+	    else
+		clipped |= clip_linear(w, &jump, cap->charge, r.cap_charge[k], 0, cap->full_limit);
+	    clipped |= clip_linear(w, &jump, cap->health, r.cap_health[k], 0, 1);
+	}
+	if (clipped)
+	    w->averaged = 0;
+
+	/* Whole steps */
+	jump = floor(fmin(jump, end - sim->time) / w->dt) * w->dt;
+	if (jump <= 0)
+	    continue;
+
+	if ((event = warp_jump(sim, w, &r, jump)) != 0)
+	{
+	    w->averaged = 0;
+	    return changed | event;
+	}
+    }
+    return changed;
+}
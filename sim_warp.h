@@ -0,0 +1,81 @@
+#ifndef SCPULSE_SIM_WARP_H
+#define SCPULSE_SIM_WARP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+/* Time warp: minutes or hours of game time without stepping through every step of it.
+ *
+ * Most of the sim is fast. Drains flicker and capacitors fill and empty within seconds. What builds up over a long run is
+ * slow: fuel, battery, capacitor and engine health, and the cooler, which settles within a second or two on whatever heat
+ * it's given. sim_warp alternates bursts of ordinary sim_steps, which measure the rates the fast part drives the slow part
+ * at, with jumps that carry only the slow part forward at those rates:
+ *
+ *   - fuel, battery and capacitor charge and health go in straight lines. A jump stops a couple of
+ *     bursts short of where any of them would run out, fill up or cross a capacitor's full limit, so what happens there
+ *     is left to the steps, float rounding and all.
+ *   - the cooler and the engine's overheat damage are integrated with adaptive Runge-Kutta under the burst's mean heat,
+ *     and a jump stops where the cooler goes over MAX_COOLER_TEMP or the engine dies
+ *
+ * The rates are the mean of every burst since the rules last changed, each standing for itself and the jump before it.
+ * That jump was settled before the burst was seen; weighting by the jump after would count a drain caught in the act for
+ * more than its share, since jumps are shorter after one. A jump doubles while bursts move the mean by less than the
+ * tolerance and halves when they don't, down to nothing, so a steady config covers hours in a few hundred bursts and
+ * one with busy drains falls back toward stepping all of it. The
+ * fast part doesn't move during a jump and draws no random numbers, so a warped run isn't the same run as a stepped one
+ * with the same seed, only one that agrees with it on the slow quantities.
+ */
+
+/* Feeds the audio in before each step, like the game's audio callback and sim_tick do: set total_output_power and
+ * engine_overload, and return the overloaded samples since the last step. changed is what the last step returned.
+ */
+typedef uint32_t (*sim_warp_audio_f)(sim_state_t *sim, unsigned changed, void *ctx);
+
+/* Per second */
+typedef struct sim_warp_rates_s
+{
+    double	heat;		/* Degrees into the cooler, from everything but its own dissipation */
+    double	damage;		/* Engine health lost to overloads and heat spikes, besides the mean heat's overheating */
+    double	fuel;
+    double	battery;
+    double	cap_charge[SIM_TAP_COUNT];
+    double	cap_health[SIM_TAP_COUNT];
+} sim_warp_rates_t;
+
+typedef struct sim_warp_s
+{
+    float	    dt;		/* Of the ordinary steps */
+    double	    burst;	/* Seconds stepped before each jump */
+    double	    max_jump;
+    double	    tolerance;	/* Drift allowed between bursts over a jump, as a share of each quantity's range */
+    sim_warp_audio_f audio;
+    void	    *ctx;
+
+    double	    jump;	/* Next jump, before clipping */
+    sim_warp_rates_t rates;	/* Mean of the bursts since anything last ran out, filled up or died */
+    double	    averaged;	/* Game time the bursts in rates stand for, 0 to start over */
+    double	    unsampled;	/* Jumped since the last burst. The next one stands for it as well as itself. */
+    unsigned	    changed;	/* What the latest step returned, for the next audio call */
+
+    uint64_t	    steps;
+    uint64_t	    jumps;
+    uint64_t	    rk_steps;
+    double	    jumped;	/* Seconds covered by jumps */
+} sim_warp_t;
+
+#define SIM_WARP_BURST 1.0
+#define SIM_WARP_MAX_JUMP 600.0
+#define SIM_WARP_TOLERANCE 0.01
+
+/* sim_warp also returns these, besides the SIM_CHANGED_* flags of its steps */
+#define SIM_WARP_OVERHEAT 0x100 /* Stopped where the cooler went over MAX_COOLER_TEMP during a jump */
+#define SIM_WARP_DEAD 0x200 /* Stopped where the engine died during a jump */
+
+void sim_warp_init(sim_warp_t *w, float dt, sim_warp_audio_f audio, void *ctx);
+
+/* Advance by seconds, to the nearest step, or less if a jump stopped at one of the SIM_WARP_* events */
+unsigned sim_warp(sim_state_t *sim, double seconds, sim_warp_t *w);
+
+#endif
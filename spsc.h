@@ -0,0 +1,94 @@
+#ifndef SCPULSE_SPSC_H
+#define SCPULSE_SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Single-producer/single-consumer lock-free message ring. One thread pushes, one other thread pops, neither ever blocks or
+ * takes a lock, so it is safe to pop from the audio callback. Messages are small fixed-size commands; what type/index/value
+ * mean is up to whoever owns the queue.
+ */
+
+#define SPSC_CAPACITY 256 /* Must be a power of two */
+#define SPSC_CACHE_LINE 64
+
+typedef struct spsc_msg_s
+{
+    uint64_t	when;	/* Consumer clock at which to apply it, 0 for as soon as possible */
+    uint64_t	stamp;	/* Consumer clock when the message was posted, for latency accounting */
+    uint16_t	type;
+    uint16_t	index;
+    float	value;
+} spsc_msg_t;
+
+typedef struct spsc_queue_s
+{
+    /* head is only written by the consumer and tail only by the producer. Keep them on separate cache lines so the two
+     * threads don't fight over one.
+     */
+    _Atomic uint32_t	head;
+    char		pad0[SPSC_CACHE_LINE - sizeof(uint32_t)];
+    _Atomic uint32_t	tail;
+    uint32_t		dropped; /* Producer side: pushes refused because the ring was full */
+    char		pad1[SPSC_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+    spsc_msg_t		msgs[SPSC_CAPACITY];
+} spsc_queue_t;
+
+static inline void spsc_init(spsc_queue_t *q)
+{
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->dropped = 0;
+}
+
+/* Producer only */
+static inline bool spsc_push(spsc_queue_t *q, const spsc_msg_t *msg)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (tail - head >= SPSC_CAPACITY)
+    {
+	q->dropped++;
+	return false;
+    }
+
+    q->msgs[tail & (SPSC_CAPACITY - 1)] = *msg;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/* Consumer only. Look at the next message without taking it. */
+static inline const spsc_msg_t *spsc_peek(spsc_queue_t *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head == tail)
+	return NULL;
+    return &q->msgs[head & (SPSC_CAPACITY - 1)];
+}
+
+/* Consumer only. Drop the message spsc_peek returned. */
+static inline void spsc_consume(spsc_queue_t *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+/* Consumer only */
+static inline bool spsc_pop(spsc_queue_t *q, spsc_msg_t *msg)
+{
+    const spsc_msg_t *m = spsc_peek(q);
+
+    if (!m)
+	return false;
+    *msg = *m;
+    spsc_consume(q);
+    return true;
+}
+
+#endif